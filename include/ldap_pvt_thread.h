@@ -242,6 +242,11 @@ ldap_pvt_thread_pool_queues LDAP_P((
 	ldap_pvt_thread_pool_t *pool,
 	int numqs ));
 
+LDAP_F( int )
+ldap_pvt_thread_pool_steal LDAP_P((
+	ldap_pvt_thread_pool_t *pool,
+	int steal ));
+
 #ifndef LDAP_PVT_THREAD_H_DONE
 typedef enum {
 	LDAP_PVT_THREAD_POOL_PARAM_UNKNOWN = -1,
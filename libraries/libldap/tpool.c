@@ -64,6 +64,7 @@ enum { NOT_PAUSED = 0, WANT_PAUSE = 1, PAUSED = 2 };
 typedef struct ldap_int_thread_userctx_s {
 	struct ldap_int_thread_poolq_s *ltu_pq;
 	ldap_pvt_thread_t ltu_id;
+	unsigned ltu_seed;		/* for picking a queue to steal from */
 	ldap_int_tpool_key_t ltu_key[MAXKEYS];
 } ldap_int_thread_userctx_t;
 
@@ -179,6 +180,14 @@ struct ldap_int_thread_pool_s {
 
 	/* Max pending + paused + idle tasks, negated when ltp_finishing */
 	int ltp_max_pending;
+
+	/* Idle threads take tasks from other queues, and tasks submitted
+	 * from a pool thread go to that thread's queue.
+	 */
+	int ltp_steal;
+
+	/* Next queue to wake a thief in, only a hint so not locked */
+	int ltp_steal_next;
 };
 
 static ldap_int_tpool_plist_t empty_pending_list =
@@ -344,6 +353,68 @@ ldap_pvt_thread_pool_init (
 	return ldap_pvt_thread_pool_init_q( tpool, max_threads, max_pending, 1 );
 }
 
+/* Wake an idle thread of another queue so it can steal work from pq.
+ * Counters of other queues are read without locking, this is a hint.
+ */
+static void
+tpool_wake_thief(
+	struct ldap_int_thread_pool_s *pool,
+	struct ldap_int_thread_poolq_s *pq )
+{
+	struct ldap_int_thread_poolq_s *thief;
+	int i, j;
+
+	j = pool->ltp_steal_next;
+	for ( i = 0; i < pool->ltp_numqs; i++ ) {
+		j = (j + 1) % pool->ltp_numqs;
+		thief = pool->ltp_wqs[j];
+		if ( thief != pq && thief->ltp_open_count > thief->ltp_active_count ) {
+			ldap_pvt_thread_cond_signal(&thief->ltp_cond);
+			break;
+		}
+	}
+	pool->ltp_steal_next = j;
+}
+
+/* Take a pending task from another queue, starting at a random one.
+ * Called with pq->ltp_mutex held, so only trylock the others: a busy
+ * queue is just skipped.
+ */
+static ldap_int_thread_task_t *
+tpool_steal(
+	struct ldap_int_thread_poolq_s *pq,
+	ldap_int_thread_userctx_t *ctx )
+{
+	struct ldap_int_thread_pool_s *pool = pq->ltp_pool;
+	struct ldap_int_thread_poolq_s *victim;
+	ldap_int_thread_task_t *task = NULL;
+	int i, j, numqs = pool->ltp_numqs;
+
+	if ( !pool->ltp_steal || numqs < 2 || pool->ltp_pause )
+		return NULL;
+
+	/* xorshift */
+	ctx->ltu_seed ^= ctx->ltu_seed << 13;
+	ctx->ltu_seed ^= ctx->ltu_seed >> 17;
+	ctx->ltu_seed ^= ctx->ltu_seed << 5;
+
+	j = ctx->ltu_seed % numqs;
+	for ( i = 0; i < numqs && task == NULL; i++, j = (j + 1) % numqs ) {
+		victim = pool->ltp_wqs[j];
+		if ( victim == pq || victim->ltp_pending_count < 1 )
+			continue;
+		if ( ldap_pvt_thread_mutex_trylock(&victim->ltp_mutex) )
+			continue;
+		task = LDAP_STAILQ_FIRST(victim->ltp_work_list);
+		if ( task ) {
+			LDAP_STAILQ_REMOVE_HEAD(victim->ltp_work_list, ltt_next.q);
+			victim->ltp_pending_count--;
+		}
+		ldap_pvt_thread_mutex_unlock(&victim->ltp_mutex);
+	}
+	return task;
+}
+
 /* Submit a task to be performed by the thread pool */
 int
 ldap_pvt_thread_pool_submit (
@@ -364,7 +435,7 @@ ldap_pvt_thread_pool_submit2 (
 	struct ldap_int_thread_poolq_s *pq;
 	ldap_int_thread_task_t *task;
 	ldap_pvt_thread_t thr;
-	int i, j;
+	int i, j, wake_thief = 0;
 
 	if (tpool == NULL)
 		return(-1);
@@ -374,7 +445,24 @@ ldap_pvt_thread_pool_submit2 (
 	if (pool == NULL)
 		return(-1);
 
-	if ( pool->ltp_numqs > 1 ) {
+	i = pool->ltp_numqs;
+	if ( pool->ltp_numqs > 1 && pool->ltp_steal ) {
+		ldap_int_thread_userctx_t *ctx = ldap_pvt_thread_pool_context();
+
+		/* Keep follow-up work on the submitting thread's queue if there
+		 * is room, another queue's idle threads will steal it if need be.
+		 */
+		if ( ctx->ltu_pq && ctx->ltu_pq->ltp_pool == pool &&
+			ctx->ltu_pq->ltp_pending_count < ctx->ltu_pq->ltp_max_pending )
+		{
+			for ( i = 0; i < pool->ltp_numqs; i++ )
+				if ( pool->ltp_wqs[i] == ctx->ltu_pq ) break;
+		}
+	}
+
+	if ( i < pool->ltp_numqs ) {
+		/* use the queue picked above */
+	} else if ( pool->ltp_numqs > 1 ) {
 		int min = pool->ltp_wqs[0]->ltp_max_pending + pool->ltp_wqs[0]->ltp_max_count;
 		int min_x = 0, cnt;
 		for ( i = 0; i < pool->ltp_numqs; i++ ) {
@@ -471,11 +559,18 @@ ldap_pvt_thread_pool_submit2 (
 			 * task will be handled eventually.
 			 */
 		}
+	} else if (pool->ltp_steal &&
+		pq->ltp_open_count < pq->ltp_active_count+pq->ltp_pending_count)
+	{
+		/* every thread of this queue is busy */
+		wake_thief = 1;
 	}
 	ldap_pvt_thread_cond_signal(&pq->ltp_cond);
 
  done:
 	ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
+	if (wake_thief)
+		tpool_wake_thief(pool, pq);
 	return(0);
 
  failed:
@@ -631,6 +726,26 @@ ldap_pvt_thread_pool_queues(
 	return 0;
 }
 
+/* Enable or disable work stealing between the work queues */
+int
+ldap_pvt_thread_pool_steal(
+	ldap_pvt_thread_pool_t *tpool,
+	int steal )
+{
+	struct ldap_int_thread_pool_s *pool;
+
+	if (tpool == NULL)
+		return(-1);
+
+	pool = *tpool;
+
+	if (pool == NULL)
+		return(-1);
+
+	pool->ltp_steal = (steal != 0);
+	return(0);
+}
+
 /* Set max #threads.  value <= 0 means max supported #threads (LDAP_MAXTHR) */
 int
 ldap_pvt_thread_pool_maxthreads(
@@ -975,6 +1090,7 @@ ldap_int_thread_pool_wrapper (
 	ctx.ltu_pq = pq;
 	ctx.ltu_id = ldap_pvt_thread_self();
 	TID_HASH(ctx.ltu_id, hash);
+	ctx.ltu_seed = hash | 1;
 
 	ldap_pvt_thread_key_setdata( ldap_tpool_key, &ctx );
 
@@ -1004,6 +1120,10 @@ ldap_int_thread_pool_wrapper (
 	for (;;) {
 		work_list = pq->ltp_work_list; /* help the compiler a bit */
 		task = LDAP_STAILQ_FIRST(work_list);
+		if (task == NULL && (task = tpool_steal(pq, &ctx)) != NULL) {
+			/* already removed from its queue */
+			work_list = NULL;
+		}
 		if (task == NULL) {	/* paused or no pending tasks */
 			if (--(pq->ltp_active_count) < 1) {
 				if (pool->ltp_pause) {
@@ -1049,6 +1169,11 @@ ldap_int_thread_pool_wrapper (
 
 				work_list = pq->ltp_work_list;
 				task = LDAP_STAILQ_FIRST(work_list);
+				if (task == NULL && !pool_lock &&
+					(task = tpool_steal(pq, &ctx)) != NULL)
+				{
+					work_list = NULL;
+				}
 			} while (task == NULL);
 
 			if (pool_lock) {
@@ -1059,8 +1184,10 @@ ldap_int_thread_pool_wrapper (
 			pq->ltp_active_count++;
 		}
 
-		LDAP_STAILQ_REMOVE_HEAD(work_list, ltt_next.q);
-		pq->ltp_pending_count--;
+		if (work_list) {
+			LDAP_STAILQ_REMOVE_HEAD(work_list, ltt_next.q);
+			pq->ltp_pending_count--;
+		}
 		ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
 
 		task->ltt_start_routine(&ctx, task->ltt_arg);
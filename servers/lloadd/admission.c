@@ -0,0 +1,767 @@
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 1998-2026 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <ac/socket.h>
+#include <ac/string.h>
+#include <ac/time.h>
+
+#include "lutil.h"
+#include "lload.h"
+
+/*
+ * Admission control.
+ *
+ * When request_process() cannot find an upstream to take an operation, the
+ * client it came from can be classified and the operation parked on its
+ * class queue. While parked, the operation keeps hold of the client's read
+ * side (LLOAD_C_READ_HANDOVER stays set), so nothing else is read from that
+ * client until the operation has been forwarded or rejected. This keeps the
+ * ordering guarantees request_process() relies on and pushes back on the
+ * client through TCP.
+ *
+ * The queues are served from daemon_base whenever an upstream operation
+ * finishes and periodically while not empty. Classes with higher priority
+ * are always served first, classes of the same priority share the capacity
+ * according to their weight. If the total number of queued operations
+ * reaches lload_admission_limit, the oldest operation of the lowest priority
+ * class is shed to make room for an operation from a more important class.
+ * A new operation does not get to overtake the queues either: while anything
+ * of the same or higher priority than its class is waiting, it is queued
+ * without trying the upstreams.
+ *
+ * Bind requests are not subject to admission control. They are forwarded
+ * over the dedicated bind connections (bindconns) rather than the operation
+ * connections whose capacity the queues share, and a client cannot send one
+ * while one of its operations is queued, the queue holds its read side.
+ *
+ * An operation holds a reference on its class from the moment it is first
+ * queued until it is unlinked, so a class removed by a configuration change
+ * stays around until the last operation classified into it is gone.
+ */
+
+lload_cc_head lload_client_classes =
+        LDAP_STAILQ_HEAD_INITIALIZER( lload_client_classes );
+int lload_admission_limit = 0;
+
+ldap_pvt_thread_mutex_t lload_admission_mutex;
+struct event *lload_admission_event;
+
+static int lload_admission_queued;
+
+/* Operations of classes that have been removed, rejected on the next run */
+static LloadClientClass lload_retired_class = {
+    .cc_name = BER_BVC("(removed)"),
+    .cc_refcnt = 1,
+    .cc_queue = LDAP_TAILQ_HEAD_INITIALIZER( lload_retired_class.cc_queue ),
+};
+
+static int
+admission_peer_parse( LloadClientClass *cls, char *msg, size_t msglen )
+{
+    char buf[LDAP_IPADDRLEN], *bits;
+    int max = 32;
+
+    if ( cls->cc_peer.bv_len >= sizeof(buf) ) {
+        snprintf( msg, msglen, "peer address \"%s\" too long",
+                cls->cc_peer.bv_val );
+        return -1;
+    }
+    memcpy( buf, cls->cc_peer.bv_val, cls->cc_peer.bv_len + 1 );
+
+    bits = strchr( buf, '/' );
+    if ( bits ) {
+        *bits++ = '\0';
+    }
+
+    cls->cc_peer_family = AF_INET;
+#ifdef LDAP_PF_INET6
+    if ( strchr( buf, ':' ) ) {
+        cls->cc_peer_family = AF_INET6;
+        max = 128;
+    }
+#endif /* LDAP_PF_INET6 */
+
+    if ( inet_pton( cls->cc_peer_family, buf, cls->cc_peer_addr ) != 1 ) {
+        snprintf( msg, msglen, "unparseable peer address \"%s\"", buf );
+        return -1;
+    }
+
+    cls->cc_peer_bits = max;
+    if ( bits && ( lutil_atoi( &cls->cc_peer_bits, bits ) ||
+                         cls->cc_peer_bits < 0 || cls->cc_peer_bits > max ) ) {
+        snprintf( msg, msglen, "invalid prefix length \"%s\"", bits );
+        return -1;
+    }
+
+    return LDAP_SUCCESS;
+}
+
+static int
+admission_peer_match( LloadClientClass *cls, struct berval *peer )
+{
+    unsigned char addr[16];
+    char buf[LDAP_IPADDRLEN], *host, *end;
+    int bytes, bits;
+
+    /* Only IP peers look like "IP=<address>:<port>" */
+    if ( peer->bv_len <= STRLENOF("IP=") ||
+            peer->bv_len - STRLENOF("IP=") >= sizeof(buf) ||
+            strncmp( peer->bv_val, "IP=", STRLENOF("IP=") ) ) {
+        return 0;
+    }
+    memcpy( buf, peer->bv_val + STRLENOF("IP="),
+            peer->bv_len - STRLENOF("IP=") + 1 );
+
+    host = buf;
+    if ( *host == '[' ) {
+        end = strchr( ++host, ']' );
+    } else {
+        end = strrchr( host, ':' );
+    }
+    if ( end ) {
+        *end = '\0';
+    }
+
+    if ( inet_pton( cls->cc_peer_family, host, addr ) != 1 ) {
+        return 0;
+    }
+
+    bytes = cls->cc_peer_bits / 8;
+    bits = cls->cc_peer_bits % 8;
+    if ( memcmp( addr, cls->cc_peer_addr, bytes ) ) {
+        return 0;
+    }
+    if ( bits ) {
+        unsigned char mask = 0xff << ( 8 - bits );
+        if ( ( addr[bytes] ^ cls->cc_peer_addr[bytes] ) & mask ) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+LloadClientClass *
+lload_client_class_new( void )
+{
+    LloadClientClass *cls = ch_calloc( 1, sizeof(LloadClientClass) );
+
+    cls->cc_weight = 1;
+    cls->cc_refcnt = 1;
+    LDAP_TAILQ_INIT( &cls->cc_queue );
+
+    return cls;
+}
+
+/*
+ * Validate a freshly parsed class and prepare it for matching.
+ */
+int
+lload_client_class_finish( LloadClientClass *cls, char *msg, size_t msglen )
+{
+    LloadClientClass *other;
+    int rc;
+
+    LDAP_STAILQ_FOREACH ( other, &lload_client_classes, cc_next ) {
+        if ( !ber_bvstrcasecmp( &other->cc_name, &cls->cc_name ) ) {
+            snprintf( msg, msglen, "client class \"%s\" already exists",
+                    cls->cc_name.bv_val );
+            return -1;
+        }
+    }
+
+    if ( cls->cc_weight < 1 ) {
+        snprintf( msg, msglen, "weight must be positive" );
+        return -1;
+    }
+    if ( cls->cc_deadline < 0 || cls->cc_max_queued < 0 ) {
+        snprintf( msg, msglen, "deadline and queue cannot be negative" );
+        return -1;
+    }
+
+    if ( !BER_BVISNULL( &cls->cc_peer ) &&
+            admission_peer_parse( cls, msg, msglen ) ) {
+        return -1;
+    }
+
+    if ( !BER_BVISNULL( &cls->cc_dn ) &&
+            (rc = regcomp( &cls->cc_dn_re, cls->cc_dn.bv_val,
+                     REG_EXTENDED|REG_ICASE|REG_NOSUB )) ) {
+        char error[AC_LINE_MAX];
+
+        regerror( rc, &cls->cc_dn_re, error, sizeof(error) );
+        snprintf( msg, msglen, "regular expression \"%s\" bad because of %s",
+                cls->cc_dn.bv_val, error );
+        ch_free( cls->cc_dn.bv_val );
+        BER_BVZERO( &cls->cc_dn );
+        return -1;
+    }
+
+    return LDAP_SUCCESS;
+}
+
+void
+lload_client_class_free( LloadClientClass *cls )
+{
+    assert( cls->cc_queued == 0 );
+    assert( cls != &lload_retired_class );
+
+    ch_free( cls->cc_name.bv_val );
+    ch_free( cls->cc_listener.bv_val );
+    ch_free( cls->cc_peer.bv_val );
+    if ( !BER_BVISNULL( &cls->cc_dn ) ) {
+        ch_free( cls->cc_dn.bv_val );
+        regfree( &cls->cc_dn_re );
+    }
+    ch_free( cls );
+}
+
+/*
+ * Drop a reference on the class, the last one frees it. The list of
+ * configured classes holds one, so does every operation that has been
+ * queued on it.
+ */
+static void
+admission_class_release( LloadClientClass *cls )
+{
+    int refcnt;
+
+    checked_lock( &lload_admission_mutex );
+    refcnt = --cls->cc_refcnt;
+    checked_unlock( &lload_admission_mutex );
+
+    if ( !refcnt ) {
+        lload_client_class_free( cls );
+    }
+}
+
+/*
+ * Classes are matched in order, index is the position to insert at, -1 to
+ * append.
+ */
+void
+lload_client_class_add( LloadClientClass *cls, int index )
+{
+    LloadClientClass *prev = NULL, *next;
+    int i = 0;
+
+    if ( index >= 0 ) {
+        LDAP_STAILQ_FOREACH ( next, &lload_client_classes, cc_next ) {
+            if ( i++ == index ) break;
+            prev = next;
+        }
+        if ( !next ) {
+            index = -1;
+        }
+    }
+
+    if ( index < 0 ) {
+        LDAP_STAILQ_INSERT_TAIL( &lload_client_classes, cls, cc_next );
+    } else if ( prev ) {
+        LDAP_STAILQ_INSERT_AFTER( &lload_client_classes, prev, cls, cc_next );
+    } else {
+        LDAP_STAILQ_INSERT_HEAD( &lload_client_classes, cls, cc_next );
+    }
+}
+
+/*
+ * Unlink the class, anything still queued on it is handed over to be rejected
+ * the next time the queues are processed.
+ */
+void
+lload_client_class_remove( LloadClientClass *cls )
+{
+    LloadOperation *op;
+
+    LDAP_STAILQ_REMOVE( &lload_client_classes, cls, LloadClientClass, cc_next );
+
+    checked_lock( &lload_admission_mutex );
+    while ( (op = LDAP_TAILQ_FIRST( &cls->cc_queue )) ) {
+        LDAP_TAILQ_REMOVE( &cls->cc_queue, op, o_queue_next );
+        LDAP_TAILQ_INSERT_TAIL( &lload_retired_class.cc_queue, op, o_queue_next );
+        op->o_class = &lload_retired_class;
+        lload_retired_class.cc_queued++;
+        cls->cc_refcnt--;
+    }
+    cls->cc_queued = 0;
+    checked_unlock( &lload_admission_mutex );
+
+    lload_admission_kick();
+    admission_class_release( cls );
+}
+
+void
+lload_client_classes_destroy( void )
+{
+    LloadClientClass *cls;
+
+    while ( (cls = LDAP_STAILQ_FIRST( &lload_client_classes )) ) {
+        LDAP_STAILQ_REMOVE_HEAD( &lload_client_classes, cc_next );
+        admission_class_release( cls );
+    }
+}
+
+static LloadClientClass *
+admission_classify( LloadConnection *c )
+{
+    LloadClientClass *cls;
+
+    CONNECTION_LOCK(c);
+    LDAP_STAILQ_FOREACH ( cls, &lload_client_classes, cc_next ) {
+        if ( !BER_BVISNULL( &cls->cc_listener ) &&
+                ( !c->c_listener ||
+                        strcasecmp( cls->cc_listener.bv_val,
+                                c->c_listener->ls_lr->sl_url.bv_val ) ) ) {
+            continue;
+        }
+        if ( !BER_BVISNULL( &cls->cc_peer ) &&
+                !admission_peer_match( cls, &c->c_peer_name ) ) {
+            continue;
+        }
+        if ( !BER_BVISNULL( &cls->cc_dn ) ) {
+            char *dn = "";
+
+            if ( !BER_BVISNULL( &c->c_auth ) ) {
+                dn = c->c_auth.bv_val;
+                if ( !strncasecmp( dn, "dn:", STRLENOF("dn:") ) ) {
+                    dn += STRLENOF("dn:");
+                }
+            }
+            if ( regexec( &cls->cc_dn_re, dn, 0, NULL, 0 ) ) {
+                continue;
+            }
+        }
+        break;
+    }
+    CONNECTION_UNLOCK(c);
+
+    return cls;
+}
+
+static void
+admission_dequeue( LloadClientClass *cls, LloadOperation *op )
+{
+    assert_locked( &lload_admission_mutex );
+    assert( op->o_queued && op->o_class == cls );
+
+    LDAP_TAILQ_REMOVE( &cls->cc_queue, op, o_queue_next );
+    op->o_queued = 0;
+    cls->cc_queued--;
+    lload_admission_queued--;
+}
+
+/*
+ * Give the client's read side back, the operation has been dealt with.
+ */
+static void
+admission_release( LloadConnection *c, int resume )
+{
+    if ( resume && IS_ALIVE( c, c_live ) ) {
+        checked_lock( &c->c_io_mutex );
+        c->c_io_state &= ~LLOAD_C_READ_HANDOVER;
+        if ( !(lload_features & LLOAD_FEATURE_PAUSE) ||
+                !(c->c_io_state & LLOAD_C_READ_PAUSE) ) {
+            event_add( c->c_read_event, c->c_read_timeout );
+        }
+        checked_unlock( &c->c_io_mutex );
+    }
+    RELEASE_REF( c, c_refcnt, c->c_destroy );
+}
+
+static void
+admission_reject( LloadConnection *c, LloadOperation *op, const char *msg )
+{
+    Debug( LDAP_DEBUG_STATS, "admission_reject: "
+            "connid=%lu msgid=%d %s from class %s\n",
+            op->o_client_connid, op->o_client_msgid, msg,
+            op->o_class->cc_name.bv_val );
+
+    operation_send_reject( op, LDAP_BUSY, msg, 1 );
+    OPERATION_UNLINK(op);
+    admission_release( c, 1 );
+}
+
+/*
+ * Put the operation on the queue unless it has been unlinked already. Pairs
+ * with the fence in lload_admission_unlink(), either it sees the operation as
+ * queued or we see it is dead.
+ */
+static int
+admission_insert( LloadClientClass *cls, LloadOperation *op, int head )
+{
+    assert_locked( &lload_admission_mutex );
+
+    __atomic_store_n( &op->o_queued, 1, __ATOMIC_SEQ_CST );
+    if ( !__atomic_load_n( &op->o_refcnt, __ATOMIC_SEQ_CST ) ) {
+        op->o_queued = 0;
+        return -1;
+    }
+
+    if ( head ) {
+        LDAP_TAILQ_INSERT_HEAD( &cls->cc_queue, op, o_queue_next );
+    } else {
+        LDAP_TAILQ_INSERT_TAIL( &cls->cc_queue, op, o_queue_next );
+    }
+    cls->cc_queued++;
+    lload_admission_queued++;
+    return LDAP_SUCCESS;
+}
+
+/*
+ * Whether anything of the same or higher priority than cls is waiting.
+ */
+static int
+admission_behind( LloadClientClass *cls )
+{
+    LloadClientClass *other;
+
+    assert_locked( &lload_admission_mutex );
+
+    LDAP_STAILQ_FOREACH ( other, &lload_client_classes, cc_next ) {
+        if ( other->cc_queued && other->cc_priority >= cls->cc_priority ) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Queue a new operation on class cls, if behind is set only if it would
+ * otherwise overtake operations already waiting. Entered with
+ * lload_admission_mutex locked, returns with it unlocked.
+ */
+static int
+admission_enqueue( LloadConnection *c, LloadOperation *op,
+        LloadClientClass *cls, int behind )
+{
+    LloadClientClass *victim_cls = NULL;
+    LloadOperation *victim = NULL;
+    LloadConnection *victim_client = NULL;
+
+    assert_locked( &lload_admission_mutex );
+
+    if ( behind && !admission_behind( cls ) ) {
+        checked_unlock( &lload_admission_mutex );
+        return -1;
+    }
+
+    if ( cls->cc_queued >= cls->cc_max_queued ) {
+        checked_unlock( &lload_admission_mutex );
+        Debug( LDAP_DEBUG_STATS, "lload_admission_enqueue: "
+                "connid=%lu msgid=%d queue of class %s full\n",
+                op->o_client_connid, op->o_client_msgid,
+                cls->cc_name.bv_val );
+        return -1;
+    }
+
+    if ( lload_admission_limit &&
+            lload_admission_queued >= lload_admission_limit ) {
+        LloadClientClass *other;
+
+        /* Shed from the lowest priority queue that is less important than us */
+        LDAP_STAILQ_FOREACH ( other, &lload_client_classes, cc_next ) {
+            if ( other->cc_queued && other->cc_priority < cls->cc_priority &&
+                    ( !victim_cls ||
+                            other->cc_priority < victim_cls->cc_priority ) ) {
+                victim_cls = other;
+            }
+        }
+        if ( !victim_cls ) {
+            checked_unlock( &lload_admission_mutex );
+            Debug( LDAP_DEBUG_STATS, "lload_admission_enqueue: "
+                    "connid=%lu msgid=%d admission queues full\n",
+                    op->o_client_connid, op->o_client_msgid );
+            return -1;
+        }
+    }
+
+    op->o_class = cls;
+    op->o_queued_client = c;
+    if ( admission_insert( cls, op, 0 ) ) {
+        op->o_class = NULL;
+        checked_unlock( &lload_admission_mutex );
+        return -1;
+    }
+    /* Released when the operation is unlinked */
+    cls->cc_refcnt++;
+    /* Our caller holds a reference so this can't fail */
+    acquire_ref( &c->c_refcnt );
+
+    if ( victim_cls ) {
+        victim = LDAP_TAILQ_FIRST( &victim_cls->cc_queue );
+        victim_client = victim->o_queued_client;
+        admission_dequeue( victim_cls, victim );
+    }
+    checked_unlock( &lload_admission_mutex );
+
+    Debug( LDAP_DEBUG_TRACE, "lload_admission_enqueue: "
+            "connid=%lu msgid=%d queued in class %s\n",
+            op->o_client_connid, op->o_client_msgid, cls->cc_name.bv_val );
+
+    if ( victim ) {
+        admission_reject( victim_client, victim, "shed by admission control" );
+    }
+
+    if ( !evtimer_pending( lload_admission_event, NULL ) ) {
+        struct timeval tv = { 0, LLOAD_ADMISSION_POLL * 1000 };
+
+        if ( cls->cc_deadline && cls->cc_deadline < LLOAD_ADMISSION_POLL ) {
+            tv.tv_usec = cls->cc_deadline * 1000;
+        }
+        evtimer_add( lload_admission_event, &tv );
+    }
+
+    return LDAP_SUCCESS;
+}
+
+/*
+ * Called from request_process() before looking for an upstream, queue the
+ * operation if others of the same or higher priority are already waiting.
+ * Returns LDAP_SUCCESS if the operation has been queued, the caller must then
+ * return LLOAD_REQUEST_QUEUED without touching the operation any further.
+ */
+int
+lload_admission_defer( LloadConnection *c, LloadOperation *op )
+{
+    LloadClientClass *cls;
+
+    /* Dispatched from a queue, or nothing is waiting */
+    if ( op->o_class ||
+            !__atomic_load_n( &lload_admission_queued, __ATOMIC_RELAXED ) ) {
+        return -1;
+    }
+
+    cls = admission_classify( c );
+    if ( !cls || !cls->cc_max_queued ) {
+        return -1;
+    }
+
+    checked_lock( &lload_admission_mutex );
+    if ( admission_enqueue( c, op, cls, 1 ) ) {
+        return -1;
+    }
+
+    /* There might be capacity available already */
+    lload_admission_kick();
+    return LDAP_SUCCESS;
+}
+
+/*
+ * Called from request_process() when no upstream would take the operation.
+ * Returns LDAP_SUCCESS if the operation has been queued, the caller must then
+ * return LLOAD_REQUEST_QUEUED without touching the operation any further.
+ */
+int
+lload_admission_enqueue( LloadConnection *c, LloadOperation *op )
+{
+    LloadClientClass *cls;
+    int rc;
+
+    checked_lock( &lload_admission_mutex );
+    if ( (cls = op->o_class) ) {
+        /* Dispatched from a queue but still no capacity, put it back where
+         * it was, the queue still holds a reference to the client */
+        rc = admission_insert( cls, op, 1 );
+        checked_unlock( &lload_admission_mutex );
+        return rc;
+    }
+    checked_unlock( &lload_admission_mutex );
+
+    if ( LDAP_STAILQ_EMPTY( &lload_client_classes ) ) {
+        return -1;
+    }
+
+    cls = admission_classify( c );
+    if ( !cls || !cls->cc_max_queued ) {
+        return -1;
+    }
+
+    checked_lock( &lload_admission_mutex );
+    return admission_enqueue( c, op, cls, 0 );
+}
+
+/*
+ * The operation is being unlinked, if it is still queued, nobody is going to
+ * process it anymore.
+ */
+void
+lload_admission_unlink( LloadOperation *op )
+{
+    LloadClientClass *cls = NULL;
+    LloadConnection *c = NULL;
+
+    /* See admission_insert() */
+    __atomic_thread_fence( __ATOMIC_SEQ_CST );
+    if ( !__atomic_load_n( &op->o_queued, __ATOMIC_SEQ_CST ) && !op->o_class ) {
+        return;
+    }
+
+    checked_lock( &lload_admission_mutex );
+    if ( op->o_queued ) {
+        admission_dequeue( op->o_class, op );
+        c = op->o_queued_client;
+    }
+    if ( op->o_class != &lload_retired_class ) {
+        cls = op->o_class;
+    }
+    op->o_class = NULL;
+    checked_unlock( &lload_admission_mutex );
+
+    if ( c ) {
+        RELEASE_REF( c, c_refcnt, c->c_destroy );
+    }
+    if ( cls ) {
+        admission_class_release( cls );
+    }
+}
+
+/*
+ * Pick the next operation to try: highest priority first, smooth weighted
+ * round-robin between classes of that priority.
+ */
+static LloadOperation *
+admission_next( void )
+{
+    LloadClientClass *cls, *chosen = NULL;
+    LloadOperation *op;
+    int total = 0, priority = 0, found = 0;
+
+    assert_locked( &lload_admission_mutex );
+
+    LDAP_STAILQ_FOREACH ( cls, &lload_client_classes, cc_next ) {
+        if ( cls->cc_queued && ( !found || cls->cc_priority > priority ) ) {
+            priority = cls->cc_priority;
+            found = 1;
+        }
+    }
+    if ( !found ) {
+        return NULL;
+    }
+
+    LDAP_STAILQ_FOREACH ( cls, &lload_client_classes, cc_next ) {
+        if ( !cls->cc_queued || cls->cc_priority != priority ) {
+            continue;
+        }
+        cls->cc_current += cls->cc_weight;
+        total += cls->cc_weight;
+        if ( !chosen || cls->cc_current > chosen->cc_current ) {
+            chosen = cls;
+        }
+    }
+    chosen->cc_current -= total;
+
+    op = LDAP_TAILQ_FIRST( &chosen->cc_queue );
+    admission_dequeue( chosen, op );
+    return op;
+}
+
+void
+lload_admission_kick( void )
+{
+    if ( lload_admission_event &&
+            __atomic_load_n( &lload_admission_queued, __ATOMIC_RELAXED ) ) {
+        event_active( lload_admission_event, EV_TIMEOUT, 0 );
+    }
+}
+
+void
+lload_admission_dispatch( evutil_socket_t s, short what, void *arg )
+{
+    lload_o_queue expired = LDAP_TAILQ_HEAD_INITIALIZER( expired );
+    LloadClientClass *cls;
+    LloadOperation *op;
+    struct timeval now, next = { 0, LLOAD_ADMISSION_POLL * 1000 };
+    epoch_t epoch;
+
+    epoch = epoch_join();
+    gettimeofday( &now, NULL );
+
+    checked_lock( &lload_admission_mutex );
+    while ( (op = LDAP_TAILQ_FIRST( &lload_retired_class.cc_queue )) ) {
+        admission_dequeue( &lload_retired_class, op );
+        LDAP_TAILQ_INSERT_TAIL( &expired, op, o_queue_next );
+    }
+    LDAP_STAILQ_FOREACH ( cls, &lload_client_classes, cc_next ) {
+        struct timeval deadline = { cls->cc_deadline / 1000,
+            ( cls->cc_deadline % 1000 ) * 1000 };
+
+        if ( !cls->cc_deadline ) {
+            continue;
+        }
+        while ( (op = LDAP_TAILQ_FIRST( &cls->cc_queue )) ) {
+            struct timeval expiry, left;
+
+            timeradd( &op->o_start, &deadline, &expiry );
+            if ( timercmp( &expiry, &now, > ) ) {
+                timersub( &expiry, &now, &left );
+                if ( timercmp( &left, &next, < ) ) {
+                    next = left;
+                }
+                break;
+            }
+            admission_dequeue( cls, op );
+            LDAP_TAILQ_INSERT_TAIL( &expired, op, o_queue_next );
+        }
+    }
+    checked_unlock( &lload_admission_mutex );
+
+    while ( (op = LDAP_TAILQ_FIRST( &expired )) ) {
+        LDAP_TAILQ_REMOVE( &expired, op, o_queue_next );
+        admission_reject( op->o_queued_client, op,
+                op->o_class == &lload_retired_class ?
+                        "client class removed" :
+                        "admission deadline exceeded" );
+    }
+
+    for ( ;; ) {
+        LloadConnection *c;
+        int rc;
+
+        checked_lock( &lload_admission_mutex );
+        op = admission_next();
+        checked_unlock( &lload_admission_mutex );
+        if ( !op ) {
+            break;
+        }
+
+        /* The reference the queue held is ours now */
+        c = op->o_queued_client;
+        rc = request_process( c, op );
+        if ( rc == LLOAD_REQUEST_QUEUED ) {
+            /* Still no capacity, it is back on the queue, try again later */
+            break;
+        }
+        admission_release( c, rc == LDAP_SUCCESS );
+    }
+
+    if ( __atomic_load_n( &lload_admission_queued, __ATOMIC_RELAXED ) ) {
+        evtimer_add( lload_admission_event, &next );
+    }
+    epoch_leave( epoch );
+}
+
+void
+lload_admission_init( void )
+{
+    ldap_pvt_thread_mutex_init( &lload_admission_mutex );
+}
+
+void
+lload_admission_destroy( void )
+{
+    lload_client_classes_destroy();
+    ldap_pvt_thread_mutex_destroy( &lload_admission_mutex );
+}
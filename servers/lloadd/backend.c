@@ -399,7 +399,31 @@ backend_select(
     *res = LDAP_BUSY;
     *message = "server busy";
 
+    if ( lload_features & LLOAD_FEATURE_AFFINITY ) {
+        /*
+         * Prefer an upstream serviced by the same I/O thread as the client,
+         * the request and its responses can then be handled without crossing
+         * over to another event base.
+         */
+        LDAP_CIRCLEQ_FOREACH( c, head, c_next ) {
+            if ( c->c_base_id != op->o_client_base_id ) {
+                continue;
+            }
+            if ( try_upstream( b, head, op, c, res, message ) ) {
+                *cp = c;
+                CONNECTION_ASSERT_LOCKED(c);
+                assert_locked( &c->c_io_mutex );
+                return 1;
+            }
+        }
+    }
+
     LDAP_CIRCLEQ_FOREACH( c, head, c_next ) {
+        /* Those on the client's I/O thread have just been tried */
+        if ( ( lload_features & LLOAD_FEATURE_AFFINITY ) &&
+                c->c_base_id == op->o_client_base_id ) {
+            continue;
+        }
         if ( try_upstream( b, head, op, c, res, message ) ) {
             *cp = c;
             CONNECTION_ASSERT_LOCKED(c);
@@ -408,6 +432,11 @@ backend_select(
         }
     }
 
+    /* All connections were busy, let the pool controller know */
+    if ( head == &b->b_conns ) {
+        b->b_pool_starved++;
+    }
+
     return 1;
 }
 
@@ -447,7 +476,7 @@ backend_retry( LloadBackend *b )
     }
     assert_locked( &b->b_mutex );
 
-    requested = b->b_numconns;
+    requested = backend_numconns( b );
 #ifdef LDAP_API_FEATURE_VERIFY_CREDENTIALS
     if ( !(lload_features & LLOAD_FEATURE_VC) )
 #endif /* LDAP_API_FEATURE_VERIFY_CREDENTIALS */
@@ -500,6 +529,141 @@ backend_retry( LloadBackend *b )
     assert_locked( &b->b_mutex );
 }
 
+/*
+ * Number of regular connections the backend should currently maintain. This
+ * is numconns unless the pool is allowed to grow up to max-numconns, in which
+ * case backend_pool_update() decides where between the two it sits.
+ */
+int
+backend_numconns( LloadBackend *b )
+{
+    if ( !b->b_numconns || b->b_max_numconns <= b->b_numconns ||
+            b->b_pool_target < b->b_numconns ) {
+        return b->b_numconns;
+    }
+    if ( b->b_pool_target > b->b_max_numconns ) {
+        return b->b_max_numconns;
+    }
+    return b->b_pool_target;
+}
+
+/*
+ * Connection pool autoscaling, called from lload_tiers_update() every second.
+ *
+ * The pool is grown by a connection when operations could not be forwarded
+ * because all regular connections were busy or when more than
+ * LLOAD_POOL_GROW_PERCENT of their capacity is in use. Capacity is
+ * conn-max-pending operations per connection or, if unset, one operation per
+ * connection since anything beyond that queues on the backend's side. Growing
+ * is held off while connection attempts to the backend are failing or the
+ * observed latency exceeds pool-max-latency, a backend that is already slow
+ * to respond will not benefit from more connections.
+ *
+ * Once utilisation has stayed under LLOAD_POOL_SHRINK_PERCENT for
+ * LLOAD_POOL_SHRINK_DELAY seconds, an idle connection is closed and the pool
+ * shrinks back towards numconns.
+ */
+void
+backend_pool_update( LloadBackend *b )
+{
+    LloadConnection *c, *victim = NULL;
+    uintptr_t starved, count, total;
+    long executing, capacity;
+    int target, active, gentle = 1;
+    char *action = NULL, *reason = NULL;
+    epoch_t epoch;
+
+    checked_lock( &b->b_mutex );
+    if ( !b->b_numconns || b->b_max_numconns <= b->b_numconns ) {
+        b->b_pool_target = 0;
+        b->b_pool_idle = 0;
+        checked_unlock( &b->b_mutex );
+        return;
+    }
+    epoch = epoch_join();
+
+    target = backend_numconns( b );
+    b->b_pool_target = target;
+
+    starved = b->b_pool_starved;
+    b->b_pool_starved = 0;
+    count = __atomic_exchange_n(
+            &b->b_pool_operation_count, 0, __ATOMIC_RELAXED );
+    total = __atomic_exchange_n(
+            &b->b_pool_operation_time, 0, __ATOMIC_RELAXED );
+    if ( count ) {
+        b->b_pool_latency = total / count;
+    }
+
+    executing = b->b_n_ops_executing;
+    active = b->b_active;
+    capacity = (long)active *
+            ( b->b_max_conn_pending ? b->b_max_conn_pending : 1 );
+
+    if ( active < target ) {
+        /* Still catching up with the last decision or the backend is not
+         * reachable, nothing to measure */
+        b->b_pool_idle = 0;
+    } else if ( starved ||
+            executing * 100 >= capacity * LLOAD_POOL_GROW_PERCENT ) {
+        b->b_pool_idle = 0;
+
+        if ( target >= b->b_max_numconns ) {
+            /* Already at the limit */
+        } else if ( b->b_failed ) {
+            action = "held";
+            reason = "connection attempts to the backend failing";
+        } else if ( b->b_pool_max_latency && count &&
+                b->b_pool_latency > (uintptr_t)b->b_pool_max_latency * 1000 ) {
+            action = "held";
+            reason = "backend latency above pool-max-latency";
+        } else {
+            action = "grew";
+            reason = starved ? "all connections busy" : "high utilisation";
+            b->b_pool_target = ++target;
+            b->b_pool_grown++;
+            backend_retry( b );
+        }
+    } else if ( target > b->b_numconns &&
+            executing * 100 < capacity * LLOAD_POOL_SHRINK_PERCENT &&
+            ++b->b_pool_idle >= LLOAD_POOL_SHRINK_DELAY ) {
+        LDAP_CIRCLEQ_FOREACH ( c, &b->b_conns, c_next ) {
+            CONNECTION_LOCK(c);
+            if ( c->c_state == LLOAD_C_READY && !c->c_n_ops_executing &&
+                    !c->c_linked && acquire_ref( &c->c_refcnt ) ) {
+                victim = c;
+            }
+            CONNECTION_UNLOCK(c);
+            if ( victim ) break;
+        }
+        if ( victim ) {
+            action = "shrank";
+            reason = "low utilisation";
+            b->b_pool_target = --target;
+            b->b_pool_shrunk++;
+            b->b_pool_idle = 0;
+        }
+    } else if ( executing * 100 >= capacity * LLOAD_POOL_SHRINK_PERCENT ) {
+        b->b_pool_idle = 0;
+    }
+
+    if ( action ) {
+        snprintf( b->b_pool_decision, sizeof(b->b_pool_decision),
+                "%s to %d connections: %s", action, target, reason );
+        Debug( LDAP_DEBUG_STATS, "backend_pool_update: "
+                "backend '%s' pool %s (pending=%ld, latency=%luus)\n",
+                b->b_name.bv_val, b->b_pool_decision, executing,
+                (unsigned long)b->b_pool_latency );
+    }
+    checked_unlock( &b->b_mutex );
+
+    if ( victim ) {
+        lload_connection_close( victim, &gentle );
+        RELEASE_REF( victim, c_refcnt, victim->c_destroy );
+    }
+    epoch_leave( epoch );
+}
+
 void
 backend_connect( evutil_socket_t s, short what, void *arg )
 {
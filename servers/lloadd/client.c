@@ -148,6 +148,10 @@ request_process( LloadConnection *client, LloadOperation *op )
         goto fail;
     }
 
+    if ( lload_admission_defer( client, op ) == LDAP_SUCCESS ) {
+        return LLOAD_REQUEST_QUEUED;
+    }
+
     CONNECTION_LOCK(client);
     client_restricted = client->c_restricted;
     if ( client_restricted ) {
@@ -199,6 +203,10 @@ request_process( LloadConnection *client, LloadOperation *op )
     }
 
     if ( !upstream ) {
+        if ( lload_admission_enqueue( client, op ) == LDAP_SUCCESS ) {
+            return LLOAD_REQUEST_QUEUED;
+        }
+
         Debug( LDAP_DEBUG_STATS, "request_process: "
                 "connid=%lu, msgid=%d no available connection found\n",
                 op->o_client_connid, op->o_client_msgid );
@@ -304,17 +312,40 @@ request_process( LloadConnection *client, LloadOperation *op )
 
     if ( (lload_features & LLOAD_FEATURE_PROXYAUTHZ) &&
             client->c_type != LLOAD_C_PRIVILEGED ) {
+        BerElementBuffer berbuf;
+        BerElement *ctrlber = NULL;
+        char *ctrloid = LDAP_CONTROL_PROXY_AUTHZ;
+        struct berval ctrlval, proxied;
+
         CONNECTION_LOCK(client);
         Debug( LDAP_DEBUG_TRACE, "request_process: "
                 "proxying identity %s to upstream\n",
                 client->c_auth.bv_val );
+        ctrlval = client->c_auth;
+        if ( upstream->c_proxy_session &&
+                (lload_features & LLOAD_FEATURE_PROXY_SESSION) ) {
+            /* The server caches the authorization decision for the session,
+             * tell it which client this is on behalf of */
+            ctrlber = (BerElement *)&berbuf;
+            ber_init2( ctrlber, NULL, LBER_USE_DER );
+            if ( ber_printf( ctrlber, "{Oi}", &client->c_auth,
+                         (ber_int_t)client->c_connid ) >= 0 &&
+                    !ber_flatten2( ctrlber, &proxied, 0 ) ) {
+                ctrloid = LDAP_CONTROL_X_PROXIED_CLIENT;
+                ctrlval = proxied;
+            }
+        }
         ber_printf( output, "t{titOt{{sbO}" /* "}}" */, LDAP_TAG_MESSAGE,
                 LDAP_TAG_MSGID, msgid,
                 op->o_tag, &op->o_request,
                 LDAP_TAG_CONTROLS,
-                LDAP_CONTROL_PROXY_AUTHZ, 1, &client->c_auth );
+                ctrloid, 1, &ctrlval );
         CONNECTION_UNLOCK(client);
 
+        if ( ctrlber ) {
+            ber_free_buf( ctrlber );
+        }
+
         if ( !BER_BVISNULL( &op->o_ctrls ) ) {
             ber_write( output, op->o_ctrls.bv_val, op->o_ctrls.bv_len, 0 );
         }
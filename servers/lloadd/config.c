@@ -116,6 +116,7 @@ static ConfigDriver config_tier;
 static ConfigDriver config_backend;
 static ConfigDriver config_bindconf;
 static ConfigDriver config_restrict_oid;
+static ConfigDriver config_client_class;
 #ifdef LDAP_TCP_BUFFER
 static ConfigDriver config_tcp_buffer;
 #endif /* LDAP_TCP_BUFFER */
@@ -181,6 +182,10 @@ enum {
     CFG_RESTRICT_CONTROL,
     CFG_TIER,
     CFG_WEIGHT,
+    CFG_MAX_NUMCONNS,
+    CFG_POOL_MAX_LATENCY,
+    CFG_CLIENT_CLASS,
+    CFG_CLIENT_QUEUE_LIMIT,
 
     CFG_LAST
 };
@@ -719,6 +724,29 @@ static ConfigTable config_back_cf_table[] = {
             "SYNTAX OMsDirectoryString )",
         NULL, NULL
     },
+    { "client_class", "name> <options", 2, 0, 0,
+        ARG_MAGIC|CFG_CLIENT_CLASS,
+        &config_client_class,
+        "( OLcfgBkAt:13.45 "
+            "NAME 'olcBkLloadClientClass' "
+            "DESC 'Client class for admission control' "
+            "EQUALITY caseIgnoreMatch "
+            "SYNTAX OMsDirectoryString "
+            "X-ORDERED 'VALUES' )",
+        NULL, NULL
+    },
+    { "client_queue_limit", "count", 2, 2, 0,
+        ARG_MAGIC|ARG_UINT|CFG_CLIENT_QUEUE_LIMIT,
+        &config_generic,
+        "( OLcfgBkAt:13.46 "
+            "NAME 'olcBkLloadClientQueueLimit' "
+            "DESC 'Maximum operations queued by admission control' "
+            "EQUALITY integerMatch "
+            "SYNTAX OMsInteger "
+            "SINGLE-VALUE )",
+        NULL,
+        { .v_uint = 0 }
+    },
 
     /* cn=config only options */
 #ifdef BALANCER_MODULE
@@ -810,6 +838,30 @@ static ConfigTable config_back_cf_table[] = {
         NULL,
         { .v_uint = 0 },
     },
+    { "", NULL, 2, 2, 0,
+        ARG_MAGIC|ARG_INT|CFG_MAX_NUMCONNS,
+        &backend_cf_gen,
+        "( OLcfgBkAt:13.43 "
+            "NAME 'olcBkLloadMaxNumconns' "
+            "DESC 'Number of regular connections the pool can grow to' "
+            "EQUALITY integerMatch "
+            "SYNTAX OMsInteger "
+            "SINGLE-VALUE )",
+        NULL,
+        { .v_int = 0 },
+    },
+    { "", NULL, 2, 2, 0,
+        ARG_MAGIC|ARG_INT|CFG_POOL_MAX_LATENCY,
+        &backend_cf_gen,
+        "( OLcfgBkAt:13.44 "
+            "NAME 'olcBkLloadPoolMaxLatency' "
+            "DESC 'Backend latency in milliseconds above which the pool is not grown' "
+            "EQUALITY integerMatch "
+            "SYNTAX OMsInteger "
+            "SINGLE-VALUE )",
+        NULL,
+        { .v_int = 0 },
+    },
 #endif /* BALANCER_MODULE */
 
     { NULL, NULL, 0, 0, 0, ARG_IGNORED, NULL }
@@ -857,6 +909,8 @@ static ConfigOCs lloadocs[] = {
             "$ olcBkLloadWriteCoherence "
             "$ olcBkLloadRestrictExop "
             "$ olcBkLloadRestrictControl "
+            "$ olcBkLloadClientClass "
+            "$ olcBkLloadClientQueueLimit "
             "$ olcBkLloadListen "
             "$ olcBkLloadSockbufMaxPendingClient "
         ") )",
@@ -876,7 +930,9 @@ static ConfigOCs lloadocs[] = {
             "$ olcBkLloadMaxPendingOps "
             "$ olcBkLloadMaxPendingConns ) "
         "MAY ( olcBkLloadStartTLS "
-            "$ olcBkLloadWeight ) "
+            "$ olcBkLloadWeight "
+            "$ olcBkLloadMaxNumconns "
+            "$ olcBkLloadPoolMaxLatency ) "
         ") )",
         Cft_Misc, config_back_cf_table,
         lload_backend_ldadd,
@@ -942,6 +998,9 @@ config_generic( ConfigArgs *c )
             case CFG_CLIENT_PENDING:
                 c->value_uint = lload_client_max_pending;
                 break;
+            case CFG_CLIENT_QUEUE_LIMIT:
+                c->value_uint = lload_admission_limit;
+                break;
             default:
                 rc = 1;
                 break;
@@ -988,6 +1047,9 @@ config_generic( ConfigArgs *c )
                     ll[i]->sl_removed = 1;
                 }
             } break;
+            case CFG_CLIENT_QUEUE_LIMIT:
+                lload_admission_limit = 0;
+                break;
             default:
                 break;
         }
@@ -1141,6 +1203,9 @@ config_generic( ConfigArgs *c )
         case CFG_CLIENT_PENDING:
             lload_client_max_pending = c->value_uint;
             break;
+        case CFG_CLIENT_QUEUE_LIMIT:
+            lload_admission_limit = c->value_uint;
+            break;
         default:
             Debug( LDAP_DEBUG_ANY, "%s: unknown CFG_TYPE %d\n",
                     c->log, c->type );
@@ -1177,6 +1242,19 @@ lload_backend_finish( ConfigArgs *ca )
         goto fail;
     }
 
+    if ( b->b_max_numconns < 0 ||
+            ( b->b_max_numconns && b->b_max_numconns < b->b_numconns ) ) {
+        Debug( LDAP_DEBUG_ANY, "lload_backend_finish: "
+                "max-numconns has to be at least numconns\n" );
+        goto fail;
+    }
+
+    if ( b->b_pool_max_latency < 0 ) {
+        Debug( LDAP_DEBUG_ANY, "lload_backend_finish: "
+                "invalid pool-max-latency configuration\n" );
+        goto fail;
+    }
+
     if ( b->b_retry_timeout < 0 ) {
         Debug( LDAP_DEBUG_ANY, "lload_backend_finish: "
                 "invalid retry timeout configuration\n" );
@@ -1602,6 +1680,72 @@ done:
     return rc;
 }
 
+static int
+config_client_class( ConfigArgs *c )
+{
+    LloadClientClass *cls;
+    int i;
+
+    if ( c->op == SLAP_CONFIG_EMIT ) {
+        LDAP_STAILQ_FOREACH ( cls, &lload_client_classes, cc_next ) {
+            struct berval bv, options;
+            char *ptr;
+
+            lload_client_class_unparse( cls, &options );
+
+            bv.bv_len = cls->cc_name.bv_len + options.bv_len;
+            bv.bv_val = ch_malloc( bv.bv_len + 1 );
+            ptr = lutil_strcopy( bv.bv_val, cls->cc_name.bv_val );
+            lutil_strcopy( ptr, options.bv_val );
+            ber_bvarray_add( &c->rvalue_vals, &bv );
+
+            ch_free( options.bv_val );
+        }
+        return LDAP_SUCCESS;
+
+    } else if ( c->op == LDAP_MOD_DELETE ) {
+        if ( c->valx < 0 ) {
+            while ( (cls = LDAP_STAILQ_FIRST( &lload_client_classes )) ) {
+                lload_client_class_remove( cls );
+            }
+        } else {
+            i = 0;
+            LDAP_STAILQ_FOREACH ( cls, &lload_client_classes, cc_next ) {
+                if ( i++ == c->valx ) break;
+            }
+            assert( cls != NULL );
+            lload_client_class_remove( cls );
+        }
+        return LDAP_SUCCESS;
+    }
+
+    cls = lload_client_class_new();
+    ber_str2bv( c->argv[1], 0, 1, &cls->cc_name );
+
+    for ( i = 2; i < c->argc; i++ ) {
+        if ( lload_client_class_parse( c, c->argv[i], cls ) ) {
+            if ( !c->cr_msg[0] ) {
+                snprintf( c->cr_msg, sizeof(c->cr_msg),
+                        "error parsing client class option '%s'",
+                        c->argv[i] );
+            }
+            goto fail;
+        }
+    }
+
+    if ( lload_client_class_finish( cls, c->cr_msg, sizeof(c->cr_msg) ) ) {
+        goto fail;
+    }
+
+    lload_client_class_add( cls, c->valx );
+    return LDAP_SUCCESS;
+
+fail:
+    Debug( LDAP_DEBUG_ANY, "%s: %s\n", c->log, c->cr_msg );
+    lload_client_class_free( cls );
+    return 1;
+}
+
 static int
 config_tier( ConfigArgs *c )
 {
@@ -2110,6 +2254,8 @@ config_feature( ConfigArgs *c )
 #endif /* LDAP_API_FEATURE_VERIFY_CREDENTIALS */
         { BER_BVC("proxyauthz"), LLOAD_FEATURE_PROXYAUTHZ },
         { BER_BVC("read_pause"), LLOAD_FEATURE_PAUSE },
+        { BER_BVC("io_affinity"), LLOAD_FEATURE_AFFINITY },
+        { BER_BVC("proxy_session"), LLOAD_FEATURE_PROXY_SESSION },
         { BER_BVNULL, 0 }
     };
     lload_features_t *fp;
@@ -2954,6 +3100,22 @@ static slap_cf_aux_table backendkey[] = {
 
     { BER_BVC("weight="), offsetof(LloadBackend, b_weight), 'i', 0, NULL },
 
+    { BER_BVC("max-numconns="), offsetof(LloadBackend, b_max_numconns), 'i', 0, NULL },
+    { BER_BVC("pool-max-latency="), offsetof(LloadBackend, b_pool_max_latency), 'i', 0, NULL },
+
+    { BER_BVNULL, 0, 0, 0, NULL }
+};
+
+static slap_cf_aux_table classkey[] = {
+    { BER_BVC("listener="), offsetof(LloadClientClass, cc_listener), 'b', 1, NULL },
+    { BER_BVC("peer="), offsetof(LloadClientClass, cc_peer), 'b', 0, NULL },
+    { BER_BVC("dn="), offsetof(LloadClientClass, cc_dn), 'b', 1, NULL },
+
+    { BER_BVC("priority="), offsetof(LloadClientClass, cc_priority), 'i', 0, NULL },
+    { BER_BVC("weight="), offsetof(LloadClientClass, cc_weight), 'i', 0, NULL },
+    { BER_BVC("queue="), offsetof(LloadClientClass, cc_max_queued), 'i', 0, NULL },
+    { BER_BVC("deadline="), offsetof(LloadClientClass, cc_deadline), 'i', 0, NULL },
+
     { BER_BVNULL, 0, 0, 0, NULL }
 };
 
@@ -3410,6 +3572,21 @@ lload_backend_parse( ConfigArgs *c, const char *word, LloadBackend *b )
     return lload_cf_aux_table_parse( c, word, b, backendkey, "backend config" );
 }
 
+int
+lload_client_class_parse(
+        ConfigArgs *c,
+        const char *word,
+        LloadClientClass *cls )
+{
+    return lload_cf_aux_table_parse( c, word, cls, classkey, "client class" );
+}
+
+int
+lload_client_class_unparse( LloadClientClass *cls, struct berval *bv )
+{
+    return lload_cf_aux_table_unparse( cls, bv, classkey );
+}
+
 int
 lload_bindconf_parse( ConfigArgs *c, const char *word, slap_bindconf *bc )
 {
@@ -3815,6 +3992,12 @@ backend_cf_gen( ConfigArgs *c )
             case CFG_WEIGHT:
                 c->value_uint = b->b_weight;
                 break;
+            case CFG_MAX_NUMCONNS:
+                c->value_int = b->b_max_numconns;
+                break;
+            case CFG_POOL_MAX_LATENCY:
+                c->value_int = b->b_pool_max_latency;
+                break;
             default:
                 rc = 1;
                 break;
@@ -3828,6 +4011,18 @@ backend_cf_gen( ConfigArgs *c )
             case CFG_STARTTLS:
                 b->b_tls_conf = LLOAD_CLEARTEXT;
                 break;
+            case CFG_MAX_NUMCONNS:
+                b->b_max_numconns = 0;
+                if ( lload_change.type == LLOAD_CHANGE_UNDEFINED ) {
+                    lload_change.type = LLOAD_CHANGE_MODIFY;
+                }
+                lload_change.object = LLOAD_BACKEND;
+                lload_change.target = b;
+                lload_change.flags.backend |= LLOAD_BACKEND_MOD_CONNS;
+                break;
+            case CFG_POOL_MAX_LATENCY:
+                b->b_pool_max_latency = 0;
+                break;
             default:
                 break;
         }
@@ -3906,6 +4101,23 @@ backend_cf_gen( ConfigArgs *c )
         case CFG_WEIGHT:
             b->b_weight = c->value_uint;
             break;
+        case CFG_MAX_NUMCONNS:
+            if ( c->value_int < 0 ) {
+                snprintf( c->cr_msg, sizeof(c->cr_msg),
+                        "invalid connection pool configuration" );
+                goto fail;
+            }
+            b->b_max_numconns = c->value_int;
+            flag = LLOAD_BACKEND_MOD_CONNS;
+            break;
+        case CFG_POOL_MAX_LATENCY:
+            if ( c->value_int < 0 ) {
+                snprintf( c->cr_msg, sizeof(c->cr_msg),
+                        "invalid pool-max-latency configuration" );
+                goto fail;
+            }
+            b->b_pool_max_latency = c->value_int;
+            break;
         default:
             rc = 1;
             break;
@@ -61,9 +61,10 @@ lload_connection_assign_nextid( LloadConnection *conn )
  * budget, we unmute the connection.
  *
  * c->c_pdu_cb might return an 'error' and not free the connection. That can
- * happen when changing the state or when client is blocked on writing and
- * already has a pdu pending on the same operation, it's their job to make sure
- * we're woken up again.
+ * happen when changing the state, when client is blocked on writing and
+ * already has a pdu pending on the same operation or when the operation has
+ * been queued by admission control, it's their job to make sure we're woken up
+ * again.
  */
 void *
 handle_pdus( void *ctx, void *arg )
@@ -268,6 +269,11 @@ connection_read_cb( evutil_socket_t s, short what, void *arg )
          * the next cycle. */
         int rc = c->c_pdu_cb( c );
 
+        if ( rc == LLOAD_REQUEST_QUEUED ) {
+            /* Admission control owns the read side now */
+            goto out;
+        }
+
         checked_lock( &c->c_io_mutex );
         c->c_io_state &= ~LLOAD_C_READ_HANDOVER;
         if ( rc == LDAP_SUCCESS &&
@@ -609,6 +615,7 @@ lload_connection_init(
     c = ch_calloc( 1, sizeof(LloadConnection) );
 
     c->c_fd = s;
+    c->c_base_id = lload_get_base_id( s );
     c->c_sb = ber_sockbuf_alloc();
     ber_sockbuf_ctrl( c->c_sb, LBER_SB_OPT_SET_FD, &s );
     ber_dupbv( &c->c_local_name, localname );
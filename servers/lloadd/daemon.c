@@ -81,9 +81,6 @@ ldap_pvt_thread_mutex_t lload_wait_mutex;
 ldap_pvt_thread_cond_t lload_wait_cond;
 ldap_pvt_thread_cond_t lload_pause_cond;
 
-#ifndef SLAPD_MAX_DAEMON_THREADS
-#define SLAPD_MAX_DAEMON_THREADS 16
-#endif
 int lload_daemon_threads = 1;
 int lload_daemon_mask;
 
@@ -691,6 +688,10 @@ lloadd_daemon_destroy( void )
 
         event_free( lload_stats_event );
         event_free( lload_timeout_event );
+        if ( lload_admission_event ) {
+            event_free( lload_admission_event );
+            lload_admission_event = NULL;
+        }
 
         event_base_free( daemon_base );
         daemon_base = NULL;
@@ -1282,6 +1283,14 @@ lloadd_daemon( struct event_base *daemon_base )
         event_add( event, lload_timeout_api );
     }
 
+    event = evtimer_new( daemon_base, lload_admission_dispatch, NULL );
+    if ( !event ) {
+        Debug( LDAP_DEBUG_ANY, "lloadd: "
+                "failed to allocate admission control event\n" );
+        return -1;
+    }
+    lload_admission_event = event;
+
     checked_lock( &lload_wait_mutex );
     lloadd_inited = 1;
     ldap_pvt_thread_cond_signal( &lload_wait_cond );
@@ -1522,9 +1531,9 @@ lload_handle_backend_invalidation( LloadChange *change )
             need_open = 1;
         }
 
-        if ( b->b_active > b->b_numconns ) {
-            need_close += b->b_active - b->b_numconns;
-        } else if ( b->b_active < b->b_numconns ) {
+        if ( b->b_active > backend_numconns( b ) ) {
+            need_close += b->b_active - backend_numconns( b );
+        } else if ( b->b_active < backend_numconns( b ) ) {
             need_open = 1;
         }
 
@@ -1580,8 +1589,8 @@ lload_handle_backend_invalidation( LloadChange *change )
             assert( diff == 0 );
         }
 
-        if ( b->b_active > b->b_numconns ) {
-            int diff = b->b_active - b->b_numconns;
+        if ( b->b_active > backend_numconns( b ) ) {
+            int diff = b->b_active - backend_numconns( b );
 
             assert( need_close >= diff );
 
@@ -1675,6 +1684,12 @@ lload_handle_global_invalidation( LloadChange *change )
          *   - off: clear c_auth/privileged on each client
          * - read pause (WIP):
          *   - nothing needed?
+         * - I/O thread affinity:
+         *   - nothing needed, upstream selection adapts straight away and
+         *     new upstream connections are spread as they are opened
+         * - proxy sessions:
+         *   - only negotiated on new upstream connections, existing ones stop
+         *     using the compact control as soon as the feature is disabled
          */
 
         assert( change->target );
@@ -1685,6 +1700,12 @@ lload_handle_global_invalidation( LloadChange *change )
         if ( feature_diff & LLOAD_FEATURE_PAUSE ) {
             feature_diff &= ~LLOAD_FEATURE_PAUSE;
         }
+        if ( feature_diff & LLOAD_FEATURE_AFFINITY ) {
+            feature_diff &= ~LLOAD_FEATURE_AFFINITY;
+        }
+        if ( feature_diff & LLOAD_FEATURE_PROXY_SESSION ) {
+            feature_diff &= ~LLOAD_FEATURE_PROXY_SESSION;
+        }
         if ( feature_diff & LLOAD_FEATURE_PROXYAUTHZ ) {
             if ( !(lload_features & LLOAD_FEATURE_PROXYAUTHZ) ) {
                 LloadConnection *c;
@@ -1938,6 +1959,19 @@ lload_get_base( ber_socket_t s )
     return lload_daemon[tid].base;
 }
 
+int
+lload_get_base_id( ber_socket_t s )
+{
+    return DAEMON_ID(s);
+}
+
+struct event_base *
+lload_get_base_by_id( int id )
+{
+    assert( id >= 0 && id < lload_daemon_threads );
+    return lload_daemon[id].base;
+}
+
 LloadListener **
 lloadd_get_listeners( void )
 {
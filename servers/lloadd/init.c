@@ -98,6 +98,7 @@ lload_global_init( void )
 
     ldap_pvt_thread_mutex_init( &clients_mutex );
     ldap_pvt_thread_mutex_init( &lload_pin_mutex );
+    lload_admission_init();
 
     if ( lload_exop_init() ) {
         return -1;
@@ -140,6 +141,7 @@ lload_global_destroy( void )
 
     ldap_pvt_thread_mutex_destroy( &clients_mutex );
     ldap_pvt_thread_mutex_destroy( &lload_pin_mutex );
+    lload_admission_destroy();
 
     lload_libevent_destroy();
 
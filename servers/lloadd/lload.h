@@ -82,6 +82,24 @@ LDAP_BEGIN_DECL
 
 #define LLOAD_CONN_MAX_PDUS_PER_CYCLE_DEFAULT 10
 
+/* Connection pool autoscaling thresholds, see backend_pool_update() */
+#define LLOAD_POOL_GROW_PERCENT 75
+#define LLOAD_POOL_SHRINK_PERCENT 25
+#define LLOAD_POOL_SHRINK_DELAY 10
+
+/* How often (ms) the admission queues are retried while not empty */
+#define LLOAD_ADMISSION_POLL 100
+
+/*
+ * Returned by request handlers when the operation has been parked on an
+ * admission queue, the queue now owns the client's read side
+ */
+#define LLOAD_REQUEST_QUEUED (-2)
+
+#ifndef SLAPD_MAX_DAEMON_THREADS
+#define SLAPD_MAX_DAEMON_THREADS 16
+#endif
+
 #define BER_BV_OPTIONAL( bv ) ( BER_BVISNULL( bv ) ? NULL : ( bv ) )
 
 #include <epoch.h>
@@ -106,11 +124,14 @@ typedef struct LloadOperation LloadOperation;
 typedef struct LloadChange LloadChange;
 typedef struct LloadListenerSocket LloadListenerSocket;
 typedef struct LloadListener LloadListener;
+typedef struct LloadClientClass LloadClientClass;
 /* end of forward declarations */
 
 typedef LDAP_STAILQ_HEAD(TierSt, LloadTier) lload_t_head;
 typedef LDAP_CIRCLEQ_HEAD(BeSt, LloadBackend) lload_b_head;
 typedef LDAP_CIRCLEQ_HEAD(ConnSt, LloadConnection) lload_c_head;
+typedef LDAP_TAILQ_HEAD(OpQ, LloadOperation) lload_o_queue;
+typedef LDAP_STAILQ_HEAD(ClassSt, LloadClientClass) lload_cc_head;
 
 LDAP_SLAPD_V (lload_t_head) tiers;
 LDAP_SLAPD_V (lload_c_head) clients;
@@ -182,6 +203,8 @@ typedef enum {
 #endif /* LDAP_API_FEATURE_VERIFY_CREDENTIALS */
     LLOAD_FEATURE_PROXYAUTHZ = 1 << 1,
     LLOAD_FEATURE_PAUSE = 1 << 2,
+    LLOAD_FEATURE_AFFINITY = 1 << 3,
+    LLOAD_FEATURE_PROXY_SESSION = 1 << 4,
 } lload_features_t;
 
 #define LLOAD_FEATURES_DEFAULT ( \
@@ -190,6 +213,8 @@ typedef enum {
 
 #define LLOAD_FEATURE_SUPPORTED_MASK ( \
     LLOAD_FEATURE_PROXYAUTHZ | \
+    LLOAD_FEATURE_AFFINITY | \
+    LLOAD_FEATURE_PROXY_SESSION | \
     0 )
 
 #ifdef BALANCER_MODULE
@@ -312,6 +337,15 @@ struct LloadBackend {
     long b_max_pending, b_max_conn_pending;
     long b_n_ops_executing;
 
+    /* Connection pool autoscaling, active if b_max_numconns > b_numconns */
+    int b_max_numconns, b_pool_max_latency;
+    int b_pool_target, b_pool_idle;
+    uintptr_t b_pool_starved;
+    uintptr_t b_pool_operation_count, b_pool_operation_time;
+    uintptr_t b_pool_latency;
+    uintptr_t b_pool_grown, b_pool_shrunk;
+    char b_pool_decision[128];
+
     lload_counters_t b_counters[LLOAD_STATS_OPS_LAST];
 
     LloadTier *b_tier;
@@ -395,6 +429,7 @@ struct LloadConnection {
     enum sc_type c_type;
     enum sc_io_state c_io_state;
     ber_socket_t c_fd;
+    int c_base_id; /* I/O thread (event base) serving this connection */
 
 /*
  * LloadConnection reference counting:
@@ -490,6 +525,7 @@ struct LloadConnection {
 #ifdef HAVE_TLS
     enum lload_tls_type c_is_tls; /* true if this LDAP over raw TLS */
 #endif
+    int c_proxy_session; /* upstream accepted LDAP_EXOP_X_PROXY_SESSION */
 
     long c_n_ops_executing;      /* num of ops currently executing */
     long c_n_ops_completed;      /* num of ops completed */
@@ -547,6 +583,7 @@ struct LloadOperation {
 
     LloadConnection *o_client;
     unsigned long o_client_connid;
+    int o_client_base_id;
     ber_int_t o_client_msgid;
     ber_int_t o_saved_msgid;
     enum op_restriction o_restricted;
@@ -566,6 +603,44 @@ struct LloadOperation {
     enum op_result o_res;
     BerElement *o_ber;
     BerValue o_request, o_ctrls;
+
+    /* Admission control, protected by lload_admission_mutex */
+    LloadClientClass *o_class;
+    LloadConnection *o_queued_client;
+    int o_queued;
+    LDAP_TAILQ_ENTRY(LloadOperation) o_queue_next;
+};
+
+/*
+ * Client classes for admission control: when no upstream can take an
+ * operation, it can wait on its class queue for up to cc_deadline ms instead
+ * of being rejected straight away. Queues are served by strict priority, then
+ * weighted round-robin among classes of the same priority.
+ */
+struct LloadClientClass {
+    struct berval cc_name;
+
+    /* Matching criteria, all configured ones have to match */
+    struct berval cc_listener;
+    struct berval cc_peer;
+    struct berval cc_dn;
+    regex_t cc_dn_re;
+    int cc_peer_family;
+    unsigned char cc_peer_addr[16];
+    int cc_peer_bits;
+
+    int cc_priority;
+    int cc_weight;
+    int cc_deadline;
+    int cc_max_queued;
+
+    /* Protected by lload_admission_mutex */
+    lload_o_queue cc_queue;
+    int cc_queued;
+    int cc_refcnt; /* configured + operations classified into it */
+    int cc_current; /* weighted round-robin state */
+
+    LDAP_STAILQ_ENTRY(LloadClientClass) cc_next;
 };
 
 struct restriction_entry {
@@ -96,6 +96,11 @@ static AttributeDescription *ad_olmPendingConnections;
 static AttributeDescription *ad_olmActiveConnections;
 static AttributeDescription *ad_olmIncomingConnections;
 static AttributeDescription *ad_olmOutgoingConnections;
+static AttributeDescription *ad_olmPoolTargetConnections;
+static AttributeDescription *ad_olmPoolGrowths;
+static AttributeDescription *ad_olmPoolShrinks;
+static AttributeDescription *ad_olmPoolLatency;
+static AttributeDescription *ad_olmPoolLastDecision;
 
 monitor_subsys_t *lload_monitor_client_subsys;
 
@@ -233,6 +238,44 @@ static struct {
       "SYNTAX 1.3.6.1.4.1.1466.115.121.1.12 "
       "USAGE dSAOperation )",
         &ad_olmConnectionAuthzDN },
+    { "( olmBalancerAttributes:17 "
+      "NAME ( 'olmPoolTargetConnections' ) "
+      "DESC 'Number of regular connections the pool is sized to' "
+      "EQUALITY integerMatch "
+      "SYNTAX 1.3.6.1.4.1.1466.115.121.1.27 "
+      "NO-USER-MODIFICATION "
+      "USAGE dSAOperation )",
+        &ad_olmPoolTargetConnections },
+    { "( olmBalancerAttributes:18 "
+      "NAME ( 'olmPoolGrowths' ) "
+      "DESC 'Number of times the connection pool was grown' "
+      "SUP monitorCounter "
+      "NO-USER-MODIFICATION "
+      "USAGE dSAOperation )",
+        &ad_olmPoolGrowths },
+    { "( olmBalancerAttributes:19 "
+      "NAME ( 'olmPoolShrinks' ) "
+      "DESC 'Number of times the connection pool was shrunk' "
+      "SUP monitorCounter "
+      "NO-USER-MODIFICATION "
+      "USAGE dSAOperation )",
+        &ad_olmPoolShrinks },
+    { "( olmBalancerAttributes:20 "
+      "NAME ( 'olmPoolLatency' ) "
+      "DESC 'Average backend latency in microseconds as seen by the pool controller' "
+      "EQUALITY integerMatch "
+      "SYNTAX 1.3.6.1.4.1.1466.115.121.1.27 "
+      "NO-USER-MODIFICATION "
+      "USAGE dSAOperation )",
+        &ad_olmPoolLatency },
+    { "( olmBalancerAttributes:21 "
+      "NAME ( 'olmPoolLastDecision' ) "
+      "DESC 'Last decision taken by the pool controller' "
+      "EQUALITY caseIgnoreMatch "
+      "SYNTAX 1.3.6.1.4.1.1466.115.121.1.15 "
+      "NO-USER-MODIFICATION "
+      "USAGE dSAOperation )",
+        &ad_olmPoolLastDecision },
 
     { NULL }
 };
@@ -270,6 +313,11 @@ static struct {
       "$ olmReceivedOps "
       "$ olmCompletedOps "
       "$ olmFailedOps "
+      "$ olmPoolTargetConnections "
+      "$ olmPoolGrowths "
+      "$ olmPoolShrinks "
+      "$ olmPoolLatency "
+      "$ olmPoolLastDecision "
       ") )",
         &oc_olmBalancerServer },
 
@@ -877,6 +925,63 @@ done:
     return rc;
 }
 
+static void
+lload_monitor_value_set( Entry *e, AttributeDescription *ad, struct berval *bv )
+{
+    Attribute *a = attr_find( e->e_attrs, ad );
+
+    if ( a ) {
+        ber_bvreplace( &a->a_vals[0], bv );
+    } else {
+        attr_merge_normalize_one( e, ad, bv, NULL );
+    }
+}
+
+/*
+ * Pool controller attributes are only present while autoscaling is
+ * configured for the backend.
+ */
+static void
+lload_monitor_pool_update( Entry *e, LloadBackend *b )
+{
+    struct berval bv;
+    char buf[ LDAP_PVT_INTTYPE_CHARS(unsigned long) ];
+
+    assert_locked( &b->b_mutex );
+
+    if ( !b->b_numconns || b->b_max_numconns <= b->b_numconns ) {
+        attr_delete( &e->e_attrs, ad_olmPoolTargetConnections );
+        attr_delete( &e->e_attrs, ad_olmPoolGrowths );
+        attr_delete( &e->e_attrs, ad_olmPoolShrinks );
+        attr_delete( &e->e_attrs, ad_olmPoolLatency );
+        attr_delete( &e->e_attrs, ad_olmPoolLastDecision );
+        return;
+    }
+
+    bv.bv_val = buf;
+    bv.bv_len = snprintf( buf, sizeof(buf), "%d", backend_numconns( b ) );
+    lload_monitor_value_set( e, ad_olmPoolTargetConnections, &bv );
+
+    bv.bv_len = snprintf(
+            buf, sizeof(buf), "%lu", (unsigned long)b->b_pool_grown );
+    lload_monitor_value_set( e, ad_olmPoolGrowths, &bv );
+
+    bv.bv_len = snprintf(
+            buf, sizeof(buf), "%lu", (unsigned long)b->b_pool_shrunk );
+    lload_monitor_value_set( e, ad_olmPoolShrinks, &bv );
+
+    bv.bv_len = snprintf(
+            buf, sizeof(buf), "%lu", (unsigned long)b->b_pool_latency );
+    lload_monitor_value_set( e, ad_olmPoolLatency, &bv );
+
+    if ( b->b_pool_decision[0] ) {
+        ber_str2bv( b->b_pool_decision, 0, 0, &bv );
+    } else {
+        ber_str2bv( "none", STRLENOF("none"), 0, &bv );
+    }
+    lload_monitor_value_set( e, ad_olmPoolLastDecision, &bv );
+}
+
 static int
 lload_monitor_server_update(
         Operation *op,
@@ -893,6 +998,7 @@ lload_monitor_server_update(
     int i;
 
     checked_lock( &b->b_mutex );
+    lload_monitor_pool_update( e, b );
     active = b->b_active + b->b_bindavail;
 
     LDAP_CIRCLEQ_FOREACH ( c, &b->b_preparing, c_next ) {
@@ -145,6 +145,7 @@ operation_init( LloadConnection *c, BerElement *ber )
     op = ch_calloc( 1, sizeof(LloadOperation) );
     op->o_client = c;
     op->o_client_connid = c->c_connid;
+    op->o_client_base_id = c->c_base_id;
     op->o_ber = ber;
     gettimeofday( &op->o_start, NULL );
 
@@ -236,6 +237,8 @@ operation_unlink( LloadOperation *op )
 
     assert( op->o_refcnt == 0 );
 
+    lload_admission_unlink( op );
+
     Debug( LDAP_DEBUG_TRACE, "operation_unlink: "
             "unlinking operation between client connid=%lu and upstream "
             "connid=%lu "
@@ -363,6 +366,9 @@ operation_unlink_upstream( LloadOperation *op, LloadConnection *upstream )
         b->b_n_ops_executing--;
         operation_update_backend_counters( op, b );
         checked_unlock( &b->b_mutex );
+
+        /* Capacity freed up, let queued operations have a go */
+        lload_admission_kick();
     }
 
     return result;
@@ -33,6 +33,27 @@
 
 LDAP_BEGIN_DECL
 
+/*
+ * admission.c
+ */
+LDAP_SLAPD_V (lload_cc_head) lload_client_classes;
+LDAP_SLAPD_V (int) lload_admission_limit;
+LDAP_SLAPD_V (ldap_pvt_thread_mutex_t) lload_admission_mutex;
+LDAP_SLAPD_V (struct event *) lload_admission_event;
+LDAP_SLAPD_F (LloadClientClass *) lload_client_class_new( void );
+LDAP_SLAPD_F (int) lload_client_class_finish( LloadClientClass *cls, char *msg, size_t msglen );
+LDAP_SLAPD_F (void) lload_client_class_free( LloadClientClass *cls );
+LDAP_SLAPD_F (void) lload_client_class_add( LloadClientClass *cls, int index );
+LDAP_SLAPD_F (void) lload_client_class_remove( LloadClientClass *cls );
+LDAP_SLAPD_F (void) lload_client_classes_destroy( void );
+LDAP_SLAPD_F (int) lload_admission_defer( LloadConnection *c, LloadOperation *op );
+LDAP_SLAPD_F (int) lload_admission_enqueue( LloadConnection *c, LloadOperation *op );
+LDAP_SLAPD_F (void) lload_admission_unlink( LloadOperation *op );
+LDAP_SLAPD_F (void) lload_admission_kick( void );
+LDAP_SLAPD_F (void) lload_admission_dispatch( evutil_socket_t s, short what, void *arg );
+LDAP_SLAPD_F (void) lload_admission_init( void );
+LDAP_SLAPD_F (void) lload_admission_destroy( void );
+
 /*
  * backend.c
  */
@@ -40,6 +61,8 @@ LDAP_BEGIN_DECL
 LDAP_SLAPD_F (void) backend_connect( evutil_socket_t s, short what, void *arg );
 LDAP_SLAPD_F (void *) backend_connect_task( void *ctx, void *arg );
 LDAP_SLAPD_F (void) backend_retry( LloadBackend *b );
+LDAP_SLAPD_F (int) backend_numconns( LloadBackend *b );
+LDAP_SLAPD_F (void) backend_pool_update( LloadBackend *b );
 LDAP_SLAPD_F (int) upstream_select( LloadOperation *op, LloadConnection **c, int *res, char **message );
 LDAP_SLAPD_F (int) backend_select( LloadBackend *b, LloadOperation *op, LloadConnection **c, int *res, char **message );
 LDAP_SLAPD_F (int) try_upstream( LloadBackend *b, lload_c_head *head, LloadOperation *op, LloadConnection *c, int *res, char **message );
@@ -83,6 +106,10 @@ LDAP_SLAPD_F (void) lload_bindconf_tls_defaults( slap_bindconf *bc );
 LDAP_SLAPD_F (int) lload_backend_parse( struct config_args_s *c,
         const char *word,
         LloadBackend *b );
+LDAP_SLAPD_F (int) lload_client_class_parse( struct config_args_s *c,
+        const char *word,
+        LloadClientClass *cls );
+LDAP_SLAPD_F (int) lload_client_class_unparse( LloadClientClass *cls, struct berval *bv );
 LDAP_SLAPD_F (int) lload_bindconf_parse( struct config_args_s *c,
         const char *word,
         slap_bindconf *bc );
@@ -126,6 +153,8 @@ LDAP_SLAPD_F (int) lloadd_daemon( struct event_base *daemon_base );
 LDAP_SLAPD_F (LloadListener **) lloadd_get_listeners( void );
 LDAP_SLAPD_F (void) listeners_reactivate( void );
 LDAP_SLAPD_F (struct event_base *) lload_get_base( ber_socket_t s );
+LDAP_SLAPD_F (int) lload_get_base_id( ber_socket_t s );
+LDAP_SLAPD_F (struct event_base *) lload_get_base_by_id( int id );
 LDAP_SLAPD_V (int) lload_daemon_threads;
 LDAP_SLAPD_V (int) lload_daemon_mask;
 
@@ -133,9 +133,15 @@ lload_tiers_update( evutil_socket_t s, short what, void *arg )
     LloadTier *tier;
 
     LDAP_STAILQ_FOREACH ( tier, &tiers, t_next ) {
+        LloadBackend *b;
+
         if ( tier->t_type.tier_update ) {
             tier->t_type.tier_update( tier );
         }
+
+        LDAP_CIRCLEQ_FOREACH ( b, &tier->t_backends, b_next ) {
+            backend_pool_update( b );
+        }
     }
 }
 
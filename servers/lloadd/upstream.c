@@ -326,6 +326,12 @@ handle_one_response( LloadConnection *c )
 
             __atomic_add_fetch( &b->b_operation_count, 1, __ATOMIC_RELAXED );
             __atomic_add_fetch( &b->b_operation_time, diff, __ATOMIC_RELAXED );
+            if ( b->b_max_numconns ) {
+                __atomic_add_fetch(
+                        &b->b_pool_operation_count, 1, __ATOMIC_RELAXED );
+                __atomic_add_fetch(
+                        &b->b_pool_operation_time, diff, __ATOMIC_RELAXED );
+            }
         }
         op->o_last_response = tv;
 
@@ -501,11 +507,134 @@ done:
 }
 #endif /* HAVE_CYRUS_SASL */
 
+/*
+ * The bind (and proxy session setup, if any) has completed, make the
+ * connection available to clients.
+ */
+static void
+upstream_bound( LloadConnection *c )
+{
+    LloadBackend *b = c->c_backend;
+
+    CONNECTION_LOCK(c);
+    c->c_pdu_cb = handle_one_response;
+    c->c_state = LLOAD_C_READY;
+    c->c_type = LLOAD_C_OPEN;
+    c->c_read_timeout = NULL;
+    Debug( LDAP_DEBUG_CONNS, "upstream_bound: "
+            "connection connid=%lu for backend server '%s' is ready "
+            "for use%s\n",
+            c->c_connid, b->b_name.bv_val,
+            c->c_proxy_session ? " (proxy session)" : "" );
+    CONNECTION_UNLOCK(c);
+    checked_lock( &b->b_mutex );
+    LDAP_CIRCLEQ_REMOVE( &b->b_preparing, c, c_next );
+    b->b_active++;
+    b->b_opening--;
+    b->b_failed = 0;
+    if ( b->b_last_conn ) {
+        LDAP_CIRCLEQ_INSERT_AFTER( &b->b_conns, b->b_last_conn, c, c_next );
+    } else {
+        LDAP_CIRCLEQ_INSERT_HEAD( &b->b_conns, c, c_next );
+    }
+    b->b_last_conn = c;
+    backend_retry( b );
+    checked_unlock( &b->b_mutex );
+}
+
+static int
+upstream_proxy_session_cb( LloadConnection *c )
+{
+    BerElement *ber = c->c_currentber;
+    BerValue matcheddn, message;
+    ber_tag_t tag;
+    ber_int_t msgid, result;
+
+    c->c_currentber = NULL;
+
+    if ( ber_scanf( ber, "it", &msgid, &tag ) == LBER_ERROR ) {
+        Debug( LDAP_DEBUG_ANY, "upstream_proxy_session_cb: "
+                "protocol violation from server\n" );
+        goto fail;
+    }
+
+    if ( msgid != ( c->c_next_msgid - 1 ) || tag != LDAP_RES_EXTENDED ) {
+        Debug( LDAP_DEBUG_ANY, "upstream_proxy_session_cb: "
+                "unexpected %s from server, msgid=%d\n",
+                lload_msgtype2str( tag ), msgid );
+        goto fail;
+    }
+
+    if ( ber_scanf( ber, "{emm" /* "}" */, &result, &matcheddn, &message ) ==
+                 LBER_ERROR ) {
+        Debug( LDAP_DEBUG_ANY, "upstream_proxy_session_cb: "
+                "protocol violation on proxy session response\n" );
+        goto fail;
+    }
+
+    if ( result == LDAP_SUCCESS ) {
+        c->c_proxy_session = 1;
+    } else {
+        /* Not fatal, we just keep sending the full proxyauthz control */
+        Debug( LDAP_DEBUG_STATS, "upstream_proxy_session_cb: "
+                "server refused proxy session on connid=%lu rc=%d "
+                "message='%s'\n",
+                c->c_connid, result, message.bv_val );
+    }
+    upstream_bound( c );
+
+    checked_lock( &c->c_io_mutex );
+    c->c_io_state &= ~LLOAD_C_READ_HANDOVER;
+    checked_unlock( &c->c_io_mutex );
+    event_add( c->c_read_event, c->c_read_timeout );
+    ber_free( ber, 1 );
+    return -1;
+
+fail:
+    CONNECTION_LOCK_DESTROY(c);
+    ber_free( ber, 1 );
+    return -1;
+}
+
+/*
+ * Ask the server to treat this connection as a proxy session, after which
+ * client operations carry the compact proxied client control rather than
+ * a full proxyauthz control, see request_process().
+ */
+static int
+upstream_proxy_session( LloadConnection *c )
+{
+    BerValue oid = BER_BVC(LDAP_EXOP_X_PROXY_SESSION);
+    BerElement *ber;
+    ber_int_t msgid;
+
+    CONNECTION_LOCK(c);
+    c->c_pdu_cb = upstream_proxy_session_cb;
+    CONNECTION_UNLOCK(c);
+
+    checked_lock( &c->c_io_mutex );
+    ber = c->c_pendingber;
+    if ( ber == NULL && (ber = ber_alloc()) == NULL ) {
+        checked_unlock( &c->c_io_mutex );
+        return -1;
+    }
+    c->c_pendingber = ber;
+
+    msgid = c->c_next_msgid++;
+    ber_printf( ber, "t{tit{tO}}", LDAP_TAG_MESSAGE,
+            LDAP_TAG_MSGID, msgid,
+            LDAP_REQ_EXTENDED,
+            LDAP_TAG_EXOP_REQ_OID, &oid );
+    checked_unlock( &c->c_io_mutex );
+
+    connection_write_cb( -1, 0, c );
+    return LDAP_SUCCESS;
+}
+
 int
 upstream_bind_cb( LloadConnection *c )
 {
     BerElement *ber = c->c_currentber;
-    LloadBackend *b = c->c_backend;
     BerValue matcheddn, message;
     ber_tag_t tag;
     ber_int_t msgid, result;
@@ -584,30 +713,14 @@ upstream_bind_cb( LloadConnection *c )
                 goto fail;
             }
 #endif /* HAVE_CYRUS_SASL */
-            CONNECTION_LOCK(c);
-            c->c_pdu_cb = handle_one_response;
-            c->c_state = LLOAD_C_READY;
-            c->c_type = LLOAD_C_OPEN;
-            c->c_read_timeout = NULL;
-            Debug( LDAP_DEBUG_CONNS, "upstream_bind_cb: "
-                    "connection connid=%lu for backend server '%s' is ready "
-                    "for use\n",
-                    c->c_connid, b->b_name.bv_val );
-            CONNECTION_UNLOCK(c);
-            checked_lock( &b->b_mutex );
-            LDAP_CIRCLEQ_REMOVE( &b->b_preparing, c, c_next );
-            b->b_active++;
-            b->b_opening--;
-            b->b_failed = 0;
-            if ( b->b_last_conn ) {
-                LDAP_CIRCLEQ_INSERT_AFTER(
-                        &b->b_conns, b->b_last_conn, c, c_next );
-            } else {
-                LDAP_CIRCLEQ_INSERT_HEAD( &b->b_conns, c, c_next );
+            if ( (lload_features & LLOAD_FEATURE_PROXY_SESSION) &&
+                    (lload_features & LLOAD_FEATURE_PROXYAUTHZ) ) {
+                if ( upstream_proxy_session( c ) ) {
+                    goto fail;
+                }
+                break;
             }
-            b->b_last_conn = c;
-            backend_retry( b );
-            checked_unlock( &b->b_mutex );
+            upstream_bound( c );
             break;
         default:
             Debug( LDAP_DEBUG_ANY, "upstream_bind_cb: "
@@ -647,6 +760,7 @@ upstream_bind( void *ctx, void *arg )
     CONNECTION_LOCK(c);
     assert( !event_pending( c->c_read_event, EV_READ, NULL ) );
     c->c_pdu_cb = upstream_bind_cb;
+    c->c_proxy_session = 0;
     CONNECTION_UNLOCK(c);
 
     checked_lock( &c->c_io_mutex );
@@ -731,7 +845,7 @@ upstream_finish( LloadConnection *c )
             b->b_active && b->b_numbindconns ) {
         if ( !b->b_bindavail ) {
             is_bindconn = 1;
-        } else if ( b->b_active >= b->b_numconns &&
+        } else if ( b->b_active >= backend_numconns( b ) &&
                 b->b_bindavail < b->b_numbindconns ) {
             is_bindconn = 1;
         }
@@ -978,6 +1092,35 @@ fail:
 }
 #endif /* HAVE_TLS */
 
+/*
+ * Pick the I/O thread with the fewest connections to this backend so that
+ * each thread ends up with its own share of the backend's upstreams.
+ */
+static int
+upstream_pick_base_id( LloadBackend *b )
+{
+    lload_c_head *heads[] = { &b->b_conns, &b->b_bindconns, &b->b_preparing };
+    int counts[SLAPD_MAX_DAEMON_THREADS] = { 0 };
+    int i, best = 0;
+
+    assert_locked( &b->b_mutex );
+
+    for ( i = 0; i < sizeof(heads) / sizeof(heads[0]); i++ ) {
+        LloadConnection *c;
+
+        LDAP_CIRCLEQ_FOREACH( c, heads[i], c_next ) {
+            counts[c->c_base_id]++;
+        }
+    }
+
+    for ( i = 1; i < lload_daemon_threads; i++ ) {
+        if ( counts[i] < counts[best] ) {
+            best = i;
+        }
+    }
+    return best;
+}
+
 /*
  * We must already hold b->b_mutex when called.
  */
@@ -989,7 +1132,7 @@ upstream_init(
         LloadBackend *b )
 {
     LloadConnection *c;
-    struct event_base *base = lload_get_base( s );
+    struct event_base *base;
     struct event *event;
     int flags;
 
@@ -1000,6 +1143,11 @@ upstream_init(
         return NULL;
     }
 
+    if ( lload_features & LLOAD_FEATURE_AFFINITY ) {
+        c->c_base_id = upstream_pick_base_id( b );
+    }
+    base = lload_get_base_by_id( c->c_base_id );
+
     CONNECTION_LOCK(c);
     c->c_backend = b;
 #ifdef HAVE_TLS
@@ -36,6 +36,7 @@
 #include "sets.h"
 #include "lber_pvt.h"
 #include "lutil.h"
+#include "lutil_hash.h"
 
 #define ACL_BUF_SIZE 	1024	/* use most appropriate size */
 
@@ -54,7 +55,8 @@ static AccessControl * slap_acl_get(
 	struct berval *val,
 	AclRegexMatches *matches,
 	slap_mask_t *mask,
-	AccessControlState *state );
+	AccessControlState *state,
+	unsigned long **dnbits );
 
 static slap_control_t slap_acl_mask(
 	AccessControl *ac,
@@ -73,6 +75,10 @@ static int	regex_matches(
 	struct berval *dn_matches, struct berval *val_matches,
 	AclRegexMatches *matches);
 
+static void acl_dn_index_free( void );
+static int acl_cache_check_list( AccessControl *a );
+static int acl_list_by_target( AccessControl *a );
+
 typedef	struct AclSetCookie {
 	SetCookie	asc_cookie;
 #define	asc_op		asc_cookie.set_op
@@ -83,6 +89,651 @@ typedef	struct AclSetCookie {
 SLAP_SET_GATHER acl_set_gather;
 SLAP_SET_GATHER acl_set_gather2;
 
+/*
+ * ACL decision cache
+ *
+ * Remembers the outcome of slap_access_allowed() for whole-attribute
+ * checks, keyed by the ACL list in effect, the authorization DN, the
+ * attribute, the requested access and the rules whose DN clause matches
+ * the target, as told by the DN index below.  Entries that differ only
+ * in their DN thus share one decision.  When the index can't tell the
+ * matching rules exactly, or a "by" clause depends on the target DN
+ * itself (self, expansions), the target DN is used instead.  Only lists
+ * whose outcome is fully determined by that key are cached: clauses that
+ * look at the connection, the security strength factors, the target
+ * entry's content, sets or dynamic ACLs make the whole list uncacheable.
+ * This is decided once per list, when its DN index is built.
+ *
+ * Every change to any ACL list bumps acl_cache_confgen, which drops all
+ * entries at once.  Decisions that consulted group membership are also
+ * tagged with acl_cache_datagen as seen when the operation started; it
+ * is bumped by every successful local write.
+ */
+typedef struct acl_cache_entry {
+	unsigned		ace_hash;
+	AccessControl		*ace_list;
+	AttributeDescription	*ace_desc;
+	slap_access_t		ace_access;
+	slap_counter_t		ace_confgen;
+	slap_counter_t		ace_datagen;
+	int			ace_datadep;
+	int			ace_ret;
+	slap_mask_t		ace_mask;
+	struct berval		ace_ondn;
+	struct berval		ace_target;	/* target DN or rule bits */
+	int			ace_bytarget;
+	ber_len_t		ace_bufsize;
+} acl_cache_entry;
+
+#define ACL_CACHE_LOCKS	64
+
+enum {
+	ACL_CACHE_HITS = 0,
+	ACL_CACHE_MISSES,
+	ACL_CACHE_INVALIDATIONS,
+
+	ACL_CACHE_LAST
+};
+
+int				acl_cache_size;
+static acl_cache_entry		*acl_cache;
+static unsigned			acl_cache_mask;
+static ldap_pvt_thread_mutex_t	acl_cache_locks[ACL_CACHE_LOCKS];
+static slap_stats_t		*acl_cache_stats;
+static slap_counter_t		acl_cache_confgen = 1;
+static slap_counter_t		acl_cache_datagen = 1;
+
+static void
+acl_cache_free( void )
+{
+	unsigned i;
+
+	if ( acl_cache == NULL )
+		return;
+
+	for ( i = 0; i <= acl_cache_mask; i++ ) {
+		if ( acl_cache[i].ace_bufsize )
+			ch_free( acl_cache[i].ace_ondn.bv_val );
+	}
+	for ( i = 0; i < ACL_CACHE_LOCKS; i++ )
+		ldap_pvt_thread_mutex_destroy( &acl_cache_locks[i] );
+	ch_free( acl_cache );
+	acl_cache = NULL;
+	acl_cache_mask = 0;
+}
+
+/*
+ * Must only be called while no operation can be evaluating ACLs,
+ * i.e. during startup or with the thread pool paused.
+ */
+int
+acl_cache_resize( int size )
+{
+	unsigned i, n;
+
+	acl_cache_free();
+	acl_cache_size = size;
+
+	if ( size <= 0 ) {
+		acl_cache_size = 0;
+		return 0;
+	}
+
+	for ( n = 1; n < (unsigned)size; n <<= 1 )
+		;	/* Empty */
+
+	acl_cache = ch_calloc( n, sizeof( acl_cache_entry ) );
+	acl_cache_mask = n - 1;
+	for ( i = 0; i < ACL_CACHE_LOCKS; i++ )
+		ldap_pvt_thread_mutex_init( &acl_cache_locks[i] );
+	if ( acl_cache_stats == NULL )
+		acl_cache_stats = slap_stats_alloc( ACL_CACHE_LAST );
+
+	return 0;
+}
+
+void
+acl_cache_destroy( void )
+{
+	acl_cache_resize( 0 );
+	slap_stats_free( acl_cache_stats );
+	acl_cache_stats = NULL;
+	acl_dn_index_free();
+}
+
+/*
+ * DN index of an ACL list
+ *
+ * The "to" DN clauses of a list are collected into a table of DN
+ * suffixes: the pattern itself for base, one, subtree and children
+ * scopes, and the literal suffix a regex is anchored to otherwise.
+ * Looking up each suffix of the target DN once yields the set of rules,
+ * by acl_pos, whose DN clause may match; slap_acl_get() skips all others
+ * without running their regexec().  Rules without a usable suffix are
+ * always candidates.  Matching is case-insensitive, so the index never
+ * excludes a rule that would match; candidates are still checked
+ * exactly.  For base, one, subtree and children scopes the depth and
+ * the exact bytes are checked too, so that unless a regex rule is among
+ * the candidates the set is exactly the rules whose DN clause matches.
+ *
+ * Indexes are built on first use and freed by acl_cache_flush(), so the
+ * cacheability of the list is worked out there as well.
+ */
+typedef struct AclDnKey {
+	struct berval		ak_suffix;
+	slap_style_t		ak_style;
+	int			ak_pos;
+} AclDnKey;
+
+typedef struct AclDnIndex {
+	AccessControl		*ai_list;
+	int			ai_nacls;
+	int			ai_nkeys;
+	AclDnKey		*ai_keys;
+	unsigned long		*ai_any;
+	int			ai_cache;	/* see acl_cache_check_list() */
+	int			ai_bytarget;	/* decisions need the target DN */
+	struct AclDnIndex	*ai_next;
+} AclDnIndex;
+
+#define ACL_DN_MAXACLS		1024
+#define ACL_DN_WORDBITS		( sizeof( unsigned long ) * 8 )
+#define ACL_DN_WORDS(n)		( ( (n) + ACL_DN_WORDBITS - 1 ) / ACL_DN_WORDBITS )
+#define ACL_DN_SET(b,i)		( (b)[ (i) / ACL_DN_WORDBITS ] |= \
+	1UL << ( (i) % ACL_DN_WORDBITS ) )
+#define ACL_DN_ISSET(b,i)	( (b)[ (i) / ACL_DN_WORDBITS ] & \
+	( 1UL << ( (i) % ACL_DN_WORDBITS ) ) )
+
+static AclDnIndex		*acl_dn_indexes;
+static ldap_pvt_thread_mutex_t	acl_dn_mutex;
+
+static int
+acl_dn_key_cmp( const void *v1, const void *v2 )
+{
+	const AclDnKey *k1 = v1, *k2 = v2;
+
+	if ( k1->ak_suffix.bv_len != k2->ak_suffix.bv_len )
+		return k1->ak_suffix.bv_len < k2->ak_suffix.bv_len ? -1 : 1;
+
+	return strncasecmp( k1->ak_suffix.bv_val, k2->ak_suffix.bv_val,
+		k1->ak_suffix.bv_len );
+}
+
+static AclDnIndex *
+acl_dn_index_build( AccessControl *list )
+{
+	AclDnIndex *ai;
+	AccessControl *a;
+
+	ai = ch_calloc( 1, sizeof( AclDnIndex ) );
+	ai->ai_list = list;
+	ai->ai_cache = acl_cache_check_list( list );
+	ai->ai_bytarget = acl_list_by_target( list );
+	for ( a = list; a != NULL; a = a->acl_next ) {
+		if ( a->acl_pos >= ai->ai_nacls )
+			ai->ai_nacls = a->acl_pos + 1;
+	}
+	if ( ai->ai_nacls > ACL_DN_MAXACLS ) {
+		ai->ai_bytarget = 1;
+		return ai;
+	}
+
+	ai->ai_any = ch_calloc( ACL_DN_WORDS( ai->ai_nacls ),
+		sizeof( unsigned long ) );
+	ai->ai_keys = ch_malloc( ai->ai_nacls * sizeof( AclDnKey ) );
+
+	for ( a = list; a != NULL; a = a->acl_next ) {
+		struct berval suffix;
+
+		switch ( a->acl_dn_style ) {
+		case ACL_STYLE_REGEX:
+			if ( BER_BVISEMPTY( &a->acl_dn_pat ) ) {
+				/* matches any entry */
+				ACL_DN_SET( ai->ai_any, a->acl_pos );
+				continue;
+			}
+			if ( !acl_regex_dn_tail( &a->acl_dn_pat, &suffix ) ) {
+				ACL_DN_SET( ai->ai_any, a->acl_pos );
+				ai->ai_bytarget = 1;
+				continue;
+			}
+			break;
+
+		case ACL_STYLE_BASE:
+		case ACL_STYLE_ONE:
+		case ACL_STYLE_SUBTREE:
+		case ACL_STYLE_CHILDREN:
+			suffix = a->acl_dn_pat;
+			/* slap_acl_get() treats the root DN specially */
+			if ( BER_BVISEMPTY( &suffix ) )
+				ai->ai_bytarget = 1;
+			break;
+
+		default:
+			ACL_DN_SET( ai->ai_any, a->acl_pos );
+			ai->ai_bytarget = 1;
+			continue;
+		}
+
+		ai->ai_keys[ ai->ai_nkeys ].ak_suffix = suffix;
+		ai->ai_keys[ ai->ai_nkeys ].ak_style = a->acl_dn_style;
+		ai->ai_keys[ ai->ai_nkeys ].ak_pos = a->acl_pos;
+		ai->ai_nkeys++;
+	}
+
+	if ( ai->ai_nkeys == 0 ) {
+		ch_free( ai->ai_keys );
+		ai->ai_keys = NULL;
+	} else {
+		qsort( ai->ai_keys, ai->ai_nkeys, sizeof( AclDnKey ),
+			acl_dn_key_cmp );
+	}
+
+	return ai;
+}
+
+static AclDnIndex *
+acl_dn_index_get( AccessControl *list )
+{
+	AclDnIndex *ai;
+
+#ifdef __ATOMIC_ACQUIRE
+	for ( ai = __atomic_load_n( &acl_dn_indexes, __ATOMIC_ACQUIRE );
+		ai != NULL; ai = ai->ai_next )
+	{
+		if ( ai->ai_list == list )
+			return ai;
+	}
+#endif
+
+	ldap_pvt_thread_mutex_lock( &acl_dn_mutex );
+	for ( ai = acl_dn_indexes; ai != NULL; ai = ai->ai_next ) {
+		if ( ai->ai_list == list )
+			break;
+	}
+	if ( ai == NULL ) {
+		ai = acl_dn_index_build( list );
+		ai->ai_next = acl_dn_indexes;
+#ifdef __ATOMIC_RELEASE
+		__atomic_store_n( &acl_dn_indexes, ai, __ATOMIC_RELEASE );
+#else
+		acl_dn_indexes = ai;
+#endif
+	}
+	ldap_pvt_thread_mutex_unlock( &acl_dn_mutex );
+
+	return ai;
+}
+
+/*
+ * Set the bits of the rules whose DN clause may match ndn.  *exact is
+ * cleared if a regex rule was let through on its suffix alone.
+ * Returns 0 if the index cannot tell.
+ */
+static int
+acl_dn_index_match(
+	AclDnIndex *ai,
+	struct berval *ndn,
+	unsigned long *bits,
+	int *exact )
+{
+	AclDnKey key;
+	char *p;
+	int depth = 0;
+
+	if ( ai->ai_any == NULL )
+		return 0;
+
+	AC_MEMCPY( bits, ai->ai_any,
+		ACL_DN_WORDS( ai->ai_nacls ) * sizeof( unsigned long ) );
+
+	key.ak_suffix = *ndn;
+	for ( ; ai->ai_keys != NULL; depth++ ) {
+		int lo = 0, hi = ai->ai_nkeys;
+
+		/* find the first key equal to the suffix */
+		while ( lo < hi ) {
+			int mid = ( lo + hi ) / 2;
+
+			if ( acl_dn_key_cmp( &ai->ai_keys[ mid ], &key ) < 0 )
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		for ( ; lo < ai->ai_nkeys &&
+			acl_dn_key_cmp( &ai->ai_keys[ lo ], &key ) == 0; lo++ )
+		{
+			AclDnKey *k = &ai->ai_keys[ lo ];
+
+			switch ( k->ak_style ) {
+			case ACL_STYLE_REGEX:
+				*exact = 0;
+				ACL_DN_SET( bits, k->ak_pos );
+				continue;
+			case ACL_STYLE_BASE:
+				if ( depth != 0 )
+					continue;
+				break;
+			case ACL_STYLE_ONE:
+				if ( depth != 1 )
+					continue;
+				break;
+			case ACL_STYLE_CHILDREN:
+				if ( depth == 0 )
+					continue;
+				break;
+			default:
+				break;
+			}
+			/* the same test as slap_acl_get() */
+			if ( memcmp( k->ak_suffix.bv_val, key.ak_suffix.bv_val,
+				key.ak_suffix.bv_len ) == 0 )
+				ACL_DN_SET( bits, k->ak_pos );
+		}
+
+		if ( BER_BVISEMPTY( &key.ak_suffix ) )
+			break;
+
+		/* normalized DNs only have unescaped separators */
+		p = memchr( key.ak_suffix.bv_val, ',', key.ak_suffix.bv_len );
+		if ( p == NULL ) {
+			key.ak_suffix.bv_val += key.ak_suffix.bv_len;
+			key.ak_suffix.bv_len = 0;
+		} else {
+			p++;
+			key.ak_suffix.bv_len -= p - key.ak_suffix.bv_val;
+			key.ak_suffix.bv_val = p;
+		}
+	}
+
+	return 1;
+}
+
+static void
+acl_dn_index_free( void )
+{
+	AclDnIndex *ai;
+
+	while ( ( ai = acl_dn_indexes ) != NULL ) {
+		acl_dn_indexes = ai->ai_next;
+		ch_free( ai->ai_keys );
+		ch_free( ai->ai_any );
+		ch_free( ai );
+	}
+}
+
+/* An ACL has been added, removed or modified */
+void
+acl_cache_flush( void )
+{
+	SLAP_COUNTER_ADD( acl_cache_confgen, 1 );
+	acl_dn_index_free();
+}
+
+/* Entries have been written, group membership may have changed */
+void
+acl_cache_data_changed( void )
+{
+	if ( acl_cache )
+		SLAP_COUNTER_ADD( acl_cache_datagen, 1 );
+}
+
+slap_counter_t
+acl_cache_generation( void )
+{
+	return SLAP_COUNTER_GET( acl_cache_datagen );
+}
+
+void
+acl_cache_counters(
+	slap_counter_t *hits,
+	slap_counter_t *misses,
+	slap_counter_t *invalidations )
+{
+	if ( acl_cache_stats == NULL ) {
+		*hits = *misses = *invalidations = 0;
+		return;
+	}
+	*hits = slap_stats_get( acl_cache_stats, ACL_CACHE_HITS );
+	*misses = slap_stats_get( acl_cache_stats, ACL_CACHE_MISSES );
+	*invalidations = slap_stats_get( acl_cache_stats, ACL_CACHE_INVALIDATIONS );
+}
+
+/*
+ * Returns -1 if the outcome of the list may depend on anything but
+ * the cache key, 1 if it may depend on group membership, 0 otherwise.
+ * Only called when the list's DN index is built.
+ */
+static int
+acl_cache_check_list( AccessControl *a )
+{
+	Access *b;
+	int rc = 0;
+
+	for ( ; a != NULL; a = a->acl_next ) {
+		if ( a->acl_op || a->acl_control || a->acl_filter )
+			return -1;
+
+		for ( b = a->acl_access; b != NULL; b = b->a_next ) {
+			if ( b->a_dn_at || b->a_realdn_at ||
+				!BER_BVISEMPTY( &b->a_realdn_pat ) ||
+				!BER_BVISEMPTY( &b->a_peername_pat ) ||
+				!BER_BVISEMPTY( &b->a_sockname_pat ) ||
+				!BER_BVISEMPTY( &b->a_domain_pat ) ||
+				!BER_BVISEMPTY( &b->a_sockurl_pat ) ||
+				!BER_BVISEMPTY( &b->a_set_pat ) ||
+				b->a_authz.sai_ssf ||
+				b->a_authz.sai_transport_ssf ||
+				b->a_authz.sai_tls_ssf ||
+				b->a_authz.sai_sasl_ssf )
+				return -1;
+#ifdef SLAP_DYNACL
+			if ( b->a_dynacl )
+				return -1;
+#endif /* SLAP_DYNACL */
+			if ( !BER_BVISEMPTY( &b->a_group_pat ) )
+				rc = 1;
+		}
+	}
+
+	return rc;
+}
+
+/*
+ * Returns 1 if a "by" clause of the list depends on the target DN
+ * itself rather than on which rules matched it.
+ */
+static int
+acl_list_by_target( AccessControl *a )
+{
+	Access *b;
+
+	for ( ; a != NULL; a = a->acl_next ) {
+		for ( b = a->acl_access; b != NULL; b = b->a_next ) {
+			if ( b->a_dn.a_style == ACL_STYLE_SELF ||
+				b->a_dn.a_style == ACL_STYLE_EXPAND ||
+				b->a_dn.a_expand || b->a_dn_self ||
+				b->a_group_style == ACL_STYLE_EXPAND )
+				return 1;
+			/* regex substitutions from the target DN */
+			if ( b->a_dn.a_style == ACL_STYLE_REGEX &&
+				!BER_BVISNULL( &b->a_dn_pat ) &&
+				memchr( b->a_dn_pat.bv_val, '$', b->a_dn_pat.bv_len ) )
+				return 1;
+		}
+	}
+
+	return 0;
+}
+
+static int
+acl_list_identity_only( AccessControl *a )
+{
+	Access *b;
+
+	for ( ; a != NULL; a = a->acl_next ) {
+		if ( a->acl_control )
+			return 0;
+
+		for ( b = a->acl_access; b != NULL; b = b->a_next ) {
+			if ( b->a_realdn_at ||
+				!BER_BVISEMPTY( &b->a_realdn_pat ) ||
+				!BER_BVISEMPTY( &b->a_peername_pat ) ||
+				!BER_BVISEMPTY( &b->a_sockname_pat ) ||
+				!BER_BVISEMPTY( &b->a_domain_pat ) ||
+				!BER_BVISEMPTY( &b->a_sockurl_pat ) ||
+				!BER_BVISEMPTY( &b->a_set_pat ) ||
+				b->a_authz.sai_ssf ||
+				b->a_authz.sai_transport_ssf ||
+				b->a_authz.sai_tls_ssf ||
+				b->a_authz.sai_sasl_ssf )
+				return 0;
+#ifdef SLAP_DYNACL
+			if ( b->a_dynacl )
+				return 0;
+#endif /* SLAP_DYNACL */
+		}
+	}
+
+	return 1;
+}
+
+/*
+ * Returns 1 if access to the entries of be can only depend on the
+ * authorization DN and the entry itself, so that two operations bound
+ * as the same identity are always given the same answers, 0 otherwise.
+ */
+int
+acl_identity_only( BackendDB *be )
+{
+	if ( be != NULL && be->be_acl != frontendDB->be_acl &&
+		!acl_list_identity_only( be->be_acl ) )
+		return 0;
+
+	return acl_list_identity_only( frontendDB->be_acl );
+}
+
+static unsigned
+acl_cache_hash(
+	AccessControl		*list,
+	Operation		*op,
+	struct berval		*target,
+	AttributeDescription	*desc,
+	slap_access_t		access )
+{
+	lutil_HASH_CTX ctx;
+
+	lutil_HASHInit( &ctx );
+	lutil_HASHUpdate( &ctx, (unsigned char *)&list, sizeof( list ) );
+	lutil_HASHUpdate( &ctx, (unsigned char *)&desc, sizeof( desc ) );
+	lutil_HASHUpdate( &ctx, (unsigned char *)&access, sizeof( access ) );
+	lutil_HASHUpdate( &ctx, (unsigned char *)op->o_ndn.bv_val,
+		op->o_ndn.bv_len );
+	lutil_HASHUpdate( &ctx, (unsigned char *)target->bv_val,
+		target->bv_len );
+
+	return ctx.hash;
+}
+
+static int
+acl_cache_get(
+	unsigned		hash,
+	AccessControl		*list,
+	Operation		*op,
+	struct berval		*target,
+	int			bytarget,
+	AttributeDescription	*desc,
+	slap_access_t		access,
+	slap_counter_t		confgen,
+	slap_mask_t		*maskp,
+	int			*retp )
+{
+	acl_cache_entry *ace = &acl_cache[ hash & acl_cache_mask ];
+	ldap_pvt_thread_mutex_t *lock =
+		&acl_cache_locks[ ( hash & acl_cache_mask ) % ACL_CACHE_LOCKS ];
+	int rc = 0, stale = 0;
+
+	ldap_pvt_thread_mutex_lock( lock );
+	if ( ace->ace_list == list && ace->ace_hash == hash &&
+		ace->ace_desc == desc && ace->ace_access == access &&
+		ace->ace_bytarget == bytarget &&
+		bvmatch( &ace->ace_ondn, &op->o_ndn ) &&
+		bvmatch( &ace->ace_target, target ) )
+	{
+		if ( ace->ace_confgen == confgen && ( !ace->ace_datadep ||
+			ace->ace_datagen == SLAP_COUNTER_GET( acl_cache_datagen ) ) )
+		{
+			*maskp = ace->ace_mask;
+			*retp = ace->ace_ret;
+			rc = 1;
+		} else {
+			ace->ace_list = NULL;
+			stale = 1;
+		}
+	}
+	ldap_pvt_thread_mutex_unlock( lock );
+
+	slap_stats_add( acl_cache_stats,
+		rc ? ACL_CACHE_HITS : ACL_CACHE_MISSES, 1 );
+	if ( stale )
+		slap_stats_add( acl_cache_stats, ACL_CACHE_INVALIDATIONS, 1 );
+
+	return rc;
+}
+
+static void
+acl_cache_put(
+	unsigned		hash,
+	AccessControl		*list,
+	Operation		*op,
+	struct berval		*target,
+	int			bytarget,
+	AttributeDescription	*desc,
+	slap_access_t		access,
+	slap_counter_t		confgen,
+	int			datadep,
+	slap_mask_t		mask,
+	int			ret )
+{
+	acl_cache_entry *ace;
+	ldap_pvt_thread_mutex_t *lock;
+	ber_len_t len;
+
+	/* group lookups may have seen any data committed before the
+	 * operation started, not later; see connection_operation() */
+	if ( datadep && op->o_acl_gen == 0 )
+		return;
+
+	ace = &acl_cache[ hash & acl_cache_mask ];
+	lock = &acl_cache_locks[ ( hash & acl_cache_mask ) % ACL_CACHE_LOCKS ];
+	len = op->o_ndn.bv_len + target->bv_len + 2;
+
+	ldap_pvt_thread_mutex_lock( lock );
+	if ( ace->ace_bufsize < len ) {
+		ace->ace_ondn.bv_val = ch_realloc( ace->ace_ondn.bv_val, len );
+		ace->ace_bufsize = len;
+	}
+	ace->ace_ondn.bv_len = op->o_ndn.bv_len;
+	AC_MEMCPY( ace->ace_ondn.bv_val, op->o_ndn.bv_val, op->o_ndn.bv_len );
+	ace->ace_ondn.bv_val[ ace->ace_ondn.bv_len ] = '\0';
+	ace->ace_target.bv_val = ace->ace_ondn.bv_val + ace->ace_ondn.bv_len + 1;
+	ace->ace_target.bv_len = target->bv_len;
+	AC_MEMCPY( ace->ace_target.bv_val, target->bv_val, target->bv_len );
+	ace->ace_target.bv_val[ ace->ace_target.bv_len ] = '\0';
+
+	ace->ace_hash = hash;
+	ace->ace_list = list;
+	ace->ace_desc = desc;
+	ace->ace_access = access;
+	ace->ace_bytarget = bytarget;
+	ace->ace_confgen = confgen;
+	ace->ace_datagen = op->o_acl_gen;
+	ace->ace_datadep = datadep;
+	ace->ace_mask = mask;
+	ace->ace_ret = ret;
+	ldap_pvt_thread_mutex_unlock( lock );
+}
+
 /*
  * access_allowed - check whether op->o_ndn is allowed the requested access
  * to entry e, attribute attr, value val.  if val is null, access to
@@ -155,6 +806,15 @@ slap_access_allowed(
 	AclRegexMatches			matches;
 	AccessControlState		acl_state = ACL_STATE_INIT;
 	static AccessControlState	state_init = ACL_STATE_INIT;
+	AccessControl			*list = NULL;
+	slap_counter_t			confgen = 0;
+	unsigned			hash = 0;
+	unsigned long			dnbits[ 2 ][ ACL_DN_WORDS( ACL_DN_MAXACLS ) ];
+	unsigned long			*dnbitsp[ 2 ] = { NULL, NULL };
+	unsigned long			tbits[ 2 * ACL_DN_WORDS( ACL_DN_MAXACLS ) ];
+	struct berval			target;
+	AclDnIndex			*ai[ 2 ] = { NULL, NULL };
+	int				n, datadep = 0, exact = 1;
 
 	assert( op != NULL );
 	assert( e != NULL );
@@ -220,6 +880,60 @@ slap_access_allowed(
 
 	if ( state == NULL )
 		state = &acl_state;
+
+	/* one set for the database's rules, one for the frontend's */
+	if ( op->o_bd->be_acl && op->o_bd->be_acl != frontendDB->be_acl )
+		ai[ 0 ] = acl_dn_index_get( op->o_bd->be_acl );
+	if ( frontendDB->be_acl )
+		ai[ 1 ] = acl_dn_index_get( frontendDB->be_acl );
+
+	target.bv_val = (char *)tbits;
+	target.bv_len = 0;
+	for ( n = 0; n < 2; n++ ) {
+		if ( ai[ n ] == NULL )
+			continue;
+		if ( ai[ n ]->ai_cache < 0 || datadep < 0 )
+			datadep = -1;
+		else
+			datadep |= ai[ n ]->ai_cache;
+		if ( ai[ n ]->ai_bytarget )
+			exact = 0;
+		if ( acl_dn_index_match( ai[ n ], &e->e_nname, dnbits[ n ],
+			&exact ) )
+		{
+			ber_len_t len = ACL_DN_WORDS( ai[ n ]->ai_nacls ) *
+				sizeof( unsigned long );
+
+			dnbitsp[ n ] = dnbits[ n ];
+			AC_MEMCPY( target.bv_val + target.bv_len, dnbits[ n ], len );
+			target.bv_len += len;
+		}
+	}
+	if ( !exact )
+		target = e->e_nname;
+
+	/* value independent checks starting from scratch may be cached */
+	if ( acl_cache != NULL && datadep >= 0 && val == NULL &&
+		*maskp == ACL_PRIV_NONE &&
+		!( state->as_desc == desc && state->as_access == access &&
+			state->as_vd_acl_present ) )
+	{
+		list = op->o_bd->be_acl ? op->o_bd->be_acl : frontendDB->be_acl;
+		confgen = SLAP_COUNTER_GET( acl_cache_confgen );
+		hash = acl_cache_hash( list, op, &target, desc, access );
+		if ( acl_cache_get( hash, list, op, &target, !exact, desc, access,
+			confgen, &mask, &ret ) )
+		{
+			*state = state_init;
+			list = NULL;
+			Debug( LDAP_DEBUG_ACL,
+				"=> slap_access_allowed: %s access %s by %s (cached)\n",
+				access2str( access ), ret ? "granted" : "denied",
+				accessmask2str( mask, accessmaskbuf, 1 ) );
+			goto done;
+		}
+	}
+
 	if ( state->as_desc == desc &&
 		state->as_access == access &&
 		state->as_vd_acl_present )
@@ -241,7 +955,7 @@ slap_access_allowed(
 	prev = a;
 
 	while ( ( a = slap_acl_get( a, &count, op, e, desc, val,
-		&matches, &mask, state ) ) != NULL )
+		&matches, &mask, state, dnbitsp ) ) != NULL )
 	{
 		int i; 
 		int dnmaxcount = MATCHES_DNMAXCOUNT( &matches );
@@ -317,6 +1031,11 @@ slap_access_allowed(
 		accessmask2str( mask, accessmaskbuf, 1 ) );
 
 done:
+	/* value dependent rules were seen, the caller will come back */
+	if ( list != NULL && !state->as_vd_acl_present ) {
+		acl_cache_put( hash, list, op, &target, !exact, desc, access,
+			confgen, datadep, mask, ret );
+	}
 	ACL_PRIV_ASSIGN( *maskp, mask );
 	return ret;
 }
@@ -374,6 +1093,7 @@ access_allowed_mask(
 	slap_mask_t			mask;
 	slap_access_t			access_level;
 	const char			*attr;
+	unsigned long			t = 0;
 
 	assert( e != NULL );
 	assert( desc != NULL );
@@ -444,6 +1164,10 @@ access_allowed_mask(
 	}
 	assert( op->o_bd != NULL );
 
+	/* don't count nested checks (e.g. from sets) twice */
+	if ( !op->o_phase_acl && SLAP_PHASE_BEGIN( t ) )
+		op->o_phase_acl = 1;
+
 	/* this is enforced in backend_add() */
 	if ( op->o_bd->bd_info->bi_access_allowed ) {
 		/* delegate to backend */
@@ -457,6 +1181,11 @@ access_allowed_mask(
 				desc, val, access, state, &mask );
 	}
 
+	if ( t ) {
+		SLAP_PHASE_END( op, SLAP_PHASE_ACL, t );
+		op->o_phase_acl = 0;
+	}
+
 	if ( !ret ) {
 		if ( ACL_IS_INVALID( mask ) ) {
 			Debug( LDAP_DEBUG_ACL,
@@ -505,11 +1234,13 @@ slap_acl_get(
 	struct berval	*val,
 	AclRegexMatches	*matches,
 	slap_mask_t *mask,
-	AccessControlState *state )
+	AccessControlState *state,
+	unsigned long **dnbits )
 {
 	const char *attr;
 	ber_len_t dnlen;
 	AccessControl *prev;
+	unsigned long *bits;
 
 	assert( e != NULL );
 	assert( count != NULL );
@@ -545,6 +1276,12 @@ slap_acl_get(
 		if ( a != frontendDB->be_acl && state->as_fe_done )
 			state->as_fe_done++;
 
+		/* DN clause cannot match, see acl_dn_index_match() */
+		bits = dnbits[ a->acl_frontend ? 1 : 0 ];
+		if ( bits && a->acl_pos < ACL_DN_MAXACLS &&
+				!ACL_DN_ISSET( bits, a->acl_pos ) )
+			continue;
+
 		if ( a->acl_op ) {
 			slap_restrictop_t restrictop = SLAP_OP2RESTRICT(slap_req2op( op->o_tag ));
 			if ( !(a->acl_op & restrictop) )
@@ -805,6 +1542,22 @@ acl_mask_dn(
 		}
 
 	} else if ( bdn->a_style == ACL_STYLE_REGEX ) {
+		if ( !BER_BVISEMPTY( &bdn->a_tail ) ) {
+			ber_len_t off;
+
+			/* cheap rejection before compiling the pattern */
+			if ( opndn->bv_len < bdn->a_tail.bv_len ) {
+				return 1;
+			}
+			off = opndn->bv_len - bdn->a_tail.bv_len;
+			if ( ( off && !DN_SEPARATOR( opndn->bv_val[ off - 1 ] ) ) ||
+				strncasecmp( &opndn->bv_val[ off ], bdn->a_tail.bv_val,
+					bdn->a_tail.bv_len ) != 0 )
+			{
+				return 1;
+			}
+		}
+
 		if ( !ber_bvccmp( &bdn->a_pat, '*' ) ) {
 			AclRegexMatches	tmp_matches,
 					*tmp_matchesp = &tmp_matches;
@@ -2548,6 +3301,8 @@ acl_init( void )
 {
 	int	i, rc;
 
+	ldap_pvt_thread_mutex_init( &acl_dn_mutex );
+
 	for ( i = 0; acl_init_func[ i ] != NULL; i++ ) {
 		rc = (*(acl_init_func[ i ]))();
 		if ( rc != 0 ) {
@@ -586,6 +586,13 @@ acl_parse_who(
 				bdn->a_pat = bv;
 			}
 			bdn->a_style = sty;
+			if ( sty == ACL_STYLE_REGEX && !ber_bvccmp( &bdn->a_pat, '*' ) &&
+				strchr( bdn->a_pat.bv_val, '$' ) ==
+					&bdn->a_pat.bv_val[ bdn->a_pat.bv_len - 1 ] )
+			{
+				/* no expansions, can check the DN suffix first */
+				acl_regex_dn_tail( &bdn->a_pat, &bdn->a_tail );
+			}
 			if ( expand ) {
 				char	*exp;
 				int	gotit = 0;
@@ -2329,6 +2336,53 @@ acl_regex_normalized_dn(
 	return;
 }
 
+/*
+ * Find the literal DN suffix any DN matching the anchored regex pat
+ * must end with, starting on an RDN boundary; e.g. "ou=people,dc=com"
+ * for "^cn=[^,]+,ou=people,dc=com$".  The result points into pat.
+ * Returns 0 if no such suffix can be determined.
+ */
+int
+acl_regex_dn_tail(
+	struct berval *pat,
+	struct berval *tail )
+{
+	char *p, *end;
+
+	if ( pat->bv_len < 2 || pat->bv_val[ pat->bv_len - 1 ] != '$' ||
+			pat->bv_val[ pat->bv_len - 2 ] == '\\' ||
+			memchr( pat->bv_val, '|', pat->bv_len ) != NULL )
+	{
+		return 0;
+	}
+
+	end = &pat->bv_val[ pat->bv_len - 1 ];
+	for ( p = end; p > pat->bv_val; p-- ) {
+		if ( strchr( "\\^$.[]()*+?{}", p[ -1 ] ) != NULL ) {
+			break;
+		}
+	}
+
+	/* unless anchored at the start, the literal part may begin
+	 * in the middle of an RDN */
+	if ( p - 1 != pat->bv_val || p[ -1 ] != '^' ) {
+		p = memchr( p, ',', end - p );
+		if ( p == NULL ) {
+			return 0;
+		}
+		p++;
+	}
+
+	if ( p == end ) {
+		return 0;
+	}
+
+	tail->bv_val = p;
+	tail->bv_len = end - p;
+
+	return 1;
+}
+
 static void
 split(
     char	*line,
@@ -2355,6 +2409,7 @@ access_append( Access **l, Access *a )
 void
 acl_append( AccessControl **l, AccessControl *a, int pos )
 {
+	AccessControl **head = l;
 	int i;
 
 	for (i=0 ; i != pos && *l != NULL; l = &(*l)->acl_next, i++ ) {
@@ -2363,6 +2418,12 @@ acl_append( AccessControl **l, AccessControl *a, int pos )
 	if ( *l && a )
 		a->acl_next = *l;
 	*l = a;
+
+	for ( i = 0, a = *head; a != NULL; a = a->acl_next, i++ ) {
+		a->acl_pos = i;
+		a->acl_frontend = ( head == &frontendDB->be_acl );
+	}
+	acl_cache_flush();
 }
 
 void
@@ -2452,6 +2513,7 @@ acl_free( AccessControl *a )
 		access_free( a->acl_access );
 	}
 	free( a );
+	acl_cache_flush();
 }
 
 void
@@ -201,6 +201,7 @@ do_add( Operation *op, SlapReply *rs )
 	oex->oe_db = NULL;
 	LDAP_SLIST_INSERT_HEAD(&op->o_extra, &oex->oe, oe_next);
 
+	SLAP_PHASE_END( op, SLAP_PHASE_DECODE, op->o_phase_start );
 	op->o_bd = frontendDB;
 	rc = frontendDB->be_add( op, rs );
 
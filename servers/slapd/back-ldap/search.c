@@ -140,6 +140,40 @@ ldap_back_munge_filter(
 	return gotit;
 }
 
+/* write out queued search results once they are due, rather than
+ * keep them waiting on the remote server */
+static int
+ldap_back_search_result(
+		Operation	*op,
+		ldapconn_t	*lc,
+		int		msgid,
+		struct timeval	*tv,
+		LDAPMessage	**res )
+{
+	struct timeval	due, rest;
+	int		rc;
+
+	if ( !slap_batch_pending( op, &due ) ) {
+		return ldap_result( lc->lc_ld, msgid, LDAP_MSG_ONE, tv, res );
+	}
+
+	if ( timercmp( tv, &due, < ) ) {
+		due = *tv;
+	}
+	timersub( tv, &due, &rest );
+
+	rc = ldap_result( lc->lc_ld, msgid, LDAP_MSG_ONE, &due, res );
+	if ( rc != 0 ) {
+		return rc;
+	}
+	slap_batch_check( op, 1 );
+
+	if ( !timerisset( &rest ) ) {
+		return 0;
+	}
+	return ldap_result( lc->lc_ld, msgid, LDAP_MSG_ONE, &rest, res );
+}
+
 int
 ldap_back_search(
 		Operation	*op,
@@ -314,7 +348,7 @@ retry:
 	 * but this is necessary for version matching, and for ACL processing.
 	 */
 
-	for ( rc = -2; rc != -1; rc = ldap_result( lc->lc_ld, msgid, LDAP_MSG_ONE, &tv, &res ) )
+	for ( rc = -2; rc != -1; rc = ldap_back_search_result( op, lc, msgid, &tv, &res ) )
 	{
 		/* check for abandon */
 		if ( op->o_abandon || LDAP_BACK_CONN_ABANDON( lc ) ) {
@@ -332,6 +332,26 @@ mdb_add(Operation *op, SlapReply *rs )
 		goto return_results;
 	}
 
+	rs->sr_err = mdb_slog_put( op, txn, op->ora_e );
+	if ( rs->sr_err != 0 ) {
+		Debug( LDAP_DEBUG_TRACE,
+			"<=- " LDAP_XSTRING(mdb_add) ": sessionlog update failed: "
+			"%s (%d)\n", mdb_strerror(rs->sr_err), rs->sr_err );
+		rs->sr_err = LDAP_OTHER;
+		rs->sr_text = "sessionlog update failed";
+		goto return_results;
+	}
+
+	rs->sr_err = mdb_ctxcsn_put( op, txn );
+	if ( rs->sr_err != 0 ) {
+		Debug( LDAP_DEBUG_TRACE,
+			"<=- " LDAP_XSTRING(mdb_add) ": ctxcsn update failed: "
+			"%s (%d)\n", mdb_strerror(rs->sr_err), rs->sr_err );
+		rs->sr_err = LDAP_OTHER;
+		rs->sr_text = "contextCSN update failed";
+		goto return_results;
+	}
+
 	/* post-read */
 	if ( wants_postread( op ) ) {
 		if( postread_ctrl == NULL ) {
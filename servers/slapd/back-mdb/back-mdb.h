@@ -34,7 +34,9 @@ LDAP_BEGIN_DECL
 #define MDB_ID2ENTRY	2
 #define MDB_ID2VAL		3
 #define MDB_IDXCKP		4
-#define MDB_NDB			5
+#define MDB_CTXCSN		5
+#define MDB_SESSIONLOG	6
+#define MDB_NDB			7
 
 /* The default search IDL stack cache depth */
 #define DEFAULT_SEARCH_STACK_DEPTH	16
@@ -133,6 +135,8 @@ struct mdb_info {
 #define mi_ad2id	mi_dbis[MDB_AD2ID]
 #define mi_id2val	mi_dbis[MDB_ID2VAL]
 #define mi_idxckp	mi_dbis[MDB_IDXCKP]
+#define mi_ctxcsn	mi_dbis[MDB_CTXCSN]
+#define mi_slog		mi_dbis[MDB_SESSIONLOG]
 
 typedef struct mdb_op_info {
 	OpExtra		moi_oe;
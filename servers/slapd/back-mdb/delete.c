@@ -339,6 +339,26 @@ mdb_delete( Operation *op, SlapReply *rs )
 		goto return_results;
 	}
 
+	rs->sr_err = mdb_slog_put( op, txn, e );
+	if ( rs->sr_err != 0 ) {
+		Debug( LDAP_DEBUG_TRACE,
+			"<=- " LDAP_XSTRING(mdb_delete) ": sessionlog update failed: "
+			"%s (%d)\n", mdb_strerror(rs->sr_err), rs->sr_err );
+		rs->sr_err = LDAP_OTHER;
+		rs->sr_text = "sessionlog update failed";
+		goto return_results;
+	}
+
+	rs->sr_err = mdb_ctxcsn_put( op, txn );
+	if ( rs->sr_err != 0 ) {
+		Debug( LDAP_DEBUG_TRACE,
+			"<=- " LDAP_XSTRING(mdb_delete) ": ctxcsn update failed: "
+			"%s (%d)\n", mdb_strerror(rs->sr_err), rs->sr_err );
+		rs->sr_err = LDAP_OTHER;
+		rs->sr_text = "contextCSN update failed";
+		goto return_results;
+	}
+
 	if ( pdn.bv_len != 0 ) {
 		parent_is_glue = is_entry_glue(p);
 		rs->sr_err = mdb_dn2id_children( op, txn, p );
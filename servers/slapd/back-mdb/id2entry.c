@@ -273,6 +273,7 @@ static int mdb_id2entry_put(
 	Ecount ec;
 	MDB_val key, data;
 	int rc, adding = flag, prev_ads = mdb->mi_numads;
+	void *copy = NULL;
 
 	/* We only store rdns, and they go in the dn2id database. */
 
@@ -285,7 +286,27 @@ static int mdb_id2entry_put(
 		goto fail;
 	}
 
-	flag |= MDB_RESERVE;
+	/* Within a transaction spanning several operations the old record
+	 * may already live on a dirty page, and the entry being written can
+	 * still point into it. Reserving in place would move that data under
+	 * us, so encode into a private buffer first.
+	 */
+	if ( !adding ) {
+		OpExtra *oex;
+		LDAP_SLIST_FOREACH( oex, &op->o_extra, oe_next ) {
+			if ( oex->oe_key == mdb ) break;
+		}
+		if ( oex && ( ((mdb_op_info *)oex)->moi_flag & MOI_KEEPER )) {
+			copy = op->o_tmpalloc( ec.dlen, op->o_tmpmemctx );
+			data.mv_data = copy;
+			data.mv_size = ec.dlen;
+			rc = mdb_entry_encode( op, e, &data, &ec );
+			if ( rc != LDAP_SUCCESS )
+				goto fail;
+		}
+	}
+	if ( !copy )
+		flag |= MDB_RESERVE;
 
 	if (e->e_id < mdb->mi_nextid)
 		flag &= ~MDB_APPEND;
@@ -301,7 +322,7 @@ again:
 		rc = mdb_cursor_put( mc, &key, &data, flag );
 	else
 		rc = mdb_put( txn, mdb->mi_id2entry, &key, &data, flag );
-	if (rc == MDB_SUCCESS) {
+	if (rc == MDB_SUCCESS && !copy) {
 		rc = mdb_entry_encode( op, e, &data, &ec );
 		if( rc != LDAP_SUCCESS )
 			goto fail;
@@ -346,6 +367,8 @@ again:
 			rc = LDAP_OTHER;
 	}
 fail:
+	if ( copy )
+		op->o_tmpfree( copy, op->o_tmpmemctx );
 	if (rc) {
 		mdb_ad_unwind( mdb, prev_ads );
 	}
@@ -401,6 +424,7 @@ int mdb_id2entry(
 {
 	MDB_val key, data;
 	int rc = 0;
+	unsigned long t;
 
 	*e = NULL;
 
@@ -446,7 +470,9 @@ int mdb_id2entry(
 		rc = MDB_NOTFOUND;
 	if ( rc ) return rc;
 
+	SLAP_PHASE_BEGIN( t );
 	rc = mdb_entry_decode( op, mdb_cursor_txn( mc ), &data, id, e );
+	SLAP_PHASE_END( op, SLAP_PHASE_ENTRY, t );
 	if ( rc ) return rc;
 
 	(*e)->e_id = id;
@@ -863,6 +889,281 @@ int mdb_txn( Operation *op, int txnop, OpExtra **ptr )
 	return LDAP_OTHER;
 }
 
+/* Keep the highest CSN written for each serverID in the transaction
+ * of the write itself, so the contextCSN needs no separate checkpoints.
+ * Only CSNs that went through the CSN queue count: syncrepl applies
+ * refresh entries with their own entryCSN, and those may be newer than
+ * entries that have not been received yet.
+ */
+int mdb_ctxcsn_put( Operation *op, MDB_txn *txn )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	MDB_val key, data;
+	struct berval bv;
+	ID sid;
+	int rc;
+
+	if ( !SLAP_DBCTXCSN( op->o_bd ) || !slap_csn_queued( op ))
+		return 0;
+
+	rc = slap_parse_csn_sid( &op->o_csn );
+	if ( rc < 0 )
+		return 0;
+	sid = rc;
+
+	key.mv_data = &sid;
+	key.mv_size = sizeof( sid );
+	rc = mdb_get( txn, mdb->mi_ctxcsn, &key, &data );
+	if ( rc == 0 ) {
+		bv.bv_val = data.mv_data;
+		bv.bv_len = data.mv_size;
+		if ( ber_bvcmp( &op->o_csn, &bv ) <= 0 )
+			return 0;
+	} else if ( rc != MDB_NOTFOUND ) {
+		return rc;
+	}
+
+	data.mv_data = op->o_csn.bv_val;
+	data.mv_size = op->o_csn.bv_len;
+	return mdb_put( txn, mdb->mi_ctxcsn, &key, &data, 0 );
+}
+
+/* Return the CSNs kept by mdb_ctxcsn_put(), one per serverID */
+int mdb_op_ctxcsn( Operation *op, BerVarray *ctxcsn )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	MDB_txn *txn;
+	MDB_cursor *mc;
+	MDB_val key, data;
+	struct berval bv;
+	int rc;
+
+	*ctxcsn = NULL;
+	rc = mdb_txn_begin( mdb->mi_dbenv, NULL, MDB_RDONLY, &txn );
+	if ( rc )
+		return LDAP_OTHER;
+
+	rc = mdb_cursor_open( txn, mdb->mi_ctxcsn, &mc );
+	if ( rc == 0 ) {
+		while (( rc = mdb_cursor_get( mc, &key, &data, MDB_NEXT )) == 0 ) {
+			bv.bv_val = data.mv_data;
+			bv.bv_len = data.mv_size;
+			value_add_one( ctxcsn, &bv );
+		}
+		mdb_cursor_close( mc );
+	}
+	mdb_txn_abort( txn );
+
+	if ( rc != MDB_NOTFOUND ) {
+		Debug( LDAP_DEBUG_ANY, "mdb_op_ctxcsn: read failed: %s (%d)\n",
+			mdb_strerror(rc), rc );
+		ber_bvarray_free( *ctxcsn );
+		*ctxcsn = NULL;
+		return LDAP_OTHER;
+	}
+	return LDAP_SUCCESS;
+}
+
+/* The syncprov sessionlog, kept in the transaction of each write.
+ * Changes are keyed by CSN, with the operation tag and the entryUUID
+ * as data. The other records sort after the CSNs: "m<sid>" holds the
+ * mincsn of a serverID, "n" the bytes used by the change records. The
+ * oldest changes are dropped once there are more than be_slog_max bytes.
+ * Any write that isn't logged drops the whole log.
+ */
+#define MDB_SLOG_MINCSN	'm'
+#define MDB_SLOG_SIZE	'n'
+
+static int
+mdb_slog_mincsn( MDB_txn *txn, MDB_dbi dbi, struct berval *csn )
+{
+	MDB_val key, data;
+	char kbuf[ 8 ];
+	int sid;
+
+	sid = slap_parse_csn_sid( csn );
+	if ( sid < 0 )
+		return 0;
+
+	key.mv_data = kbuf;
+	key.mv_size = snprintf( kbuf, sizeof( kbuf ), "%c%03x", MDB_SLOG_MINCSN, sid );
+	data.mv_data = csn->bv_val;
+	data.mv_size = csn->bv_len;
+	return mdb_put( txn, dbi, &key, &data, 0 );
+}
+
+int mdb_slog_put( Operation *op, MDB_txn *txn, Entry *e )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	MDB_cursor *mc;
+	MDB_stat st;
+	MDB_val key, data, skey;
+	Attribute *a;
+	struct berval csn;
+	ber_len_t size = 0;
+	char sbuf[ 1 ], dbuf[ 1 + 16 ], cbuf[ LDAP_PVT_CSNSTR_BUFSIZE ];
+	int rc;
+
+	rc = mdb_stat( txn, mdb->mi_slog, &st );
+	if ( rc )
+		return rc;
+
+	if ( !SLAP_DBSESSIONLOG( op->o_bd )) {
+		/* This change is not logged, a kept log would miss it */
+		if ( st.ms_entries )
+			rc = mdb_drop( txn, mdb->mi_slog, 0 );
+		return rc;
+	}
+
+	/* Not logged by syncprov_op_response() either */
+	if ( op->o_dont_replicate ||
+		( SLAPD_SYNC_IS_SYNCCONN( op->o_connid ) &&
+			op->o_tag == LDAP_REQ_MODIFY &&
+			op->orm_modlist &&
+			op->orm_modlist->sml_op == LDAP_MOD_REPLACE &&
+			op->orm_modlist->sml_desc == slap_schema.si_ad_contextCSN ))
+		return 0;
+
+	/* Consumer state can't be known across changes without a CSN */
+	if ( BER_BVISEMPTY( &op->o_csn ))
+		return st.ms_entries ? mdb_drop( txn, mdb->mi_slog, 0 ) : 0;
+
+	sbuf[0] = MDB_SLOG_SIZE;
+	skey.mv_data = sbuf;
+	skey.mv_size = sizeof( sbuf );
+
+	if ( st.ms_entries ) {
+		rc = mdb_get( txn, mdb->mi_slog, &skey, &data );
+		if ( rc == 0 && data.mv_size == sizeof( size ))
+			memcpy( &size, data.mv_data, sizeof( size ));
+		else if ( rc != MDB_NOTFOUND )
+			return rc;
+	} else {
+		/* A new log has everything of this serverID from here on */
+		rc = mdb_slog_mincsn( txn, mdb->mi_slog, &op->o_csn );
+		if ( rc )
+			return rc;
+	}
+
+	dbuf[0] = op->o_tag;
+	data.mv_data = dbuf;
+	data.mv_size = 1;
+	a = attr_find( e->e_attrs, slap_schema.si_ad_entryUUID );
+	if ( a && a->a_nvals[0].bv_len < sizeof( dbuf )) {
+		AC_MEMCPY( dbuf + 1, a->a_nvals[0].bv_val, a->a_nvals[0].bv_len );
+		data.mv_size += a->a_nvals[0].bv_len;
+	}
+	key.mv_data = op->o_csn.bv_val;
+	key.mv_size = op->o_csn.bv_len;
+	rc = mdb_put( txn, mdb->mi_slog, &key, &data, MDB_NOOVERWRITE );
+	if ( rc == MDB_KEYEXIST )
+		return 0;
+	if ( rc )
+		return rc;
+	size += key.mv_size + data.mv_size;
+
+	if ( size > op->o_bd->be_slog_max ) {
+		rc = mdb_cursor_open( txn, mdb->mi_slog, &mc );
+		if ( rc )
+			return rc;
+		while ( size > op->o_bd->be_slog_max &&
+			( rc = mdb_cursor_get( mc, &key, &data, MDB_FIRST )) == 0 ) {
+			if ( *(char *)key.mv_data >= MDB_SLOG_MINCSN ||
+				key.mv_size >= sizeof( cbuf ))
+				break;
+			size -= key.mv_size + data.mv_size;
+			/* the page may move once the record is gone */
+			AC_MEMCPY( cbuf, key.mv_data, key.mv_size );
+			csn.bv_val = cbuf;
+			csn.bv_len = key.mv_size;
+			rc = mdb_cursor_del( mc, 0 );
+			if ( rc == 0 )
+				rc = mdb_slog_mincsn( txn, mdb->mi_slog, &csn );
+			if ( rc )
+				break;
+		}
+		mdb_cursor_close( mc );
+		if ( rc && rc != MDB_NOTFOUND )
+			return rc;
+	}
+
+	data.mv_data = &size;
+	data.mv_size = sizeof( size );
+	return mdb_put( txn, mdb->mi_slog, &skey, &data, 0 );
+}
+
+/* Return the sessionlog kept by mdb_slog_put(), oldest change first.
+ * Without one, start a log that has all changes after ctxcsn.
+ */
+int mdb_op_sessionlog( Operation *op, BerVarray ctxcsn, BerVarray *mincsn,
+	slap_slog_func *func, void *arg )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	MDB_txn *txn;
+	MDB_cursor *mc;
+	MDB_stat st;
+	MDB_val key, data;
+	struct berval csn, uuid;
+	char *k;
+	int i, rc;
+
+	*mincsn = NULL;
+	rc = mdb_txn_begin( mdb->mi_dbenv, NULL, MDB_RDONLY, &txn );
+	if ( rc )
+		return LDAP_OTHER;
+
+	rc = mdb_stat( txn, mdb->mi_slog, &st );
+	if ( rc == 0 && !st.ms_entries ) {
+		mdb_txn_abort( txn );
+		rc = mdb_txn_begin( mdb->mi_dbenv, NULL, 0, &txn );
+		if ( rc )
+			goto done;
+		for ( i = 0; ctxcsn && !BER_BVISNULL( &ctxcsn[i] ); i++ ) {
+			rc = mdb_slog_mincsn( txn, mdb->mi_slog, &ctxcsn[i] );
+			if ( rc )
+				break;
+		}
+		if ( rc == 0 )
+			rc = mdb_txn_commit( txn );
+		else
+			mdb_txn_abort( txn );
+		goto done;
+	}
+
+	if ( rc == 0 )
+		rc = mdb_cursor_open( txn, mdb->mi_slog, &mc );
+	if ( rc == 0 ) {
+		while (( rc = mdb_cursor_get( mc, &key, &data, MDB_NEXT )) == 0 ) {
+			k = key.mv_data;
+			if ( k[0] == MDB_SLOG_MINCSN ) {
+				csn.bv_val = data.mv_data;
+				csn.bv_len = data.mv_size;
+				value_add_one( mincsn, &csn );
+			} else if ( k[0] < MDB_SLOG_MINCSN && data.mv_size ) {
+				csn.bv_val = k;
+				csn.bv_len = key.mv_size;
+				uuid.bv_val = (char *)data.mv_data + 1;
+				uuid.bv_len = data.mv_size - 1;
+				if ( func( arg, &csn, &uuid,
+						*(unsigned char *)data.mv_data ))
+					break;
+			}
+		}
+		mdb_cursor_close( mc );
+	}
+	mdb_txn_abort( txn );
+
+done:
+	if ( rc && rc != MDB_NOTFOUND ) {
+		Debug( LDAP_DEBUG_ANY, "mdb_op_sessionlog: failed: %s (%d)\n",
+			mdb_strerror(rc), rc );
+		ber_bvarray_free( *mincsn );
+		*mincsn = NULL;
+		return LDAP_OTHER;
+	}
+	return LDAP_SUCCESS;
+}
+
 /* Count up the sizes of the components of an entry */
 static int mdb_entry_partsize(struct mdb_info *mdb, MDB_txn *txn, Entry *e,
 	Ecount *eh)
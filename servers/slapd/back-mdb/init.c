@@ -33,6 +33,8 @@ static const struct berval mdmi_databases[] = {
 	BER_BVC("id2e"),
 	BER_BVC("id2v"),
 	BER_BVC("ixck"),
+	BER_BVC("ctxc"),
+	BER_BVC("slog"),
 	BER_BVNULL
 };
 
@@ -224,6 +226,8 @@ mdb_db_open( BackendDB *be, ConfigReply *cr )
 				flags |= MDB_DUPSORT;
 			if ( i == MDB_ID2VAL )
 				flags ^= MDB_INTEGERKEY|MDB_DUPSORT;
+			if ( i == MDB_SESSIONLOG )
+				flags ^= MDB_INTEGERKEY;
 			if ( !(slapMode & SLAP_TOOL_READONLY) )
 				flags |= MDB_CREATE;
 		}
@@ -234,7 +238,7 @@ mdb_db_open( BackendDB *be, ConfigReply *cr )
 			&mdb->mi_dbis[i] );
 
 		if ( rc != 0 ) {
-			/* when read-only, it's ok for ID2VAL or IDXCKP to not exist */
+			/* when read-only, it's ok for ID2VAL, IDXCKP, CTXCSN or SESSIONLOG to not exist */
 			if (( flags & MDB_CREATE ) || ( i < MDB_ID2VAL )) {
 				snprintf( cr->msg, sizeof(cr->msg), "database \"%s\": "
 					"mdb_dbi_open(%s/%s) failed: %s (%d).",
@@ -294,6 +298,15 @@ mdb_db_open( BackendDB *be, ConfigReply *cr )
 		goto fail;
 	}
 
+	/* Tool writes bypass mdb_slog_put(), a kept sessionlog would miss them */
+	if (( slapMode & SLAP_TOOL_MODE ) && !( slapMode & SLAP_TOOL_READMAIN )) {
+		rc = mdb_drop( txn, mdb->mi_slog, 0 );
+		if ( rc ) {
+			mdb_txn_abort( txn );
+			goto fail;
+		}
+	}
+
 	/* slapcat doesn't need indexes. avoid a failure if
 	 * a configured index wasn't created yet.
 	 */
@@ -525,6 +538,8 @@ mdb_back_initialize(
 
 	bi->bi_op_unbind = 0;
 	bi->bi_op_txn = mdb_txn;
+	bi->bi_op_ctxcsn = mdb_op_ctxcsn;
+	bi->bi_op_sessionlog = mdb_op_sessionlog;
 
 	bi->bi_extended = mdb_extended;
 
@@ -738,6 +738,26 @@ mdb_modify( Operation *op, SlapReply *rs )
 		goto return_results;
 	}
 
+	rs->sr_err = mdb_slog_put( op, txn, &dummy );
+	if ( rs->sr_err != 0 ) {
+		Debug( LDAP_DEBUG_TRACE,
+			"<=- " LDAP_XSTRING(mdb_modify) ": sessionlog update failed: "
+			"%s (%d)\n", mdb_strerror(rs->sr_err), rs->sr_err );
+		rs->sr_err = LDAP_OTHER;
+		rs->sr_text = "sessionlog update failed";
+		goto return_results;
+	}
+
+	rs->sr_err = mdb_ctxcsn_put( op, txn );
+	if ( rs->sr_err != 0 ) {
+		Debug( LDAP_DEBUG_TRACE,
+			"<=- " LDAP_XSTRING(mdb_modify) ": ctxcsn update failed: "
+			"%s (%d)\n", mdb_strerror(rs->sr_err), rs->sr_err );
+		rs->sr_err = LDAP_OTHER;
+		rs->sr_text = "contextCSN update failed";
+		goto return_results;
+	}
+
 	if ( wants_postread( op ) ) {
 		if( postread_ctrl == NULL ) {
 			postread_ctrl = &ctrls[num_ctrls++];
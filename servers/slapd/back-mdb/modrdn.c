@@ -474,6 +474,26 @@ mdb_modrdn( Operation	*op, SlapReply *rs )
 		goto return_results;
 	}
 
+	rs->sr_err = mdb_slog_put( op, txn, &dummy );
+	if ( rs->sr_err != 0 ) {
+		Debug( LDAP_DEBUG_TRACE,
+			"<=- " LDAP_XSTRING(mdb_modrdn) ": sessionlog update failed: "
+			"%s (%d)\n", mdb_strerror(rs->sr_err), rs->sr_err );
+		rs->sr_err = LDAP_OTHER;
+		rs->sr_text = "sessionlog update failed";
+		goto return_results;
+	}
+
+	rs->sr_err = mdb_ctxcsn_put( op, txn );
+	if ( rs->sr_err != 0 ) {
+		Debug( LDAP_DEBUG_TRACE,
+			"<=- " LDAP_XSTRING(mdb_modrdn) ": ctxcsn update failed: "
+			"%s (%d)\n", mdb_strerror(rs->sr_err), rs->sr_err );
+		rs->sr_err = LDAP_OTHER;
+		rs->sr_text = "contextCSN update failed";
+		goto return_results;
+	}
+
 	if ( p_ndn.bv_len != 0 ) {
 		if ((parent_is_glue = is_entry_glue(p))) {
 			rs->sr_err = mdb_dn2id_children( op, txn, p );
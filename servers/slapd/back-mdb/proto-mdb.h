@@ -216,6 +216,10 @@ int mdb_entry_return( Operation *op, Entry *e );
 BI_entry_release_rw mdb_entry_release;
 BI_entry_get_rw mdb_entry_get;
 BI_op_txn mdb_txn;
+BI_op_ctxcsn mdb_op_ctxcsn;
+int mdb_ctxcsn_put( Operation *op, MDB_txn *txn );
+BI_op_sessionlog mdb_op_sessionlog;
+int mdb_slog_put( Operation *op, MDB_txn *txn, Entry *e );
 
 int mdb_entry_decode( Operation *op, MDB_txn *txn, MDB_val *data, ID id, Entry **e );
 
@@ -418,11 +418,129 @@ mdb_waitfixup( Operation *op, ww_ctx *ww, MDB_cursor *mci, MDB_cursor *mcd, IdSc
 
 #define PAUSEPOLL	100
 
+/* A sync refresh from a cookie searches for (&(entryCSN>=cookie)...).
+ * Rather than building the full candidate IDL for the inequality,
+ * walk the entryCSN index in key order and feed the candidate loop
+ * one key's worth of IDs at a time. Scope and filter are then checked
+ * per entry as usual.
+ */
+typedef struct csn_stream {
+	MDB_dbi cs_dbi;
+	int cs_done;
+	size_t cs_len;
+	unsigned char cs_key[16];	/* next key to look for */
+} csn_stream;
+
+static int
+mdb_csn_stream_init( Operation *op, csn_stream *cs )
+{
+	Filter *f = op->ors_filter;
+	AttributeAssertion *ava;
+	MatchingRule *mr;
+	struct berval prefix = BER_BVNULL;
+	struct berval *keys = NULL;
+	slap_mask_t mask;
+	int rc;
+
+	cs->cs_done = 1;
+
+	if ( !wants_sync( op ) || wants_pagedresults( op ) ||
+		( op->ors_deref & LDAP_DEREF_SEARCHING ))
+		return 0;
+	/* the whole candidate set is not known up front */
+	if ( op->ors_limit && op->ors_limit->lms_s_unchecked != -1 )
+		return 0;
+
+	if ( f->f_choice != LDAP_FILTER_AND || !f->f_and ||
+		f->f_and->f_choice != LDAP_FILTER_GE ||
+		f->f_and->f_av_desc != slap_schema.si_ad_entryCSN )
+		return 0;
+	ava = f->f_and->f_ava;
+
+	if ( mdb_index_param( op->o_bd, ava->aa_desc, LDAP_FILTER_EQUALITY,
+		&cs->cs_dbi, &mask, &prefix ) != LDAP_SUCCESS )
+		return 0;
+
+	mr = ava->aa_desc->ad_type->sat_equality;
+	if ( !mr || !mr->smr_filter )
+		return 0;
+
+	rc = (mr->smr_filter)( LDAP_FILTER_EQUALITY, mask,
+		ava->aa_desc->ad_type->sat_syntax, mr, &prefix,
+		&ava->aa_value, &keys, op->o_tmpmemctx );
+	if ( rc != LDAP_SUCCESS || keys == NULL )
+		return 0;
+
+	/* keys are stored padded, see mdb_key_read() */
+	cs->cs_len = keys[0].bv_len;
+#ifndef MISALIGNED_OK
+	if ( cs->cs_len & ALIGNER )
+		cs->cs_len = ( cs->cs_len + ALIGNER ) & ~ALIGNER;
+#endif
+	if ( cs->cs_len <= sizeof( cs->cs_key )) {
+		memset( cs->cs_key, 0, cs->cs_len );
+		memcpy( cs->cs_key, keys[0].bv_val, keys[0].bv_len );
+		cs->cs_done = 0;
+	}
+	ber_bvarray_free_x( keys, op->o_tmpmemctx );
+
+	return !cs->cs_done;
+}
+
+/* Fetch the IDs of the first index key at or after the saved one.
+ * Each call opens its own cursor, so the read txn may have been
+ * reset and renewed in between.
+ */
+static int
+mdb_csn_stream_next( Operation *op, MDB_txn *txn, csn_stream *cs, ID *ids )
+{
+	MDB_cursor *mc;
+	MDB_val key, data;
+	int i, rc;
+
+	MDB_IDL_ZERO( ids );
+	if ( cs->cs_done )
+		return MDB_NOTFOUND;
+
+	rc = mdb_cursor_open( txn, cs->cs_dbi, &mc );
+	if ( rc )
+		return rc;
+
+	key.mv_data = cs->cs_key;
+	key.mv_size = cs->cs_len;
+	rc = mdb_cursor_get( mc, &key, &data, MDB_SET_RANGE );
+	/* skip presence key */
+	while ( rc == 0 && key.mv_size != cs->cs_len )
+		rc = mdb_cursor_get( mc, &key, &data, MDB_NEXT_NODUP );
+	if ( rc == 0 )
+		memcpy( cs->cs_key, key.mv_data, cs->cs_len );
+	mdb_cursor_close( mc );
+
+	if ( rc ) {
+		cs->cs_done = 1;
+		return rc;
+	}
+
+	key.mv_data = cs->cs_key;
+	rc = mdb_idl_fetch_key( op->o_bd, txn, cs->cs_dbi, &key, ids, NULL, 0 );
+
+	/* next time, start just past this key */
+	for ( i = cs->cs_len - 1; i >= 0; i-- ) {
+		if ( ++cs->cs_key[i] )
+			break;
+	}
+	if ( i < 0 )
+		cs->cs_done = 1;
+
+	return rc;
+}
+
 int
 mdb_search( Operation *op, SlapReply *rs )
 {
 	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
-	ID		id, cursor, nsubs, ncand, cscope;
+	ID		id, cursor, nsubs, ncand;
+	ID		cscope = 0;
 	ID		lastid = NOID;
 	ID		*candidates, *iscopes, *c0;
 	ID2		*scopes;
@@ -440,6 +558,9 @@ mdb_search( Operation *op, SlapReply *rs )
 	MDB_cursor	*mci, *mcd;
 	ww_ctx wwctx;
 	slap_callback cb = { 0 };
+	unsigned long	t;
+	FilterProg	*fprog = NULL;
+	csn_stream	cstream;
 
 	mdb_op_info	opinfo = {{{0}}}, *moi = &opinfo;
 	MDB_txn			*ltid = NULL;
@@ -487,6 +608,7 @@ mdb_search( Operation *op, SlapReply *rs )
 	isc.scopes = scopes;
 	isc.oscope = op->ors_scope;
 	isc.sctmp = stack;
+	cstream.cs_done = 1;
 
 	if ( op->ors_deref & LDAP_DEREF_FINDING ) {
 		MDB_IDL_ZERO(candidates);
@@ -678,8 +800,25 @@ dn2entry_retry:
 		scopes[0].mid = 1;
 		scopes[1].mid = base->e_id;
 		scopes[1].mval.mv_data = NULL;
-		rs->sr_err = search_candidates( op, rs, base,
-			&isc, mci, candidates, stack );
+		SLAP_PHASE_BEGIN( t );
+		if ( mdb_csn_stream_init( op, &cstream )) {
+			Debug( LDAP_DEBUG_TRACE,
+				LDAP_XSTRING(mdb_search)
+				": streaming candidates from entryCSN index\n" );
+			rs->sr_err = mdb_csn_stream_next( op, ltid, &cstream, candidates );
+			if ( rs->sr_err == MDB_NOTFOUND ) {
+				rs->sr_err = LDAP_SUCCESS;
+			} else if ( rs->sr_err ) {
+				rs->sr_err = LDAP_OTHER;
+				rs->sr_text = "internal error in entryCSN index";
+				send_ldap_result( op, rs );
+				goto done;
+			}
+		} else {
+			rs->sr_err = search_candidates( op, rs, base,
+				&isc, mci, candidates, stack );
+		}
+		SLAP_PHASE_END( op, SLAP_PHASE_INDEX, t );
 
 		if ( rs->sr_err == LDAP_ADMINLIMIT_EXCEEDED ) {
 adminlimit:
@@ -702,6 +841,10 @@ adminlimit:
 		}
 	}
 
+	/* the stream only knows the IDs of its current key */
+	if ( !cstream.cs_done )
+		nsubs = ncand;
+
 	/* start cursor at beginning of candidates.
 	 */
 	cursor = 0;
@@ -849,6 +992,9 @@ loop_begin:
 			goto done;
 		}
 
+		/* don't hold back results while scanning candidates */
+		slap_batch_check( op, 0 );
+
 
 		if ( nsubs < ncand ) {
 			unsigned i;
@@ -955,7 +1101,9 @@ notfound:
 				goto done;
 			}
 
+			SLAP_PHASE_BEGIN( t );
 			rs->sr_err = mdb_entry_decode( op, ltid, &edata, id, &e );
+			SLAP_PHASE_END( op, SLAP_PHASE_ENTRY, t );
 			if ( rs->sr_err ) {
 				rs->sr_err = LDAP_OTHER;
 				rs->sr_text = "internal error in mdb_entry_decode";
@@ -1092,7 +1240,9 @@ notfound:
 		}
 
 		/* if it matches the filter and scope, send it */
-		rs->sr_err = test_filter( op, e, op->oq_search.rs_filter );
+		if ( fprog == NULL )
+			fprog = filter_prog_compile( op, op->oq_search.rs_filter );
+		rs->sr_err = test_filter_prog( op, e, fprog );
 
 		if ( rs->sr_err == LDAP_COMPARE_TRUE ) {
 			/* check size limit */
@@ -1208,6 +1358,18 @@ loop_continue:
 				id = isc.id;
 		} else {
 			id = mdb_idl_next( candidates, &cursor );
+			if ( id == NOID && !cstream.cs_done ) {
+				rs->sr_err = mdb_csn_stream_next( op, ltid, &cstream, candidates );
+				if ( rs->sr_err == MDB_SUCCESS ) {
+					cursor = 0;
+					id = mdb_idl_first( candidates, &cursor );
+				} else if ( rs->sr_err != MDB_NOTFOUND ) {
+					rs->sr_err = LDAP_OTHER;
+					rs->sr_text = "internal error in entryCSN index";
+					send_ldap_result( op, rs );
+					goto done;
+				}
+			}
 		}
 	}
 
@@ -1223,6 +1385,8 @@ nochange:
 	}
 
 done:
+	if ( fprog )
+		filter_prog_free( op, fprog );
 	if ( cb.sc_private ) {
 		/* remove our writewait callback */
 		slap_callback **scp = &op->o_callback;
@@ -147,6 +147,7 @@ typedef struct monitor_info_t {
 	AttributeDescription	*mi_ad_monitorConnectionOpsDeferExecuting;
 	AttributeDescription	*mi_ad_monitorConnectionOpsDeferPending;
 	AttributeDescription	*mi_ad_monitorConnectionOpsDeferWritewait;
+	AttributeDescription	*mi_ad_monitorOpLatency;
 
 	/*
 	 * Generic description attribute
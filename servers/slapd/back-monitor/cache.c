@@ -450,7 +450,7 @@ monitor_entry_destroy( void *v_mc )
 				if ( cb->mc_free ) {
 					(void)cb->mc_free( mc->mc_e, &cb->mc_private );
 				}
-				ch_free( mp->mp_cb );
+				ch_free( cb );
 
 				cb = next;
 			}
@@ -2003,6 +2003,14 @@ monitor_back_initialize(
 			"NO-USER-MODIFICATION "
 			"USAGE dSAOperation )", SLAP_AT_FINAL|SLAP_AT_HIDE,
 			offsetof(monitor_info_t, mi_ad_monitorConnectionOpsDeferWritewait) },
+			{ "( 1.3.6.1.4.1.4203.666.1.55.41 "
+			"NAME 'monitorOpLatency' "
+			"DESC 'monitor per phase latency of completed operations' "
+			"EQUALITY caseIgnoreMatch "
+			"SYNTAX 1.3.6.1.4.1.1466.115.121.1.15 "
+			"NO-USER-MODIFICATION "
+			"USAGE dSAOperation )", SLAP_AT_FINAL|SLAP_AT_HIDE,
+			offsetof(monitor_info_t, mi_ad_monitorOpLatency) },
 		{ NULL, 0, -1 }
 	};
 
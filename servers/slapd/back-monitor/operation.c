@@ -56,6 +56,39 @@ monitor_subsys_ops_update(
 	SlapReply		*rs,
 	Entry                   *e );
 
+/*
+ * One value per phase, e.g.
+ * "search count=12 usec=3400 hist=0,0,3,9"
+ * where hist[n] counts operations that spent less than 2^n usec
+ * in the phase; trailing empty buckets are omitted.
+ */
+static void
+monitor_subsys_ops_latency(
+	monitor_info_t		*mi,
+	Entry			*e,
+	slap_op_t		opidx )
+{
+	slap_latency_t	sl[SLAP_PHASE_LAST];
+	char		buf[ 64 + SLAP_LATENCY_BUCKETS * 21 ];
+	struct berval	bv;
+	int		i;
+
+	slap_latency_get( opidx, sl );
+
+	attr_delete( &e->e_attrs, mi->mi_ad_monitorOpLatency );
+	if ( sl[SLAP_PHASE_TOTAL].sl_count == 0 ) {
+		return;
+	}
+
+	for ( i = 0; i < SLAP_PHASE_LAST; i++ ) {
+		bv.bv_len = snprintf( buf, sizeof( buf ), "%s ", slap_phase2str( i ));
+		bv.bv_len += slap_latency2str( &sl[i], buf + bv.bv_len,
+			sizeof( buf ) - bv.bv_len );
+		bv.bv_val = buf;
+		attr_merge_normalize_one( e, mi->mi_ad_monitorOpLatency, &bv, NULL );
+	}
+}
+
 int
 monitor_subsys_ops_init(
 	BackendDB		*be,
@@ -169,7 +202,7 @@ monitor_subsys_ops_update(
 	struct berval		rdn;
 	int 			i;
 	Attribute		*a;
-	slap_counters_t *sc;
+	slap_counters_t		sum;
 	static struct berval	bv_ops = BER_BVC( "cn=operations" );
 
 	assert( mi != NULL );
@@ -178,34 +211,21 @@ monitor_subsys_ops_update(
 	dnRdn( &e->e_nname, &rdn );
 
 	if ( dn_match( &rdn, &bv_ops ) ) {
+		slap_counters_sum( &sum );
 		ldap_pvt_mp_init( nInitiated );
 		ldap_pvt_mp_init( nCompleted );
-
-		ldap_pvt_thread_mutex_lock( &slap_counters.sc_mutex );
-		ldap_pvt_mp_add( nInitiated, slap_counters.sc_ops_initiated );
-		ldap_pvt_mp_add( nCompleted, slap_counters.sc_ops_completed );
-		for ( sc = slap_counters.sc_next; sc; sc = sc->sc_next ) {
-			ldap_pvt_thread_mutex_lock( &sc->sc_mutex );
-			ldap_pvt_mp_add( nInitiated, sc->sc_ops_initiated );
-			ldap_pvt_mp_add( nCompleted, sc->sc_ops_completed );
-			ldap_pvt_thread_mutex_unlock( &sc->sc_mutex );
-		}
-		ldap_pvt_thread_mutex_unlock( &slap_counters.sc_mutex );
+		ldap_pvt_mp_add_ulong( nInitiated, sum.sc_ops_initiated );
+		ldap_pvt_mp_add_ulong( nCompleted, sum.sc_ops_completed );
 		
 	} else {
 		for ( i = 0; i < SLAP_OP_LAST; i++ ) {
 			if ( dn_match( &rdn, &monitor_op[ i ].nrdn ) )
 			{
-				ldap_pvt_thread_mutex_lock( &slap_counters.sc_mutex );
-				ldap_pvt_mp_init_set( nInitiated, slap_counters.sc_ops_initiated_[ i ] );
-				ldap_pvt_mp_init_set( nCompleted, slap_counters.sc_ops_completed_[ i ] );
-				for ( sc = slap_counters.sc_next; sc; sc = sc->sc_next ) {
-					ldap_pvt_thread_mutex_lock( &sc->sc_mutex );
-					ldap_pvt_mp_add( nInitiated, sc->sc_ops_initiated_[ i ] );
-					ldap_pvt_mp_add( nCompleted, sc->sc_ops_completed_[ i ] );
-					ldap_pvt_thread_mutex_unlock( &sc->sc_mutex );
-				}
-				ldap_pvt_thread_mutex_unlock( &slap_counters.sc_mutex );
+				slap_counters_sum( &sum );
+				ldap_pvt_mp_init( nInitiated );
+				ldap_pvt_mp_init( nCompleted );
+				ldap_pvt_mp_add_ulong( nInitiated, sum.sc_ops_initiated_[ i ] );
+				ldap_pvt_mp_add_ulong( nCompleted, sum.sc_ops_completed_[ i ] );
 				break;
 			}
 		}
@@ -214,6 +234,10 @@ monitor_subsys_ops_update(
 			/* not found ... */
 			return( 0 );
 		}
+
+		if ( slap_latency_stats ) {
+			monitor_subsys_ops_latency( mi, e, i );
+		}
 	}
 
 	a = attr_find( e->e_attrs, mi->mi_ad_monitorOpInitiated );
@@ -332,6 +332,7 @@ wt_search( Operation *op, SlapReply *rs )
 	Entry *base = NULL;
 	slap_mask_t mask;
 	time_t stoptime;
+	FilterProg *fprog = NULL;
 
 	ID candidates[WT_IDL_UM_SIZE];
 	ID scopes[WT_IDL_DB_SIZE];
@@ -660,7 +661,9 @@ loop_begin:
 		}
 
 		/* if it matches the filter and scope, send it */
-		rs->sr_err = test_filter( op, e, op->oq_search.rs_filter );
+		if ( fprog == NULL )
+			fprog = filter_prog_compile( op, op->oq_search.rs_filter );
+		rs->sr_err = test_filter_prog( op, e, fprog );
 		if ( rs->sr_err == LDAP_COMPARE_TRUE ) {
 			/* check size limit */
 			if ( wants_pagedresults(op) ) {
@@ -732,6 +735,10 @@ nochange:
 
 done:
 
+	if( fprog ) {
+		filter_prog_free( op, fprog );
+	}
+
 	if( base ) {
 		wt_entry_return( base );
 	}
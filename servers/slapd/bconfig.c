@@ -201,11 +201,13 @@ enum {
 	CFG_IX_HASH64,
 	CFG_DISABLED,
 	CFG_THREADQS,
+	CFG_THREADSTEAL,
 	CFG_TLS_ECNAME,
 	CFG_TLS_CACERT,
 	CFG_TLS_CERT,
 	CFG_TLS_KEY,
 	CFG_RESTRICTOP,
+	CFG_ACLCACHE,
 
 	CFG_LAST
 };
@@ -312,6 +314,11 @@ static ConfigTable config_back_cf_table[] = {
 			"DESC 'Access Control List' "
 			"EQUALITY caseIgnoreMatch "
 			"SYNTAX OMsDirectoryString X-ORDERED 'VALUES' )", NULL, NULL },
+	{ "aclcache", "entries", 2, 2, 0, ARG_INT|ARG_MAGIC|CFG_ACLCACHE,
+		&config_generic, "( OLcfgGlAt:112 NAME 'olcAclCache' "
+			"DESC 'Number of cached access control decisions' "
+			"EQUALITY integerMatch "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "add_content_acl",	NULL, 0, 0, 0, ARG_MAY_DB|ARG_ON_OFF|ARG_MAGIC|CFG_ACL_ADD,
 		&config_generic, "( OLcfgGlAt:86 NAME 'olcAddContentAcl' "
 			"DESC 'Check ACLs against content of Add ops' "
@@ -468,6 +475,14 @@ static ConfigTable config_back_cf_table[] = {
 			"EQUALITY booleanMatch "
 			"SYNTAX OMsBoolean SINGLE-VALUE )", NULL, NULL,
 	},
+	{ "latencystats", "on|off", 2, 2, 0, ARG_ON_OFF,
+		&slap_latency_stats, "( OLcfgGlAt:110 NAME 'olcLatencyStats' "
+			"EQUALITY booleanMatch "
+			"SYNTAX OMsBoolean SINGLE-VALUE )", NULL, NULL },
+	{ "latencytrace", "ops", 2, 2, 0, ARG_INT,
+		&slap_latency_trace, "( OLcfgGlAt:111 NAME 'olcLatencyTrace' "
+			"EQUALITY integerMatch "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "ldapsyntax",	"syntax", 2, 0, 0,
 		ARG_PAREN|ARG_MAGIC|CFG_SYNTAX,
 		&config_generic, "( OLcfgGlAt:85 NAME 'olcLdapSyntaxes' "
@@ -748,6 +763,10 @@ static ConfigTable config_back_cf_table[] = {
 			"EQUALITY integerMatch "
 			"SYNTAX OMsInteger SINGLE-VALUE )", NULL,
 			{ .v_ber_t = SLAP_SB_MAX_INCOMING_AUTH } },
+	{ "sockbuf_readahead", "bytes", 2, 2, 0, ARG_BER_LEN_T,
+		&sockbuf_readahead, "( OLcfgGlAt:109 NAME 'olcSockbufReadahead' "
+			"EQUALITY integerMatch "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "sortvals", "attr", 2, 0, 0, ARG_MAGIC|CFG_SORTVALS,
 		&config_generic, "( OLcfgGlAt:83 NAME 'olcSortVals' "
 			"DESC 'Attributes whose values will always be sorted' "
@@ -794,6 +813,11 @@ static ConfigTable config_back_cf_table[] = {
 			"SYNTAX OMsInteger SINGLE-VALUE )", NULL,
 			{ .v_int = 1 }
 	},
+	{ "threadstealing", "on|off", 2, 2, 0,
+		ARG_ON_OFF|ARG_MAGIC|CFG_THREADSTEAL, &config_generic,
+		"( OLcfgGlAt:106 NAME 'olcThreadStealing' "
+			"EQUALITY booleanMatch "
+			"SYNTAX OMsBoolean SINGLE-VALUE )", NULL, NULL },
 	{ "timelimit", "limit", 2, 0, 0, ARG_MAY_DB|ARG_MAGIC,
 		&config_timelimit, "( OLcfgGlAt:67 NAME 'olcTimeLimit' "
 			"EQUALITY caseExactMatch "
@@ -952,6 +976,14 @@ static ConfigTable config_back_cf_table[] = {
 		&config_updateref, "( OLcfgDbAt:0.13 NAME 'olcUpdateRef' "
 			"EQUALITY caseIgnoreMatch "
 			"SUP labeledURI )", NULL, NULL },
+	{ "writebatch", "bytes", 2, 2, 0, ARG_INT,
+		&global_writebatch, "( OLcfgGlAt:107 NAME 'olcWriteBatch' "
+			"EQUALITY integerMatch "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "writebatchdelay", "msec", 2, 2, 0, ARG_INT,
+		&global_writebatch_delay, "( OLcfgGlAt:108 NAME 'olcWriteBatchDelay' "
+			"EQUALITY integerMatch "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "writetimeout", "timeout", 2, 2, 0, ARG_INT,
 		&global_writetimeout, "( OLcfgGlAt:88 NAME 'olcWriteTimeout' "
 			"EQUALITY integerMatch "
@@ -998,14 +1030,14 @@ static ConfigOCs cf_ocs[] = {
 		"NAME 'olcGlobal' "
 		"DESC 'OpenLDAP Global configuration options' "
 		"SUP olcConfig STRUCTURAL "
-		"MAY ( cn $ olcConfigFile $ olcConfigDir $ olcAllows $ olcArgsFile $ "
+		"MAY ( cn $ olcConfigFile $ olcConfigDir $ olcAclCache $ olcAllows $ olcArgsFile $ "
 		 "olcAttributeOptions $ olcAuthIDRewrite $ "
 		 "olcAuthzPolicy $ olcAuthzRegexp $ olcConcurrency $ "
 		 "olcConnMaxPending $ olcConnMaxPendingAuth $ "
 		 "olcDisallows $ olcGentleHUP $ olcIdleTimeout $ "
 		 "olcIndexSubstrIfMaxLen $ olcIndexSubstrIfMinLen $ "
 		 "olcIndexSubstrAnyLen $ olcIndexSubstrAnyStep $ olcIndexHash64 $ "
-		 "olcIndexIntLen $ "
+		 "olcIndexIntLen $ olcLatencyStats $ olcLatencyTrace $ "
 		 "olcListenerThreads $ olcLocalSSF $ olcLogFile $ olcLogFileFormat $ olcLogLevel $ "
 		 "olcLogFileOnly $ olcLogFileRotate $ olcMaxFilterDepth $ "
 		 "olcPasswordCryptSaltFormat $ olcPasswordHash $ olcPidFile $ "
@@ -1015,15 +1047,16 @@ static ConfigOCs cf_ocs[] = {
 		 "olcSaslAuxprops $ olcSaslAuxpropsDontUseCopy $ olcSaslAuxpropsDontUseCopyIgnore $ "
 		 "olcSaslCBinding $ olcSaslHost $ olcSaslRealm $ olcSaslSecProps $ "
 		 "olcSecurity $ olcServerID $ olcSizeLimit $ "
-		 "olcSockbufMaxIncoming $ olcSockbufMaxIncomingAuth $ "
+		 "olcSockbufMaxIncoming $ olcSockbufMaxIncomingAuth $ olcSockbufReadahead $ "
 		 "olcTCPBuffer $ "
-		 "olcThreads $ olcThreadQueues $ "
+		 "olcThreads $ olcThreadQueues $ olcThreadStealing $ "
 		 "olcTimeLimit $ olcTLSCACertificateFile $ "
 		 "olcTLSCACertificatePath $ olcTLSCertificateFile $ "
 		 "olcTLSCertificateKeyFile $ olcTLSCipherSuite $ olcTLSCRLCheck $ "
 		 "olcTLSCACertificate $ olcTLSCertificate $ olcTLSCertificateKey $ "
 		 "olcTLSRandFile $ olcTLSVerifyClient $ olcTLSDHParamFile $ olcTLSECName $ "
-		 "olcTLSCRLFile $ olcTLSProtocolMin $ olcToolThreads $ olcWriteTimeout $ "
+		 "olcTLSCRLFile $ olcTLSProtocolMin $ olcToolThreads $ "
+		 "olcWriteBatch $ olcWriteBatchDelay $ olcWriteTimeout $ "
 		 "olcObjectIdentifier $ olcAttributeTypes $ olcObjectClasses $ "
 		 "olcDitContentRules $ olcLdapSyntaxes ) )", Cft_Global },
 	{ "( OLcfgGlOc:2 "
@@ -1169,6 +1202,15 @@ config_generic(ConfigArgs *c) {
 		case CFG_THREADQS:
 			c->value_int = connection_pool_queues;
 			break;
+		case CFG_ACLCACHE:
+			if ( acl_cache_size )
+				c->value_int = acl_cache_size;
+			else
+				rc = 1;
+			break;
+		case CFG_THREADSTEAL:
+			c->value_int = connection_pool_steal;
+			break;
 		case CFG_TTHREADS:
 			c->value_int = slap_tool_thread_max;
 			break;
@@ -1561,6 +1603,16 @@ config_generic(ConfigArgs *c) {
 			connection_pool_queues = 1;	/* save for reference */
 			break;
 
+		case CFG_ACLCACHE:
+			acl_cache_resize( 0 );
+			break;
+
+		case CFG_THREADSTEAL:
+			if ( slapMode & SLAP_SERVER_MODE )
+				ldap_pvt_thread_pool_steal(&connection_pool, 0);
+			connection_pool_steal = 0;
+			break;
+
 		case CFG_TTHREADS:
 			slap_tool_thread_max = 1;
 			break;
@@ -2044,6 +2096,24 @@ config_generic(ConfigArgs *c) {
 			connection_pool_queues = c->value_int;	/* save for reference */
 			break;
 
+		case CFG_ACLCACHE:
+			if ( c->value_int < 0 ) {
+				snprintf( c->cr_msg, sizeof( c->cr_msg ),
+					"aclcache=%d must not be negative",
+					c->value_int );
+				Debug(LDAP_DEBUG_ANY, "%s: %s.\n",
+					c->log, c->cr_msg );
+				return 1;
+			}
+			acl_cache_resize( c->value_int );
+			break;
+
+		case CFG_THREADSTEAL:
+			if ( slapMode & SLAP_SERVER_MODE )
+				ldap_pvt_thread_pool_steal(&connection_pool, c->value_int);
+			connection_pool_steal = c->value_int;	/* save for reference */
+			break;
+
 		case CFG_TTHREADS:
 			if ( slapMode & SLAP_TOOL_MODE )
 				ldap_pvt_thread_pool_maxthreads(&connection_pool, c->value_int);
@@ -2069,6 +2139,8 @@ config_generic(ConfigArgs *c) {
 			new_daemon_threads = mask+1;
 			if ( CONFIG_ONLINE_ADD( c ) ) {
 				config_push_cleanup( c, config_resize_lthreads );
+			} else {
+				slapd_daemon_resize( new_daemon_threads );
 			}
 			}
 			break;
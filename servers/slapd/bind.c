@@ -202,6 +202,7 @@ do_bind(
 
 	op->orb_mech = mech;
 
+	SLAP_PHASE_END( op, SLAP_PHASE_DECODE, op->o_phase_start );
 	op->o_bd = frontendDB;
 	rs->sr_err = frontendDB->be_bind( op, rs );
 
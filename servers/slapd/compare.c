@@ -123,6 +123,7 @@ do_compare(
 		op->o_req_dn.bv_val,
 		ava.aa_desc->ad_cname.bv_val, ava.aa_value.bv_val );
 
+	SLAP_PHASE_END( op, SLAP_PHASE_DECODE, op->o_phase_start );
 	op->o_bd = frontendDB;
 	rs->sr_err = frontendDB->be_compare( op, rs );
 	if ( rs->sr_err == SLAPD_ASYNCOP ) {
@@ -70,6 +70,8 @@ slap_mask_t		global_allows = 0;
 slap_mask_t		global_disallows = 0;
 int		global_gentlehup = 0;
 int		global_idletimeout = 0;
+int		global_writebatch = 0;
+int		global_writebatch_delay = 10;
 int		global_writetimeout = 0;
 char	*global_host = NULL;
 struct berval global_host_bv = BER_BVNULL;
@@ -82,6 +84,10 @@ struct berval default_search_nbase = BER_BVNULL;
 
 ber_len_t sockbuf_max_incoming = SLAP_SB_MAX_INCOMING_DEFAULT;
 ber_len_t sockbuf_max_incoming_auth= SLAP_SB_MAX_INCOMING_AUTH;
+ber_len_t sockbuf_readahead = 0;
+
+int	slap_latency_stats = 0;
+int	slap_latency_trace = 0;
 
 int	slap_conn_max_pending = SLAP_CONN_MAX_PENDING_DEFAULT;
 int	slap_conn_max_pending_auth = SLAP_CONN_MAX_PENDING_AUTH;
@@ -2277,6 +2283,7 @@ config_destroy( )
 		if ( frontendDB->be_acl )
 			acl_destroy( frontendDB->be_acl );
 	}
+	acl_cache_destroy();
 	free( line );
 	if ( slapd_args_file )
 		free ( slapd_args_file );
@@ -39,9 +39,7 @@
 #include "lutil.h"
 #include "slap.h"
 
-#ifdef LDAP_CONNECTIONLESS
 #include "../../libraries/liblber/lber-int.h"	/* ber_int_sb_read() */
-#endif
 
 #ifdef LDAP_SLAPI
 #include "slapi/slapi.h"
@@ -90,6 +88,10 @@ static void connection_destroy( Connection *c );
 
 static ldap_pvt_thread_start_t connection_operation;
 
+/* requests buffered past the last one read, see connection_rbuf_get() */
+#define connection_rbuf_pending(c) \
+	( (c)->c_rbnext || (c)->c_rbhead < (c)->c_rbtail )
+
 /*
  * Initialize connection management infrastructure.
  */
@@ -151,6 +153,7 @@ int connections_destroy(void)
 		ldap_pvt_thread_mutex_destroy( &connections[i].c_mutex );
 		ldap_pvt_thread_mutex_destroy( &connections[i].c_write1_mutex );
 		ldap_pvt_thread_cond_destroy( &connections[i].c_write1_cv );
+		slap_batch_destroy( &connections[i] );
 		if( connections[i].c_sb ) {
 			ber_sockbuf_free( connections[i].c_sb );
 #ifdef LDAP_SLAPI
@@ -384,6 +387,11 @@ Connection * connection_init(
 		c->c_txn_backend = NULL;
 		LDAP_STAILQ_INIT(&c->c_txn_ops);
 
+		c->c_proxy_session = 0;
+		c->c_proxy_nauthz = 0;
+		c->c_proxy_authz = NULL;
+		c->c_batch = NULL;
+
 		BER_BVZERO( &c->c_sasl_bind_mech );
 		c->c_sasl_done = 0;
 		c->c_sasl_authctx = NULL;
@@ -419,6 +427,7 @@ Connection * connection_init(
 	assert( c->c_txn == CONN_TXN_INACTIVE );
 	assert( c->c_txn_backend == NULL );
 	assert( LDAP_STAILQ_EMPTY(&c->c_txn_ops) );
+	assert( c->c_proxy_authz == NULL );
 	assert( BER_BVISNULL( &c->c_sasl_bind_mech ) );
 	assert( c->c_sasl_done == 0 );
 	assert( c->c_sasl_authctx == NULL );
@@ -427,6 +436,7 @@ Connection * connection_init(
 	assert( c->c_sasl_bindop == NULL );
 	assert( c->c_sasl_cbind == NULL );
 	assert( c->c_currentber == NULL );
+	assert( c->c_rbuf == NULL );
 	assert( c->c_writewaiter == 0);
 	assert( c->c_writers == 0);
 
@@ -611,6 +621,8 @@ void connection2anonymous( Connection *c )
 	BER_BVZERO( &c->c_sasl_authz_dn );
 
 	c->c_authz_backend = NULL;
+
+	slap_proxy_session_free( c );
 }
 
 static void
@@ -668,6 +680,13 @@ connection_destroy( Connection *c )
 		c->c_currentber = NULL;
 	}
 
+	if ( c->c_rbuf != NULL ) {
+		connection_rbuf_release( c->c_rbuf );
+		c->c_rbuf = NULL;
+	}
+	c->c_rbhead = c->c_rbtail = c->c_rbnext = 0;
+	c->c_rbstop = 0;
+
 
 #ifdef LDAP_SLAPI
 	/* call destructors, then constructors; avoids unnecessary allocation */
@@ -933,19 +952,12 @@ void connection_done( Connection *c )
  * calls the appropriate stub to handle it.
  */
 
-/* FIXME: returns 0 in case of failure */
 #define INCR_OP_INITIATED(index) \
-	do { \
-		ldap_pvt_thread_mutex_lock( &op->o_counters->sc_mutex ); \
-		ldap_pvt_mp_add_ulong(op->o_counters->sc_ops_initiated_[(index)], 1); \
-		ldap_pvt_thread_mutex_unlock( &op->o_counters->sc_mutex ); \
-	} while (0)
+	SLAP_COUNTER_ADD( op->o_counters->sc_ops_initiated_[(index)], 1 )
 #define INCR_OP_COMPLETED(index) \
 	do { \
-		ldap_pvt_thread_mutex_lock( &op->o_counters->sc_mutex ); \
-		ldap_pvt_mp_add_ulong(op->o_counters->sc_ops_completed, 1); \
-		ldap_pvt_mp_add_ulong(op->o_counters->sc_ops_completed_[(index)], 1); \
-		ldap_pvt_thread_mutex_unlock( &op->o_counters->sc_mutex ); \
+		SLAP_COUNTER_ADD( op->o_counters->sc_ops_completed, 1 ); \
+		SLAP_COUNTER_ADD( op->o_counters->sc_ops_completed_[(index)], 1 ); \
 	} while (0)
 
 /*
@@ -979,16 +991,17 @@ conn_counter_destroy( void *key, void *data )
 			int i;
 
 			*prev = sc->sc_next;
-			/* Copy data to main counter */
-			ldap_pvt_mp_add( slap_counters.sc_bytes, sc->sc_bytes );
-			ldap_pvt_mp_add( slap_counters.sc_pdu, sc->sc_pdu );
-			ldap_pvt_mp_add( slap_counters.sc_entries, sc->sc_entries );
-			ldap_pvt_mp_add( slap_counters.sc_refs, sc->sc_refs );
-			ldap_pvt_mp_add( slap_counters.sc_ops_initiated, sc->sc_ops_initiated );
-			ldap_pvt_mp_add( slap_counters.sc_ops_completed, sc->sc_ops_completed );
+			/* Copy data to main counter, internal operations
+			 * may be updating it concurrently */
+			SLAP_COUNTER_ADD( slap_counters.sc_bytes, sc->sc_bytes );
+			SLAP_COUNTER_ADD( slap_counters.sc_pdu, sc->sc_pdu );
+			SLAP_COUNTER_ADD( slap_counters.sc_entries, sc->sc_entries );
+			SLAP_COUNTER_ADD( slap_counters.sc_refs, sc->sc_refs );
+			SLAP_COUNTER_ADD( slap_counters.sc_ops_initiated, sc->sc_ops_initiated );
+			SLAP_COUNTER_ADD( slap_counters.sc_ops_completed, sc->sc_ops_completed );
 			for ( i = 0; i < SLAP_OP_LAST; i++ ) {
-				ldap_pvt_mp_add( slap_counters.sc_ops_initiated_[ i ], sc->sc_ops_initiated_[ i ] );
-				ldap_pvt_mp_add( slap_counters.sc_ops_initiated_[ i ], sc->sc_ops_completed_[ i ] );
+				SLAP_COUNTER_ADD( slap_counters.sc_ops_initiated_[ i ], sc->sc_ops_initiated_[ i ] );
+				SLAP_COUNTER_ADD( slap_counters.sc_ops_completed_[ i ], sc->sc_ops_completed_[ i ] );
 			}
 			slap_counters_destroy( sc );
 			ber_memfree_x( data, NULL );
@@ -1068,13 +1081,12 @@ connection_operation( void *ctx, void *arg_v )
 	}
 	op->o_qtime.tv_sec -= op->o_time;
 	operation_counter_init( op, ctx );
-	ldap_pvt_thread_mutex_lock( &op->o_counters->sc_mutex );
-	/* FIXME: returns 0 in case of failure */
-	ldap_pvt_mp_add_ulong(op->o_counters->sc_ops_initiated, 1);
-	ldap_pvt_thread_mutex_unlock( &op->o_counters->sc_mutex );
+	SLAP_COUNTER_ADD( op->o_counters->sc_ops_initiated, 1 );
 
 	op->o_threadctx = ctx;
 	op->o_tid = ldap_pvt_thread_pool_tid( ctx );
+	SLAP_PHASE_BEGIN( op->o_phase_start );
+	op->o_acl_gen = acl_cache_generation();
 
 	switch ( tag ) {
 	case LDAP_REQ_BIND:
@@ -1169,6 +1181,8 @@ operations_error:
 		 * only if operation was initiated
 		 * and rc != SLAPD_DISCONNECT */
 		INCR_OP_COMPLETED( opidx );
+		if ( slap_latency_stats )
+			slap_op_latency( op, opidx );
 	}
 
 	ldap_pvt_thread_mutex_lock( &conn->c_mutex );
@@ -1373,6 +1387,20 @@ connection_read( ber_socket_t s, conn_readinfo *cri )
 
 #ifdef HAVE_TLS
 	if ( c->c_is_tls && c->c_needs_tls_accept ) {
+		if ( connection_rbuf_pending( c ) ) {
+			Debug( LDAP_DEBUG_ANY,
+				"connection_read(%d): plaintext data buffered "
+				"before TLS accept id=%lu, closing\n",
+				s, c->c_connid );
+
+			c->c_needs_tls_accept = 0;
+			/* c_mutex is locked */
+			connection_closing( c, "data pipelined after StartTLS" );
+			connection_close( c );
+			connection_return( c );
+			return 0;
+		}
+
 		rc = ldap_pvt_tls_accept( c->c_sb, slap_tls_ctx );
 		if ( rc < 0 ) {
 			Debug( LDAP_DEBUG_TRACE,
@@ -1446,6 +1474,19 @@ connection_read( ber_socket_t s, conn_readinfo *cri )
 
 		c->c_sasl_layers = 0;
 
+		if ( connection_rbuf_pending( c ) ) {
+			Debug( LDAP_DEBUG_ANY,
+				"connection_read(%d): data buffered before "
+				"SASL layer install id=%lu, closing\n",
+				s, c->c_connid );
+
+			/* c_mutex is locked */
+			connection_closing( c, "data pipelined after SASL bind" );
+			connection_close( c );
+			connection_return( c );
+			return 0;
+		}
+
 		rc = ldap_pvt_sasl_install( c->c_sb, c->c_sasl_sockctx );
 		if( rc != LDAP_SUCCESS ) {
 			Debug( LDAP_DEBUG_TRACE,
@@ -1500,6 +1541,262 @@ connection_read( ber_socket_t s, conn_readinfo *cri )
 	return 0;
 }
 
+/*
+ * Shared read buffer. With sockbuf_readahead set, requests are read
+ * in bulk into a chunk of this size. Larger requests are decoded in
+ * place and their operation keeps a reference on the chunk, so the
+ * PDU is not copied; requests of up to SLAP_RBUF_COPY octets are
+ * copied out, so that long-lived operations such as persistent
+ * searches don't pin a whole chunk.
+ *
+ * Readahead stops for good once a StartTLS or SASL Bind request has
+ * been read: octets read past it would otherwise be taken as having
+ * arrived over the security layer it installs.
+ */
+#define SLAP_RBUF_COPY	1024
+typedef struct slap_rbuf {
+	ldap_pvt_thread_mutex_t	rb_mutex;
+	int			rb_refs;
+	ber_len_t	rb_size;
+	char		rb_buf[1];	/* rb_size octets plus one spare */
+} slap_rbuf;
+
+static slap_rbuf *
+connection_rbuf_alloc( ber_len_t size )
+{
+	slap_rbuf *rb;
+
+	rb = ch_malloc( sizeof( slap_rbuf ) + size );
+	ldap_pvt_thread_mutex_init( &rb->rb_mutex );
+	rb->rb_refs = 1;
+	rb->rb_size = size;
+	return rb;
+}
+
+void
+connection_rbuf_release( slap_rbuf *rb )
+{
+	int refs;
+
+	ldap_pvt_thread_mutex_lock( &rb->rb_mutex );
+	refs = --rb->rb_refs;
+	ldap_pvt_thread_mutex_unlock( &rb->rb_mutex );
+
+	if ( refs == 0 ) {
+		ldap_pvt_thread_mutex_destroy( &rb->rb_mutex );
+		ch_free( rb );
+	}
+}
+
+static int
+connection_rbuf_shared( slap_rbuf *rb )
+{
+	int refs;
+
+	ldap_pvt_thread_mutex_lock( &rb->rb_mutex );
+	refs = rb->rb_refs;
+	ldap_pvt_thread_mutex_unlock( &rb->rb_mutex );
+
+	return refs > 1;
+}
+
+/*
+ * Move the unconsumed octets of the connection's read buffer into
+ * a fresh chunk of at least size octets, dropping the connection's
+ * reference on the old one.
+ */
+static void
+connection_rbuf_move( Connection *c, ber_len_t size )
+{
+	slap_rbuf *rb;
+	ber_len_t len = c->c_rbtail - c->c_rbhead;
+
+	if ( size < sockbuf_readahead )
+		size = sockbuf_readahead;
+	rb = connection_rbuf_alloc( size );
+	if ( c->c_rbuf != NULL ) {
+		AC_MEMCPY( rb->rb_buf, c->c_rbuf->rb_buf + c->c_rbhead, len );
+		connection_rbuf_release( c->c_rbuf );
+	}
+	c->c_rbuf = rb;
+	c->c_rbhead = 0;
+	c->c_rbtail = len;
+}
+
+/*
+ * Parse the LDAPMessage header at c_rbhead. Returns 1 and leaves
+ * c_rbhead at the contents, with their length in c_rbnext, if the
+ * header is complete; 0 if more data is needed; -1 if it is invalid.
+ */
+static int
+connection_rbuf_header( Connection *c )
+{
+	unsigned char *p = (unsigned char *)c->c_rbuf->rb_buf + c->c_rbhead;
+	ber_len_t avail = c->c_rbtail - c->c_rbhead;
+	ber_len_t len, n = 2;
+	unsigned i;
+
+	if ( avail < 2 )
+		return 0;
+	if ( p[0] != LDAP_TAG_MESSAGE )
+		return -1;
+
+	len = p[1];
+	if ( len & 0x80U ) {
+		i = len & 0x7fU;
+		if ( i == 0 || i > sizeof( ber_len_t ) )
+			return -1;
+		if ( avail < n + i )
+			return 0;
+		for ( len = 0; i; i-- )
+			len = ( len << 8 ) | p[n++];
+	}
+
+	if ( len == 0 )
+		return -1;
+	if ( c->c_sb->sb_max_incoming && len > c->c_sb->sb_max_incoming ) {
+		Debug( LDAP_DEBUG_CONNS,
+			"connection_rbuf_header: conn=%lu sockbuf_max_incoming "
+			"exceeded (%lu > %lu)\n", c->c_connid, (unsigned long) len,
+			(unsigned long) c->c_sb->sb_max_incoming );
+		return -1;
+	}
+
+	c->c_rbhead += n;
+	c->c_rbnext = len;
+	return 1;
+}
+
+/*
+ * Whether the request in ber, of type tag, installs a security
+ * layer on the connection: StartTLS or a SASL Bind.
+ */
+static int
+connection_rbuf_layer( BerElement *ber, ber_tag_t tag )
+{
+	BerElementBuffer berbuf;
+	BerElement *b = (BerElement *)&berbuf;
+	struct berval bv;
+	ber_int_t version;
+	ber_len_t len;
+
+	/* Only peek and skip, "m" would terminate values in place */
+	*b = *ber;
+	switch ( tag ) {
+	case LDAP_REQ_BIND:
+		if ( ber_scanf( b, "{ix" /*}*/, &version ) == LBER_ERROR )
+			return 0;
+		return ber_peek_tag( b, &len ) == LDAP_AUTH_SASL;
+
+	case LDAP_REQ_EXTENDED:
+		if ( ber_scanf( b, "{" /*}*/ ) == LBER_ERROR )
+			return 0;
+		return ber_peek_element( b, &bv ) == LDAP_TAG_EXOP_REQ_OID &&
+			bvmatch( &bv, &slap_EXOP_START_TLS );
+	}
+	return 0;
+}
+
+/*
+ * Get the next request from the connection's read buffer, reading
+ * from the sockbuf as needed. Behaves like ber_get_next(); on success
+ * *berp decodes in place from *rbp, on which a reference is held.
+ */
+static ber_tag_t
+connection_rbuf_get( Connection *c, BerElement **berp, slap_rbuf **rbp )
+{
+	slap_rbuf *rb;
+	BerElement *ber;
+	struct berval bv;
+	ber_len_t need;
+	ber_slen_t n;
+	int rc;
+
+	for (;;) {
+		rb = c->c_rbuf;
+		if ( rb != NULL && c->c_rbnext == 0 ) {
+			rc = connection_rbuf_header( c );
+			if ( rc < 0 ) {
+				sock_errset( ERANGE );
+				return LBER_DEFAULT;
+			}
+		}
+		if ( rb != NULL && c->c_rbnext &&
+			c->c_rbtail - c->c_rbhead >= c->c_rbnext )
+		{
+			break;
+		}
+
+		/* Room needed for the rest of the current PDU */
+		need = c->c_rbnext ? c->c_rbnext : 1;
+		if ( rb == NULL || rb->rb_size < need ||
+			connection_rbuf_shared( rb ) )
+		{
+			/* Operations may still be reading from a shared chunk,
+			 * it must not be overwritten or appended to.
+			 */
+			connection_rbuf_move( c, need );
+		} else if ( c->c_rbtail == rb->rb_size ||
+			rb->rb_size - c->c_rbhead < need )
+		{
+			AC_MEMCPY( rb->rb_buf, rb->rb_buf + c->c_rbhead,
+				c->c_rbtail - c->c_rbhead );
+			c->c_rbtail -= c->c_rbhead;
+			c->c_rbhead = 0;
+		}
+
+		rb = c->c_rbuf;
+		n = ber_int_sb_read( c->c_sb, rb->rb_buf + c->c_rbtail,
+			rb->rb_size - c->c_rbtail );
+		if ( n <= 0 )
+			return LBER_DEFAULT;
+		c->c_rbtail += n;
+	}
+
+	bv.bv_val = rb->rb_buf + c->c_rbhead;
+	bv.bv_len = c->c_rbnext;
+	c->c_rbhead += c->c_rbnext;
+	c->c_rbnext = 0;
+
+	ber = ber_alloc_t( LBER_USE_DER );
+	if ( ber == NULL )
+		return LBER_DEFAULT;
+
+	if ( bv.bv_len <= SLAP_RBUF_COPY ) {
+		/* one spare octet, see below */
+		char *buf = ber_memalloc( bv.bv_len + 1 );
+
+		if ( buf == NULL ) {
+			ber_free( ber, 0 );
+			return LBER_DEFAULT;
+		}
+		AC_MEMCPY( buf, bv.bv_val, bv.bv_len );
+		bv.bv_val = buf;
+		ber_init2( ber, &bv, LBER_USE_DER );
+
+		*berp = ber;
+		*rbp = NULL;
+		return LDAP_TAG_MESSAGE;
+	}
+	ber_init2( ber, &bv, LBER_USE_DER );
+
+	ldap_pvt_thread_mutex_lock( &rb->rb_mutex );
+	rb->rb_refs++;
+	ldap_pvt_thread_mutex_unlock( &rb->rb_mutex );
+
+	/* The decoder may terminate the last value of this request in
+	 * place, on the octet just past it. Parse the header there now;
+	 * if that's not possible, move what follows out of the way.
+	 */
+	if ( c->c_rbhead < c->c_rbtail && connection_rbuf_header( c ) <= 0 ) {
+		connection_rbuf_move( c, 0 );
+	}
+
+	*berp = ber;
+	*rbp = rb;
+	return LDAP_TAG_MESSAGE;
+}
+
 static int
 connection_input( Connection *conn , conn_readinfo *cri )
 {
@@ -1508,6 +1805,7 @@ connection_input( Connection *conn , conn_readinfo *cri )
 	ber_len_t	len;
 	ber_int_t	msgid;
 	BerElement	*ber;
+	slap_rbuf	*rb = NULL;
 	int 		rc;
 #ifdef LDAP_CONNECTIONLESS
 	Sockaddr	peeraddr;
@@ -1515,6 +1813,34 @@ connection_input( Connection *conn , conn_readinfo *cri )
 #endif
 	char *defer = NULL;
 	void *ctx;
+	int		readahead = 0;
+
+	/* keep draining buffered requests if readahead was switched off */
+	if ( ( ( sockbuf_readahead && !conn->c_rbstop ) ||
+			connection_rbuf_pending( conn ) ) &&
+		conn->c_currentber == NULL
+#ifdef LDAP_CONNECTIONLESS
+		&& !conn->c_is_udp
+#endif
+		)
+	{
+		sock_errset(0);
+		tag = connection_rbuf_get( conn, &ber, &rb );
+		readahead = 1;
+		if ( tag != LDAP_TAG_MESSAGE ) {
+			int err = sock_errno();
+
+			if ( err != EWOULDBLOCK && err != EAGAIN ) {
+				char ebuf[128];
+				Debug( LDAP_DEBUG_TRACE,
+					"connection_rbuf_get on fd=%d failed errno=%d (%s)\n",
+					conn->c_sd, err, sock_errstr(err, ebuf, sizeof(ebuf)) );
+				return -2;
+			}
+			return 1;
+		}
+		goto decode;
+	}
 
 	if ( conn->c_currentber == NULL &&
 		( conn->c_currentber = ber_alloc()) == NULL )
@@ -1601,19 +1927,17 @@ connection_input( Connection *conn , conn_readinfo *cri )
 	ber = conn->c_currentber;
 	conn->c_currentber = NULL;
 
+decode:
 	if ( (tag = ber_get_int( ber, &msgid )) != LDAP_TAG_MSGID ) {
 		/* log, close and send error */
 		Debug( LDAP_DEBUG_ANY, "ber_get_int returns 0x%lx\n", tag );
-		ber_free( ber, 1 );
-		return -1;
+		goto fail;
 	}
 
 	if ( (tag = ber_peek_tag( ber, &len )) == LBER_ERROR ) {
 		/* log, close and send error */
 		Debug( LDAP_DEBUG_ANY, "ber_peek_tag returns 0x%lx\n", tag );
-		ber_free( ber, 1 );
-
-		return -1;
+		goto fail;
 	}
 
 #ifdef LDAP_CONNECTIONLESS
@@ -1630,6 +1954,18 @@ connection_input( Connection *conn , conn_readinfo *cri )
 	}
 #endif
 
+	if ( readahead && connection_rbuf_layer( ber, tag ) ) {
+		conn->c_rbstop = 1;
+		if ( connection_rbuf_pending( conn ) ) {
+			/* RFC 4511 4.2.1, 4.14.1: nothing may follow these
+			 * until their response has been received */
+			Debug( LDAP_DEBUG_ANY, "connection_input: conn=%lu "
+				"data pipelined after a StartTLS or SASL Bind request\n",
+				conn->c_connid );
+			goto fail;
+		}
+	}
+
 	if(tag == LDAP_REQ_BIND) {
 		/* immediately abandon all existing operations upon BIND */
 		connection_abandon( conn );
@@ -1637,6 +1973,7 @@ connection_input( Connection *conn , conn_readinfo *cri )
 
 	ctx = cri->ctx;
 	op = slap_op_alloc( ber, msgid, tag, conn->c_n_ops_received++, ctx );
+	op->o_rbuf = rb;
 
 	Debug( LDAP_DEBUG_TRACE, "op tag 0x%lx, time %ld\n", tag,
 		(long) op->o_time );
@@ -1756,6 +2093,15 @@ connection_input( Connection *conn , conn_readinfo *cri )
 	}
 
 	return rc;
+
+fail:
+	if ( rb != NULL ) {
+		ber_free( ber, 0 );
+		connection_rbuf_release( rb );
+	} else {
+		ber_free( ber, 1 );
+	}
+	return -1;
 }
 
 static int
@@ -36,6 +36,7 @@ static SLAP_CTRL_PARSE_FN parsePagedResults;
 static SLAP_CTRL_PARSE_FN parsePermissiveModify;
 static SLAP_CTRL_PARSE_FN parsePreRead, parsePostRead;
 static SLAP_CTRL_PARSE_FN parseProxyAuthz;
+static SLAP_CTRL_PARSE_FN parseProxiedClient;
 static SLAP_CTRL_PARSE_FN parseRelax;
 static SLAP_CTRL_PARSE_FN parseSearchOptions;
 #ifdef SLAP_CONTROL_X_SORTEDRESULTS
@@ -214,6 +215,11 @@ static struct slap_control control_defs[] = {
 		SLAP_CTRL_GLOBAL|SLAP_CTRL_ACCESS,
 		proxy_authz_extops, NULL,
 		parseProxyAuthz, LDAP_SLIST_ENTRY_INITIALIZER(next) },
+	{ LDAP_CONTROL_X_PROXIED_CLIENT,
+ 		(int)offsetof(struct slap_control_ids, sc_proxiedClient),
+		SLAP_CTRL_GLOBAL|SLAP_CTRL_ACCESS,
+		proxy_authz_extops, NULL,
+		parseProxiedClient, LDAP_SLIST_ENTRY_INITIALIZER(next) },
 #ifdef SLAP_CONTROL_X_SESSION_TRACKING
 	{ LDAP_CONTROL_X_SESSION_TRACKING,
  		(int)offsetof(struct slap_control_ids, sc_sessionTracking),
@@ -1271,6 +1277,209 @@ static int parseProxyAuthz (
 	return LDAP_SUCCESS;
 }
 
+/*
+ * Proxied client control, sent by a load balancer on a connection that
+ * has completed the proxy session extended operation.  The value is
+ *
+ *	SEQUENCE {
+ *		authzId		OCTET STRING,
+ *		connId		INTEGER }
+ *
+ * The authorization checks are the same as for proxyAuthz, but since
+ * the proxy's identity is fixed for the lifetime of the session, the
+ * resulting mappings are cached on the connection until it rebinds.
+ * The cache is also dropped when the authz generation moves on, i.e.
+ * after a write that may have revoked a mapping.
+ */
+#define SLAP_PROXY_AUTHZ_CACHE_MAX	1024
+
+typedef struct proxy_authz_map {
+	struct berval pam_authzid;
+	struct berval pam_ndn;
+} proxy_authz_map;
+
+static int
+proxy_authz_map_cmp( const void *v1, const void *v2 )
+{
+	const proxy_authz_map *m1 = v1, *m2 = v2;
+
+	return ber_bvcmp( &m1->pam_authzid, &m2->pam_authzid );
+}
+
+void
+slap_proxy_session_free( Connection *c )
+{
+	if ( c->c_proxy_authz ) {
+		ldap_avl_free( c->c_proxy_authz, ch_free );
+		c->c_proxy_authz = NULL;
+	}
+	c->c_proxy_nauthz = 0;
+	c->c_proxy_session = 0;
+}
+
+static int parseProxiedClient (
+	Operation *op,
+	SlapReply *rs,
+	LDAPControl *ctrl )
+{
+	BerElementBuffer berbuf;
+	BerElement	*ber = (BerElement *)&berbuf;
+	Connection	*c = op->o_conn;
+	proxy_authz_map	pam, *pamp;
+	struct berval	dn = BER_BVNULL;
+	ber_int_t	connid;
+	slap_counter_t	gen;
+	int		rc, cacheable;
+
+	if ( op->o_proxy_authz != SLAP_CONTROL_NONE ) {
+		rs->sr_text = "proxy authorization control specified multiple times";
+		return LDAP_PROTOCOL_ERROR;
+	}
+
+	if ( BER_BVISNULL( &ctrl->ldctl_value )) {
+		rs->sr_text = "proxied client control value absent";
+		return LDAP_PROTOCOL_ERROR;
+	}
+
+	if ( ( global_disallows & SLAP_DISALLOW_PROXY_AUTHZ_N_CRIT )
+		&& !ctrl->ldctl_iscritical )
+	{
+		rs->sr_text = "proxied authorization criticality of FALSE not allowed";
+		return LDAP_PROTOCOL_ERROR;
+	}
+
+	if ( !( global_allows & SLAP_ALLOW_PROXY_AUTHZ_ANON )
+		&& BER_BVISEMPTY( &op->o_ndn ) )
+	{
+		rs->sr_text = "anonymous proxied authorization not allowed";
+		return LDAP_PROXIED_AUTHORIZATION_DENIED;
+	}
+
+	ber_init2( ber, &ctrl->ldctl_value, 0 );
+	if ( ber_scanf( ber, "{mi}", &pam.pam_authzid, &connid ) == LBER_ERROR ) {
+		rs->sr_text = "proxied client control value invalid";
+		return LDAP_PROTOCOL_ERROR;
+	}
+
+	op->o_proxy_authz = ctrl->ldctl_iscritical
+		? SLAP_CONTROL_CRITICAL
+		: SLAP_CONTROL_NONCRITICAL;
+	op->o_proxied_client = op->o_proxy_authz;
+
+	Debug( LDAP_DEBUG_ARGS,
+		"parseProxiedClient: conn %lu authzid=\"%s\" client conn=%d\n",
+		op->o_connid,
+		pam.pam_authzid.bv_len ? pam.pam_authzid.bv_val : "anonymous",
+		connid );
+
+	ldap_pvt_thread_mutex_lock( &c->c_mutex );
+	if ( !c->c_proxy_session ) {
+		ldap_pvt_thread_mutex_unlock( &c->c_mutex );
+		rs->sr_text = "proxied client control requires a proxy session";
+		return LDAP_PROXIED_AUTHORIZATION_DENIED;
+	}
+	cacheable = bvmatch( &op->o_ndn, &c->c_ndn );
+	/* taken before checking, so a concurrent write makes the result stale */
+	gen = slap_sasl_authz_generation();
+	if ( cacheable && c->c_proxy_authz_gen != gen ) {
+		if ( c->c_proxy_authz ) {
+			ldap_avl_free( c->c_proxy_authz, ch_free );
+			c->c_proxy_authz = NULL;
+			c->c_proxy_nauthz = 0;
+		}
+		c->c_proxy_authz_gen = gen;
+	}
+	if ( cacheable ) {
+		pamp = ldap_avl_find( c->c_proxy_authz, &pam, proxy_authz_map_cmp );
+		if ( pamp ) {
+			ber_dupbv( &dn, &pamp->pam_ndn );
+		}
+	}
+	ldap_pvt_thread_mutex_unlock( &c->c_mutex );
+
+	if ( BER_BVISEMPTY( &pam.pam_authzid )) {
+		/* anonymous */
+		if ( !BER_BVISNULL( &op->o_ndn ) ) {
+			op->o_ndn.bv_val[ 0 ] = '\0';
+		}
+		op->o_ndn.bv_len = 0;
+
+		if ( !BER_BVISNULL( &op->o_dn ) ) {
+			op->o_dn.bv_val[ 0 ] = '\0';
+		}
+		op->o_dn.bv_len = 0;
+
+		return LDAP_SUCCESS;
+	}
+
+	if ( BER_BVISNULL( &dn ) ) {
+		rc = slap_sasl_getdn( c, op, &pam.pam_authzid,
+				NULL, &dn, SLAP_GETDN_AUTHZID );
+		if ( rc != LDAP_SUCCESS ) {
+			if ( dn.bv_val ) {
+				ch_free( dn.bv_val );
+			}
+			rs->sr_text = "authzId mapping failed";
+			return LDAP_PROXIED_AUTHORIZATION_DENIED;
+		}
+
+		rc = slap_sasl_authorized( op, &op->o_ndn, &dn );
+		if ( rc ) {
+			ch_free( dn.bv_val );
+			rs->sr_text = "not authorized to assume identity";
+			return LDAP_PROXIED_AUTHORIZATION_DENIED;
+		}
+
+		if ( cacheable ) {
+			pamp = ch_malloc( sizeof(proxy_authz_map) +
+					pam.pam_authzid.bv_len + dn.bv_len + 2 );
+			pamp->pam_authzid.bv_val = (char *)(pamp + 1);
+			pamp->pam_authzid.bv_len = pam.pam_authzid.bv_len;
+			AC_MEMCPY( pamp->pam_authzid.bv_val, pam.pam_authzid.bv_val,
+					pam.pam_authzid.bv_len );
+			pamp->pam_authzid.bv_val[pam.pam_authzid.bv_len] = '\0';
+			pamp->pam_ndn.bv_val = pamp->pam_authzid.bv_val +
+					pam.pam_authzid.bv_len + 1;
+			pamp->pam_ndn.bv_len = dn.bv_len;
+			AC_MEMCPY( pamp->pam_ndn.bv_val, dn.bv_val, dn.bv_len + 1 );
+
+			ldap_pvt_thread_mutex_lock( &c->c_mutex );
+			/* the session may have been reset by a Bind meanwhile, or
+			 * the mapping revoked by a write */
+			if ( c->c_proxy_session && bvmatch( &op->o_ndn, &c->c_ndn ) &&
+				c->c_proxy_authz_gen == gen &&
+				slap_sasl_authz_generation() == gen )
+			{
+				if ( c->c_proxy_nauthz >= SLAP_PROXY_AUTHZ_CACHE_MAX ) {
+					ldap_avl_free( c->c_proxy_authz, ch_free );
+					c->c_proxy_authz = NULL;
+					c->c_proxy_nauthz = 0;
+				}
+				if ( ldap_avl_insert( &c->c_proxy_authz, pamp,
+						proxy_authz_map_cmp, ldap_avl_dup_error ) ) {
+					ch_free( pamp );
+				} else {
+					c->c_proxy_nauthz++;
+				}
+			} else {
+				ch_free( pamp );
+			}
+			ldap_pvt_thread_mutex_unlock( &c->c_mutex );
+		}
+	}
+
+	ch_free( op->o_ndn.bv_val );
+
+	/* slap_sasl_getdn() returns a normalized dn, see parseProxyAuthz */
+	op->o_ndn = dn;
+	ber_bvreplace( &op->o_dn, &dn );
+
+	Debug( LDAP_DEBUG_STATS, "%s PROXYAUTHZ dn=\"%s\" client conn=%d\n",
+	    op->o_log_prefix, dn.bv_val, connid );
+
+	return LDAP_SUCCESS;
+}
+
 static int parseNoOp (
 	Operation *op,
 	SlapReply *rs,
@@ -85,6 +85,33 @@ slap_get_commit_csn(
 	ldap_pvt_thread_mutex_unlock( &be->be_pcsn_p->be_pcsn_mutex );
 }
 
+/* Tell whether op's CSN was queued by slap_queue_csn(), i.e. whether it
+ * is one that the contextCSN advances through once the op commits.
+ */
+int
+slap_csn_queued( Operation *op )
+{
+	struct slap_csn_entry *csne;
+	BackendDB *be = op->o_bd->bd_self;
+	int found = 0;
+
+	if ( BER_BVISEMPTY( &op->o_csn ))
+		return 0;
+
+	ldap_pvt_thread_mutex_lock( &be->be_pcsn_p->be_pcsn_mutex );
+
+	LDAP_TAILQ_FOREACH( csne, &be->be_pcsn_p->be_pcsn_list, ce_csn_link ) {
+		if ( csne->ce_op == op ) {
+			found = !ber_bvcmp( &csne->ce_csn, &op->o_csn );
+			break;
+		}
+	}
+
+	ldap_pvt_thread_mutex_unlock( &be->be_pcsn_p->be_pcsn_mutex );
+
+	return found;
+}
+
 void
 slap_rewind_commit_csn( Operation *op )
 {
@@ -49,6 +49,10 @@
 #include <poll.h>
 #endif
 
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
 #ifdef HAVE_KQUEUE
 # include <sys/types.h>
 # include <sys/event.h>
@@ -92,6 +96,14 @@ struct runqueue_s slapd_rq = {
 int slapd_daemon_threads = 1;
 int slapd_daemon_mask;
 
+/* number of SO_REUSEPORT sockets opened per TCP listener address */
+int slapd_listener_shards = 1;
+/* max connections accepted per listener activation, 0 = default */
+int slapd_accept_batch = 0;
+
+#define SLAPD_ACCEPT_BATCH_DEFAULT	16
+#define SLAPD_ACCEPT_BATCH_MAX	64
+
 #ifdef LDAP_TCP_BUFFER
 int slapd_tcp_rmem;
 int slapd_tcp_wmem;
@@ -1500,6 +1512,55 @@ errexit:
 	return -1;
 }
 
+#ifdef SO_REUSEPORT
+/*
+ * Open one more socket bound to the address of an existing
+ * SO_REUSEPORT listener. The kernel then distributes incoming
+ * connections across all sockets bound to that address.
+ */
+static ber_socket_t
+slap_open_shard(
+	Sockaddr *sa,
+	int addrlen )
+{
+	ber_socket_t s;
+	int rc, tmp, err;
+	char ebuf[128];
+
+	s = socket( sa->sa_addr.sa_family, SOCK_STREAM, 0 );
+	if ( s == AC_SOCKET_INVALID ) {
+		err = sock_errno();
+		Debug( LDAP_DEBUG_ANY,
+			"daemon: shard socket() failed errno=%d (%s)\n",
+			err, sock_errstr(err, ebuf, sizeof(ebuf)) );
+		return AC_SOCKET_INVALID;
+	}
+
+	tmp = 1;
+	(void)setsockopt( s, SOL_SOCKET, SO_REUSEADDR,
+		(char *) &tmp, sizeof(tmp) );
+#if defined(LDAP_PF_INET6) && defined(IPV6_V6ONLY)
+	if ( sa->sa_addr.sa_family == AF_INET6 ) {
+		(void)setsockopt( s, IPPROTO_IPV6, IPV6_V6ONLY,
+			(char *) &tmp, sizeof(tmp) );
+	}
+#endif /* LDAP_PF_INET6 && IPV6_V6ONLY */
+	rc = setsockopt( s, SOL_SOCKET, SO_REUSEPORT,
+		(char *) &tmp, sizeof(tmp) );
+	if ( rc == 0 )
+		rc = bind( s, (struct sockaddr *)sa, addrlen );
+	if ( rc ) {
+		err = sock_errno();
+		Debug( LDAP_DEBUG_ANY,
+			"daemon: shard bind(%ld) failed errno=%d (%s)\n",
+			(long)s, err, sock_errstr(err, ebuf, sizeof(ebuf)) );
+		tcp_close( s );
+		return AC_SOCKET_INVALID;
+	}
+	return s;
+}
+#endif /* SO_REUSEPORT */
+
 static int
 slap_open_listener(
 	const char* url,
@@ -1507,6 +1568,7 @@ slap_open_listener(
 	int *cur )
 {
 	int	num, proto, tmp, rc;
+	int	shards;
 	Listener l;
 	Listener *li;
 	LDAPURLDesc *lud;
@@ -1529,6 +1591,7 @@ slap_open_listener(
 	l.sl_url.bv_val = NULL;
 	l.sl_mute = 0;
 	l.sl_busy = 0;
+	l.sl_shard = -1;
 
 #ifndef HAVE_TLS
 	if( ldap_pvt_url_scheme2tls( lud->lud_scheme ) ) {
@@ -1650,6 +1713,19 @@ slap_open_listener(
 		}
 		l.sl_sd = SLAP_SOCKNEW( s );
 
+		shards = 1;
+#ifdef SO_REUSEPORT
+		if ( slapd_listener_shards > 1 && socktype == SOCK_STREAM && (
+			(*sal)->sa_family == AF_INET
+#ifdef LDAP_PF_INET6
+			|| (*sal)->sa_family == AF_INET6
+#endif /* LDAP_PF_INET6 */
+			) )
+		{
+			shards = slapd_listener_shards;
+		}
+#endif /* SO_REUSEPORT */
+
 		if ( l.sl_sd >= dtblsize ) {
 			Debug( LDAP_DEBUG_ANY,
 				"daemon: listener descriptor %ld is too great %ld\n",
@@ -1677,6 +1753,20 @@ slap_open_listener(
 					(long) l.sl_sd, err, sock_errstr(err, ebuf, sizeof(ebuf)) );
 			}
 #endif /* SO_REUSEADDR */
+#ifdef SO_REUSEPORT
+			if ( shards > 1 ) {
+				tmp = 1;
+				rc = setsockopt( s, SOL_SOCKET, SO_REUSEPORT,
+					(char *) &tmp, sizeof(tmp) );
+				if ( rc == AC_SOCKET_ERROR ) {
+					int err = sock_errno();
+					Debug( LDAP_DEBUG_ANY, "slapd(%ld): "
+						"setsockopt(SO_REUSEPORT) failed errno=%d (%s)\n",
+						(long) l.sl_sd, err, sock_errstr(err, ebuf, sizeof(ebuf)) );
+					shards = 1;
+				}
+			}
+#endif /* SO_REUSEPORT */
 		}
 
 		switch( (*sal)->sa_family ) {
@@ -1810,10 +1900,50 @@ slap_open_listener(
 
 		AC_MEMCPY(&l.sl_sa, *sal, addrlen);
 		ber_str2bv( url, 0, 1, &l.sl_url);
+		l.sl_shard = shards > 1 ? 0 : -1;
 		li = ch_malloc( sizeof( Listener ) );
 		*li = l;
 		slap_listeners[*cur] = li;
 		(*cur)++;
+
+#ifdef SO_REUSEPORT
+		if ( shards > 1 ) {
+			int k;
+
+			*listeners += shards-1;
+			slap_listeners = ch_realloc( slap_listeners,
+				(*listeners + 1) * sizeof(Listener *) );
+
+			for ( k = 1; k < shards; k++ ) {
+				s = slap_open_shard( &l.sl_sa, addrlen );
+				if ( s == AC_SOCKET_INVALID ) break;
+				if ( SLAP_SOCKNEW( s ) >= dtblsize ) {
+					tcp_close( s );
+					break;
+				}
+				li = ch_malloc( sizeof( Listener ) );
+				*li = l;
+				li->sl_sd = SLAP_SOCKNEW( s );
+				li->sl_shard = k;
+				ber_dupbv( &li->sl_url, &l.sl_url );
+				ber_dupbv( &li->sl_name, &l.sl_name );
+				ldap_pvt_mp_init( li->sl_n_conns_opened );
+				slap_listeners[*cur] = li;
+				(*cur)++;
+			}
+			if ( k < shards ) {
+				/* give back the slots of the shards that failed */
+				*listeners -= shards - k;
+				Debug( LDAP_DEBUG_ANY,
+					"daemon: %s opened with %d of %d SO_REUSEPORT shards\n",
+					l.sl_name.bv_val, k, shards );
+			} else {
+				Debug( LDAP_DEBUG_TRACE,
+					"daemon: %s opened with %d SO_REUSEPORT shards\n",
+					l.sl_name.bv_val, shards );
+			}
+		}
+#endif /* SO_REUSEPORT */
 		sal++;
 	}
 
@@ -1834,6 +1964,7 @@ static int sockinit(void);
 static int sockdestroy(void);
 
 static int daemon_inited = 0;
+static int daemon_started = 0;
 
 int
 slapd_daemon_init( const char *urls )
@@ -2085,14 +2216,17 @@ destroy_listeners( void )
 	slap_listeners = NULL;
 }
 
-static int
-slap_listener(
-	Listener *sl )
+/*
+ * Set up a freshly accepted session and hand it to connection_init()
+ */
+static void
+slap_listener_conn(
+	Listener *sl,
+	ber_socket_t s,
+	Sockaddr *from,
+	ber_socklen_t len )
 {
-	Sockaddr		from;
-
-	ber_socket_t s, sfd;
-	ber_socklen_t len = sizeof(from);
+	ber_socket_t sfd;
 	Connection *c;
 	slap_ssf_t ssf = 0;
 	struct berval authid = BER_BVNULL;
@@ -2111,60 +2245,8 @@ slap_listener(
 	int tid;
 	char ebuf[128];
 
-	Debug( LDAP_DEBUG_TRACE,
-		">>> slap_listener(%s)\n",
-		sl->sl_url.bv_val );
-
 	peername[0] = '\0';
 
-#ifdef LDAP_CONNECTIONLESS
-	if ( sl->sl_is_udp ) return 1;
-#endif /* LDAP_CONNECTIONLESS */
-
-#  ifdef LDAP_PF_LOCAL
-	/* FIXME: apparently accept doesn't fill
-	 * the sun_path sun_path member */
-	from.sa_un_addr.sun_path[0] = '\0';
-#  endif /* LDAP_PF_LOCAL */
-
-	s = accept( SLAP_FD2SOCK( sl->sl_sd ), (struct sockaddr *) &from, &len );
-	if ( s != AC_SOCKET_INVALID ) {
-		SET_CLOSE(s);
-	}
-	Debug( LDAP_DEBUG_CONNS,
-		"daemon: accept() = %d\n", s );
-
-	/* Resume the listener FD to allow concurrent-processing of
-	 * additional incoming connections.
-	 */
-	sl->sl_busy = 0;
-	WAKE_LISTENER(DAEMON_ID(sl->sl_sd),1);
-
-	if ( s == AC_SOCKET_INVALID ) {
-		int err = sock_errno();
-
-		if(
-#ifdef EMFILE
-		    err == EMFILE ||
-#endif /* EMFILE */
-#ifdef ENFILE
-		    err == ENFILE ||
-#endif /* ENFILE */
-		    0 )
-		{
-			ldap_pvt_thread_mutex_lock( &emfile_mutex );
-			emfile++;
-			/* Stop listening until an existing session closes */
-			sl->sl_mute = 1;
-			ldap_pvt_thread_mutex_unlock( &emfile_mutex );
-		}
-
-		Debug( LDAP_DEBUG_ANY,
-			"daemon: accept(%ld) failed errno=%d (%s)\n",
-			(long) sl->sl_sd, err, sock_errstr(err, ebuf, sizeof(ebuf)) );
-		ldap_pvt_thread_yield();
-		return 0;
-	}
 	sfd = SLAP_SOCKNEW( s );
 
 	/* make sure descriptor number isn't too great */
@@ -2175,7 +2257,7 @@ slap_listener(
 
 		tcp_close(s);
 		ldap_pvt_thread_yield();
-		return 0;
+		return;
 	}
 	tid = DAEMON_ID(sfd);
 
@@ -2189,7 +2271,7 @@ slap_listener(
 #if defined( SO_KEEPALIVE ) || defined( TCP_NODELAY )
 #ifdef LDAP_PF_LOCAL
 	/* for IPv4 and IPv6 sockets only */
-	if ( from.sa_addr.sa_family != AF_LOCAL )
+	if ( from->sa_addr.sa_family != AF_LOCAL )
 #endif /* LDAP_PF_LOCAL */
 	{
 		int rc;
@@ -2205,7 +2287,7 @@ slap_listener(
 				"slapd(%ld): setsockopt(SO_KEEPALIVE) failed "
 				"errno=%d (%s)\n", (long) sfd, err, sock_errstr(err, ebuf, sizeof(ebuf)) );
 			slapd_close(sfd);
-			return 0;
+			return;
 		}
 #endif /* SO_KEEPALIVE */
 #ifdef TCP_NODELAY
@@ -2219,7 +2301,7 @@ slap_listener(
 				"slapd(%ld): setsockopt(TCP_NODELAY) failed "
 				"errno=%d (%s)\n", (long) sfd, err, sock_errstr(err, ebuf, sizeof(ebuf)) );
 			slapd_close(sfd);
-			return 0;
+			return;
 		}
 #endif /* TCP_NODELAY */
 	}
@@ -2230,20 +2312,20 @@ slap_listener(
 		(long) sl->sl_sd, (long) sfd );
 
 	cflag = 0;
-	switch ( from.sa_addr.sa_family ) {
+	switch ( from->sa_addr.sa_family ) {
 #  ifdef LDAP_PF_LOCAL
 	case AF_LOCAL:
 		cflag |= CONN_IS_IPC;
 
 		/* FIXME: apparently accept doesn't fill
 		 * the sun_path sun_path member */
-		if ( from.sa_un_addr.sun_path[0] == '\0' ) {
-			AC_MEMCPY( from.sa_un_addr.sun_path,
+		if ( from->sa_un_addr.sun_path[0] == '\0' ) {
+			AC_MEMCPY( from->sa_un_addr.sun_path,
 					sl->sl_sa.sa_un_addr.sun_path,
-					sizeof( from.sa_un_addr.sun_path ) );
+					sizeof( from->sa_un_addr.sun_path ) );
 		}
 
-		sprintf( peername, "PATH=%s", from.sa_un_addr.sun_path );
+		sprintf( peername, "PATH=%s", from->sa_un_addr.sun_path );
 		ssf = local_ssf;
 		{
 			uid_t uid;
@@ -2275,23 +2357,23 @@ slap_listener(
 #  endif /* LDAP_PF_INET6 */
 	case AF_INET:
 		if ( sl->sl_is_proxied ) {
-			if ( !proxyp( sfd, &from, &len ) ) {
+			if ( !proxyp( sfd, from, &len ) ) {
 				Debug( LDAP_DEBUG_ANY, "slapd(%ld): proxyp failed\n", (long)sfd );
 				slapd_close( sfd );
-				return 0;
+				return;
 			}
 		}
-		ldap_pvt_sockaddrstr( &from, &peerbv );
+		ldap_pvt_sockaddrstr( from, &peerbv );
 		break;
 
 	default:
 		slapd_close(sfd);
-		return 0;
+		return;
 	}
 
-	if ( ( from.sa_addr.sa_family == AF_INET )
+	if ( ( from->sa_addr.sa_family == AF_INET )
 #ifdef LDAP_PF_INET6
-		|| ( from.sa_addr.sa_family == AF_INET6 )
+		|| ( from->sa_addr.sa_family == AF_INET6 )
 #endif /* LDAP_PF_INET6 */
 		)
 	{
@@ -2299,7 +2381,7 @@ slap_listener(
 #ifdef SLAPD_RLOOKUPS
 		if ( use_reverse_lookup ) {
 			char *herr;
-			if (ldap_pvt_get_hname( (const struct sockaddr *)&from, len, hbuf,
+			if (ldap_pvt_get_hname( (const struct sockaddr *)from, len, hbuf,
 				sizeof(hbuf), &herr ) == 0) {
 				ldap_pvt_str2lower( hbuf );
 				dnsname = hbuf;
@@ -2334,7 +2416,7 @@ slap_listener(
 					dnsname != NULL ? dnsname : SLAP_STRING_UNKNOWN,
 					peeraddr );
 				slapd_close(sfd);
-				return 0;
+				return;
 			}
 			if ( paend ) {
 				if ( peeraddr[-1] == '[' )
@@ -2363,6 +2445,101 @@ slap_listener(
 			(long) sfd, peername, sl->sl_name.bv_val );
 		slapd_close(sfd);
 	}
+}
+
+static int
+slap_listener(
+	Listener *sl )
+{
+	Sockaddr		from[SLAPD_ACCEPT_BATCH_MAX];
+	ber_socklen_t	len[SLAPD_ACCEPT_BATCH_MAX];
+	ber_socket_t	s[SLAPD_ACCEPT_BATCH_MAX];
+	int i, n, batch, err = 0;
+	char ebuf[128];
+
+	Debug( LDAP_DEBUG_TRACE,
+		">>> slap_listener(%s)\n",
+		sl->sl_url.bv_val );
+
+#ifdef LDAP_CONNECTIONLESS
+	if ( sl->sl_is_udp ) return 1;
+#endif /* LDAP_CONNECTIONLESS */
+
+	batch = slapd_accept_batch;
+	if ( !batch )
+		batch = slapd_listener_shards > 1 ? SLAPD_ACCEPT_BATCH_DEFAULT : 1;
+	if ( batch > SLAPD_ACCEPT_BATCH_MAX )
+		batch = SLAPD_ACCEPT_BATCH_MAX;
+
+	/* Drain up to batch pending connections before releasing the
+	 * listener; the socket is non-blocking so this stops as soon
+	 * as the backlog is empty.
+	 */
+	for ( n = 0; n < batch; n++ ) {
+#  ifdef LDAP_PF_LOCAL
+		/* FIXME: apparently accept doesn't fill
+		 * the sun_path sun_path member */
+		from[n].sa_un_addr.sun_path[0] = '\0';
+#  endif /* LDAP_PF_LOCAL */
+		len[n] = sizeof(from[n]);
+
+		s[n] = accept( SLAP_FD2SOCK( sl->sl_sd ),
+			(struct sockaddr *) &from[n], &len[n] );
+		if ( s[n] == AC_SOCKET_INVALID ) {
+			err = sock_errno();
+			if ( n == 0 )
+				Debug( LDAP_DEBUG_CONNS,
+					"daemon: accept() = %d\n", s[n] );
+			break;
+		}
+		SET_CLOSE(s[n]);
+		Debug( LDAP_DEBUG_CONNS,
+			"daemon: accept() = %d\n", s[n] );
+	}
+
+	/* Resume the listener FD to allow concurrent-processing of
+	 * additional incoming connections.
+	 */
+	sl->sl_busy = 0;
+	WAKE_LISTENER(DAEMON_ID(sl->sl_sd),1);
+
+	if ( n < batch && ( n == 0 || (
+#ifdef EWOULDBLOCK
+		( err != EWOULDBLOCK ) &&
+#endif /* EWOULDBLOCK */
+#ifdef EAGAIN
+		( err != EAGAIN ) &&
+#endif /* EAGAIN */
+		1 ) ) )
+	{
+		if(
+#ifdef EMFILE
+		    err == EMFILE ||
+#endif /* EMFILE */
+#ifdef ENFILE
+		    err == ENFILE ||
+#endif /* ENFILE */
+		    0 )
+		{
+			ldap_pvt_thread_mutex_lock( &emfile_mutex );
+			emfile++;
+			/* Stop listening until an existing session closes */
+			sl->sl_mute = 1;
+			ldap_pvt_thread_mutex_unlock( &emfile_mutex );
+		}
+
+		Debug( LDAP_DEBUG_ANY,
+			"daemon: accept(%ld) failed errno=%d (%s)\n",
+			(long) sl->sl_sd, err, sock_errstr(err, ebuf, sizeof(ebuf)) );
+		if ( n == 0 ) {
+			ldap_pvt_thread_yield();
+			return 0;
+		}
+	}
+
+	for ( i = 0; i < n; i++ ) {
+		slap_listener_conn( sl, s[i], &from[i], len[i] );
+	}
 
 	return 0;
 }
@@ -3221,6 +3398,27 @@ slapd_daemon_resize( int newnum )
 	if ( newnum == slapd_daemon_threads )
 		return 0;
 
+	/* Set from the startup configuration, before any listener
+	 * thread exists. Only size the per-thread arrays here,
+	 * slapd_daemon() initializes the new slots.
+	 */
+	if ( !daemon_started ) {
+		if ( daemon_inited ) {
+			ldap_pvt_thread_mutex_destroy( &slap_daemon[0].sd_mutex );
+			wake_sds = ch_realloc( wake_sds, newnum * sizeof( sdpair ));
+			slap_daemon = ch_realloc( slap_daemon, newnum * sizeof( slap_daemon_st ));
+			for ( i=slapd_daemon_threads; i<newnum; i++ ) {
+				wake_sds[i][0] = AC_SOCKET_INVALID;
+				wake_sds[i][1] = AC_SOCKET_INVALID;
+				memset( &slap_daemon[i], 0, sizeof( slap_daemon_st ));
+			}
+			ldap_pvt_thread_mutex_init( &slap_daemon[0].sd_mutex );
+		}
+		slapd_daemon_threads = newnum;
+		slapd_daemon_mask = newnum - 1;
+		return 0;
+	}
+
 	/* wake up all current listener threads */
 	for ( i=0; i<slapd_daemon_threads; i++ )
 		WAKE_LISTENER(i,1);
@@ -3327,6 +3525,62 @@ connectionless_init( void )
 }
 #endif /* LDAP_CONNECTIONLESS */
 
+#if defined(SO_REUSEPORT) && defined(F_DUPFD_CLOEXEC)
+/*
+ * Close one of two descriptors of a listener socket. Unlike
+ * slapd_close() this must not shutdown() the socket, which would
+ * also stop the descriptor that is kept.
+ */
+static void
+slapd_close_dup( ber_socket_t s )
+{
+	Debug( LDAP_DEBUG_CONNS, "daemon: closing duplicate %ld\n",
+		(long) s );
+	close( SLAP_FD2SOCK(s) );
+}
+
+/*
+ * A descriptor's daemon thread is derived from its number, so move
+ * each SO_REUSEPORT shard onto a descriptor owned by the thread that
+ * matches its shard index. Each event loop then polls and accepts
+ * from its own socket.
+ */
+static void
+slap_listeners_place( void )
+{
+	int l;
+
+	for ( l = 0; slap_listeners[l] != NULL; l++ ) {
+		Listener *lr = slap_listeners[l];
+		ber_socket_t nfd, base;
+		int tid;
+
+		if ( lr->sl_shard < 0 || lr->sl_sd == AC_SOCKET_INVALID ) continue;
+
+		tid = lr->sl_shard & slapd_daemon_mask;
+		if ( DAEMON_ID( lr->sl_sd ) == tid ) continue;
+
+		base = tid;
+		for (;;) {
+			nfd = fcntl( lr->sl_sd, F_DUPFD_CLOEXEC, base );
+			if ( nfd < 0 || DAEMON_ID( nfd ) == tid ) break;
+			slapd_close_dup( nfd );
+			/* next descriptor number above nfd owned by tid */
+			base = ( nfd & ~slapd_daemon_mask ) + slapd_daemon_mask + 1 + tid;
+		}
+		if ( nfd < 0 || nfd >= dtblsize ) {
+			if ( nfd >= 0 ) slapd_close_dup( nfd );
+			Debug( LDAP_DEBUG_ANY, "daemon: "
+				"unable to move listener %ld to thread %d\n",
+				(long) lr->sl_sd, tid );
+			continue;
+		}
+		slapd_close_dup( lr->sl_sd );
+		lr->sl_sd = nfd;
+	}
+}
+#endif /* SO_REUSEPORT && F_DUPFD_CLOEXEC */
+
 int
 slapd_daemon( void )
 {
@@ -3338,6 +3592,8 @@ slapd_daemon( void )
 
 	SLAP_SOCK_INIT2();
 
+	daemon_started = 1;
+
 	/* daemon_init only inits element 0 */
 	for ( i=1; i<slapd_daemon_threads; i++ )
 	{
@@ -3353,6 +3609,11 @@ slapd_daemon( void )
 		SLAP_SOCK_INIT(i);
 	}
 
+#if defined(SO_REUSEPORT) && defined(F_DUPFD_CLOEXEC)
+	if ( slapd_listener_shards > 1 && slapd_daemon_threads > 1 )
+		slap_listeners_place();
+#endif /* SO_REUSEPORT && F_DUPFD_CLOEXEC */
+
 	for ( i=0; i<slapd_daemon_threads; i++ )
 	{
 		/* listener as a separate THREAD */
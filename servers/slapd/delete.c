@@ -91,6 +91,7 @@ do_delete(
 		goto cleanup;
 	}
 
+	SLAP_PHASE_END( op, SLAP_PHASE_DECODE, op->o_phase_start );
 	op->o_bd = frontendDB;
 	rs->sr_err = frontendDB->be_delete( op, rs );
 	if ( rs->sr_err == SLAPD_ASYNCOP ) {
@@ -47,6 +47,7 @@ static struct extop_list {
 } *supp_ext_list = NULL;
 
 static SLAP_EXTOP_MAIN_FN whoami_extop;
+static SLAP_EXTOP_MAIN_FN proxy_session_extop;
 
 /* This list of built-in extops is for extops that are not part
  * of backends or in external modules.	Essentially, this is
@@ -62,6 +63,7 @@ static struct {
 	{ &slap_EXOP_TXN_END, 0, txn_end_extop },
 	{ &slap_EXOP_CANCEL, 0, cancel_extop },
 	{ &slap_EXOP_WHOAMI, 0, whoami_extop },
+	{ &slap_EXOP_PROXY_SESSION, 0, proxy_session_extop },
 	{ &slap_EXOP_MODIFY_PASSWD, SLAP_EXOP_WRITES, passwd_extop },
 	{ NULL, 0, NULL }
 };
@@ -171,6 +173,7 @@ do_extended(
 		op->ore_reqdata = &reqdata;
 	}
 
+	SLAP_PHASE_END( op, SLAP_PHASE_DECODE, op->o_phase_start );
 	op->o_bd = frontendDB;
 	rs->sr_err = frontendDB->be_extended( op, rs );
 
@@ -461,3 +464,45 @@ whoami_extop (
 	rs->sr_rspdata = bv;
 	return LDAP_SUCCESS;
 }
+
+const struct berval slap_EXOP_PROXY_SESSION = BER_BVC(LDAP_EXOP_X_PROXY_SESSION);
+
+/*
+ * Marks the connection as a proxy session, typically one opened by lloadd.
+ * Operations on it may then carry the proxied client control, whose
+ * authorization results are cached until the connection rebinds.
+ */
+static int
+proxy_session_extop (
+	Operation *op,
+	SlapReply *rs )
+{
+	if ( op->ore_reqdata != NULL ) {
+		/* no request data should be provided */
+		rs->sr_text = "no request data expected";
+		return LDAP_PROTOCOL_ERROR;
+	}
+
+	Debug( LDAP_DEBUG_STATS, "%s PROXY SESSION\n",
+	    op->o_log_prefix );
+
+	if ( !( global_allows & SLAP_ALLOW_PROXY_AUTHZ_ANON )
+		&& BER_BVISEMPTY( &op->o_ndn ) )
+	{
+		rs->sr_text = "anonymous proxy session not allowed";
+		return LDAP_INAPPROPRIATE_AUTH;
+	}
+
+	op->o_bd = op->o_conn->c_authz_backend;
+	if( backend_check_restrictions( op, rs,
+		(struct berval *)&slap_EXOP_PROXY_SESSION ) != LDAP_SUCCESS )
+	{
+		return rs->sr_err;
+	}
+
+	ldap_pvt_thread_mutex_lock( &op->o_conn->c_mutex );
+	op->o_conn->c_proxy_session = 1;
+	ldap_pvt_thread_mutex_unlock( &op->o_conn->c_mutex );
+
+	return LDAP_SUCCESS;
+}
@@ -37,15 +37,84 @@
 #include "component.h"
 #endif
 
+/* Compiled filters, see filter_prog_compile() */
+enum {
+	FP_CONST = 0,	/* fi_type holds the result */
+	FP_AND,
+	FP_OR,
+	FP_NOT,
+	FP_AVA,
+	FP_SUBSTRINGS,
+	FP_PRESENT,
+	FP_FILTER	/* evaluate fi_f with test_filter() */
+};
+
+/* fi_at without tags, and no subtypes: match attributes by type */
+#define FP_EXACT	0x01
+
+typedef struct FilterInsn {
+	int		fi_op;
+	int		fi_type;
+	int		fi_next;	/* index past this subtree */
+	int		fi_flags;
+	int		fi_use;
+	Filter		*fi_f;
+	AttributeType	*fi_at;
+	MatchingRule	*fi_mr;
+} FilterInsn;
+
+struct FilterProg {
+	int		fp_len;
+	FilterInsn	fp_insn[1];
+};
+
 static int	test_filter_and( Operation *op, Entry *e, Filter *flist );
 static int	test_filter_or( Operation *op, Entry *e, Filter *flist );
-static int	test_substrings_filter( Operation *op, Entry *e, Filter *f);
+static int	test_substrings_filter( Operation *op,
+	Entry *e, Filter *f, FilterInsn *fi );
 static int	test_ava_filter( Operation *op,
-	Entry *e, AttributeAssertion *ava, int type );
+	Entry *e, AttributeAssertion *ava, int type, FilterInsn *fi );
 static int	test_mra_filter( Operation *op,
 	Entry *e, MatchingRuleAssertion *mra );
 static int	test_presence_filter( Operation *op,
-	Entry *e, AttributeDescription *desc );
+	Entry *e, AttributeDescription *desc, FilterInsn *fi );
+
+static MatchingRule *
+filter_ava_mr( AttributeType *at, int type, int *use )
+{
+	switch ( type ) {
+	case LDAP_FILTER_APPROX:
+		*use = SLAP_MR_EQUALITY_APPROX;
+		if ( at->sat_approx ) return at->sat_approx;
+		return at->sat_equality;
+
+	case LDAP_FILTER_EQUALITY:
+		*use = SLAP_MR_EQUALITY;
+		return at->sat_equality;
+
+	case LDAP_FILTER_GE:
+	case LDAP_FILTER_LE:
+		*use = SLAP_MR_ORDERING;
+		return at->sat_ordering;
+	}
+
+	*use = SLAP_MR_EQUALITY;
+	return NULL;
+}
+
+/* attrs_find(), restricted to what the instruction fi can match if given */
+static Attribute *
+fp_attrs_find( FilterInsn *fi, Attribute *a, AttributeDescription *ad )
+{
+	if ( fi && ( fi->fi_flags & FP_EXACT )) {
+		for ( ; a; a = a->a_next ) {
+			if ( a->a_desc->ad_type == fi->fi_at )
+				return a;
+		}
+		return NULL;
+	}
+	return attrs_find( a, ad );
+}
 
 
 /*
@@ -85,32 +154,32 @@ test_filter(
 
 	case LDAP_FILTER_EQUALITY:
 		Debug( LDAP_DEBUG_FILTER, "    EQUALITY\n" );
-		rc = test_ava_filter( op, e, f->f_ava, LDAP_FILTER_EQUALITY );
+		rc = test_ava_filter( op, e, f->f_ava, LDAP_FILTER_EQUALITY, NULL );
 		break;
 
 	case LDAP_FILTER_SUBSTRINGS:
 		Debug( LDAP_DEBUG_FILTER, "    SUBSTRINGS\n" );
-		rc = test_substrings_filter( op, e, f );
+		rc = test_substrings_filter( op, e, f, NULL );
 		break;
 
 	case LDAP_FILTER_GE:
 		Debug( LDAP_DEBUG_FILTER, "    GE\n" );
-		rc = test_ava_filter( op, e, f->f_ava, LDAP_FILTER_GE );
+		rc = test_ava_filter( op, e, f->f_ava, LDAP_FILTER_GE, NULL );
 		break;
 
 	case LDAP_FILTER_LE:
 		Debug( LDAP_DEBUG_FILTER, "    LE\n" );
-		rc = test_ava_filter( op, e, f->f_ava, LDAP_FILTER_LE );
+		rc = test_ava_filter( op, e, f->f_ava, LDAP_FILTER_LE, NULL );
 		break;
 
 	case LDAP_FILTER_PRESENT:
 		Debug( LDAP_DEBUG_FILTER, "    PRESENT\n" );
-		rc = test_presence_filter( op, e, f->f_desc );
+		rc = test_presence_filter( op, e, f->f_desc, NULL );
 		break;
 
 	case LDAP_FILTER_APPROX:
 		Debug( LDAP_DEBUG_FILTER, "    APPROX\n" );
-		rc = test_ava_filter( op, e, f->f_ava, LDAP_FILTER_APPROX );
+		rc = test_ava_filter( op, e, f->f_ava, LDAP_FILTER_APPROX, NULL );
 		break;
 
 	case LDAP_FILTER_AND:
@@ -528,7 +597,8 @@ test_ava_filter(
 	Operation	*op,
 	Entry		*e,
 	AttributeAssertion *ava,
-	int		type )
+	int		type,
+	FilterInsn	*fi )
 {
 	int rc;
 	Attribute	*a;
@@ -612,9 +682,9 @@ test_ava_filter(
 	}
 #endif
 
-	for(a = attrs_find( e->e_attrs, ava->aa_desc );
+	for(a = fp_attrs_find( fi, e->e_attrs, ava->aa_desc );
 		a != NULL;
-		a = attrs_find( a->a_next, ava->aa_desc ) )
+		a = fp_attrs_find( fi, a->a_next, ava->aa_desc ) )
 	{
 		int use;
 		MatchingRule *mr;
@@ -627,29 +697,12 @@ test_ava_filter(
 			continue;
 		}
 
-		use = SLAP_MR_EQUALITY;
-
-		switch ( type ) {
-		case LDAP_FILTER_APPROX:
-			use = SLAP_MR_EQUALITY_APPROX;
-			mr = a->a_desc->ad_type->sat_approx;
-			if( mr != NULL ) break;
-
-			/* fallthru: use EQUALITY matching rule if no APPROX rule */
-
-		case LDAP_FILTER_EQUALITY:
-			/* use variable set above so fall thru use is not clobbered */
-			mr = a->a_desc->ad_type->sat_equality;
-			break;
-
-		case LDAP_FILTER_GE:
-		case LDAP_FILTER_LE:
-			use = SLAP_MR_ORDERING;
-			mr = a->a_desc->ad_type->sat_ordering;
-			break;
-
-		default:
-			mr = NULL;
+		if ( fi && a->a_desc->ad_type == fi->fi_at ) {
+			/* resolved when the filter was compiled */
+			mr = fi->fi_mr;
+			use = fi->fi_use;
+		} else {
+			mr = filter_ava_mr( a->a_desc->ad_type, type, &use );
 		}
 
 		if( mr == NULL ) {
@@ -813,7 +866,8 @@ static int
 test_presence_filter(
 	Operation	*op,
 	Entry		*e,
-	AttributeDescription *desc )
+	AttributeDescription *desc,
+	FilterInsn	*fi )
 {
 	Attribute	*a;
 	int rc;
@@ -845,9 +899,9 @@ test_presence_filter(
 
 	rc = LDAP_COMPARE_FALSE;
 
-	for(a = attrs_find( e->e_attrs, desc );
+	for(a = fp_attrs_find( fi, e->e_attrs, desc );
 		a != NULL;
-		a = attrs_find( a->a_next, desc ) )
+		a = fp_attrs_find( fi, a->a_next, desc ) )
 	{
 		if (( desc != a->a_desc ) && !access_allowed( op,
 			e, a->a_desc, NULL, ACL_SEARCH, NULL ))
@@ -930,7 +984,8 @@ static int
 test_substrings_filter(
 	Operation	*op,
 	Entry	*e,
-	Filter	*f )
+	Filter	*f,
+	FilterInsn	*fi )
 {
 	Attribute	*a;
 	int rc;
@@ -945,9 +1000,9 @@ test_substrings_filter(
 
 	rc = LDAP_COMPARE_FALSE;
 
-	for(a = attrs_find( e->e_attrs, f->f_sub_desc );
+	for(a = fp_attrs_find( fi, e->e_attrs, f->f_sub_desc );
 		a != NULL;
-		a = attrs_find( a->a_next, f->f_sub_desc ) )
+		a = fp_attrs_find( fi, a->a_next, f->f_sub_desc ) )
 	{
 		MatchingRule *mr;
 		struct berval *bv;
@@ -984,3 +1039,233 @@ test_substrings_filter(
 		rc );
 	return rc;
 }
+
+/*
+ * Compiled filters.
+ *
+ * test_filter() interprets the Filter tree for every candidate entry.
+ * For searches that post-filter many entries the filter is compiled
+ * once into a flat array of instructions in prefix order: nested
+ * AND/OR of the same kind are flattened, double negations and constant
+ * subtrees are folded, and for simple attribute assertions the
+ * attribute type and matching rule are resolved ahead of time. Those
+ * assertions are matched by the same test_*_filter() functions as in
+ * test_filter(), given the instruction. Assertions involving special
+ * attributes (entryDN, hasSubordinates, ...), extensible matches and
+ * component filters are handed back to test_filter() as they are, so
+ * the results are always the same.
+ */
+
+static int
+filter_prog_count( Filter *f )
+{
+	int n = 1;
+
+	if ( f->f_choice & SLAPD_FILTER_UNDEFINED )
+		return n;
+
+	switch ( f->f_choice & SLAPD_FILTER_MASK ) {
+	case LDAP_FILTER_AND:
+	case LDAP_FILTER_OR:
+		for ( f = f->f_list; f; f = f->f_next )
+			n += filter_prog_count( f );
+		break;
+	case LDAP_FILTER_NOT:
+		n += filter_prog_count( f->f_not );
+		break;
+	}
+	return n;
+}
+
+static void filter_prog_emit( FilterProg *fp, Filter *f );
+
+static void
+filter_prog_emit_list( FilterProg *fp, Filter *f, ber_tag_t choice )
+{
+	for ( ; f; f = f->f_next ) {
+		if ( f->f_choice == choice ) {
+			filter_prog_emit_list( fp, f->f_list, choice );
+		} else {
+			filter_prog_emit( fp, f );
+		}
+	}
+}
+
+static void
+filter_prog_emit( FilterProg *fp, Filter *f )
+{
+	FilterInsn *fi;
+	AttributeDescription *ad = NULL;
+
+	/* NOT (NOT x) is x */
+	while ( f->f_choice == LDAP_FILTER_NOT &&
+		f->f_not->f_choice == LDAP_FILTER_NOT )
+	{
+		f = f->f_not->f_not;
+	}
+
+	fi = &fp->fp_insn[ fp->fp_len++ ];
+	memset( fi, 0, sizeof( *fi ));
+	fi->fi_f = f;
+	fi->fi_op = FP_FILTER;
+
+	if ( f->f_choice & SLAPD_FILTER_UNDEFINED ) {
+		fi->fi_op = FP_CONST;
+		fi->fi_type = SLAPD_COMPARE_UNDEFINED;
+		goto done;
+	}
+
+	switch ( f->f_choice & SLAPD_FILTER_MASK ) {
+	case SLAPD_FILTER_COMPUTED:
+		fi->fi_op = FP_CONST;
+		fi->fi_type = f->f_result;
+		break;
+
+	case LDAP_FILTER_AND:
+	case LDAP_FILTER_OR:
+		fi->fi_op = f->f_choice == LDAP_FILTER_AND ? FP_AND : FP_OR;
+		filter_prog_emit_list( fp, f->f_list, f->f_choice );
+		break;
+
+	case LDAP_FILTER_NOT:
+		fi->fi_op = FP_NOT;
+		filter_prog_emit( fp, f->f_not );
+		break;
+
+	case LDAP_FILTER_EQUALITY:
+	case LDAP_FILTER_GE:
+	case LDAP_FILTER_LE:
+	case LDAP_FILTER_APPROX:
+#ifdef LDAP_COMP_MATCH
+		if ( f->f_ava->aa_cf )
+			break;
+#endif
+		ad = f->f_ava->aa_desc;
+		if ( ad == slap_schema.si_ad_hasSubordinates ||
+			ad == slap_schema.si_ad_entryDN )
+			break;
+		fi->fi_op = FP_AVA;
+		fi->fi_type = f->f_choice;
+		fi->fi_mr = filter_ava_mr( ad->ad_type, fi->fi_type, &fi->fi_use );
+		break;
+
+	case LDAP_FILTER_SUBSTRINGS:
+		ad = f->f_sub_desc;
+		fi->fi_op = FP_SUBSTRINGS;
+		break;
+
+	case LDAP_FILTER_PRESENT:
+		ad = f->f_desc;
+		if ( ad == slap_schema.si_ad_hasSubordinates ||
+			ad == slap_schema.si_ad_entryDN ||
+			ad == slap_schema.si_ad_subschemaSubentry )
+			break;
+		fi->fi_op = FP_PRESENT;
+		break;
+	}
+
+	if ( fi->fi_op != FP_FILTER && ad != NULL ) {
+		fi->fi_at = ad->ad_type;
+		if ( ad->ad_type->sat_subtypes == NULL &&
+			ad->ad_flags == 0 && BER_BVISEMPTY( &ad->ad_tags ))
+			fi->fi_flags |= FP_EXACT;
+	}
+
+done:
+	fi->fi_next = fp->fp_len;
+}
+
+FilterProg *
+filter_prog_compile( Operation *op, Filter *f )
+{
+	FilterProg *fp;
+	int n;
+
+	if ( f == NULL )
+		return NULL;
+
+	n = filter_prog_count( f );
+	fp = op->o_tmpalloc( sizeof( FilterProg ) +
+		( n - 1 ) * sizeof( FilterInsn ), op->o_tmpmemctx );
+	fp->fp_len = 0;
+	filter_prog_emit( fp, f );
+	assert( fp->fp_len <= n );
+
+	return fp;
+}
+
+void
+filter_prog_free( Operation *op, FilterProg *fp )
+{
+	op->o_tmpfree( fp, op->o_tmpmemctx );
+}
+
+static int
+fp_eval( Operation *op, Entry *e, FilterInsn *base, int i )
+{
+	FilterInsn *fi = &base[i];
+	int j, rc, rtn;
+
+	switch ( fi->fi_op ) {
+	case FP_CONST:
+		return fi->fi_type;
+
+	case FP_AND:
+		rtn = LDAP_COMPARE_TRUE;
+		for ( j = i + 1; j < fi->fi_next; j = base[j].fi_next ) {
+			rc = fp_eval( op, e, base, j );
+			if ( rc == LDAP_COMPARE_FALSE )
+				return rc;
+			if ( rc != LDAP_COMPARE_TRUE )
+				rtn = rc;
+		}
+		return rtn;
+
+	case FP_OR:
+		rtn = LDAP_COMPARE_FALSE;
+		for ( j = i + 1; j < fi->fi_next; j = base[j].fi_next ) {
+			rc = fp_eval( op, e, base, j );
+			if ( rc == LDAP_COMPARE_TRUE )
+				return rc;
+			if ( rc != LDAP_COMPARE_FALSE )
+				rtn = rc;
+		}
+		return rtn;
+
+	case FP_NOT:
+		rc = fp_eval( op, e, base, i + 1 );
+		if ( rc == LDAP_COMPARE_TRUE )
+			return LDAP_COMPARE_FALSE;
+		if ( rc == LDAP_COMPARE_FALSE )
+			return LDAP_COMPARE_TRUE;
+		return rc;
+
+	case FP_AVA:
+		return test_ava_filter( op, e, fi->fi_f->f_ava, fi->fi_type, fi );
+
+	case FP_SUBSTRINGS:
+		return test_substrings_filter( op, e, fi->fi_f, fi );
+
+	case FP_PRESENT:
+		return test_presence_filter( op, e, fi->fi_f->f_desc, fi );
+	}
+
+	return test_filter( op, e, fi->fi_f );
+}
+
+/*
+ * test_filter_prog - test a compiled filter against a single entry.
+ * Same results as test_filter() on the filter it was compiled from.
+ */
+int
+test_filter_prog(
+	Operation	*op,
+	Entry		*e,
+	FilterProg	*fp )
+{
+	int rc;
+
+	rc = fp_eval( op, e, fp->fp_insn, 0 );
+	Debug( LDAP_DEBUG_FILTER, "<= test_filter_prog %d\n", rc );
+	return rc;
+}
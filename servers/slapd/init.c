@@ -61,6 +61,7 @@ BerVarray default_referral = NULL;
 ldap_pvt_thread_pool_t	connection_pool;
 int		connection_pool_max = SLAP_MAX_WORKER_THREADS;
 int		connection_pool_queues = 1;
+int		connection_pool_steal = 0;
 int		slap_tool_thread_max = 1;
 
 slap_counters_t			slap_counters, *slap_counters_list;
@@ -292,39 +293,116 @@ int slap_destroy(void)
 
 void slap_counters_init( slap_counters_t *sc )
 {
-	int i;
-
+	memset( sc, 0, sizeof( *sc ));
 	ldap_pvt_thread_mutex_init( &sc->sc_mutex );
-	ldap_pvt_mp_init( sc->sc_bytes );
-	ldap_pvt_mp_init( sc->sc_pdu );
-	ldap_pvt_mp_init( sc->sc_entries );
-	ldap_pvt_mp_init( sc->sc_refs );
+}
+
+void slap_counters_destroy( slap_counters_t *sc )
+{
+	ldap_pvt_thread_mutex_destroy( &sc->sc_mutex );
+}
 
-	ldap_pvt_mp_init( sc->sc_ops_initiated );
-	ldap_pvt_mp_init( sc->sc_ops_completed );
+/* Add up the global counters and those of all running threads */
+void slap_counters_sum( slap_counters_t *sum )
+{
+	slap_counters_t *sc;
+	int i;
 
-	for ( i = 0; i < SLAP_OP_LAST; i++ ) {
-		ldap_pvt_mp_init( sc->sc_ops_initiated_[ i ] );
-		ldap_pvt_mp_init( sc->sc_ops_completed_[ i ] );
+	memset( sum, 0, sizeof( *sum ));
+
+	ldap_pvt_thread_mutex_lock( &slap_counters.sc_mutex );
+	for ( sc = &slap_counters; sc; sc = sc->sc_next ) {
+		sum->sc_bytes += SLAP_COUNTER_GET( sc->sc_bytes );
+		sum->sc_pdu += SLAP_COUNTER_GET( sc->sc_pdu );
+		sum->sc_entries += SLAP_COUNTER_GET( sc->sc_entries );
+		sum->sc_refs += SLAP_COUNTER_GET( sc->sc_refs );
+		sum->sc_ops_initiated += SLAP_COUNTER_GET( sc->sc_ops_initiated );
+		sum->sc_ops_completed += SLAP_COUNTER_GET( sc->sc_ops_completed );
+		for ( i = 0; i < SLAP_OP_LAST; i++ ) {
+			sum->sc_ops_initiated_[ i ] += SLAP_COUNTER_GET( sc->sc_ops_initiated_[ i ] );
+			sum->sc_ops_completed_[ i ] += SLAP_COUNTER_GET( sc->sc_ops_completed_[ i ] );
+		}
 	}
+	ldap_pvt_thread_mutex_unlock( &slap_counters.sc_mutex );
 }
 
-void slap_counters_destroy( slap_counters_t *sc )
+/*
+ * Sharded statistics counters for overlays and backends that have no
+ * per-thread state to hang their counters off. Each shard holds a full
+ * set of counters on its own cache lines; threads are spread across the
+ * shards by their thread ID and update them with relaxed atomics.
+ * Reading a counter sums all shards.
+ */
+#define SLAP_STATS_SHARDS	16
+
+struct slap_stats_t {
+	int		ss_nstats;
+	int		ss_stride;	/* counters per shard */
+	slap_counter_t	*ss_vals;
+	void		*ss_mem;
+};
+
+slap_stats_t *
+slap_stats_alloc( int nstats )
 {
-	int i;
+	slap_stats_t *ss;
+	int stride;
 
-	ldap_pvt_thread_mutex_destroy( &sc->sc_mutex );
-	ldap_pvt_mp_clear( sc->sc_bytes );
-	ldap_pvt_mp_clear( sc->sc_pdu );
-	ldap_pvt_mp_clear( sc->sc_entries );
-	ldap_pvt_mp_clear( sc->sc_refs );
+	assert( nstats > 0 );
+
+	stride = ( nstats * sizeof( slap_counter_t ) + SLAP_CACHELINE - 1 )
+		& ~( SLAP_CACHELINE - 1 );
 
-	ldap_pvt_mp_clear( sc->sc_ops_initiated );
-	ldap_pvt_mp_clear( sc->sc_ops_completed );
+	ss = ch_malloc( sizeof( slap_stats_t ));
+	ss->ss_nstats = nstats;
+	ss->ss_stride = stride / sizeof( slap_counter_t );
+	ss->ss_mem = ch_calloc( 1, SLAP_STATS_SHARDS * stride + SLAP_CACHELINE );
+	ss->ss_vals = (slap_counter_t *)( ( (unsigned long)ss->ss_mem +
+		SLAP_CACHELINE - 1 ) & ~( (unsigned long)SLAP_CACHELINE - 1 ));
 
-	for ( i = 0; i < SLAP_OP_LAST; i++ ) {
-		ldap_pvt_mp_clear( sc->sc_ops_initiated_[ i ] );
-		ldap_pvt_mp_clear( sc->sc_ops_completed_[ i ] );
+	return ss;
+}
+
+void
+slap_stats_free( slap_stats_t *ss )
+{
+	if ( ss ) {
+		ch_free( ss->ss_mem );
+		ch_free( ss );
 	}
 }
 
+static int
+slap_stats_shard( void )
+{
+	ldap_pvt_thread_t tid = ldap_pvt_thread_self();
+	unsigned char *p = (unsigned char *)&tid;
+	unsigned int i, h = 0;
+
+	for ( i = 0; i < sizeof( tid ); i++ )
+		h = h * 31 + p[i];
+
+	return ( h ^ ( h >> 8 ) ^ ( h >> 16 )) % SLAP_STATS_SHARDS;
+}
+
+void
+slap_stats_add( slap_stats_t *ss, int idx, unsigned long v )
+{
+	assert( idx >= 0 && idx < ss->ss_nstats );
+
+	SLAP_COUNTER_ADD( ss->ss_vals[ slap_stats_shard() * ss->ss_stride + idx ], v );
+}
+
+slap_counter_t
+slap_stats_get( slap_stats_t *ss, int idx )
+{
+	slap_counter_t sum = 0;
+	int i;
+
+	assert( idx >= 0 && idx < ss->ss_nstats );
+
+	for ( i = 0; i < SLAP_STATS_SHARDS; i++ )
+		sum += SLAP_COUNTER_GET( ss->ss_vals[ i * ss->ss_stride + idx ] );
+
+	return sum;
+}
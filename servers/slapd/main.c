@@ -139,6 +139,40 @@ slapd_opt_slp( const char *val, void *arg )
 #endif
 }
 
+static int
+slapd_opt_reuseport( const char *val, void *arg )
+{
+#ifdef SO_REUSEPORT
+	int n;
+
+	if ( val == NULL || lutil_atoi( &n, val ) != 0 || n < 1 ) {
+		fprintf( stderr, "invalid value \"%s\" for reuseport option\n",
+			val ? val : "" );
+		return -1;
+	}
+	slapd_listener_shards = n;
+	return 0;
+
+#else
+	fputs( "slapd: SO_REUSEPORT is not available\n", stderr );
+	return 0;
+#endif
+}
+
+static int
+slapd_opt_acceptbatch( const char *val, void *arg )
+{
+	int n;
+
+	if ( val == NULL || lutil_atoi( &n, val ) != 0 || n < 1 ) {
+		fprintf( stderr, "invalid value \"%s\" for acceptbatch option\n",
+			val ? val : "" );
+		return -1;
+	}
+	slapd_accept_batch = n;
+	return 0;
+}
+
 /*
  * Option helper structure:
  * 
@@ -159,6 +193,8 @@ struct option_helper {
 	const char	*oh_usage;
 } option_helpers[] = {
 	{ BER_BVC("slp"),	slapd_opt_slp,	NULL, "slp[={on|off|(attrs)}] enable/disable SLP using (attrs)" },
+	{ BER_BVC("reuseport"),	slapd_opt_reuseport,	NULL, "reuseport=<n> open <n> SO_REUSEPORT sockets per TCP listener" },
+	{ BER_BVC("acceptbatch"),	slapd_opt_acceptbatch,	NULL, "acceptbatch=<n> accept up to <n> connections per listener wakeup" },
 	{ BER_BVNULL, 0, NULL, NULL }
 };
 
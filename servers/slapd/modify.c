@@ -207,6 +207,7 @@ do_modify(
 		goto cleanup;
 	}
 
+	SLAP_PHASE_END( op, SLAP_PHASE_DECODE, op->o_phase_start );
 	op->o_bd = frontendDB;
 	rs->sr_err = frontendDB->be_modify( op, rs );
 	if ( rs->sr_err == SLAPD_ASYNCOP ) {
@@ -1071,7 +1072,10 @@ slap_parse_modlist(
 			goto done;
 		}
 
-		mod = (Modifications *) ch_malloc( sizeof(Modifications) );
+		/* Freed through ch_free() by slap_mods_free(), which finds
+		 * the operation's memory context */
+		mod = (Modifications *) op->o_tmpalloc( sizeof(Modifications),
+			op->o_tmpmemctx );
 		mod->sml_op = mop;
 		mod->sml_flags = 0;
 		mod->sml_type = tmp.sml_type;
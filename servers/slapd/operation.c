@@ -41,10 +41,23 @@ static ldap_pvt_thread_mutex_t	slap_op_mutex;
 static time_t last_time;
 static int last_incr;
 
+/* Latency totals, kept as slap_latency_t-shaped runs of sharded
+ * counters, SLAP_LATENCY_SLOTS per operation type and phase */
+#define SLAP_LATENCY_SLOTS	( 2 + SLAP_LATENCY_BUCKETS )
+#define SLAP_LATENCY_IDX(opidx,phase) \
+	( ( (opidx) * SLAP_PHASE_LAST + (phase) ) * SLAP_LATENCY_SLOTS )
+static slap_stats_t *slap_latency;
+static slap_counter_t slap_latency_ops;
+
+static const char *slap_phase_names[] = {
+	"queue", "decode", "acl", "index", "entry", "encode", "write", "total"
+};
+
 void slap_op_init(void)
 {
 	struct timeval tv;
 	ldap_pvt_thread_mutex_init( &slap_op_mutex );
+	slap_latency = slap_stats_alloc( SLAP_LATENCY_IDX( SLAP_OP_LAST, 0 ) );
 	gettimeofday( &tv, NULL );
 	last_time = tv.tv_sec;
 	last_incr = tv.tv_usec;
@@ -53,6 +66,8 @@ void slap_op_init(void)
 void slap_op_destroy(void)
 {
 	ldap_pvt_thread_mutex_destroy( &slap_op_mutex );
+	slap_stats_free( slap_latency );
+	slap_latency = NULL;
 }
 
 static void
@@ -86,7 +101,12 @@ slap_op_free( Operation *op, void *ctx )
 	/* paranoia */
 	op->o_abandon = 1;
 
-	if ( op->o_ber != NULL ) {
+	if ( op->o_rbuf != NULL ) {
+		/* request was decoded in place from a shared read buffer */
+		ber_free( op->o_ber, 0 );
+		connection_rbuf_release( op->o_rbuf );
+		op->o_rbuf = NULL;
+	} else if ( op->o_ber != NULL ) {
 		ber_free( op->o_ber, 1 );
 	}
 	if ( !BER_BVISNULL( &op->o_dn ) ) {
@@ -126,6 +146,13 @@ slap_op_free( Operation *op, void *ctx )
 		op->o_tmpfree( op->o_pagedresults_state, op->o_tmpmemctx );
 	}
 
+	/* The operation is done with its memory context, free whatever
+	 * spilled past the thread's slab now instead of at the next task.
+	 */
+	if ( ctx && op->o_tmpmemctx ) {
+		slap_sl_mem_trim( ctx, op->o_tmpmemctx );
+	}
+
 	/* Selectively zero out the struct. Ignore fields that will
 	 * get explicitly initialized later anyway. Keep o_abandon intact.
 	 */
@@ -178,6 +205,148 @@ slap_op_time(time_t *t, int *nop)
 	nop[1] = tv.tv_usec;
 }
 
+/* Monotonic clock in microseconds, for timing operation phases */
+unsigned long
+slap_phase_now( void )
+{
+#ifdef HAVE_CLOCK_GETTIME
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec * 1000000UL + ts.tv_nsec / 1000;
+#else
+	struct timeval tv;
+
+	gettimeofday( &tv, NULL );
+	return tv.tv_sec * 1000000UL + tv.tv_usec;
+#endif
+}
+
+const char *
+slap_phase2str( int phase )
+{
+	if ( phase < 0 || phase >= SLAP_PHASE_LAST )
+		return "unknown";
+	return slap_phase_names[phase];
+}
+
+/* Fold the phase times of a completed operation into the
+ * per-operation type totals and histograms (bucket n counts
+ * samples below 2^n usec).
+ */
+void
+slap_op_latency( Operation *op, slap_op_t opidx )
+{
+	struct timeval tv;
+	unsigned long *ph = op->o_phase;
+	int i, idx, trace;
+
+	ph[SLAP_PHASE_QUEUE] = op->o_qtime.tv_sec * 1000000UL +
+		op->o_qtime.tv_usec;
+	gettimeofday( &tv, NULL );
+	ph[SLAP_PHASE_TOTAL] = ( tv.tv_sec - op->o_time ) * 1000000UL +
+		tv.tv_usec - op->o_tusec;
+
+	for ( i = 0; i < SLAP_PHASE_LAST; i++ ) {
+		idx = SLAP_LATENCY_IDX( opidx, i );
+		slap_stats_add( slap_latency, idx, 1 );
+		slap_stats_add( slap_latency, idx + 1, ph[i] );
+		slap_stats_add( slap_latency, idx + 2 + slap_latency_bucket( ph[i] ), 1 );
+	}
+
+	trace = slap_latency_trace;
+	if ( trace > 0 && SLAP_COUNTER_ADD( slap_latency_ops, 1 ) % trace == 0 ) {
+		Debug( LDAP_DEBUG_STATS, "%s LATENCY queue=%lu decode=%lu "
+			"acl=%lu index=%lu entry=%lu encode=%lu write=%lu total=%lu\n",
+			op->o_log_prefix, ph[SLAP_PHASE_QUEUE], ph[SLAP_PHASE_DECODE],
+			ph[SLAP_PHASE_ACL], ph[SLAP_PHASE_INDEX], ph[SLAP_PHASE_ENTRY],
+			ph[SLAP_PHASE_ENCODE], ph[SLAP_PHASE_WRITE],
+			ph[SLAP_PHASE_TOTAL] );
+	}
+}
+
+/* Sum the shards into sl, an array of SLAP_PHASE_LAST entries. The
+ * totals are read without a lock and may be slightly out of step with
+ * each other while operations complete. */
+void
+slap_latency_get( slap_op_t opidx, slap_latency_t *sl )
+{
+	int i, j, idx;
+
+	for ( i = 0; i < SLAP_PHASE_LAST; i++ ) {
+		idx = SLAP_LATENCY_IDX( opidx, i );
+		sl[i].sl_count = slap_stats_get( slap_latency, idx );
+		sl[i].sl_usec = slap_stats_get( slap_latency, idx + 1 );
+		for ( j = 0; j < SLAP_LATENCY_BUCKETS; j++ )
+			sl[i].sl_hist[j] = slap_stats_get( slap_latency, idx + 2 + j );
+	}
+}
+
+/* Histogram bucket for a sample: the first n with usec < 2^n */
+int
+slap_latency_bucket( unsigned long usec )
+{
+	int b = 0;
+
+	while ( usec && b < SLAP_LATENCY_BUCKETS - 1 ) {
+		usec >>= 1;
+		b++;
+	}
+	return b;
+}
+
+/* Add a sample; the caller serializes access to sl */
+void
+slap_latency_add( slap_latency_t *sl, unsigned long usec )
+{
+	sl->sl_count++;
+	sl->sl_usec += usec;
+	sl->sl_hist[ slap_latency_bucket( usec ) ]++;
+}
+
+/*
+ * Format sl as "count=12 usec=3400 hist=0,0,3,9", trailing empty
+ * buckets omitted. Returns the length, truncated to fit in len.
+ */
+int
+slap_latency2str( slap_latency_t *sl, char *buf, int len )
+{
+	char *ptr = buf, *end = buf + len;
+	int j, last;
+
+	for ( last = SLAP_LATENCY_BUCKETS; last > 1; last-- ) {
+		if ( sl->sl_hist[last - 1] ) break;
+	}
+
+	ptr += snprintf( ptr, end - ptr, "count=%lu usec=%lu hist=",
+		sl->sl_count, sl->sl_usec );
+	for ( j = 0; j < last && ptr < end; j++ ) {
+		ptr += snprintf( ptr, end - ptr, j ? ",%lu" : "%lu",
+			sl->sl_hist[j] );
+	}
+
+	return ptr < end ? ptr - buf : len - 1;
+}
+
+/*
+ * Per second rate of a running counter, averaged over the time since
+ * the previous update at least a second ago. The caller serializes
+ * access to sr.
+ */
+unsigned long
+slap_rate_update( slap_rate_t *sr, slap_counter_t count, time_t now )
+{
+	if ( !sr->sr_time ) {
+		sr->sr_time = now;
+		sr->sr_count = count;
+	} else if ( now > sr->sr_time ) {
+		sr->sr_rate = ( count - sr->sr_count ) / ( now - sr->sr_time );
+		sr->sr_time = now;
+		sr->sr_count = count;
+	}
+	return sr->sr_rate;
+}
+
 Operation *
 slap_op_alloc(
     BerElement		*ber,
@@ -65,6 +65,20 @@ typedef struct log_base {
 	struct berval lb_line;
 } log_base;
 
+/* A log entry waiting for a group commit. The operation is the one
+ * its CSN was queued under, so it must stay put until written. The
+ * record belongs to the waiting operation, which frees it once the
+ * writer has filled in lr_rc.
+ */
+typedef struct log_rec {
+	struct log_rec *lr_next;
+	unsigned long lr_seq;
+	int lr_rc;
+	Entry *lr_e;
+	Operation lr_op;
+	char lr_csnbuf[LDAP_PVT_CSNSTR_BUFSIZE];
+} log_rec;
+
 typedef struct log_info {
 	BackendDB *li_db;
 	struct berval li_db_suffix;
@@ -96,10 +110,38 @@ typedef struct log_info {
 	 */
 	ldap_pvt_thread_mutex_t li_op_rmutex;
 	ldap_pvt_thread_mutex_t li_log_mutex;
+
+	/*
+	 * With logbatch, log entries are queued in li_log_mutex order and
+	 * written by whichever waiting thread gets there first, up to
+	 * li_batch of them per log DB transaction. See accesslog_wait().
+	 */
+	int li_batch;
+	ldap_pvt_thread_mutex_t li_wq_mutex;
+	ldap_pvt_thread_cond_t li_wq_cond;
+	log_rec *li_wq_head, **li_wq_tail;
+	unsigned long li_wq_seq, li_wq_done;
+	int li_wq_busy;
 } log_info;
 
 static ConfigDriver log_cf_gen;
 
+/* A syncprov on the log DB sends each log entry to its consumers and
+ * advances its contextCSN as soon as the entry is added, while a batch
+ * only commits later. The two can't be combined.
+ */
+static int
+accesslog_batch_check( log_info *li, char *msg, size_t len )
+{
+	if ( li->li_batch && li->li_db &&
+		overlay_is_inst( li->li_db, "syncprov" )) {
+		snprintf( msg, len, "logbatch cannot be used, "
+			"the log database has the syncprov overlay" );
+		return 1;
+	}
+	return 0;
+}
+
 enum {
 	LOG_DB = 1,
 	LOG_OPS,
@@ -108,7 +150,8 @@ enum {
 	LOG_OLD,
 	LOG_OLDATTR,
 	LOG_BASE,
-	LOG_YIELD_FACTOR
+	LOG_YIELD_FACTOR,
+	LOG_BATCH
 };
 
 static ConfigTable log_cfats[] = {
@@ -154,6 +197,11 @@ static ConfigTable log_cfats[] = {
 			"DESC 'Pause purge task after every N entries have been purged' "
 			"EQUALITY integerMatch "
 			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "logbatch", NULL, 2, 2, 0, ARG_MAGIC|ARG_UINT|LOG_BATCH,
+		log_cf_gen, "( OLcfgOvAt:4.9 NAME 'olcAccessLogBatch' "
+			"DESC 'Write up to N log entries per log database transaction' "
+			"EQUALITY integerMatch "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ NULL }
 };
 
@@ -165,7 +213,7 @@ static ConfigOCs log_cfocs[] = {
 		"MUST olcAccessLogDB "
 		"MAY ( olcAccessLogOps $ olcAccessLogPurge $ olcAccessLogSuccess $ "
 			"olcAccessLogOld $ olcAccessLogOldAttr $ olcAccessLogBase $ "
-			"olcAccessLogPurgeBatch ) )",
+			"olcAccessLogPurgeBatch $ olcAccessLogBatch ) )",
 			Cft_Overlay, log_cfats },
 	{ NULL }
 };
@@ -938,6 +986,12 @@ log_cf_gen(ConfigArgs *c)
 			else
 				rc = 1;
 			break;
+		case LOG_BATCH:
+			if ( li->li_batch )
+				c->value_int = li->li_batch;
+			else
+				rc = 1;
+			break;
 	case LDAP_MOD_DELETE:
 		switch( c->type ) {
 		case LOG_DB:
@@ -1017,6 +1071,9 @@ log_cf_gen(ConfigArgs *c)
 		case LOG_YIELD_FACTOR:
 			li->li_yield_factor = 0;
 			break;
+		case LOG_BATCH:
+			li->li_batch = 0;
+			break;
 		}
 		break;
 	default:
@@ -1040,6 +1097,13 @@ log_cf_gen(ConfigArgs *c)
 						c->log, c->cr_msg, c->value_dn.bv_val );
 					rc = 1;
 				}
+				if ( !rc && accesslog_batch_check( li, c->cr_msg,
+						sizeof( c->cr_msg ))) {
+					Debug( LDAP_DEBUG_ANY, "%s: %s\n",
+						c->log, c->cr_msg );
+					li->li_db = NULL;
+					rc = 1;
+				}
 				ch_free( c->value_ndn.bv_val );
 			} else {
 				li->li_db_suffix = c->value_ndn;
@@ -1194,6 +1258,17 @@ log_cf_gen(ConfigArgs *c)
 		case LOG_YIELD_FACTOR:
 			li->li_yield_factor = c->value_int;
 			break;
+		case LOG_BATCH: {
+			int batch = li->li_batch;
+
+			li->li_batch = c->value_int;
+			if ( accesslog_batch_check( li, c->cr_msg,
+					sizeof( c->cr_msg ))) {
+				Debug( LDAP_DEBUG_ANY, "%s: %s\n", c->log, c->cr_msg );
+				li->li_batch = batch;
+				rc = ARG_BAD_CONF;
+			}
+			} break;
 		}
 		break;
 	}
@@ -1619,6 +1694,121 @@ accesslog_op2logop( Operation *op )
 	return LOG_EN_UNKNOWN;
 }
 
+/* Write out a run of queued log entries, in queue order */
+static void
+accesslog_write( log_info *li, Operation *op, log_rec *lr )
+{
+	Operation top = {0};
+	OpExtra *oex = NULL;
+	SlapReply rs2 = {REP_RESULT};
+	log_rec *first = lr;
+	int n = 0, rc;
+
+	top.o_hdr = op->o_hdr;
+	top.o_bd = li->li_db;
+	if ( lr->lr_next && li->li_db->bd_info->bi_op_txn ) {
+		if ( li->li_db->bd_info->bi_op_txn( &top, SLAP_TXN_BEGIN, &oex ))
+			oex = NULL;
+		else
+			LDAP_SLIST_REMOVE( &top.o_extra, oex, OpExtra, oe_next );
+	}
+
+	for ( ; lr; lr = lr->lr_next, n++ ) {
+		Operation *op2 = &lr->lr_op;
+		Entry *e = lr->lr_e;
+
+		op2->o_hdr = op->o_hdr;
+		op2->o_bd = li->li_db;
+		op2->o_tag = LDAP_REQ_ADD;
+		op2->o_dn = li->li_db->be_rootdn;
+		op2->o_ndn = li->li_db->be_rootndn;
+		op2->o_req_dn = e->e_name;
+		op2->o_req_ndn = e->e_nname;
+		op2->ora_e = e;
+		op2->o_callback = &nullsc;
+		if ( oex )
+			LDAP_SLIST_INSERT_HEAD( &op2->o_extra, oex, oe_next );
+
+		rs_reinit( &rs2, REP_RESULT );
+		op2->o_bd->be_add( op2, &rs2 );
+		lr->lr_rc = rs2.sr_err;
+		if ( oex )
+			LDAP_SLIST_REMOVE( &op2->o_extra, oex, OpExtra, oe_next );
+		if ( e == op2->ora_e ) entry_free( e );
+		lr->lr_e = NULL;
+	}
+
+	if ( oex ) {
+		rc = li->li_db->bd_info->bi_op_txn( &top, SLAP_TXN_COMMIT, &oex );
+		if ( rc ) {
+			Debug( LDAP_DEBUG_ANY, "%s accesslog_write: "
+				"commit of %d log entries failed (%d)\n",
+				op->o_log_prefix, n, rc );
+			/* none of them made it */
+			for ( lr = first; lr; lr = lr->lr_next )
+				lr->lr_rc = LDAP_OTHER;
+		}
+	}
+}
+
+/* Queue a log entry, called with li_log_mutex held so the queue stays
+ * in CSN order.
+ */
+static void
+accesslog_enqueue( log_info *li, log_rec *lr, Entry *e )
+{
+	lr->lr_e = e;
+	ldap_pvt_thread_mutex_lock( &li->li_wq_mutex );
+	lr->lr_seq = ++li->li_wq_seq;
+	*li->li_wq_tail = lr;
+	li->li_wq_tail = &lr->lr_next;
+	ldap_pvt_thread_mutex_unlock( &li->li_wq_mutex );
+}
+
+/* Wait until the given log entry has been committed. If nobody is
+ * writing, take over the head of the queue and write it ourselves, so
+ * concurrent operations share one log commit instead of taking turns.
+ * Returns the result of adding the entry, or of the commit if that
+ * failed.
+ */
+static int
+accesslog_wait( log_info *li, Operation *op, log_rec *mine )
+{
+	unsigned long seq = mine->lr_seq;
+
+	ldap_pvt_thread_mutex_lock( &li->li_wq_mutex );
+	while ( li->li_wq_done < seq ) {
+		log_rec *lr, **lp;
+		unsigned long last;
+		int i;
+
+		if ( li->li_wq_busy ) {
+			ldap_pvt_thread_cond_wait( &li->li_wq_cond, &li->li_wq_mutex );
+			continue;
+		}
+
+		lr = li->li_wq_head;
+		for ( i = 1, lp = &lr->lr_next; *lp && i < li->li_batch; i++ )
+			lp = &(*lp)->lr_next;
+		li->li_wq_head = *lp;
+		if ( !*lp )
+			li->li_wq_tail = &li->li_wq_head;
+		*lp = NULL;
+		last = lr->lr_seq + i - 1;
+		li->li_wq_busy = 1;
+		ldap_pvt_thread_mutex_unlock( &li->li_wq_mutex );
+
+		accesslog_write( li, op, lr );
+
+		ldap_pvt_thread_mutex_lock( &li->li_wq_mutex );
+		li->li_wq_done = last;
+		li->li_wq_busy = 0;
+		ldap_pvt_thread_cond_broadcast( &li->li_wq_cond );
+	}
+	ldap_pvt_thread_mutex_unlock( &li->li_wq_mutex );
+	return mine->lr_rc;
+}
+
 static int
 accesslog_response(Operation *op, SlapReply *rs)
 {
@@ -1636,9 +1826,10 @@ accesslog_response(Operation *op, SlapReply *rs)
 	struct berval bv;
 	char *ptr;
 	BerVarray vals;
-	Operation op2 = {0};
+	Operation op2 = {0}, *cop = &op2;
 	SlapReply rs2 = {REP_RESULT};
 	char csnbuf[LDAP_PVT_CSNSTR_BUFSIZE];
+	log_rec *lr = NULL, *queued = NULL;
 
 	/* ITS#9051 Make sure we only remove the callback on a final response */
 	if ( rs->sr_type != REP_RESULT && rs->sr_type != REP_EXTENDED &&
@@ -1689,6 +1880,19 @@ accesslog_response(Operation *op, SlapReply *rs)
 	op2.o_csn.bv_val = csnbuf;
 	op2.o_csn.bv_len = sizeof(csnbuf);
 
+	/* Configuring both is refused, see accesslog_batch_check(), but
+	 * syncprov could still have been added to the log DB since.
+	 */
+	if ( li->li_batch && !overlay_is_inst( li->li_db, "syncprov" )) {
+		/* the log entry's CSN is queued under the op that will write it */
+		lr = ch_calloc( 1, sizeof( log_rec ));
+		cop = &lr->lr_op;
+		cop->o_hdr = op->o_hdr;
+		cop->o_bd = li->li_db;
+		cop->o_csn.bv_val = lr->lr_csnbuf;
+		cop->o_csn.bv_len = sizeof(lr->lr_csnbuf);
+	}
+
 	if ( !( lo->mask & LOG_OP_WRITES ) ) {
 		ldap_pvt_thread_mutex_lock( &li->li_op_rmutex );
 	}
@@ -1698,7 +1902,7 @@ accesslog_response(Operation *op, SlapReply *rs)
 		 * ordering
 		 */
 		if ( !success || BER_BVISEMPTY( &op->o_csn ) ) {
-			slap_get_csn( &op2, &op2.o_csn, 1 );
+			slap_get_csn( cop, &cop->o_csn, 1 );
 		} else {
 			if ( !( lo->mask & LOG_OP_WRITES ) ) {
 				Debug( LDAP_DEBUG_ANY, "%s accesslog_response: "
@@ -1707,8 +1911,14 @@ accesslog_response(Operation *op, SlapReply *rs)
 						op->o_log_prefix, li->li_db_suffix.bv_val );
 				assert(0);
 			}
-			slap_queue_csn( &op2, &op->o_csn );
+			slap_queue_csn( cop, &op->o_csn );
+		}
+		if ( lr ) {
+			op2.o_csn.bv_len = cop->o_csn.bv_len;
+			AC_MEMCPY( csnbuf, cop->o_csn.bv_val, cop->o_csn.bv_len + 1 );
 		}
+	} else if ( lr ) {
+		BER_BVZERO( &cop->o_csn );
 	}
 
 	ldap_pvt_thread_mutex_lock( &li->li_log_mutex );
@@ -2048,13 +2258,22 @@ accesslog_response(Operation *op, SlapReply *rs)
 	/* contextCSN updates may still reach here */
 	op2.o_dont_replicate = op->o_dont_replicate;
 
-	op2.o_bd->be_add( &op2, &rs2 );
-	if ( rs2.sr_err != LDAP_SUCCESS ) {
-		Debug( LDAP_DEBUG_SYNC, "%s accesslog_response: "
-			"got result 0x%x adding log entry %s\n",
-			op->o_log_prefix, rs2.sr_err, op2.o_req_dn.bv_val );
+	if ( lr ) {
+		lr->lr_op.o_time = op2.o_time;
+		lr->lr_op.o_tincr = op2.o_tincr;
+		lr->lr_op.o_dont_replicate = op2.o_dont_replicate;
+		accesslog_enqueue( li, lr, e );
+		queued = lr;
+		lr = NULL;
+	} else {
+		op2.o_bd->be_add( &op2, &rs2 );
+		if ( rs2.sr_err != LDAP_SUCCESS ) {
+			Debug( LDAP_DEBUG_SYNC, "%s accesslog_response: "
+				"got result 0x%x adding log entry %s\n",
+				op->o_log_prefix, rs2.sr_err, op2.o_req_dn.bv_val );
+		}
+		if ( e == op2.ora_e ) entry_free( e );
 	}
-	if ( e == op2.ora_e ) entry_free( e );
 	e = NULL;
 
 	if ( ( lo->mask & LOG_OP_WRITES ) ) {
@@ -2167,6 +2386,15 @@ accesslog_response(Operation *op, SlapReply *rs)
 done:
 	ldap_pvt_thread_mutex_unlock( &li->li_log_mutex );
 	if ( old ) entry_free( old );
+	if ( queued ) {
+		int rc = accesslog_wait( li, op, queued );
+		if ( rc != LDAP_SUCCESS ) {
+			Debug( LDAP_DEBUG_ANY, "%s accesslog_response: "
+				"log entry was not written (%d)\n",
+				op->o_log_prefix, rc );
+		}
+		ch_free( queued );
+	}
 	return SLAP_CB_CONTINUE;
 
 skip:
@@ -2494,6 +2722,9 @@ accesslog_db_init(
 	on->on_bi.bi_private = li;
 	ldap_pvt_thread_mutex_recursive_init( &li->li_op_rmutex );
 	ldap_pvt_thread_mutex_init( &li->li_log_mutex );
+	ldap_pvt_thread_mutex_init( &li->li_wq_mutex );
+	ldap_pvt_thread_cond_init( &li->li_wq_cond );
+	li->li_wq_tail = &li->li_wq_head;
 	return 0;
 }
 
@@ -2519,6 +2750,8 @@ accesslog_db_destroy(
 		ber_bvarray_free( li->li_mincsn );
 	if ( li->li_db_suffix.bv_val )
 		ch_free( li->li_db_suffix.bv_val );
+	ldap_pvt_thread_cond_destroy( &li->li_wq_cond );
+	ldap_pvt_thread_mutex_destroy( &li->li_wq_mutex );
 	ldap_pvt_thread_mutex_destroy( &li->li_log_mutex );
 	ldap_pvt_thread_mutex_destroy( &li->li_op_rmutex );
 	free( li );
@@ -2712,6 +2945,10 @@ accesslog_db_open(
 			"accesslog: \"logdb <suffix>\" is this database, cannot log to itself.\n" );
 		return 1;
 	}
+	if ( accesslog_batch_check( li, cr->msg, sizeof( cr->msg ))) {
+		Debug( LDAP_DEBUG_ANY, "accesslog: %s.\n", cr->msg );
+		return 1;
+	}
 
 	if ( slapMode & SLAP_TOOL_MODE )
 		return 0;
@@ -23,10 +23,14 @@
 #ifdef SLAPD_OVER_SYNCPROV
 
 #include <ac/string.h>
+#include <ac/ctype.h>
+#include <ac/errno.h>
+#include <ac/unistd.h>
 #include "lutil.h"
 #include "slap.h"
 #include "slap-config.h"
 #include "ldap_rq.h"
+#include "../back-monitor/back-monitor.h"
 
 #ifdef LDAP_DEVEL
 #define	CHECK_CSN	1
@@ -45,6 +49,17 @@ typedef struct modtarget {
 	ldap_pvt_thread_mutex_t mt_mutex;
 } modtarget;
 
+/* An entry as encoded for the psearches of one identity that
+ * asked for the same attributes
+ */
+typedef struct syncpdu {
+	struct syncpdu *sp_next;
+	struct berval sp_ndn;
+	struct berval sp_attrs;
+	int sp_attrsonly;
+	struct berval sp_bv;
+} syncpdu;
+
 /* All the info of a psearch result that's shared between
  * multiple queues
  */
@@ -57,6 +72,8 @@ typedef struct resinfo {
 	struct berval ri_csn;
 	struct berval ri_cookie;
 	char ri_isref;
+	char ri_share;	/* ACLs only look at the identity */
+	syncpdu *ri_pdus;
 	ldap_pvt_thread_mutex_t ri_mutex;
 } resinfo;
 
@@ -87,6 +104,7 @@ typedef struct syncops {
 #define	PS_TASK_QUEUED		0x20
 
 	int		s_inuse;	/* reference count */
+	struct syncprov_eqkey *s_eqkey;	/* equality assertion the filter requires */
 	struct syncres *s_res;
 	struct syncres *s_restail;
 	void *s_pool_cookie;
@@ -113,6 +131,22 @@ typedef struct syncmatches {
 	syncops *sm_op;
 } syncmatches;
 
+/* Index of the equality assertions psearch filters require, by attribute
+ * type and matching rule index key. A write only evaluates the filters
+ * of psearches whose key occurs in the entry, or that have no key.
+ */
+typedef struct syncprov_eqkey {
+	struct syncprov_eqtype *ek_type;
+	struct berval	ek_key;
+	int		ek_refs;
+	unsigned long	ek_gen;	/* last match pass whose entry had this key */
+} syncprov_eqkey;
+
+typedef struct syncprov_eqtype {
+	AttributeType	*et_at;
+	Avlnode		*et_keys;
+} syncprov_eqtype;
+
 /* Session log data */
 typedef struct slog_entry {
 	struct berval se_uuid;
@@ -145,6 +179,16 @@ typedef struct syncprov_accesslog_deletes {
 	char *uuid_buf;
 } syncprov_accesslog_deletes;
 
+/* Statistics, published in the overlay's cn=monitor entry */
+enum {
+	SP_STAT_SENT = 0,	/* entries sent to consumers */
+	SP_STAT_SLOG_HIT,	/* refreshes served from the session log */
+	SP_STAT_SLOG_MISS,	/* refreshes that needed a present phase */
+	SP_STAT_MATCH_USEC,	/* time spent in syncprov_matchops */
+	SP_STAT_MATCH_HIST,	/* its histogram, SLAP_LATENCY_BUCKETS long */
+	SP_STAT_LAST = SP_STAT_MATCH_HIST + SLAP_LATENCY_BUCKETS
+};
+
 /* The main state for this overlay */
 typedef struct syncprov_info_t {
 	syncops		*si_ops;
@@ -165,11 +209,19 @@ typedef struct syncprov_info_t {
 #endif
 	time_t	si_chklast;	/* time of last checkpoint */
 	Avlnode	*si_mods;	/* entries being modified */
+	Avlnode	*si_eqidx;	/* psearches by required equality assertion */
+	unsigned long	si_eqgen;	/* match pass counter, under si_ops_mutex */
 	sessionlog	*si_logs;
+	ber_len_t	si_logmax;	/* bytes of sessionlog kept by the backend */
 	ldap_pvt_thread_rdwr_t	si_csn_rwlock;
 	ldap_pvt_thread_mutex_t	si_ops_mutex;
 	ldap_pvt_thread_mutex_t	si_mods_mutex;
 	ldap_pvt_thread_mutex_t	si_resp_mutex;
+	ldap_pvt_thread_mutex_t	si_eqidx_mutex;
+	slap_stats_t	*si_stats;
+	slap_rate_t	si_sent_rate;	/* used by the monitor update only */
+	void		*si_monitor_cb;
+	struct berval	si_monitor_ndn;
 } syncprov_info_t;
 
 typedef struct opcookie {
@@ -433,6 +485,202 @@ sp_avl_cmp( const void *c1, const void *c2 )
 	return ber_bvcmp( &m1->mt_dn, &m2->mt_dn );
 }
 
+static int
+sp_eqtype_cmp( const void *c1, const void *c2 )
+{
+	const syncprov_eqtype *t1 = c1, *t2 = c2;
+
+	if ( t1->et_at == t2->et_at ) return 0;
+	return t1->et_at < t2->et_at ? -1 : 1;
+}
+
+static int
+sp_eqkey_cmp( const void *c1, const void *c2 )
+{
+	const syncprov_eqkey *k1 = c1, *k2 = c2;
+	int rc;
+
+	rc = k1->ek_key.bv_len - k2->ek_key.bv_len;
+	if ( rc ) return rc;
+	return memcmp( k1->ek_key.bv_val, k2->ek_key.bv_val, k1->ek_key.bv_len );
+}
+
+/* Find an equality assertion that must hold for the filter to match.
+ * Only indexable ones qualify: the type must have no subtypes and an
+ * equality rule with an indexer, so that the rule's keys of a matching
+ * value always include the assertion's key.
+ */
+static Filter *
+syncprov_eq_find( Filter *f )
+{
+	Filter *f2, *best = NULL;
+	AttributeDescription *ad;
+	MatchingRule *mr;
+
+	switch ( f->f_choice ) {
+	case LDAP_FILTER_EQUALITY:
+		ad = f->f_av_desc;
+		mr = ad->ad_type->sat_equality;
+		if ( ad == slap_schema.si_ad_entryDN ||
+			ad == slap_schema.si_ad_hasSubordinates ||
+#ifdef LDAP_COMP_MATCH
+			f->f_ava->aa_cf ||
+#endif
+			ad->ad_type->sat_subtypes || ad->ad_flags ||
+			!BER_BVISEMPTY( &ad->ad_tags ) ||
+			!mr || !mr->smr_indexer || !mr->smr_filter )
+			return NULL;
+		return f;
+
+	case LDAP_FILTER_AND:
+		/* objectClass is rarely selective, prefer anything else */
+		for ( f2 = f->f_and; f2; f2 = f2->f_next ) {
+			Filter *fe = syncprov_eq_find( f2 );
+			if ( fe && ( !best ||
+				best->f_av_desc == slap_schema.si_ad_objectClass ))
+				best = fe;
+		}
+		return best;
+	}
+	return NULL;
+}
+
+/* Register the psearch's required equality assertion, if any.
+ * Caller must hold si_ops_mutex.
+ */
+static void
+syncprov_eqidx_add( syncprov_info_t *si, syncops *so, Filter *f )
+{
+	syncprov_eqtype *et, etmp;
+	syncprov_eqkey *ek, ektmp;
+	AttributeType *at;
+	MatchingRule *mr;
+	BerVarray keys = NULL;
+
+	f = syncprov_eq_find( f );
+	if ( !f )
+		return;
+
+	at = f->f_av_desc->ad_type;
+	mr = at->sat_equality;
+	if ( mr->smr_filter( LDAP_FILTER_EQUALITY, SLAP_INDEX_EQUALITY,
+			at->sat_syntax, mr, &at->sat_cname, &f->f_av_value,
+			&keys, NULL ) != LDAP_SUCCESS || !keys )
+		return;
+
+	/* an equality assertion yields a single key */
+	if ( BER_BVISNULL( &keys[0] ) || !BER_BVISNULL( &keys[1] )) {
+		ber_bvarray_free( keys );
+		return;
+	}
+
+	ldap_pvt_thread_mutex_lock( &si->si_eqidx_mutex );
+	etmp.et_at = at;
+	et = ldap_avl_find( si->si_eqidx, &etmp, sp_eqtype_cmp );
+	if ( !et ) {
+		et = ch_calloc( 1, sizeof( syncprov_eqtype ));
+		et->et_at = at;
+		ldap_avl_insert( &si->si_eqidx, et, sp_eqtype_cmp, ldap_avl_dup_error );
+	}
+	ektmp.ek_key = keys[0];
+	ek = ldap_avl_find( et->et_keys, &ektmp, sp_eqkey_cmp );
+	if ( !ek ) {
+		ek = ch_calloc( 1, sizeof( syncprov_eqkey ));
+		ek->ek_type = et;
+		ek->ek_key = keys[0];
+		BER_BVZERO( &keys[0] );
+		ldap_avl_insert( &et->et_keys, ek, sp_eqkey_cmp, ldap_avl_dup_error );
+	}
+	ek->ek_refs++;
+	so->s_eqkey = ek;
+	ldap_pvt_thread_mutex_unlock( &si->si_eqidx_mutex );
+
+	ber_bvarray_free( keys );
+}
+
+static void
+syncprov_eqkey_free( void *ptr )
+{
+	syncprov_eqkey *ek = ptr;
+
+	ch_free( ek->ek_key.bv_val );
+	ch_free( ek );
+}
+
+static void
+syncprov_eqidx_del( syncprov_info_t *si, syncops *so )
+{
+	syncprov_eqkey *ek = so->s_eqkey;
+	syncprov_eqtype *et;
+
+	if ( !ek )
+		return;
+	so->s_eqkey = NULL;
+
+	ldap_pvt_thread_mutex_lock( &si->si_eqidx_mutex );
+	if ( !--ek->ek_refs ) {
+		et = ek->ek_type;
+		ldap_avl_delete( &et->et_keys, ek, sp_eqkey_cmp );
+		syncprov_eqkey_free( ek );
+		if ( !et->et_keys ) {
+			ldap_avl_delete( &si->si_eqidx, et, sp_eqtype_cmp );
+			ch_free( et );
+		}
+	}
+	ldap_pvt_thread_mutex_unlock( &si->si_eqidx_mutex );
+}
+
+static void
+syncprov_eqtype_free( void *ptr )
+{
+	syncprov_eqtype *et = ptr;
+
+	ldap_avl_free( et->et_keys, syncprov_eqkey_free );
+	ch_free( et );
+}
+
+/* Start a match pass: stamp every index key the entry carries with
+ * a new generation. Caller must hold si_ops_mutex.
+ */
+static void
+syncprov_eqidx_mark( Operation *op, syncprov_info_t *si, Entry *e )
+{
+	syncprov_eqtype *et, etmp;
+	syncprov_eqkey *ek, ektmp;
+	Attribute *a;
+	BerVarray keys;
+	int i;
+
+	si->si_eqgen++;
+	if ( !e || !si->si_eqidx )
+		return;
+
+	ldap_pvt_thread_mutex_lock( &si->si_eqidx_mutex );
+	for ( a = e->e_attrs; a; a = a->a_next ) {
+		AttributeType *at = a->a_desc->ad_type;
+
+		etmp.et_at = at;
+		et = ldap_avl_find( si->si_eqidx, &etmp, sp_eqtype_cmp );
+		if ( !et )
+			continue;
+
+		keys = NULL;
+		if ( at->sat_equality->smr_indexer( LDAP_FILTER_EQUALITY,
+				SLAP_INDEX_EQUALITY, at->sat_syntax, at->sat_equality,
+				&at->sat_cname, a->a_nvals, &keys,
+				op->o_tmpmemctx ) != LDAP_SUCCESS || !keys )
+			continue;
+		for ( i = 0; !BER_BVISNULL( &keys[i] ); i++ ) {
+			ektmp.ek_key = keys[i];
+			ek = ldap_avl_find( et->et_keys, &ektmp, sp_eqkey_cmp );
+			if ( ek )
+				ek->ek_gen = si->si_eqgen;
+		}
+		ber_bvarray_free_x( keys, op->o_tmpmemctx );
+	}
+	ldap_pvt_thread_mutex_unlock( &si->si_eqidx_mutex );
+}
+
 static int
 sp_uuid_cmp( const void *l, const void *r )
 {
@@ -875,7 +1123,14 @@ static void free_resinfo( syncres *sr )
 	}
 	ldap_pvt_thread_mutex_unlock( &ri->ri_mutex );
 	if ( freeit ) {
+		syncpdu *sp;
+
 		ldap_pvt_thread_mutex_destroy( &ri->ri_mutex );
+		while (( sp = ri->ri_pdus )) {
+			ri->ri_pdus = sp->sp_next;
+			ch_free( sp->sp_bv.bv_val );
+			ch_free( sp );
+		}
 		if ( ri->ri_e )
 			entry_free( ri->ri_e );
 		if ( !BER_BVISNULL( &ri->ri_cookie ))
@@ -925,6 +1180,8 @@ syncprov_free_syncop( syncops *so, int flags )
 		}
 		ldap_pvt_thread_mutex_unlock( &so->s_si->si_ops_mutex );
 	}
+	if ( so->s_si )
+		syncprov_eqidx_del( so->s_si, so );
 	if ( so->s_flags & PS_IS_DETACHED ) {
 		filter_free( so->s_op->ors_filter );
 		for ( ga = so->s_op->o_groups; ga; ga=gnext ) {
@@ -944,6 +1201,81 @@ syncprov_free_syncop( syncops *so, int flags )
 	return FSR_DIDFREE;
 }
 
+/* Send the entry of a change, encoding it only once for all the
+ * psearches that are going to read it the same way
+ */
+static int
+syncprov_sendentry( Operation *op, SlapReply *rs, resinfo *ri )
+{
+	syncpdu *sp;
+	struct berval attrs, pdu = BER_BVNULL;
+	AttributeName *an;
+	char *ptr;
+	int rc;
+
+	if ( !ri->ri_share || op->o_vrFilter )
+		return send_search_entry( op, rs );
+
+	attrs.bv_len = 0;
+	for ( an = op->ors_attrs; an && !BER_BVISNULL( &an->an_name ); an++ )
+		attrs.bv_len += an->an_name.bv_len + 1;
+	ptr = attrs.bv_val = op->o_tmpalloc( attrs.bv_len + 1, op->o_tmpmemctx );
+	for ( an = op->ors_attrs; an && !BER_BVISNULL( &an->an_name ); an++ ) {
+		ptr = lutil_strcopy( ptr, an->an_name.bv_val );
+		*ptr++ = ',';
+	}
+	*ptr = '\0';
+
+	ldap_pvt_thread_mutex_lock( &ri->ri_mutex );
+	for ( sp = ri->ri_pdus; sp; sp = sp->sp_next ) {
+		if ( sp->sp_attrsonly == op->ors_attrsonly &&
+			dn_match( &sp->sp_ndn, &op->o_ndn ) &&
+			ber_bvcmp( &sp->sp_attrs, &attrs ) == 0 )
+			break;
+	}
+	if ( sp ) {
+		pdu = sp->sp_bv;
+	} else if ( !ri->ri_list->s_rilist ) {
+		/* nobody else is going to send it */
+		ldap_pvt_thread_mutex_unlock( &ri->ri_mutex );
+		op->o_tmpfree( attrs.bv_val, op->o_tmpmemctx );
+		return send_search_entry( op, rs );
+	}
+	ldap_pvt_thread_mutex_unlock( &ri->ri_mutex );
+
+	if ( sp )
+		Debug( LDAP_DEBUG_SYNC, "%s syncprov_sendentry: "
+			"reusing encoded entry, %lu bytes\n",
+			op->o_log_prefix, (unsigned long)pdu.bv_len );
+
+	rs->sr_pdu = &pdu;
+	rc = send_search_entry( op, rs );
+	rs->sr_pdu = NULL;
+
+	if ( !sp && !BER_BVISNULL( &pdu ) ) {
+		sp = ch_malloc( sizeof( syncpdu ) +
+			op->o_ndn.bv_len + 1 + attrs.bv_len + 1 );
+		sp->sp_ndn.bv_val = (char *)(sp + 1);
+		sp->sp_ndn.bv_len = op->o_ndn.bv_len;
+		if ( op->o_ndn.bv_len )
+			AC_MEMCPY( sp->sp_ndn.bv_val, op->o_ndn.bv_val, op->o_ndn.bv_len );
+		sp->sp_ndn.bv_val[sp->sp_ndn.bv_len] = '\0';
+		sp->sp_attrs.bv_val = sp->sp_ndn.bv_val + sp->sp_ndn.bv_len + 1;
+		sp->sp_attrs.bv_len = attrs.bv_len;
+		AC_MEMCPY( sp->sp_attrs.bv_val, attrs.bv_val, attrs.bv_len + 1 );
+		sp->sp_attrsonly = op->ors_attrsonly;
+		sp->sp_bv = pdu;
+
+		ldap_pvt_thread_mutex_lock( &ri->ri_mutex );
+		sp->sp_next = ri->ri_pdus;
+		ri->ri_pdus = sp;
+		ldap_pvt_thread_mutex_unlock( &ri->ri_mutex );
+	}
+	op->o_tmpfree( attrs.bv_val, op->o_tmpmemctx );
+
+	return rc;
+}
+
 /* Send a persistent search response */
 static int
 syncprov_sendresp( Operation *op, resinfo *ri, syncops *so, int mode )
@@ -1002,7 +1334,7 @@ syncprov_sendresp( Operation *op, resinfo *ri, syncops *so, int mode )
 			mode == LDAP_SYNC_ADD ? "LDAP_SYNC_ADD" : "LDAP_SYNC_MODIFY",
 			e_uuid.e_nname.bv_val );
 		rs.sr_attrs = op->ors_attrs;
-		rs.sr_err = send_search_entry( op, &rs );
+		rs.sr_err = syncprov_sendentry( op, &rs, ri );
 		break;
 	case LDAP_SYNC_DELETE:
 		Debug( LDAP_DEBUG_SYNC, "%s syncprov_sendresp: "
@@ -1022,6 +1354,8 @@ syncprov_sendresp( Operation *op, resinfo *ri, syncops *so, int mode )
 	default:
 		assert(0);
 	}
+	if ( rs.sr_err == LDAP_SUCCESS && so->s_si )
+		slap_stats_add( so->s_si->si_stats, SP_STAT_SENT, 1 );
 	return rs.sr_err;
 }
 
@@ -1225,6 +1559,8 @@ syncprov_qresp( opcookie *opc, syncops *so, int mode )
 		ri->ri_e = opc->se;
 		ri->ri_csn.bv_len = csn.bv_len;
 		ri->ri_isref = opc->sreference;
+		ri->ri_share = ri->ri_e && acl_identity_only( so->s_op->o_bd );
+		ri->ri_pdus = NULL;
 		BER_BVZERO( &ri->ri_cookie );
 		ldap_pvt_thread_mutex_init( &ri->ri_mutex );
 		opc->se = NULL;
@@ -1350,6 +1686,7 @@ syncprov_matchops( Operation *op, opcookie *opc, int saveit )
 	Attribute *a;
 	int rc, gonext;
 	BackendDB *b0 = op->o_bd, db;
+	unsigned long t0 = slap_phase_now();
 
 	fc.fdn = saveit ? &op->o_req_ndn : &opc->sndn;
 	if ( !saveit && op->o_tag == LDAP_REQ_DELETE ) {
@@ -1401,6 +1738,7 @@ syncprov_matchops( Operation *op, opcookie *opc, int saveit )
 	}
 
 	ldap_pvt_thread_mutex_lock( &si->si_ops_mutex );
+	syncprov_eqidx_mark( op, si, e );
 	for (pss = &si->si_ops; *pss; pss = gonext ? &(*pss)->s_next : pss)
 	{
 		Operation op2;
@@ -1469,8 +1807,11 @@ syncprov_matchops( Operation *op, opcookie *opc, int saveit )
 			}
 		}
 
+		/* The filter can't match if the entry lacks its required
+		 * equality assertion, see syncprov_eqidx_mark() */
 		rc = LDAP_COMPARE_FALSE;
-		if ( e && !is_entry_glue( e ) && fc.fscope ) {
+		if ( e && !is_entry_glue( e ) && fc.fscope &&
+			( !ss->s_eqkey || ss->s_eqkey->ek_gen == si->si_eqgen )) {
 			ldap_pvt_thread_mutex_lock( &ss->s_mutex );
 			op2 = *ss->s_op;
 			oh = *op->o_hdr;
@@ -1543,6 +1884,11 @@ syncprov_matchops( Operation *op, opcookie *opc, int saveit )
 			entry_free( opc->se );
 	}
 	op->o_bd = b0;
+
+	t0 = slap_phase_now() - t0;
+	slap_stats_add( si->si_stats, SP_STAT_MATCH_USEC, t0 );
+	slap_stats_add( si->si_stats,
+		SP_STAT_MATCH_HIST + slap_latency_bucket( t0 ), 1 );
 }
 
 static int
@@ -1684,6 +2030,42 @@ syncprov_checkpoint( Operation *op, slap_overinst *on )
 #endif
 }
 
+/* Drop the oldest entries beyond sl_size, caller holds sl_mutex */
+static void
+syncprov_sessionlog_expire( sessionlog *sl, const char *prefix )
+{
+	TAvlnode *edge = ldap_tavl_end( sl->sl_entries, TAVL_DIR_LEFT );
+	slog_entry *se;
+
+	while ( sl->sl_num > sl->sl_size ) {
+		int i;
+		TAvlnode *next = ldap_tavl_next( edge, TAVL_DIR_RIGHT );
+		se = edge->avl_data;
+		Debug( LDAP_DEBUG_SYNC, "%s syncprov_sessionlog_expire: "
+			"expiring csn=%s from sessionlog (sessionlog size=%d)\n",
+			prefix, se->se_csn.bv_val, sl->sl_num );
+		for ( i=0; i<sl->sl_numcsns; i++ )
+			if ( sl->sl_sids[i] >= se->se_sid )
+				break;
+		if  ( i == sl->sl_numcsns || sl->sl_sids[i] != se->se_sid ) {
+			Debug( LDAP_DEBUG_SYNC, "%s syncprov_sessionlog_expire: "
+				"adding csn=%s to mincsn\n",
+				prefix, se->se_csn.bv_val );
+			slap_insert_csn_sids( (struct sync_cookie *)sl,
+				i, se->se_sid, &se->se_csn );
+		} else {
+			Debug( LDAP_DEBUG_SYNC, "%s syncprov_sessionlog_expire: "
+				"updating mincsn for sid=%d csn=%s to %s\n",
+				prefix, se->se_sid, sl->sl_mincsn[i].bv_val, se->se_csn.bv_val );
+			ber_bvreplace( &sl->sl_mincsn[i], &se->se_csn );
+		}
+		ldap_tavl_delete( &sl->sl_entries, se, syncprov_sessionlog_cmp );
+		ch_free( se );
+		edge = next;
+		sl->sl_num--;
+	}
+}
+
 static void
 syncprov_add_slog( Operation *op )
 {
@@ -1759,36 +2141,8 @@ syncprov_add_slog( Operation *op )
 			goto leave;
 		}
 		sl->sl_num++;
-		if ( !sl->sl_playing && sl->sl_num > sl->sl_size ) {
-			TAvlnode *edge = ldap_tavl_end( sl->sl_entries, TAVL_DIR_LEFT );
-			while ( sl->sl_num > sl->sl_size ) {
-				int i;
-				TAvlnode *next = ldap_tavl_next( edge, TAVL_DIR_RIGHT );
-				se = edge->avl_data;
-				Debug( LDAP_DEBUG_SYNC, "%s syncprov_add_slog: "
-					"expiring csn=%s from sessionlog (sessionlog size=%d)\n",
-					op->o_log_prefix, se->se_csn.bv_val, sl->sl_num );
-				for ( i=0; i<sl->sl_numcsns; i++ )
-					if ( sl->sl_sids[i] >= se->se_sid )
-						break;
-				if  ( i == sl->sl_numcsns || sl->sl_sids[i] != se->se_sid ) {
-					Debug( LDAP_DEBUG_SYNC, "%s syncprov_add_slog: "
-						"adding csn=%s to mincsn\n",
-						op->o_log_prefix, se->se_csn.bv_val );
-					slap_insert_csn_sids( (struct sync_cookie *)sl,
-						i, se->se_sid, &se->se_csn );
-				} else {
-					Debug( LDAP_DEBUG_SYNC, "%s syncprov_add_slog: "
-						"updating mincsn for sid=%d csn=%s to %s\n",
-						op->o_log_prefix, se->se_sid, sl->sl_mincsn[i].bv_val, se->se_csn.bv_val );
-					ber_bvreplace( &sl->sl_mincsn[i], &se->se_csn );
-				}
-				ldap_tavl_delete( &sl->sl_entries, se, syncprov_sessionlog_cmp );
-				ch_free( se );
-				edge = next;
-				sl->sl_num--;
-			}
-		}
+		if ( !sl->sl_playing && sl->sl_num > sl->sl_size )
+			syncprov_sessionlog_expire( sl, op->o_log_prefix );
 leave:
 		ldap_pvt_thread_rdwr_wunlock( &sl->sl_mutex );
 	}
@@ -2606,7 +2960,9 @@ syncprov_op_response( Operation *op, SlapReply *rs )
 
 		if ( csn_changed )
 			si->si_numops++;
-		if ( si->si_chkops || si->si_chktime ) {
+		/* Nothing to checkpoint if the backend already keeps it */
+		if (( si->si_chkops || si->si_chktime ) &&
+			!SLAP_DBCTXCSN( op->o_bd )) {
 			/* Never checkpoint adding the context entry,
 			 * it will deadlock
 			 */
@@ -3073,6 +3429,7 @@ syncprov_search_response( Operation *op, SlapReply *rs )
 			rs->sr_err = syncprov_state_ctrl( op, rs, rs->sr_entry,
 				LDAP_SYNC_ADD, rs->sr_ctrls, 0, 0, NULL );
 		}
+		slap_stats_add( si->si_stats, SP_STAT_SENT, 1 );
 	} else if ( rs->sr_type == REP_RESULT && rs->sr_err == LDAP_SUCCESS ) {
 		struct berval cookie = BER_BVNULL;
 
@@ -3277,6 +3634,7 @@ aband:
 		sop->s_next = si->si_ops;
 		sop->s_si = si;
 		si->si_ops = sop;
+		syncprov_eqidx_add( si, sop, op->ors_filter );
 		ldap_pvt_thread_mutex_unlock( &si->si_ops_mutex );
 		Debug( LDAP_DEBUG_SYNC, "%s syncprov_op_search: "
 			"registered persistent search\n", op->o_log_prefix );
@@ -3399,6 +3757,7 @@ bailout:
 						}
 					}
 					ldap_pvt_thread_mutex_unlock( &si->si_ops_mutex );
+					syncprov_eqidx_del( si, sop );
 					ch_free( sop->s_base.bv_val );
 					ch_free( sop );
 				}
@@ -3448,12 +3807,16 @@ no_change:	if ( !(op->o_sync_mode & SLAP_SYNC_PERSIST) ) {
 					numcsns, sids, &mincsn, minsid ) ) {
 				do_present = SS_PRESENT;
 			}
+			slap_stats_add( si->si_stats, do_present ?
+				SP_STAT_SLOG_MISS : SP_STAT_SLOG_HIT, 1 );
 		} else if ( si->si_logs ) {
 			do_present = 0;
 			if ( syncprov_play_sessionlog( op, rs, srs, ctxcsn,
 					numcsns, sids, &mincsn, minsid ) ) {
 				do_present = SS_PRESENT;
 			}
+			slap_stats_add( si->si_stats, do_present ?
+				SP_STAT_SLOG_MISS : SP_STAT_SLOG_HIT, 1 );
 		} else if ( ad_minCSN != NULL && si->si_nopres && si->si_usehint ) {
 			/* We are instructed to trust minCSN if it exists. */
 			Entry *e;
@@ -3740,12 +4103,95 @@ syncprov_setup_accesslog(void)
 	return LDAP_SUCCESS;
 }
 
+typedef struct slog_load {
+	TAvlnode	*sd_entries;
+	int		sd_num;
+} slog_load;
+
+static int
+syncprov_sessionlog_load_cb( void *arg, struct berval *csn,
+	struct berval *uuid, ber_tag_t tag )
+{
+	slog_load *sd = arg;
+	slog_entry *se;
+
+	se = ch_malloc( sizeof( slog_entry ) + uuid->bv_len + csn->bv_len + 1 );
+	se->se_tag = tag;
+	se->se_uuid.bv_val = (char *)(&se[1]);
+	AC_MEMCPY( se->se_uuid.bv_val, uuid->bv_val, uuid->bv_len );
+	se->se_uuid.bv_len = uuid->bv_len;
+	se->se_csn.bv_val = se->se_uuid.bv_val + uuid->bv_len;
+	AC_MEMCPY( se->se_csn.bv_val, csn->bv_val, csn->bv_len );
+	se->se_csn.bv_val[csn->bv_len] = '\0';
+	se->se_csn.bv_len = csn->bv_len;
+	se->se_sid = slap_parse_csn_sid( &se->se_csn );
+	if ( ldap_tavl_insert( &sd->sd_entries, se, syncprov_sessionlog_cmp,
+			ldap_avl_dup_error )) {
+		ch_free( se );
+		return 0;
+	}
+	sd->sd_num++;
+	return 0;
+}
+
+/* Read back the sessionlog the backend keeps with its writes, or let
+ * it start one from the current contextCSN. The mincsn it kept replaces
+ * the contextCSN the log was initialized with.
+ */
+static void
+syncprov_sessionlog_load( Operation *op, slap_overinst *on )
+{
+	syncprov_info_t *si = on->on_bi.bi_private;
+	sessionlog *sl = si->si_logs;
+	slog_load sd = { NULL, 0 };
+	BerVarray mincsn = NULL;
+	int i, j, sid, num;
+
+	if ( on->on_info->oi_orig->bi_op_sessionlog( op, si->si_ctxcsn, &mincsn,
+			syncprov_sessionlog_load_cb, &sd ) != LDAP_SUCCESS ) {
+		ldap_tavl_free( sd.sd_entries, (AVL_FREE)ch_free );
+		return;
+	}
+	if ( !sd.sd_num ) {
+		ber_bvarray_free( mincsn );
+		return;
+	}
+
+	ldap_pvt_thread_rdwr_wlock( &sl->sl_mutex );
+	ldap_tavl_free( sl->sl_entries, (AVL_FREE)ch_free );
+	sl->sl_entries = sd.sd_entries;
+	sl->sl_num = sd.sd_num;
+	for ( i = 0; mincsn && !BER_BVISNULL( &mincsn[i] ); i++ ) {
+		sid = slap_parse_csn_sid( &mincsn[i] );
+		for ( j = 0; j < sl->sl_numcsns; j++ ) {
+			if ( sid <= sl->sl_sids[j] )
+				break;
+		}
+		if ( j < sl->sl_numcsns && sid == sl->sl_sids[j] )
+			ber_bvreplace( &sl->sl_mincsn[j], &mincsn[i] );
+		else
+			slap_insert_csn_sids( (struct sync_cookie *)sl,
+				j, sid, &mincsn[i] );
+	}
+	/* sessionlog may have been made smaller, keep the newest entries */
+	if ( sl->sl_num > sl->sl_size )
+		syncprov_sessionlog_expire( sl, op->o_log_prefix );
+	num = sl->sl_num;
+	ldap_pvt_thread_rdwr_wunlock( &sl->sl_mutex );
+	ber_bvarray_free( mincsn );
+
+	Debug( LDAP_DEBUG_SYNC, "syncprov_sessionlog_load: "
+		"loaded %d sessionlog entries for suffix %s\n",
+		num, op->o_bd->be_suffix[0].bv_val );
+}
+
 enum {
 	SP_CHKPT = 1,
 	SP_SESSL,
 	SP_NOPRES,
 	SP_USEHINT,
-	SP_LOGDB
+	SP_LOGDB,
+	SP_LOGMAX
 };
 
 static ConfigDriver sp_cf_gen;
@@ -3775,6 +4221,11 @@ static ConfigTable spcfg[] = {
 		sp_cf_gen, "( OLcfgOvAt:1.5 NAME 'olcSpSessionlogSource' "
 			"DESC 'On startup, try loading sessionlog from this subtree' "
 			"SYNTAX OMsDN SINGLE-VALUE )", NULL, NULL },
+	{ "syncprov-sessionlog-maxsize", "bytes", 2, 2, 0, ARG_BER_LEN_T|ARG_MAGIC|SP_LOGMAX,
+		sp_cf_gen, "( OLcfgOvAt:1.6 NAME 'olcSpSessionlogMaxSize' "
+			"DESC 'Keep up to this many bytes of session log in the database' "
+			"EQUALITY integerMatch "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ NULL, NULL, 0, 0, 0, ARG_IGNORED }
 };
 
@@ -3788,6 +4239,7 @@ static ConfigOCs spocs[] = {
 			"$ olcSpNoPresent "
 			"$ olcSpReloadHint "
 			"$ olcSpSessionlogSource "
+			"$ olcSpSessionlogMaxSize "
 		") )",
 			Cft_Overlay, spcfg },
 	{ NULL, 0, NULL }
@@ -3849,6 +4301,13 @@ sp_cf_gen(ConfigArgs *c)
 				value_add_one( &c->rvalue_nvals, &si->si_logbase );
 			}
 			break;
+		case SP_LOGMAX:
+			if ( si->si_logmax ) {
+				c->value_ber_t = si->si_logmax;
+			} else {
+				rc = 1;
+			}
+			break;
 		}
 		return rc;
 	} else if ( c->op == LDAP_MOD_DELETE ) {
@@ -3873,6 +4332,11 @@ sp_cf_gen(ConfigArgs *c)
 				BER_BVZERO( &si->si_logbase );
 			}
 			break;
+		case SP_LOGMAX:
+			/* writes from now on are not logged, the backend drops its log */
+			si->si_logmax = 0;
+			SLAP_DBFLAGS( c->be->bd_self ) &= ~SLAP_DBFLAG_SESSIONLOG;
+			break;
 		}
 		return rc;
 	}
@@ -3966,10 +4430,309 @@ sp_cf_gen(ConfigArgs *c)
 		rc = syncprov_setup_accesslog();
 		ch_free( c->value_dn.bv_val );
 		break;
+	case SP_LOGMAX:
+		if ( !c->value_ber_t ) {
+			snprintf( c->cr_msg, sizeof( c->cr_msg ), "%s size must be positive",
+				c->argv[0] );
+			Debug( LDAP_DEBUG_CONFIG|LDAP_DEBUG_NONE,
+				"%s: %s\n", c->log, c->cr_msg );
+			return ARG_BAD_CONF;
+		}
+		/* only a new bound here, logging starts when the database opens */
+		si->si_logmax = c->value_ber_t;
+		c->be->bd_self->be_slog_max = si->si_logmax;
+		break;
 	}
 	return rc;
 }
 
+static ObjectClass *oc_olmSyncProv;
+static AttributeDescription *ad_olmSPEntriesSent, *ad_olmSPSendRate,
+	*ad_olmSPSessionlogHits, *ad_olmSPSessionlogMisses, *ad_olmSPMatchTime;
+
+static struct {
+	char *name;
+	char *oid;
+} sp_oid[] = {
+	{ "olmSyncProvAttributes",	"olmOverlayAttributes:2" },
+	{ "olmSyncProvObjectClasses", "olmOverlayObjectClasses:2" },
+	{ NULL }
+};
+
+static struct {
+	char *desc;
+	AttributeDescription **ad;
+} sp_at[] = {
+	{ "( olmSyncProvAttributes:1 "
+		"NAME ( 'olmSPEntriesSent' ) "
+		"DESC 'Number of entries sent to consumers' "
+		"SUP monitorCounter "
+		"SINGLE-VALUE "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmSPEntriesSent },
+	{ "( olmSyncProvAttributes:2 "
+		"NAME ( 'olmSPSendRate' ) "
+		"DESC 'Entries sent to consumers per second' "
+		"EQUALITY integerMatch "
+		"ORDERING integerOrderingMatch "
+		"SYNTAX 1.3.6.1.4.1.1466.115.121.1.27 "
+		"SINGLE-VALUE "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmSPSendRate },
+	{ "( olmSyncProvAttributes:3 "
+		"NAME ( 'olmSPSessionlogHits' ) "
+		"DESC 'Number of refreshes served from the session log' "
+		"SUP monitorCounter "
+		"SINGLE-VALUE "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmSPSessionlogHits },
+	{ "( olmSyncProvAttributes:4 "
+		"NAME ( 'olmSPSessionlogMisses' ) "
+		"DESC 'Number of refreshes the session log could not serve' "
+		"SUP monitorCounter "
+		"SINGLE-VALUE "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmSPSessionlogMisses },
+	{ "( olmSyncProvAttributes:5 "
+		"NAME ( 'olmSPMatchTime' ) "
+		"DESC 'Histogram of time spent matching writes against persistent searches' "
+		"SUP monitoredInfo "
+		"SINGLE-VALUE "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmSPMatchTime },
+	{ NULL }
+};
+
+static struct {
+	char *desc;
+	ObjectClass **oc;
+} sp_oc[] = {
+	/* augments the overlay's entry, so it must be AUXILIARY */
+	{ "( olmSyncProvObjectClasses:1 "
+		"NAME ( 'olmSyncProv' ) "
+		"SUP top AUXILIARY "
+		"MAY ( "
+			"olmSPEntriesSent "
+			"$ olmSPSendRate "
+			"$ olmSPSessionlogHits "
+			"$ olmSPSessionlogMisses "
+			"$ olmSPMatchTime "
+			") )",
+		&oc_olmSyncProv },
+	{ NULL }
+};
+
+static int
+syncprov_monitor_initialize( void )
+{
+	static int syncprov_monitor_initialized;
+	ConfigArgs c;
+	char *argv[3];
+	int i, code;
+
+	if ( backend_info( "monitor" ) == NULL )
+		return -1;
+
+	if ( syncprov_monitor_initialized++ )
+		return 0;
+
+	argv[ 0 ] = "syncprov monitor";
+	c.argv = argv;
+	c.argc = 3;
+	c.fname = argv[0];
+	for ( i = 0; sp_oid[i].name; i++ ) {
+		c.lineno = i;
+		argv[1] = sp_oid[i].name;
+		argv[2] = sp_oid[i].oid;
+		if ( parse_oidm( &c, 0, NULL )) {
+			Debug( LDAP_DEBUG_ANY, "syncprov_monitor_initialize: "
+				"unable to add objectIdentifier \"%s=%s\"\n",
+				sp_oid[i].name, sp_oid[i].oid );
+			return 1;
+		}
+	}
+
+	for ( i = 0; sp_at[i].desc; i++ ) {
+		code = register_at( sp_at[i].desc, sp_at[i].ad, 1 );
+		if ( code != LDAP_SUCCESS ) {
+			Debug( LDAP_DEBUG_ANY, "syncprov_monitor_initialize: "
+				"register_at failed for attributeType (%s)\n",
+				sp_at[i].desc );
+			return 2;
+		}
+		(*sp_at[i].ad)->ad_type->sat_flags |= SLAP_AT_HIDE;
+	}
+
+	for ( i = 0; sp_oc[i].desc; i++ ) {
+		code = register_oc( sp_oc[i].desc, sp_oc[i].oc, 1 );
+		if ( code != LDAP_SUCCESS ) {
+			Debug( LDAP_DEBUG_ANY, "syncprov_monitor_initialize: "
+				"register_oc failed for objectClass (%s)\n",
+				sp_oc[i].desc );
+			return 3;
+		}
+		(*sp_oc[i].oc)->soc_flags |= SLAP_OC_HIDE;
+	}
+
+	return 0;
+}
+
+static int
+syncprov_monitor_update(
+	Operation *op,
+	SlapReply *rs,
+	Entry *e,
+	void *priv )
+{
+	syncprov_info_t *si = priv;
+	slap_latency_t sl = { 0 };
+	char buf[ 64 + SLAP_LATENCY_BUCKETS * 21 ];
+	struct berval bv;
+	slap_counter_t sent;
+	int i;
+
+	bv.bv_val = buf;
+
+	sent = slap_stats_get( si->si_stats, SP_STAT_SENT );
+	attr_delete( &e->e_attrs, ad_olmSPEntriesSent );
+	bv.bv_len = snprintf( buf, sizeof( buf ), "%llu", (unsigned long long)sent );
+	attr_merge_normalize_one( e, ad_olmSPEntriesSent, &bv, NULL );
+
+	attr_delete( &e->e_attrs, ad_olmSPSendRate );
+	bv.bv_len = snprintf( buf, sizeof( buf ), "%lu",
+		slap_rate_update( &si->si_sent_rate, sent, slap_get_time() ));
+	attr_merge_normalize_one( e, ad_olmSPSendRate, &bv, NULL );
+
+	attr_delete( &e->e_attrs, ad_olmSPSessionlogHits );
+	bv.bv_len = snprintf( buf, sizeof( buf ), "%llu", (unsigned long long)
+		slap_stats_get( si->si_stats, SP_STAT_SLOG_HIT ));
+	attr_merge_normalize_one( e, ad_olmSPSessionlogHits, &bv, NULL );
+
+	attr_delete( &e->e_attrs, ad_olmSPSessionlogMisses );
+	bv.bv_len = snprintf( buf, sizeof( buf ), "%llu", (unsigned long long)
+		slap_stats_get( si->si_stats, SP_STAT_SLOG_MISS ));
+	attr_merge_normalize_one( e, ad_olmSPSessionlogMisses, &bv, NULL );
+
+	for ( i = 0; i < SLAP_LATENCY_BUCKETS; i++ ) {
+		sl.sl_hist[i] = slap_stats_get( si->si_stats, SP_STAT_MATCH_HIST + i );
+		sl.sl_count += sl.sl_hist[i];
+	}
+	sl.sl_usec = slap_stats_get( si->si_stats, SP_STAT_MATCH_USEC );
+	attr_delete( &e->e_attrs, ad_olmSPMatchTime );
+	if ( sl.sl_count ) {
+		bv.bv_len = slap_latency2str( &sl, buf, sizeof( buf ));
+		attr_merge_normalize_one( e, ad_olmSPMatchTime, &bv, NULL );
+	}
+
+	return SLAP_CB_CONTINUE;
+}
+
+static int
+syncprov_monitor_free(
+	Entry *e,
+	void **priv )
+{
+	struct berval values[ 2 ];
+	Modification mod = { 0 };
+	const char *text;
+	char textbuf[ SLAP_TEXT_BUFLEN ];
+	int i;
+
+	/* NOTE: if slap_shutdown != 0, priv might have already been freed */
+	*priv = NULL;
+
+	mod.sm_op = LDAP_MOD_DELETE;
+	mod.sm_desc = slap_schema.si_ad_objectClass;
+	mod.sm_values = values;
+	mod.sm_numvals = 1;
+	values[ 0 ] = oc_olmSyncProv->soc_cname;
+	BER_BVZERO( &values[ 1 ] );
+	(void)modify_delete_values( e, &mod, 1, &text,
+		textbuf, sizeof( textbuf ) );
+
+	for ( i = 0; sp_at[i].desc; i++ )
+		attr_delete( &e->e_attrs, *sp_at[i].ad );
+
+	return SLAP_CB_CONTINUE;
+}
+
+static int
+syncprov_monitor_db_open( BackendDB *be )
+{
+	slap_overinst *on = (slap_overinst *)be->bd_info;
+	syncprov_info_t *si = on->on_bi.bi_private;
+	monitor_callback_t *cb;
+	BackendInfo *mi;
+	monitor_extra_t *mbe;
+	Attribute *a;
+	int rc;
+
+	if ( !SLAP_DBMONITORING( be ))
+		return 0;
+
+	mi = backend_info( "monitor" );
+	if ( !mi || !mi->bi_extra ) {
+		SLAP_DBFLAGS( be ) ^= SLAP_DBFLAG_MONITORING;
+		return 0;
+	}
+	mbe = mi->bi_extra;
+
+	/* don't bother if monitor is not configured */
+	if ( !mbe->is_configured() )
+		return 0;
+
+	/* the values are filled in by syncprov_monitor_update() */
+	a = attrs_alloc( 1 );
+	a->a_desc = slap_schema.si_ad_objectClass;
+	attr_valadd( a, &oc_olmSyncProv->soc_cname, NULL, 1 );
+
+	cb = ch_calloc( sizeof( monitor_callback_t ), 1 );
+	cb->mc_update = syncprov_monitor_update;
+	cb->mc_free = syncprov_monitor_free;
+	cb->mc_private = (void *)si;
+
+	BER_BVZERO( &si->si_monitor_ndn );
+	rc = mbe->register_overlay( be, on, &si->si_monitor_ndn );
+	if ( rc == 0 ) {
+		rc = mbe->register_entry_attrs( &si->si_monitor_ndn, a, cb,
+			NULL, -1, NULL );
+	}
+	if ( rc ) {
+		ch_free( cb );
+		cb = NULL;
+	}
+	si->si_monitor_cb = cb;
+	attrs_free( a );
+
+	return rc;
+}
+
+static void
+syncprov_monitor_db_close( BackendDB *be )
+{
+	slap_overinst *on = (slap_overinst *)be->bd_info;
+	syncprov_info_t *si = on->on_bi.bi_private;
+
+	if ( si->si_monitor_cb && !BER_BVISNULL( &si->si_monitor_ndn )) {
+		BackendInfo *mi = backend_info( "monitor" );
+
+		if ( mi && mi->bi_extra ) {
+			monitor_extra_t *mbe = mi->bi_extra;
+			struct berval dummy = BER_BVNULL;
+
+			mbe->unregister_entry_callback( &si->si_monitor_ndn,
+				(monitor_callback_t *)si->si_monitor_cb,
+				&dummy, 0, &dummy );
+		}
+		si->si_monitor_cb = NULL;
+	}
+}
+
 /* ITS#3456 we cannot run this search on the main thread, must use a
  * child thread in order to insure we have a big enough stack.
  */
@@ -4066,6 +4829,8 @@ syncprov_db_open(
 		"starting syncprov for suffix %s\n",
 		be->be_suffix[0].bv_val );
 
+	syncprov_monitor_db_open( be );
+
 	thrctx = ldap_pvt_thread_pool_context();
 	connection_fake_init2( &conn, &opbuf, thrctx, 0 );
 	op = &opbuf.ob_op;
@@ -4079,6 +4844,19 @@ syncprov_db_open(
 	} else {
 		si->si_contextdn = be->be_nsuffix[0];
 	}
+
+	/* Let the backend keep the contextCSN with its own writes, unless
+	 * the changes may also land in glued databases */
+	if ( on->on_info->oi_orig->bi_op_ctxcsn && !SLAP_GLUE_INSTANCE( be ))
+		SLAP_DBFLAGS( be->bd_self ) |= SLAP_DBFLAG_CTXCSN;
+
+	/* Likewise the sessionlog, if it is to be kept across restarts */
+	if ( si->si_logs && si->si_logmax &&
+		on->on_info->oi_orig->bi_op_sessionlog && !SLAP_GLUE_INSTANCE( be )) {
+		be->bd_self->be_slog_max = si->si_logmax;
+		SLAP_DBFLAGS( be->bd_self ) |= SLAP_DBFLAG_SESSIONLOG;
+	}
+
 	rc = overlay_entry_get_ov( op, &si->si_contextdn, NULL,
 		slap_schema.si_ad_contextCSN, 0, &e, on );
 
@@ -4093,7 +4871,8 @@ syncprov_db_open(
 			slap_sort_csn_sids( si->si_ctxcsn, si->si_sids, si->si_numcsns, NULL );
 		}
 		overlay_entry_release_ov( op, e, 0, on );
-		if ( si->si_ctxcsn && !SLAP_DBCLEAN( be )) {
+		if ( si->si_ctxcsn && !SLAP_DBCLEAN( be ) &&
+			!SLAP_DBCTXCSN( be->bd_self )) {
 			op->o_tag = LDAP_REQ_SEARCH;
 			op->o_req_dn = be->be_suffix[0];
 			op->o_req_ndn = be->be_nsuffix[0];
@@ -4103,6 +4882,36 @@ syncprov_db_open(
 		}
 	}
 
+	/* The backend may have newer CSNs than the last checkpoint */
+	if ( SLAP_DBCTXCSN( be->bd_self )) {
+		BerVarray csns = NULL;
+		int i, j, sid;
+
+		if ( on->on_info->oi_orig->bi_op_ctxcsn( op, &csns ) == LDAP_SUCCESS
+			&& csns ) {
+			for ( i = 0; !BER_BVISNULL( &csns[i] ); i++ ) {
+				sid = slap_parse_csn_sid( &csns[i] );
+				for ( j = 0; j < si->si_numcsns; j++ ) {
+					if ( sid <= si->si_sids[j] )
+						break;
+				}
+				if ( j < si->si_numcsns && sid == si->si_sids[j] ) {
+					if ( ber_bvcmp( &csns[i], &si->si_ctxcsn[j] ) > 0 )
+						ber_bvreplace( &si->si_ctxcsn[j], &csns[i] );
+				} else {
+					slap_insert_csn_sids( (struct sync_cookie *)&si->si_ctxcsn,
+						j, sid, &csns[i] );
+				}
+				Debug( LDAP_DEBUG_SYNC, "syncprov_db_open: "
+					"backend ctxcsn=%s for suffix %s\n",
+					csns[i].bv_val, be->be_suffix[0].bv_val );
+			}
+			ber_bvarray_free( csns );
+			/* write the merged values out on close */
+			si->si_numops++;
+		}
+	}
+
 	/* Didn't find a contextCSN, should we generate one? */
 	if ( !si->si_ctxcsn ) {
 		char csnbuf[ LDAP_PVT_CSNSTR_BUFSIZE ];
@@ -4155,6 +4964,9 @@ syncprov_db_open(
 		sl->sl_sids = ch_malloc( si->si_numcsns * sizeof(int) );
 		for ( i=0; i < si->si_numcsns; i++ )
 			sl->sl_sids[i] = si->si_sids[i];
+
+		if ( SLAP_DBSESSIONLOG( be->bd_self ))
+			syncprov_sessionlog_load( op, on );
 	}
 
 	if ( !BER_BVISNULL( &si->si_logbase ) ) {
@@ -4189,6 +5001,7 @@ syncprov_db_close(
 	if ( slapMode & SLAP_TOOL_MODE ) {
 		return 0;
 	}
+	syncprov_monitor_db_close( be );
 	if ( si->si_numops ) {
 		Connection conn = {0};
 		OperationBuffer opbuf;
@@ -4203,6 +5016,7 @@ syncprov_db_close(
 		op->o_ndn = be->be_rootndn;
 		syncprov_checkpoint( op, on );
 	}
+	SLAP_DBFLAGS( be->bd_self ) &= ~(SLAP_DBFLAG_CTXCSN|SLAP_DBFLAG_SESSIONLOG);
 
 #ifdef SLAP_CONFIG_DELETE
 	if ( !slapd_shutdown ) {
@@ -4249,6 +5063,11 @@ syncprov_db_init(
 	ldap_pvt_thread_mutex_init( &si->si_ops_mutex );
 	ldap_pvt_thread_mutex_init( &si->si_mods_mutex );
 	ldap_pvt_thread_mutex_init( &si->si_resp_mutex );
+	ldap_pvt_thread_mutex_init( &si->si_eqidx_mutex );
+	si->si_stats = slap_stats_alloc( SP_STAT_LAST );
+
+	if ( syncprov_monitor_initialize() == LDAP_SUCCESS )
+		SLAP_DBFLAGS( be ) |= SLAP_DBFLAG_MONITORING;
 
 	csn_anlist[0].an_desc = slap_schema.si_ad_entryCSN;
 	csn_anlist[0].an_name = slap_schema.si_ad_entryCSN->ad_cname;
@@ -4289,6 +5108,9 @@ syncprov_db_destroy(
 			ch_free( si->si_sids );
 		if ( si->si_logbase.bv_val )
 			ch_free( si->si_logbase.bv_val );
+		ldap_avl_free( si->si_eqidx, syncprov_eqtype_free );
+		slap_stats_free( si->si_stats );
+		ldap_pvt_thread_mutex_destroy( &si->si_eqidx_mutex );
 		ldap_pvt_thread_mutex_destroy( &si->si_resp_mutex );
 		ldap_pvt_thread_mutex_destroy( &si->si_mods_mutex );
 		ldap_pvt_thread_mutex_destroy( &si->si_ops_mutex );
@@ -83,11 +83,26 @@ LDAP_SLAPD_F (int) acl_check_who LDAP_P((
 
 LDAP_SLAPD_F (void) acl_append( AccessControl **l, AccessControl *a, int pos );
 
+LDAP_SLAPD_V (int) acl_cache_size;
+LDAP_SLAPD_F (int) acl_cache_resize LDAP_P(( int size ));
+LDAP_SLAPD_F (void) acl_cache_destroy LDAP_P(( void ));
+LDAP_SLAPD_F (void) acl_cache_flush LDAP_P(( void ));
+LDAP_SLAPD_F (void) acl_cache_data_changed LDAP_P(( void ));
+LDAP_SLAPD_F (slap_counter_t) acl_cache_generation LDAP_P(( void ));
+LDAP_SLAPD_F (int) acl_identity_only LDAP_P(( BackendDB *be ));
+LDAP_SLAPD_F (void) acl_cache_counters LDAP_P((
+	slap_counter_t *hits,
+	slap_counter_t *misses,
+	slap_counter_t *invalidations ));
+
 #ifdef SLAP_DYNACL
 LDAP_SLAPD_F (int) slap_dynacl_register LDAP_P(( slap_dynacl_t *da ));
 LDAP_SLAPD_F (slap_dynacl_t *) slap_dynacl_get LDAP_P(( const char *name ));
 #endif /* SLAP_DYNACL */
 LDAP_SLAPD_F (int) acl_init LDAP_P(( void ));
+LDAP_SLAPD_F (int) acl_regex_dn_tail LDAP_P((
+	struct berval *pat,
+	struct berval *tail ));
 
 LDAP_SLAPD_F (int) acl_get_part LDAP_P((
 	struct berval	*list,
@@ -708,6 +723,8 @@ LDAP_SLAPD_F (int) slap_remove_control LDAP_P((
 	SlapReply	*rs,
 	int		ctrl,
 	BI_chk_controls	fnc ));
+LDAP_SLAPD_F (void) slap_proxy_session_free LDAP_P((
+	Connection *c ));
 
 #ifdef SLAP_CONTROL_X_SESSION_TRACKING
 LDAP_SLAPD_F (int)
@@ -814,6 +831,8 @@ LDAP_SLAPD_F (void) connection_write_resume LDAP_P((Connection *c));
 
 LDAP_SLAPD_F (void) connection_op_finish LDAP_P((
 	Operation *op, int lock ));
+LDAP_SLAPD_F (void) connection_rbuf_release LDAP_P((
+	struct slap_rbuf *rb ));
 
 LDAP_SLAPD_F (unsigned long) connections_nextid(void);
 
@@ -868,6 +887,7 @@ LDAP_SLAPD_V( const struct berval ) slap_ldapsync_bv;
 LDAP_SLAPD_V( const struct berval ) slap_ldapsync_cn_bv;
 LDAP_SLAPD_F (void) slap_get_commit_csn LDAP_P((
 	Operation *, struct berval *maxcsn, int *foundit ));
+LDAP_SLAPD_F (int) slap_csn_queued LDAP_P(( Operation * ));
 LDAP_SLAPD_F (void) slap_rewind_commit_csn LDAP_P(( Operation * ));
 LDAP_SLAPD_F (void) slap_graduate_commit_csn LDAP_P(( Operation * ));
 LDAP_SLAPD_F (Entry *) slap_create_context_csn_entry LDAP_P(( Backend *, struct berval *));
@@ -911,6 +931,8 @@ LDAP_SLAPD_V (slap_ssf_t) local_ssf;
 LDAP_SLAPD_V (struct runqueue_s) slapd_rq;
 LDAP_SLAPD_V (int) slapd_daemon_threads;
 LDAP_SLAPD_V (int) slapd_daemon_mask;
+LDAP_SLAPD_V (int) slapd_listener_shards;
+LDAP_SLAPD_V (int) slapd_accept_batch;
 #ifdef LDAP_TCP_BUFFER
 LDAP_SLAPD_V (int) slapd_tcp_rmem;
 LDAP_SLAPD_V (int) slapd_tcp_wmem;
@@ -1076,6 +1098,7 @@ LDAP_SLAPD_F (int) exop_root_dse_info LDAP_P ((Entry *e));
 
 LDAP_SLAPD_V( const struct berval ) slap_EXOP_CANCEL;
 LDAP_SLAPD_V( const struct berval ) slap_EXOP_WHOAMI;
+LDAP_SLAPD_V( const struct berval ) slap_EXOP_PROXY_SESSION;
 LDAP_SLAPD_V( const struct berval ) slap_EXOP_MODIFY_PASSWD;
 LDAP_SLAPD_V( const struct berval ) slap_EXOP_START_TLS;
 LDAP_SLAPD_V( const struct berval ) slap_EXOP_TXN_START;
@@ -1155,6 +1178,11 @@ LDAP_SLAPD_F (void) filter_destroy LDAP_P(( void ));
  */
 
 LDAP_SLAPD_F (int) test_filter LDAP_P(( Operation *op, Entry *e, Filter *f ));
+LDAP_SLAPD_F (FilterProg *) filter_prog_compile LDAP_P((
+	Operation *op, Filter *f ));
+LDAP_SLAPD_F (void) filter_prog_free LDAP_P(( Operation *op, FilterProg *fp ));
+LDAP_SLAPD_F (int) test_filter_prog LDAP_P((
+	Operation *op, Entry *e, FilterProg *fp ));
 
 /*
  * frontend.c
@@ -1189,6 +1217,13 @@ LDAP_SLAPD_F (int)	slap_shutdown LDAP_P(( Backend *be ));
 LDAP_SLAPD_F (int)	slap_destroy LDAP_P((void));
 LDAP_SLAPD_F (void) slap_counters_init LDAP_P((slap_counters_t *sc));
 LDAP_SLAPD_F (void) slap_counters_destroy LDAP_P((slap_counters_t *sc));
+LDAP_SLAPD_F (void) slap_counters_sum LDAP_P((slap_counters_t *sum));
+LDAP_SLAPD_F (slap_stats_t *) slap_stats_alloc LDAP_P(( int nstats ));
+LDAP_SLAPD_F (void) slap_stats_free LDAP_P(( slap_stats_t *ss ));
+LDAP_SLAPD_F (void) slap_stats_add LDAP_P((
+	slap_stats_t *ss, int idx, unsigned long v ));
+LDAP_SLAPD_F (slap_counter_t) slap_stats_get LDAP_P((
+	slap_stats_t *ss, int idx ));
 
 LDAP_SLAPD_V (char *)	slap_known_controls[];
 
@@ -1534,6 +1569,19 @@ LDAP_SLAPD_F (Operation *) slap_op_alloc LDAP_P((
 	ber_tag_t tag, ber_int_t id, void *ctx ));
 
 LDAP_SLAPD_F (slap_op_t) slap_req2op LDAP_P(( ber_tag_t tag ));
+LDAP_SLAPD_F (unsigned long) slap_phase_now LDAP_P(( void ));
+LDAP_SLAPD_F (const char *) slap_phase2str LDAP_P(( int phase ));
+LDAP_SLAPD_F (void) slap_op_latency LDAP_P((
+	Operation *op, slap_op_t opidx ));
+LDAP_SLAPD_F (void) slap_latency_get LDAP_P((
+	slap_op_t opidx, slap_latency_t *sl ));
+LDAP_SLAPD_F (int) slap_latency_bucket LDAP_P(( unsigned long usec ));
+LDAP_SLAPD_F (void) slap_latency_add LDAP_P((
+	slap_latency_t *sl, unsigned long usec ));
+LDAP_SLAPD_F (int) slap_latency2str LDAP_P((
+	slap_latency_t *sl, char *buf, int len ));
+LDAP_SLAPD_F (unsigned long) slap_rate_update LDAP_P((
+	slap_rate_t *sr, slap_counter_t count, time_t now ));
 
 /*
  * operational.c
@@ -1673,6 +1721,12 @@ LDAP_SLAPD_F (void) slap_send_ldap_intermediate LDAP_P(( Operation *op, SlapRepl
 LDAP_SLAPD_F (void) slap_send_search_result LDAP_P(( Operation *op, SlapReply *rs ));
 LDAP_SLAPD_F (int) slap_send_search_reference LDAP_P(( Operation *op, SlapReply *rs ));
 LDAP_SLAPD_F (int) slap_send_search_entry LDAP_P(( Operation *op, SlapReply *rs ));
+LDAP_SLAPD_F (void) slap_batch_begin LDAP_P(( Operation *op ));
+LDAP_SLAPD_F (void) slap_batch_check LDAP_P(( Operation *op, int wait ));
+LDAP_SLAPD_F (int) slap_batch_pending LDAP_P(( Operation *op,
+	struct timeval *tv ));
+LDAP_SLAPD_F (void) slap_batch_end LDAP_P(( Operation *op ));
+LDAP_SLAPD_F (void) slap_batch_destroy LDAP_P(( Connection *c ));
 LDAP_SLAPD_F (int) slap_null_cb LDAP_P(( Operation *op, SlapReply *rs ));
 LDAP_SLAPD_F (int) slap_freeself_cb LDAP_P(( Operation *op, SlapReply *rs ));
 
@@ -1762,6 +1816,9 @@ LDAP_SLAPD_F (int) slap_sasl_authorized LDAP_P((
 	Operation *op,
 	struct berval *authcid,
 	struct berval *authzid ));
+LDAP_SLAPD_F (int) slap_sasl_authz_relevant LDAP_P(( Operation *op ));
+LDAP_SLAPD_F (void) slap_sasl_authz_changed LDAP_P(( void ));
+LDAP_SLAPD_F (slap_counter_t) slap_sasl_authz_generation LDAP_P(( void ));
 LDAP_SLAPD_F (int) slap_sasl_regexp_config LDAP_P((
 	const char *match, const char *replace, int valx ));
 LDAP_SLAPD_F (void) slap_sasl_regexp_unparse LDAP_P(( BerVarray *bva ));
@@ -1931,6 +1988,7 @@ LDAP_SLAPD_F (void) slap_sl_mem_init LDAP_P(( void ));
 LDAP_SLAPD_F (void *) slap_sl_mem_create LDAP_P((
 						ber_len_t size, int stack, void *ctx, int flag ));
 LDAP_SLAPD_F (void) slap_sl_mem_setctx LDAP_P(( void *ctx, void *memctx ));
+LDAP_SLAPD_F (void) slap_sl_mem_trim LDAP_P(( void *ctx, void *memctx ));
 LDAP_SLAPD_F (void) slap_sl_mem_destroy LDAP_P(( void *key, void *data ));
 LDAP_SLAPD_F (void *) slap_sl_context LDAP_P(( void *ptr ));
 
@@ -2134,6 +2192,9 @@ LDAP_SLAPD_V (unsigned int) index_intlen_strlen;
 
 LDAP_SLAPD_V (ber_len_t) sockbuf_max_incoming;
 LDAP_SLAPD_V (ber_len_t) sockbuf_max_incoming_auth;
+LDAP_SLAPD_V (ber_len_t) sockbuf_readahead;
+LDAP_SLAPD_V (int)		slap_latency_stats;
+LDAP_SLAPD_V (int)		slap_latency_trace;
 LDAP_SLAPD_V (int)		slap_conn_max_pending;
 LDAP_SLAPD_V (int)		slap_conn_max_pending_auth;
 LDAP_SLAPD_V (int)		slap_max_filter_depth;
@@ -2146,6 +2207,8 @@ LDAP_SLAPD_V (const char) 	Versionstr[];
 
 LDAP_SLAPD_V (int)		global_gentlehup;
 LDAP_SLAPD_V (int)		global_idletimeout;
+LDAP_SLAPD_V (int)		global_writebatch;
+LDAP_SLAPD_V (int)		global_writebatch_delay;
 LDAP_SLAPD_V (int)		global_writetimeout;
 LDAP_SLAPD_V (char *)	global_host;
 LDAP_SLAPD_V (struct berval)	global_host_bv;
@@ -2175,6 +2238,7 @@ LDAP_SLAPD_V (time_t)		starttime;
 LDAP_SLAPD_V (ldap_pvt_thread_pool_t)	connection_pool;
 LDAP_SLAPD_V (int)			connection_pool_max;
 LDAP_SLAPD_V (int)			connection_pool_queues;
+LDAP_SLAPD_V (int)			connection_pool_steal;
 LDAP_SLAPD_V (int)			slap_tool_thread_max;
 
 LDAP_SLAPD_V (ldap_pvt_thread_mutex_t)	entry2str_mutex;
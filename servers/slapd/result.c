@@ -332,7 +332,7 @@ slap_writewait_play(
 	}
 }
 
-static long send_ldap_ber(
+static long send_ldap_ber_write(
 	Operation *op,
 	BerElement *ber )
 {
@@ -341,8 +341,10 @@ static long send_ldap_ber(
 	long ret = 0;
 	char *close_reason;
 	int do_resume = 0;
+	unsigned long t;
 
 	ber_get_option( ber, LBER_OPT_BER_BYTES_TO_WRITE, &bytes );
+	SLAP_PHASE_BEGIN( t );
 
 	/* write only one pdu at a time - wait til it's our turn */
 	ldap_pvt_thread_mutex_lock( &conn->c_write1_mutex );
@@ -403,6 +405,7 @@ fail:
 			if ( op->o_connid == conn->c_connid )
 				connection_closing( conn, close_reason );
 			ldap_pvt_thread_mutex_unlock( &conn->c_mutex );
+			SLAP_PHASE_END( op, SLAP_PHASE_WRITE, t );
 			return -1;
 		}
 
@@ -459,9 +462,315 @@ fail:
 	if ( do_resume )
 		connection_write_resume( conn );
 
+	SLAP_PHASE_END( op, SLAP_PHASE_WRITE, t );
+	return ret;
+}
+
+/*
+ * Output batching for search results.
+ *
+ * While a search runs, its entries are encoded as usual and then
+ * copied into a per-connection buffer instead of being written one
+ * PDU at a time. The buffer is written with a single flush, through
+ * the normal writer path, once it holds global_writebatch bytes, once
+ * its oldest entry has waited global_writebatch_delay msecs, or when
+ * any other PDU is sent for the operation, normally the final result.
+ * Backends call slap_batch_check() while looking for the next entry,
+ * so the delay holds even when no further entry turns up. Queued
+ * entries are only counted in the statistics once they are written.
+ *
+ * A connection batches one search at a time. The batch belongs to the
+ * operation's msgid and to the thread running it, so copies of the
+ * operation made by overlays share it while they run within the
+ * search, and copies kept beyond it, or used by other threads, write
+ * directly.
+ */
+struct slap_batch {
+	BerElementBuffer	sb_berbuf;
+	ber_len_t	sb_len;		/* bytes queued */
+	ber_len_t	sb_elen;	/* of which search entries */
+	int		sb_nentries;	/* entries queued */
+	int		sb_polls;	/* checks since the clock was read */
+	struct timeval	sb_start;	/* when the first queued PDU arrived */
+	ber_int_t	sb_msgid;	/* owner, -1 if unused */
+	ldap_pvt_thread_t	sb_tid;
+};
+
+#define SB_BER(sb)	((BerElement *)&(sb)->sb_berbuf)
+
+/* reading the clock once per this many entries or candidates */
+#define SB_POLL		32
+
+static struct slap_batch *
+slap_batch_get( Operation *op )
+{
+	struct slap_batch *sb;
+
+	if ( op->o_conn == NULL ||
+		( sb = op->o_conn->c_batch ) == NULL ||
+		__atomic_load_n( &sb->sb_msgid, __ATOMIC_ACQUIRE ) != op->o_msgid ||
+		!ldap_pvt_thread_equal( sb->sb_tid, ldap_pvt_thread_self() ))
+		return NULL;
+
+	return sb;
+}
+
+static void
+slap_batch_reset( Operation *op, struct slap_batch *sb )
+{
+	BerElement *ber = SB_BER( sb );
+
+	if ( sb->sb_len )
+		ber_free_buf( ber );
+	ber_init2( ber, NULL, LBER_USE_DER );
+	ber_set_option( ber, LBER_OPT_BER_MEMCTX, &op->o_tmpmemctx );
+	sb->sb_len = 0;
+	sb->sb_elen = 0;
+	sb->sb_nentries = 0;
+	sb->sb_polls = 0;
+}
+
+static int
+slap_batch_add( struct slap_batch *sb, BerElement *ber, int entry )
+{
+	struct berval bv;
+
+	if ( ber_flatten2( ber, &bv, 0 ) < 0 ||
+		ber_write( SB_BER( sb ), bv.bv_val, bv.bv_len, 0 ) < 0 )
+		return -1;
+
+	if ( !sb->sb_len )
+		gettimeofday( &sb->sb_start, NULL );
+	sb->sb_len += bv.bv_len;
+	if ( entry ) {
+		sb->sb_elen += bv.bv_len;
+		sb->sb_nentries++;
+	}
+	return 0;
+}
+
+static long
+slap_batch_flush( Operation *op, struct slap_batch *sb )
+{
+	long ret;
+
+	if ( !sb->sb_len )
+		return 0;
+
+	ret = send_ldap_ber_write( op, SB_BER( sb ));
+	if ( ret > 0 && sb->sb_nentries ) {
+		SLAP_COUNTER_ADD( op->o_counters->sc_bytes, (unsigned long)sb->sb_elen );
+		SLAP_COUNTER_ADD( op->o_counters->sc_entries, sb->sb_nentries );
+		SLAP_COUNTER_ADD( op->o_counters->sc_pdu, sb->sb_nentries );
+	}
+	slap_batch_reset( op, sb );
 	return ret;
 }
 
+/* msecs until the oldest queued PDU is due, 0 if it already is */
+static long
+slap_batch_due( struct slap_batch *sb )
+{
+	struct timeval now;
+	long waited;
+
+	gettimeofday( &now, NULL );
+	waited = ( now.tv_sec - sb->sb_start.tv_sec ) * 1000 +
+		( now.tv_usec - sb->sb_start.tv_usec ) / 1000;
+	return waited < global_writebatch_delay ?
+		global_writebatch_delay - waited : 0;
+}
+
+/* Whether the queue has waited long enough, only looking at the clock
+ * every SB_POLL calls */
+static int
+slap_batch_expired( struct slap_batch *sb )
+{
+	if ( global_writebatch_delay <= 0 || ++sb->sb_polls < SB_POLL )
+		return 0;
+
+	sb->sb_polls = 0;
+	return slap_batch_due( sb ) == 0;
+}
+
+/* Start batching the results of a search, if configured */
+void
+slap_batch_begin( Operation *op )
+{
+	Connection *c = op->o_conn;
+	struct slap_batch *sb;
+
+	if ( global_writebatch <= 0 || !c || op->o_res_ber || op->o_sync )
+		return;
+#ifdef LDAP_CONNECTIONLESS
+	if ( c->c_is_udp )
+		return;
+#endif
+
+	ldap_pvt_thread_mutex_lock( &c->c_mutex );
+	sb = c->c_batch;
+	if ( sb == NULL ) {
+		sb = ch_calloc( 1, sizeof( struct slap_batch ));
+		sb->sb_msgid = -1;
+		c->c_batch = sb;
+	} else if ( sb->sb_msgid != -1 ) {
+		/* another search on this connection is batching */
+		sb = NULL;
+	}
+	if ( sb != NULL ) {
+		sb->sb_len = 0;
+		slap_batch_reset( op, sb );
+		sb->sb_tid = ldap_pvt_thread_self();
+		__atomic_store_n( &sb->sb_msgid, op->o_msgid, __ATOMIC_RELEASE );
+	}
+	ldap_pvt_thread_mutex_unlock( &c->c_mutex );
+}
+
+/*
+ * Called by backends between entries. With wait set, the caller is
+ * about to block, e.g. on a remote server, and everything queued is
+ * written; otherwise only entries that have waited long enough are.
+ */
+void
+slap_batch_check( Operation *op, int wait )
+{
+	struct slap_batch *sb = slap_batch_get( op );
+
+	if ( sb == NULL || !sb->sb_len )
+		return;
+
+	if ( wait || slap_batch_expired( sb ))
+		slap_batch_flush( op, sb );
+}
+
+/*
+ * For backends waiting on a remote server: returns 0 if nothing is
+ * queued, otherwise sets *tv to how long the queue may still wait
+ * before slap_batch_check() has to be called with wait set.
+ */
+int
+slap_batch_pending( Operation *op, struct timeval *tv )
+{
+	struct slap_batch *sb = slap_batch_get( op );
+	long due = 0;
+
+	if ( sb == NULL || !sb->sb_len )
+		return 0;
+
+	if ( global_writebatch_delay > 0 )
+		due = slap_batch_due( sb );
+	tv->tv_sec = due / 1000;
+	tv->tv_usec = ( due % 1000 ) * 1000;
+	return 1;
+}
+
+/* Write out whatever is still queued and stop batching */
+void
+slap_batch_end( Operation *op )
+{
+	struct slap_batch *sb = slap_batch_get( op );
+
+	if ( sb == NULL )
+		return;
+
+	slap_batch_flush( op, sb );
+	ber_free_buf( SB_BER( sb ));
+	ldap_pvt_thread_mutex_lock( &op->o_conn->c_mutex );
+	__atomic_store_n( &sb->sb_msgid, -1, __ATOMIC_RELEASE );
+	ldap_pvt_thread_mutex_unlock( &op->o_conn->c_mutex );
+}
+
+/* Release the batch buffer of a connection slot */
+void
+slap_batch_destroy( Connection *c )
+{
+	ch_free( c->c_batch );
+	c->c_batch = NULL;
+}
+
+static long send_ldap_ber(
+	Operation *op,
+	BerElement *ber )
+{
+	struct slap_batch *sb = slap_batch_get( op );
+	ber_len_t bytes;
+	long ret;
+
+	if ( sb == NULL || !sb->sb_len )
+		return send_ldap_ber_write( op, ber );
+
+	/* Anything else sent for this operation goes out after, and
+	 * together with, the entries still queued */
+	ber_get_option( ber, LBER_OPT_BER_BYTES_TO_WRITE, &bytes );
+	if ( slap_batch_add( sb, ber, 0 ) < 0 ) {
+		ret = slap_batch_flush( op, sb );
+		if ( ret < 0 )
+			return ret;
+		return send_ldap_ber_write( op, ber );
+	}
+
+	ret = slap_batch_flush( op, sb );
+	return ret > 0 ? (long)bytes : ret;
+}
+
+/*
+ * Returns the bytes written now, 0 if the entry was queued; queued
+ * entries are counted by slap_batch_flush().
+ */
+static long send_search_ber(
+	Operation *op,
+	BerElement *ber )
+{
+	struct slap_batch *sb = slap_batch_get( op );
+	ber_len_t bytes;
+
+	if ( sb == NULL )
+		return send_ldap_ber_write( op, ber );
+
+	ber_get_option( ber, LBER_OPT_BER_BYTES_TO_WRITE, &bytes );
+
+	/* nothing to gain from copying a large entry */
+	if ( !sb->sb_len && bytes >= (ber_len_t)global_writebatch )
+		return send_ldap_ber_write( op, ber );
+
+	if ( slap_batch_add( sb, ber, 1 ) < 0 ) {
+		long ret = slap_batch_flush( op, sb );
+		if ( ret < 0 )
+			return ret;
+		return send_ldap_ber_write( op, ber );
+	}
+
+	if ( sb->sb_len >= (ber_len_t)global_writebatch ||
+		slap_batch_expired( sb ))
+	{
+		long ret = slap_batch_flush( op, sb );
+		if ( ret < 0 )
+			return ret;
+	}
+
+	return 0;
+}
+
+/* Start a SearchResultEntry around a protocolOp encoded earlier */
+static int
+send_search_pdu( Operation *op, BerElement *ber, struct berval *pdu )
+{
+	struct berval	bv;
+
+	/* room for the message header; controls are added as needed */
+	bv.bv_len = pdu->bv_len + 64;
+	bv.bv_val = op->o_tmpalloc( bv.bv_len, op->o_tmpmemctx );
+
+	ber_init2( ber, &bv, LBER_USE_DER );
+	ber_set_option( ber, LBER_OPT_BER_MEMCTX, &op->o_tmpmemctx );
+
+	if ( ber_printf( ber, "{i" /*}*/, op->o_msgid ) == -1 ||
+		ber_write( ber, pdu->bv_val, pdu->bv_len, 0 ) == -1 )
+		return -1;
+
+	return 0;
+}
+
 static int
 send_ldap_control( BerElement *ber, LDAPControl *c )
 {
@@ -782,10 +1091,8 @@ send_ldap_response(
 		goto cleanup;
 	}
 
-	ldap_pvt_thread_mutex_lock( &op->o_counters->sc_mutex );
-	ldap_pvt_mp_add_ulong( op->o_counters->sc_pdu, 1 );
-	ldap_pvt_mp_add_ulong( op->o_counters->sc_bytes, (unsigned long)bytes );
-	ldap_pvt_thread_mutex_unlock( &op->o_counters->sc_mutex );
+	SLAP_COUNTER_ADD( op->o_counters->sc_pdu, 1 );
+	SLAP_COUNTER_ADD( op->o_counters->sc_bytes, (unsigned long)bytes );
 
 cleanup:;
 	/* Tell caller that we did this for real, as opposed to being
@@ -877,6 +1184,21 @@ slap_send_ldap_result( Operation *op, SlapReply *rs )
 
 	assert( rs->sr_err != LDAP_PARTIAL_RESULTS );
 
+	/* let the ACL and proxy authz caches forget decisions based on
+	 * group membership or authz rules */
+	if ( rs->sr_err == LDAP_SUCCESS ) {
+		switch ( op->o_tag ) {
+		case LDAP_REQ_ADD:
+		case LDAP_REQ_DELETE:
+		case LDAP_REQ_MODIFY:
+		case LDAP_REQ_MODRDN:
+			acl_cache_data_changed();
+			if ( slap_sasl_authz_relevant( op ))
+				slap_sasl_authz_changed();
+			break;
+		}
+	}
+
 	if ( rs->sr_err == LDAP_REFERRAL ) {
 		if ( wants_domainScope( op ) ) rs->sr_ref = NULL;
 
@@ -1039,6 +1361,8 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 	AccessControlState acl_state = ACL_STATE_INIT;
 	int			 attrsonly;
 	AttributeDescription *ad_entry = slap_schema.si_ad_entry;
+	unsigned long	t, acl_usec;
+	int		pdu = 0;
 
 	/* a_flags: array of flags telling if the i-th element will be
 	 *          returned or filtered out
@@ -1061,6 +1385,10 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 		goto error_return;
 	}
 
+	/* access checks are accounted for separately */
+	SLAP_PHASE_BEGIN( t );
+	acl_usec = op->o_phase[SLAP_PHASE_ACL];
+
 	/* eventually will loop through generated operational attribute types
 	 * currently implemented types include:
 	 *	entryDN, subschemaSubentry, and hasSubordinates */
@@ -1099,6 +1427,22 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 		goto error_return;
 	}
 
+	/* The caller may share the encoded protocolOp between searches
+	 * that are known to see the same attributes of this entry: if
+	 * it is already there, only the message around it is built. */
+	if ( rs->sr_pdu && op->o_res_ber == NULL && op->o_vrFilter == NULL
+#ifdef LDAP_CONNECTIONLESS
+		&& !( op->o_conn && op->o_conn->c_is_udp )
+#endif
+		)
+	{
+		if ( !BER_BVISNULL( rs->sr_pdu ) ) {
+			rc = send_search_pdu( op, ber, rs->sr_pdu );
+			goto encoded;
+		}
+		pdu = 1;
+	}
+
 	if ( op->o_res_ber ) {
 		/* read back control or LDAP_CONNECTIONLESS */
 	    ber = op->o_res_ber;
@@ -1124,8 +1468,8 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 		}
 	} else
 #endif
-	if ( op->o_res_ber ) {
-		/* read back control */
+	if ( op->o_res_ber || pdu ) {
+		/* read back control, or protocolOp to be kept */
 	    rc = ber_printf( ber, "t{O{" /*}}*/,
 			LDAP_RES_SEARCH_ENTRY, &rs->sr_entry->e_name );
 	} else {
@@ -1464,6 +1808,20 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 
 	rc = ber_printf( ber, /*{{*/ "}N}" );
 
+	if ( rc != -1 && pdu ) {
+		struct berval	bv;
+
+		/* hand a copy to the caller and wrap the message around it */
+		rc = ber_flatten2( ber, &bv, 0 );
+		if ( rc != -1 && ber_dupbv( rs->sr_pdu, &bv ) == NULL )
+			rc = -1;
+		if ( rc != -1 ) {
+			ber_free_buf( ber );
+			rc = send_search_pdu( op, ber, rs->sr_pdu );
+		}
+	}
+
+encoded:;
 	if( rc != -1 ) {
 		rc = send_ldap_controls( op, ber, rs->sr_ctrls );
 	}
@@ -1493,10 +1851,15 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 	Debug( LDAP_DEBUG_STATS2, "%s ENTRY dn=\"%s\"\n",
 	    op->o_log_prefix, rs->sr_entry->e_nname.bv_val );
 
+	SLAP_PHASE_END( op, SLAP_PHASE_ENCODE, t );
+	if ( t )
+		op->o_phase[SLAP_PHASE_ENCODE] -=
+			op->o_phase[SLAP_PHASE_ACL] - acl_usec;
+
 	rs_flush_entry( op, rs, NULL );
 
 	if ( op->o_res_ber == NULL ) {
-		bytes = send_ldap_ber( op, ber );
+		bytes = send_search_ber( op, ber );
 		ber_free_buf( ber );
 
 		if ( bytes < 0 ) {
@@ -1509,11 +1872,11 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 		}
 		rs->sr_nentries++;
 
-		ldap_pvt_thread_mutex_lock( &op->o_counters->sc_mutex );
-		ldap_pvt_mp_add_ulong( op->o_counters->sc_bytes, (unsigned long)bytes );
-		ldap_pvt_mp_add_ulong( op->o_counters->sc_entries, 1 );
-		ldap_pvt_mp_add_ulong( op->o_counters->sc_pdu, 1 );
-		ldap_pvt_thread_mutex_unlock( &op->o_counters->sc_mutex );
+		if ( bytes > 0 ) {
+			SLAP_COUNTER_ADD( op->o_counters->sc_bytes, (unsigned long)bytes );
+			SLAP_COUNTER_ADD( op->o_counters->sc_entries, 1 );
+			SLAP_COUNTER_ADD( op->o_counters->sc_pdu, 1 );
+		}
 	}
 
 	Debug( LDAP_DEBUG_TRACE,
@@ -1668,11 +2031,9 @@ slap_send_search_reference( Operation *op, SlapReply *rs )
 	if ( bytes < 0 ) {
 		rc = LDAP_UNAVAILABLE;
 	} else {
-		ldap_pvt_thread_mutex_lock( &op->o_counters->sc_mutex );
-		ldap_pvt_mp_add_ulong( op->o_counters->sc_bytes, (unsigned long)bytes );
-		ldap_pvt_mp_add_ulong( op->o_counters->sc_refs, 1 );
-		ldap_pvt_mp_add_ulong( op->o_counters->sc_pdu, 1 );
-		ldap_pvt_thread_mutex_unlock( &op->o_counters->sc_mutex );
+		SLAP_COUNTER_ADD( op->o_counters->sc_bytes, (unsigned long)bytes );
+		SLAP_COUNTER_ADD( op->o_counters->sc_refs, 1 );
+		SLAP_COUNTER_ADD( op->o_counters->sc_pdu, 1 );
 	}
 #ifdef LDAP_CONNECTIONLESS
 	}
@@ -1748,6 +1748,140 @@ slap_sasl_matches( Operation *op, BerVarray rules,
  * The assertDN should not have the dn: prefix
  */
 
+/* The outcome of slap_sasl_authorized() and slap_sasl_getdn() depends
+ * on authzTo/authzFrom values, on the authz configuration, and on the
+ * entries found by the searches their rules run. Those searches record
+ * the attributes of their filters here. Writes that touch any of these
+ * bump slap_authz_gen so that cached decisions can tell when they may
+ * be out of date.
+ */
+#define SLAP_AUTHZ_ADS	32
+
+static slap_counter_t slap_authz_gen = 1;
+static AttributeDescription *slap_authz_ads[ SLAP_AUTHZ_ADS ];
+static int slap_authz_anyattr;	/* a filter the registry can't describe */
+
+static void
+slap_sasl_authz_ad( AttributeDescription *ad )
+{
+	AttributeDescription *cur;
+	int i;
+
+	for ( i = 0; i < SLAP_AUTHZ_ADS; i++ ) {
+		cur = __atomic_load_n( &slap_authz_ads[i], __ATOMIC_ACQUIRE );
+		if ( cur == NULL &&
+			__atomic_compare_exchange_n( &slap_authz_ads[i], &cur, ad, 0,
+				__ATOMIC_RELEASE, __ATOMIC_ACQUIRE ))
+			return;
+		if ( cur == ad )
+			return;
+	}
+	__atomic_store_n( &slap_authz_anyattr, 1, __ATOMIC_RELAXED );
+}
+
+static void
+slap_sasl_authz_filter( Filter *f )
+{
+	for ( ; f; f = f->f_next ) {
+		switch ( f->f_choice & SLAPD_FILTER_MASK ) {
+		case LDAP_FILTER_EQUALITY:
+		case LDAP_FILTER_GE:
+		case LDAP_FILTER_LE:
+		case LDAP_FILTER_APPROX:
+			slap_sasl_authz_ad( f->f_av_desc );
+			break;
+		case LDAP_FILTER_SUBSTRINGS:
+			slap_sasl_authz_ad( f->f_sub_desc );
+			break;
+		case LDAP_FILTER_PRESENT:
+			slap_sasl_authz_ad( f->f_desc );
+			break;
+		case LDAP_FILTER_EXT:
+			if ( f->f_mr_desc )
+				slap_sasl_authz_ad( f->f_mr_desc );
+			else
+				__atomic_store_n( &slap_authz_anyattr, 1, __ATOMIC_RELAXED );
+			break;
+		case LDAP_FILTER_NOT:
+			/* an added entry may match by lacking attributes */
+			__atomic_store_n( &slap_authz_anyattr, 1, __ATOMIC_RELAXED );
+			break;
+		case LDAP_FILTER_AND:
+		case LDAP_FILTER_OR:
+			slap_sasl_authz_filter( f->f_list );
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+static int
+slap_sasl_authz_attr( AttributeDescription *ad )
+{
+	AttributeDescription *cur;
+	int i;
+
+	if ( ad == slap_schema.si_ad_saslAuthzTo ||
+		ad == slap_schema.si_ad_saslAuthzFrom )
+		return 1;
+	for ( i = 0; i < SLAP_AUTHZ_ADS; i++ ) {
+		cur = __atomic_load_n( &slap_authz_ads[i], __ATOMIC_ACQUIRE );
+		if ( cur == NULL )
+			break;
+		if ( is_ad_subtype( ad, cur ))
+			return 1;
+	}
+	return 0;
+}
+
+/* Whether a successful write may change authz decisions */
+int
+slap_sasl_authz_relevant( Operation *op )
+{
+	Modifications *ml;
+	Attribute *a;
+
+	if ( op->o_bd && SLAP_CONFIG( op->o_bd ))
+		return 1;
+
+	switch ( op->o_tag ) {
+	case LDAP_REQ_ADD:
+		if ( __atomic_load_n( &slap_authz_anyattr, __ATOMIC_RELAXED ))
+			return 1;
+		for ( a = op->ora_e->e_attrs; a; a = a->a_next ) {
+			if ( slap_sasl_authz_attr( a->a_desc ))
+				return 1;
+		}
+		return 0;
+	case LDAP_REQ_MODIFY:
+		if ( __atomic_load_n( &slap_authz_anyattr, __ATOMIC_RELAXED ))
+			return 1;
+		for ( ml = op->orm_modlist; ml; ml = ml->sml_next ) {
+			if ( slap_sasl_authz_attr( ml->sml_desc ))
+				return 1;
+		}
+		return 0;
+	case LDAP_REQ_DELETE:
+	case LDAP_REQ_MODRDN:
+		/* the entry may have been a group, or found by a rule's search */
+		return 1;
+	}
+	return 0;
+}
+
+void
+slap_sasl_authz_changed( void )
+{
+	SLAP_COUNTER_ADD( slap_authz_gen, 1 );
+}
+
+slap_counter_t
+slap_sasl_authz_generation( void )
+{
+	return SLAP_COUNTER_GET( slap_authz_gen );
+}
+
 static int
 slap_sasl_match( Operation *opx, struct berval *rule,
 	struct berval *assertDN, struct berval *authc )
@@ -1933,6 +2067,7 @@ exact_match:
 	op.ors_attrs = slap_anlist_no_attrs;
 	op.ors_attrsonly = 1;
 
+	slap_sasl_authz_filter( op.ors_filter );
 	op.o_bd->be_search( &op, &rs );
 
 	if (sm.match) {
@@ -2103,6 +2238,7 @@ slap_sasl2dn(
 	}
 	ber_dupbv_x( &op.o_req_dn, &op.o_req_ndn, op.o_tmpmemctx );
 
+	slap_sasl_authz_filter( op.ors_filter );
 	op.o_bd->be_search( &op, &rs );
 	
 FINISHED:
@@ -263,6 +263,7 @@ do_search(
 		}
 	}
 
+	SLAP_PHASE_END( op, SLAP_PHASE_DECODE, op->o_phase_start );
 	op->o_bd = frontendDB;
 	rs->sr_err = frontendDB->be_search( op, rs );
 	if ( rs->sr_err == SLAPD_ASYNCOP ) {
@@ -423,7 +424,9 @@ fail1:
 	} else if ( op->o_bd->be_search ) {
 		if ( limits_check( op, rs ) == 0 ) {
 			/* actually do the search and send the result(s) */
+			slap_batch_begin( op );
 			(op->o_bd->be_search)( op, rs );
+			slap_batch_end( op );
 		}
 		/* else limits_check() sends error */
 
@@ -55,7 +55,9 @@
  * It falls back to context NULL - plain ber_memalloc() - when the
  * context's slab is full.  A reset does not reclaim such memory.
  * Conversely, free/realloc of data not from the given context assumes
- * context NULL.  The data must not belong to another memory context.
+ * context NULL.  The data must not belong to another memory context;
+ * another context's overflow chunks are detected, asserted on and left
+ * alone.
  *
  * Code which has lost track of the current memory context can try
  * slap_sl_context() or ch_malloc.c:ch_free/ch_realloc().
@@ -70,6 +72,22 @@
  * by ORing *next* block's head with 1.  Freed blocks are only reclaimed
  * from the last block forward.  This is fast, but when a block is never
  * freed, older blocks will not be reclaimed until the slab is reset...
+ *
+ * When a stack slab is full, allocation continues in overflow chunks
+ * laid out the same way, instead of falling back to context NULL.  The
+ * chunks make the context an arena for the whole operation: they are
+ * freed in bulk by slap_sl_mem_trim() when the operation is freed, or
+ * when the context is reset.  Each chunk also counts its live blocks,
+ * so a chunk is reclaimed as soon as everything in it has been freed,
+ * in whatever order.
+ *
+ * Chunks are looked up by address in an AVL tree per context.  The
+ * address range of every chunk is also published in a fixed table that
+ * is read without locking, so that a free or realloc of another
+ * context's chunk memory is caught instead of being passed to the
+ * system allocator.  The table is only searched while other contexts
+ * actually have chunks; when it is full, the context falls back to
+ * context NULL as if it had no chunks.
  */
 
 #ifdef SLAP_NO_SL_MALLOC /* Useful with memory debuggers like Valgrind */
@@ -86,10 +104,28 @@ struct slab_object {
     LDAP_LIST_ENTRY(slab_object) so_link;
 };
 
+struct slab_chunk {
+	LDAP_LIST_ENTRY(slab_chunk) sc_link;
+	struct slab_heap *sc_heap;
+	void *sc_last;
+	void *sc_end;
+	ber_len_t sc_live;	/* blocks not yet freed */
+	int sc_slot;		/* in slap_sl_chunktab */
+};
+
+/* A published chunk address range, see slap_sl_chunk_foreign() */
+struct slab_chunk_slot {
+	struct slab_chunk *cs_chunk;	/* NULL if unused */
+	void *cs_end;					/* NULL while being set up */
+};
+
 struct slab_heap {
     void *sh_base;
     void *sh_last;
     void *sh_end;
+	LDAP_LIST_HEAD(sh_chunks, slab_chunk) sh_chunks; /* newest first */
+	Avlnode *sh_chunktree;
+	int sh_nchunks;
 	int sh_stack;
 	int sh_maxorder;
     unsigned char **sh_map;
@@ -102,10 +138,15 @@ enum {
 		? sizeof(ber_len_t) : 2*sizeof(int),
 	Align_log2 = 1 + (Align>2) + (Align>4) + (Align>8) + (Align>16),
 	order_start = Align_log2 - 1,
-	pad = Align - 1
+	pad = Align - 1,
+	/* Align (base + head of first block) == first returned block */
+	Base_offset = (unsigned) -sizeof(ber_len_t) % Align,
+	Chunk_head = ((sizeof(struct slab_chunk) + pad) & -Align) + Base_offset
 };
 
 static struct slab_object * slap_replenish_sopool(struct slab_heap* sh);
+static void slap_sl_chunks_free(struct slab_heap *sh, struct slab_chunk *keep);
+static struct slab_chunk * slap_sl_chunk_find(struct slab_heap *sh, void *ptr);
 #ifdef SLAPD_UNUSED
 static void print_slheap(int level, void *ctx);
 #endif
@@ -133,6 +174,8 @@ slap_sl_mem_destroy(
 	if (!sh)
 		return;
 
+	slap_sl_chunks_free(sh, NULL);
+
 	if (!sh->sh_stack) {
 		for (i = 0; i <= sh->sh_maxorder - order_start; i++) {
 			so = LDAP_LIST_FIRST(&sh->sh_free[i]);
@@ -168,6 +211,12 @@ slap_sl_mem_destroy(
 	}
 }
 
+/* Chunks of all contexts, for catching cross-context frees */
+#define SLAP_SL_CHUNKTAB	256
+static struct slab_chunk_slot slap_sl_chunktab[SLAP_SL_CHUNKTAB];
+static int slap_sl_chunkmax;	/* slots ever used */
+static int slap_sl_nchunks;
+
 BerMemoryFunctions slap_sl_mfuncs =
 	{ slap_sl_malloc, slap_sl_calloc, slap_sl_realloc, slap_sl_free };
 
@@ -193,7 +242,6 @@ slap_sl_mem_create(
 	ber_len_t size_shift;
 	struct slab_object *so;
 	char *base, *newptr;
-	enum { Base_offset = (unsigned) -sizeof(ber_len_t) % Align };
 
 	sh = GET_MEMCTX(thrctx, &memctx);
 	if ( sh && !new )
@@ -205,6 +253,9 @@ slap_sl_mem_create(
 
 	if (!sh) {
 		sh = ch_malloc(sizeof(struct slab_heap));
+		LDAP_LIST_INIT(&sh->sh_chunks);
+		sh->sh_chunktree = NULL;
+		sh->sh_nchunks = 0;
 		base = ch_malloc(size);
 		SET_MEMCTX(thrctx, sh, slap_sl_mem_destroy);
 		VGMEMP_MARK(base, size);
@@ -288,6 +339,242 @@ slap_sl_mem_setctx(
 	SET_MEMCTX(thrctx, memctx, slap_sl_mem_destroy);
 }
 
+/* Order chunks by address */
+static int
+slap_sl_chunk_cmp( const void *v1, const void *v2 )
+{
+	const char *c1 = v1, *c2 = v2;
+
+	return c1 < c2 ? -1 : c1 > c2;
+}
+
+/* Find the chunk holding an address; a mark may point at its end */
+static int
+slap_sl_chunk_ptr_cmp( const void *ptr, const void *v )
+{
+	const struct slab_chunk *sc = v;
+
+	if ( (const char *) ptr <= (const char *) sc )
+		return -1;
+	return (const char *) ptr > (const char *) sc->sc_end;
+}
+
+/*
+ * Publish the chunk's address range.  A slot is claimed by setting its
+ * chunk, then the end is filled in; readers skip a slot until both are
+ * set and recheck the chunk afterwards.
+ */
+static int
+slap_sl_chunk_publish( struct slab_chunk *sc )
+{
+	struct slab_chunk *unused;
+	int i, max;
+
+	for ( i = 0; i < SLAP_SL_CHUNKTAB; i++ ) {
+		unused = NULL;
+		if ( __atomic_load_n( &slap_sl_chunktab[i].cs_chunk,
+				__ATOMIC_RELAXED ) == NULL &&
+			__atomic_compare_exchange_n( &slap_sl_chunktab[i].cs_chunk,
+				&unused, sc, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED ))
+			break;
+	}
+	if ( i == SLAP_SL_CHUNKTAB )
+		return -1;
+
+	sc->sc_slot = i;
+	__atomic_store_n( &slap_sl_chunktab[i].cs_end, sc->sc_end,
+		__ATOMIC_RELEASE );
+	max = __atomic_load_n( &slap_sl_chunkmax, __ATOMIC_RELAXED );
+	while ( max <= i && !__atomic_compare_exchange_n( &slap_sl_chunkmax,
+			&max, i + 1, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED ))
+		;
+	__atomic_fetch_add( &slap_sl_nchunks, 1, __ATOMIC_RELEASE );
+	return 0;
+}
+
+static void
+slap_sl_chunk_unpublish( struct slab_chunk *sc )
+{
+	struct slab_chunk_slot *cs = &slap_sl_chunktab[sc->sc_slot];
+
+	__atomic_fetch_sub( &slap_sl_nchunks, 1, __ATOMIC_RELAXED );
+	__atomic_store_n( &cs->cs_end, NULL, __ATOMIC_RELAXED );
+	__atomic_store_n( &cs->cs_chunk, NULL, __ATOMIC_RELEASE );
+}
+
+static void
+slap_sl_chunk_unlink( struct slab_heap *sh, struct slab_chunk *sc )
+{
+	LDAP_LIST_REMOVE( sc, sc_link );
+	ldap_avl_delete( &sh->sh_chunktree, sc, slap_sl_chunk_cmp );
+	sh->sh_nchunks--;
+
+	slap_sl_chunk_unpublish( sc );
+	ber_memfree_x( sc, NULL );
+}
+
+/* Free overflow chunks newer than keep, or all of them */
+static void
+slap_sl_chunks_free( struct slab_heap *sh, struct slab_chunk *keep )
+{
+	struct slab_chunk *sc;
+
+	while (( sc = LDAP_LIST_FIRST( &sh->sh_chunks )) != keep ) {
+		slap_sl_chunk_unlink( sh, sc );
+	}
+}
+
+static struct slab_chunk *
+slap_sl_chunk_find( struct slab_heap *sh, void *ptr )
+{
+	struct slab_chunk *sc;
+
+	if ( !sh || !sh->sh_nchunks )
+		return NULL;
+
+	/* Most frees hit the chunk currently being filled */
+	sc = LDAP_LIST_FIRST( &sh->sh_chunks );
+	if ( !slap_sl_chunk_ptr_cmp( ptr, sc ))
+		return sc;
+
+	return ldap_avl_find( sh->sh_chunktree, ptr, slap_sl_chunk_ptr_cmp );
+}
+
+/*
+ * Check whether ptr, which is not from context sh, belongs to another
+ * context's chunk.  Such memory cannot be handed to the system allocator,
+ * nor can it be freed into its context from this thread: that is a bug
+ * in the caller.  A pointer into a chunk only reaches another thread
+ * after the chunk was published, so the count is a safe shortcut.
+ */
+static int
+slap_sl_chunk_foreign( struct slab_heap *sh, void *ptr )
+{
+	struct slab_chunk *sc;
+	void *end;
+	int i, max;
+
+	if ( __atomic_load_n( &slap_sl_nchunks, __ATOMIC_ACQUIRE ) <=
+			( sh ? sh->sh_nchunks : 0 ))
+		return 0;
+
+	max = __atomic_load_n( &slap_sl_chunkmax, __ATOMIC_RELAXED );
+	for ( i = 0; i < max; i++ ) {
+		sc = __atomic_load_n( &slap_sl_chunktab[i].cs_chunk,
+			__ATOMIC_ACQUIRE );
+		if ( !sc || (char *) ptr <= (char *) sc )
+			continue;
+		end = __atomic_load_n( &slap_sl_chunktab[i].cs_end,
+			__ATOMIC_ACQUIRE );
+		if ( !end || (char *) ptr > (char *) end )
+			continue;
+		if ( __atomic_load_n( &slap_sl_chunktab[i].cs_chunk,
+				__ATOMIC_ACQUIRE ) != sc )
+			continue;
+
+		Debug( LDAP_DEBUG_ANY, "slap_sl_chunk_foreign: %p belongs to "
+			"the memory chunk %p of another context, not %p\n",
+			ptr, (void *) sc, (void *) sh );
+		assert( 0 );
+		return 1;
+	}
+	return 0;
+}
+
+/* size includes the block head and is already rounded up */
+static void *
+slap_sl_chunk_malloc( struct slab_heap *sh, ber_len_t size )
+{
+	struct slab_chunk *sc = LDAP_LIST_FIRST( &sh->sh_chunks );
+	ber_len_t *newptr, len;
+
+	if ( !sc || size >= (ber_len_t) ((char *) sc->sc_end - (char *) sc->sc_last) ) {
+		len = (char *) sh->sh_end - (char *) sh->sh_base;
+		if ( len < Chunk_head + size + Align )
+			len = Chunk_head + size + Align;
+		sc = ch_malloc( len );
+		sc->sc_heap = sh;
+		sc->sc_last = (char *) sc + Chunk_head;
+		sc->sc_end = (char *) sc + len;
+		sc->sc_live = 0;
+		if ( slap_sl_chunk_publish( sc )) {
+			/* Nowhere to publish it, use context NULL */
+			ber_memfree_x( sc, NULL );
+			size -= sizeof(ber_len_t);
+			Debug( LDAP_DEBUG_TRACE, "sl_malloc %lu: ch_malloc\n",
+				(unsigned long) size );
+			return ch_malloc( size );
+		}
+		LDAP_LIST_INSERT_HEAD( &sh->sh_chunks, sc, sc_link );
+		ldap_avl_insert( &sh->sh_chunktree, sc, slap_sl_chunk_cmp,
+			ldap_avl_dup_error );
+		sh->sh_nchunks++;
+	}
+
+	newptr = sc->sc_last;
+	sc->sc_last = (char *) sc->sc_last + size;
+	sc->sc_live++;
+	*newptr++ = size;
+	return newptr;
+}
+
+/*
+ * p is the block head, as in the stack slab.  When the last live block
+ * goes, the current chunk is emptied and older chunks are released.
+ */
+static void
+slap_sl_chunk_free( struct slab_heap *sh, struct slab_chunk *sc, ber_len_t *p )
+{
+	ber_len_t size = *p & -2;
+	ber_len_t *nextp = (ber_len_t *) ((char *) p + size);
+
+	if ( sc->sc_live && !--sc->sc_live ) {
+		if ( sc == LDAP_LIST_FIRST( &sh->sh_chunks ))
+			sc->sc_last = (char *) sc + Chunk_head;
+		else
+			slap_sl_chunk_unlink( sh, sc );
+	} else if ( sc->sc_last != nextp ) {
+		nextp[-1] = size;
+		nextp[0] |= 1;
+	} else {
+		while ( *p & 1 ) {
+			p = (ber_len_t *) ((char *) p - p[-1]);
+		}
+		sc->sc_last = p;
+	}
+}
+
+static void *
+slap_sl_chunk_realloc( struct slab_heap *sh, struct slab_chunk *sc,
+	void *ptr, ber_len_t size )
+{
+	ber_len_t *p = (ber_len_t *) ptr - 1, oldsize = *p & -2;
+	void *newptr;
+
+	if ( size == 0 ) {
+		slap_sl_chunk_free( sh, sc, p );
+		return NULL;
+	}
+
+	size = (size + sizeof(ber_len_t) + Align-1) & -Align;
+	if ( size <= oldsize )
+		return ptr;
+
+	/* Grow the last block in place if there is room */
+	if ( (char *) p + oldsize == sc->sc_last &&
+		size < (ber_len_t) ((char *) sc->sc_end - (char *) p) )
+	{
+		sc->sc_last = (char *) p + size;
+		*p = (*p & 1) | size;
+		return ptr;
+	}
+
+	newptr = slap_sl_malloc( size - sizeof(ber_len_t), sh );
+	AC_MEMCPY( newptr, ptr, oldsize - sizeof(ber_len_t) );
+	slap_sl_chunk_free( sh, sc, p );
+	return newptr;
+}
+
 void *
 slap_sl_malloc(
     ber_len_t	size,
@@ -320,7 +607,7 @@ slap_sl_malloc(
 			return( (void *)newptr );
 		}
 
-		size -= sizeof(ber_len_t);
+		return slap_sl_chunk_malloc(sh, size);
 
 	} else {
 		struct slab_object *so_new, *so_left, *so_right;
@@ -421,6 +708,19 @@ slap_sl_realloc(void *ptr, ber_len_t size, void *ctx)
 
 	/* Not our memory? */
 	if (No_sl_malloc || !sh || ptr < sh->sh_base || ptr >= sh->sh_end) {
+		struct slab_chunk *sc = slap_sl_chunk_find(sh, ptr);
+		if (sc) {
+			return slap_sl_chunk_realloc(sh, sc, ptr, size);
+		}
+		if (slap_sl_chunk_foreign(sh, ptr)) {
+			/* Can't touch it, hand back a copy */
+			if (size == 0)
+				return NULL;
+			oldsize = (p[-1] & -2) - sizeof(ber_len_t);
+			newptr = slap_sl_malloc(size, ctx);
+			AC_MEMCPY(newptr, ptr, oldsize < size ? oldsize : size);
+			return newptr;
+		}
 		/* Like ch_realloc(), except not trying a new context */
 		newptr = ber_memrealloc_x(ptr, size, NULL);
 		if (newptr) {
@@ -496,7 +796,12 @@ slap_sl_free(void *ptr, void *ctx)
 		return;
 
 	if (No_sl_malloc || !sh || ptr < sh->sh_base || ptr >= sh->sh_end) {
-		ber_memfree_x(ptr, NULL);
+		struct slab_chunk *sc = slap_sl_chunk_find(sh, ptr);
+		if (sc) {
+			slap_sl_chunk_free(sh, sc, p - 1);
+		} else if (!slap_sl_chunk_foreign(sh, ptr)) {
+			ber_memfree_x(ptr, NULL);
+		}
 		return;
 	}
 
@@ -647,17 +952,45 @@ void
 slap_sl_release( void *ptr, void *ctx )
 {
 	struct slab_heap *sh = ctx;
-	if ( sh && ptr >= sh->sh_base && ptr <= sh->sh_end )
+	struct slab_chunk *sc;
+
+	if ( !sh )
+		return;
+	if ( ptr >= sh->sh_base && ptr <= sh->sh_end ) {
+		slap_sl_chunks_free( sh, NULL );
 		sh->sh_last = ptr;
+	} else if (( sc = slap_sl_chunk_find( sh, ptr )) != NULL ) {
+		/* Blocks dropped here stay in sc_live, so sc is kept
+		 * until the context is trimmed or reset */
+		slap_sl_chunks_free( sh, sc );
+		sc->sc_last = ptr;
+	}
 }
 
 void *
 slap_sl_mark( void *ctx )
 {
 	struct slab_heap *sh = ctx;
+	if ( !LDAP_LIST_EMPTY( &sh->sh_chunks ))
+		return LDAP_LIST_FIRST( &sh->sh_chunks )->sc_last;
 	return sh->sh_last;
 }
 
+/*
+ * Free the overflow chunks of the thread's memory context once the
+ * operation that used it is done. The slab itself is reset by the
+ * next slap_sl_mem_create().
+ */
+void
+slap_sl_mem_trim( void *thrctx, void *memctx )
+{
+	void *cur;
+	struct slab_heap *sh = GET_MEMCTX(thrctx, &cur);
+
+	if ( sh && sh == memctx )
+		slap_sl_chunks_free( sh, NULL );
+}
+
 /*
  * Return the memory context of the current thread if the given block of
  * memory belongs to it, otherwise return NULL.
@@ -671,7 +1004,9 @@ slap_sl_context( void *ptr )
 	if ( slapMode & SLAP_TOOL_MODE ) return NULL;
 
 	sh = GET_MEMCTX(ldap_pvt_thread_pool_context(), &memctx);
-	if (sh && ptr >= sh->sh_base && ptr <= sh->sh_end) {
+	if (sh && ((ptr >= sh->sh_base && ptr <= sh->sh_end) ||
+		slap_sl_chunk_find(sh, ptr)))
+	{
 		return sh;
 	}
 	return NULL;
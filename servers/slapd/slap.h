@@ -357,6 +357,7 @@ typedef struct ContentRule ContentRule;
 typedef struct AttributeAssertion AttributeAssertion;
 typedef struct SubstringsAssertion SubstringsAssertion;
 typedef struct Filter Filter;
+typedef struct FilterProg FilterProg;
 typedef struct ValuesReturnFilter ValuesReturnFilter;
 typedef struct Attribute Attribute;
 #ifdef LDAP_COMP_MATCH
@@ -1438,6 +1439,9 @@ typedef struct slap_dn_access {
 	AttributeDescription	*a_at;
 	int			a_self;
 	int 			a_expand;
+
+	/* literal suffix required by a regex, points into a_pat */
+	struct berval		a_tail;
 } slap_dn_access;
 
 /* the "by" part */
@@ -1631,6 +1635,10 @@ typedef struct AccessControl {
 	/* "by" part: list of who has what access to the entries */
 	Access	*acl_access;
 
+	/* position in the database's or the frontend's list */
+	int		acl_pos;
+	int		acl_frontend;
+
 	struct AccessControl	*acl_next;
 } AccessControl;
 
@@ -1996,6 +2004,8 @@ struct BackendDB {
 #define SLAP_DBFLAG_LASTBIND	0x200000U
 #define SLAP_DBFLAG_OPEN	0x400000U	/* db is currently open */
 #define SLAP_DBFLAG_LASTBIND_ASSERT	0x800000U /* send assert control when forwarding pwdLastSuccess */
+#define SLAP_DBFLAG_CTXCSN	0x1000000U /* backend keeps the contextCSN with its writes */
+#define SLAP_DBFLAG_SESSIONLOG	0x2000000U /* backend keeps the syncprov sessionlog with its writes */
 	slap_mask_t	be_flags;
 #define SLAP_DBFLAGS(be)			((be)->be_flags)
 #define SLAP_NOLASTMOD(be)			(SLAP_DBFLAGS(be) & SLAP_DBFLAG_NOLASTMOD)
@@ -2029,6 +2039,8 @@ struct BackendDB {
 #define SLAP_DBACL_ADD(be)			(SLAP_DBFLAGS(be) & SLAP_DBFLAG_ACL_ADD)
 #define SLAP_SYNC_SUBENTRY(be)			(SLAP_DBFLAGS(be) & SLAP_DBFLAG_SYNC_SUBENTRY)
 #define SLAP_LASTBIND_ASSERT(be)		(SLAP_DBFLAGS(be) & SLAP_DBFLAG_LASTBIND_ASSERT)
+#define SLAP_DBCTXCSN(be)			(SLAP_DBFLAGS(be) & SLAP_DBFLAG_CTXCSN)
+#define SLAP_DBSESSIONLOG(be)		(SLAP_DBFLAGS(be) & SLAP_DBFLAG_SESSIONLOG)
 
 	slap_restrictop_t	be_restrictops;		/* restriction operations */
 
@@ -2086,6 +2098,7 @@ struct BackendDB {
 	be_pcsn	be_pcsn_st;			/* be_pending_csn_list now inside this */
 	be_pcsn	*be_pcsn_p;
 	struct syncinfo_s						*be_syncinfo; /* For syncrepl */
+	ber_len_t	be_slog_max;	/* bytes of sessionlog kept, see SLAP_DBFLAG_SESSIONLOG */
 
 	void    *be_pb;         /* Netscape plugin */
 	struct ConfigOCs *be_cf_ocs;
@@ -2228,6 +2241,7 @@ typedef struct rep_search_s {
 	AttributeName *r_attrs;
 	int r_nentries;
 	BerVarray r_v2ref;
+	struct berval *r_pdu;	/* encoded protocolOp to reuse, or to fill in */
 } rep_search_s;
 
 struct SlapReply {
@@ -2272,6 +2286,7 @@ struct SlapReply {
 #define sr_attr_flags sr_un.sru_search.r_attr_flags
 #define	sr_v2ref sr_un.sru_search.r_v2ref
 #define	sr_nentries sr_un.sru_search.r_nentries
+#define	sr_pdu sr_un.sru_search.r_pdu
 #define	sr_rspoid sr_un.sru_extended.r_rspoid
 #define	sr_rspdata sr_un.sru_extended.r_rspdata
 #define	sr_sasldata sr_un.sru_sasl.r_sasldata
@@ -2308,6 +2323,11 @@ typedef int (BI_acl_attribute) LDAP_P(( Operation *op, Entry *target,
 	BerVarray *vals, slap_access_t access ));
 struct OpExtra;
 typedef int (BI_op_txn) LDAP_P(( Operation *op, int txnop, struct OpExtra **ptr ));
+typedef int (BI_op_ctxcsn) LDAP_P(( Operation *op, BerVarray *ctxcsn ));
+typedef int (slap_slog_func) LDAP_P(( void *arg, struct berval *csn,
+	struct berval *uuid, ber_tag_t tag ));
+typedef int (BI_op_sessionlog) LDAP_P(( Operation *op, BerVarray ctxcsn,
+	BerVarray *mincsn, slap_slog_func *func, void *arg ));
 #define SLAP_TXN_BEGIN	1
 #define SLAP_TXN_COMMIT	2
 #define SLAP_TXN_ABORT	3
@@ -2410,6 +2430,8 @@ struct BackendInfo {
 	BI_chk_referrals	*bi_chk_referrals;
 	BI_chk_controls		*bi_chk_controls;
 	BI_op_txn			*bi_op_txn;
+	BI_op_ctxcsn		*bi_op_ctxcsn;
+	BI_op_sessionlog	*bi_op_sessionlog;
 	BI_entry_get_rw		*bi_entry_get_rw;
 	BI_entry_release_rw	*bi_entry_release_rw;
 
@@ -2606,6 +2628,7 @@ struct slap_control_ids {
 	int sc_postRead;
 	int sc_preRead;
 	int sc_proxyAuthz;
+	int sc_proxiedClient;
 	int sc_relax;
 	int sc_searchOptions;
 #ifdef SLAP_CONTROL_X_SORTEDRESULTS
@@ -2628,20 +2651,88 @@ struct slap_control_ids {
 #endif
 };
 
+/*
+ * Statistics counters. Updates are relaxed atomic adds with no locking;
+ * readers sum them up and get an approximate snapshot. Without compiler
+ * atomics concurrent updates of the same counter may get lost.
+ */
+#ifdef HAVE_LONG_LONG
+typedef unsigned long long	slap_counter_t;
+#else
+typedef unsigned long		slap_counter_t;
+#endif
+
+#ifdef __ATOMIC_RELAXED
+#define SLAP_COUNTER_ADD(c,v)	__atomic_fetch_add( &(c), (v), __ATOMIC_RELAXED )
+#define SLAP_COUNTER_GET(c)	__atomic_load_n( &(c), __ATOMIC_RELAXED )
+#else
+#define SLAP_COUNTER_ADD(c,v)	((c) += (v))
+#define SLAP_COUNTER_GET(c)	(c)
+#endif
+
+#ifndef SLAP_CACHELINE
+#define SLAP_CACHELINE	64
+#endif
+
+/* One block per thread, so updates never contend. slap_counters
+ * heads the list and holds the totals of threads that have exited.
+ */
 typedef struct slap_counters_t {
+	char			sc_pad0[SLAP_CACHELINE];
 	struct slap_counters_t	*sc_next;
-	ldap_pvt_thread_mutex_t	sc_mutex;
-	ldap_pvt_mp_t		sc_bytes;
-	ldap_pvt_mp_t		sc_pdu;
-	ldap_pvt_mp_t		sc_entries;
-	ldap_pvt_mp_t		sc_refs;
-
-	ldap_pvt_mp_t		sc_ops_completed;
-	ldap_pvt_mp_t		sc_ops_initiated;
-	ldap_pvt_mp_t		sc_ops_completed_[SLAP_OP_LAST];
-	ldap_pvt_mp_t		sc_ops_initiated_[SLAP_OP_LAST];
+	ldap_pvt_thread_mutex_t	sc_mutex;	/* protects the list */
+	slap_counter_t		sc_bytes;
+	slap_counter_t		sc_pdu;
+	slap_counter_t		sc_entries;
+	slap_counter_t		sc_refs;
+
+	slap_counter_t		sc_ops_completed;
+	slap_counter_t		sc_ops_initiated;
+	slap_counter_t		sc_ops_completed_[SLAP_OP_LAST];
+	slap_counter_t		sc_ops_initiated_[SLAP_OP_LAST];
+	char			sc_pad1[SLAP_CACHELINE];
 } slap_counters_t;
 
+/* Sharded counters for overlays and backends, see slap_stats_alloc() */
+typedef struct slap_stats_t slap_stats_t;
+
+/*
+ * Phases of an operation timed when latencystats is enabled
+ */
+enum {
+	SLAP_PHASE_QUEUE = 0,	/* waiting for a thread */
+	SLAP_PHASE_DECODE,	/* parsing the request */
+	SLAP_PHASE_ACL,		/* access control checks */
+	SLAP_PHASE_INDEX,	/* backend candidate lookup */
+	SLAP_PHASE_ENTRY,	/* backend entry decoding */
+	SLAP_PHASE_ENCODE,	/* encoding search results */
+	SLAP_PHASE_WRITE,	/* writing responses */
+	SLAP_PHASE_TOTAL,	/* the whole operation */
+	SLAP_PHASE_LAST
+};
+
+/* bucket i counts samples below 2^i microseconds, the last one the rest */
+#define SLAP_LATENCY_BUCKETS	24
+
+typedef struct slap_latency_t {
+	unsigned long	sl_count;
+	unsigned long	sl_usec;
+	unsigned long	sl_hist[SLAP_LATENCY_BUCKETS];
+} slap_latency_t;
+
+/* per second rate of a counter, see slap_rate_update() */
+typedef struct slap_rate_t {
+	slap_counter_t	sr_count;
+	time_t		sr_time;
+	unsigned long	sr_rate;
+} slap_rate_t;
+
+#define SLAP_PHASE_BEGIN(t) \
+	((t) = slap_latency_stats ? slap_phase_now() : 0)
+#define SLAP_PHASE_END(op,p,t) do { \
+	if ( (t) ) (op)->o_phase[p] += slap_phase_now() - (t); \
+} while (0)
+
 /*
  * represents an operation pending from an ldap client
  */
@@ -2661,6 +2752,8 @@ typedef struct Opheader {
 
 	slap_counters_t	*oh_counters;
 
+	slap_counter_t	oh_acl_gen;	/* ACL cache data generation at start */
+
 	char		oh_log_prefix[ /* sizeof("conn= op=") + 2*LDAP_PVT_INTTYPE_CHARS(unsigned long) */ SLAP_TEXT_BUFLEN ];
 
 #ifdef LDAP_SLAPI
@@ -2708,6 +2801,7 @@ struct Operation {
 #define o_tmpmemctx o_hdr->oh_tmpmemctx
 #define o_tmpmfuncs o_hdr->oh_tmpmfuncs
 #define o_counters o_hdr->oh_counters
+#define o_acl_gen o_hdr->oh_acl_gen
 
 #define	o_tmpalloc	o_tmpmfuncs->bmf_malloc
 #define o_tmpcalloc	o_tmpmfuncs->bmf_calloc
@@ -2836,6 +2930,7 @@ struct Operation {
 
 #define o_proxy_authz	o_ctrlflag[slap_cids.sc_proxyAuthz]
 #define wants_proxy_authz(op)	(_SCM((op)->o_proxy_authz) > SLAP_CONTROL_IGNORED)
+#define o_proxied_client	o_ctrlflag[slap_cids.sc_proxiedClient]
 
 #define o_subentries	o_ctrlflag[slap_cids.sc_subentries]
 #define get_subentries(op)				_SCM((op)->o_subentries)
@@ -2918,7 +3013,13 @@ struct Operation {
 	AuthorizationInformation o_authz;
 
 	BerElement	*o_ber;		/* ber of the request */
+	struct slap_rbuf *o_rbuf;	/* read buffer o_ber points into */
 	BerElement	*o_res_ber;	/* ber of the CLDAP reply or readback control */
+
+	unsigned long	o_phase[SLAP_PHASE_LAST];	/* usec spent per phase */
+	unsigned long	o_phase_start;	/* start of request decoding */
+	int		o_phase_acl;	/* inside a timed access check */
+
 	slap_callback *o_callback;	/* callback pointers */
 	LDAPControl	**o_ctrls;	 /* controls */
 	struct berval o_csn;
@@ -3028,6 +3129,11 @@ struct Connection {
 	ldap_pvt_thread_cond_t	c_write1_cv;	/* only one pdu written at a time */
 
 	BerElement	*c_currentber;	/* ber we're attempting to read */
+	struct slap_rbuf *c_rbuf;	/* shared read buffer, if any */
+	ber_len_t	c_rbhead;	/* first unconsumed octet in c_rbuf */
+	ber_len_t	c_rbtail;	/* end of data in c_rbuf */
+	ber_len_t	c_rbnext;	/* length of the parsed PDU at c_rbhead */
+	char		c_rbstop;	/* no readahead, a security layer follows */
 	int			c_writers;		/* number of writers waiting */
 	char		c_writing;		/* someone is writing */
 
@@ -3063,6 +3169,13 @@ struct Connection {
 	Backend *c_txn_backend;
 	LDAP_STAILQ_HEAD(c_to, Operation) c_txn_ops; /* list of operations in txn */
 
+	char	c_proxy_session;	/* LDAP_EXOP_X_PROXY_SESSION done */
+	int		c_proxy_nauthz;		/* entries in c_proxy_authz */
+	Avlnode	*c_proxy_authz;		/* cached proxied authzid mappings */
+	slap_counter_t	c_proxy_authz_gen;	/* authz generation of the cache */
+
+	struct slap_batch	*c_batch;	/* queued search results */
+
 	PagedResultsState c_pagedresults_state; /* paged result state */
 
 	long	c_n_ops_received;	/* num of ops received (next op_id) */
@@ -3126,6 +3239,7 @@ struct Listener {
 	int	sl_is_proxied;
 	int	sl_mute;	/* Listener is temporarily disabled due to emfile */
 	int	sl_busy;	/* Listener is busy (accept thread activated) */
+	int	sl_shard;	/* SO_REUSEPORT shard index, -1 if not sharded */
 	ber_socket_t sl_sd;
 	Sockaddr sl_sa;
 #define sl_addr	sl_sa.sa_in_addr
@@ -107,6 +107,13 @@ typedef struct cookie_state {
 #define	SYNCLOG_LOGGING		0	/* doing a log-based update */
 #define	SYNCLOG_FALLBACK	1	/* doing a full refresh */
 
+/* replication lag for one provider serverID */
+typedef struct sync_lag {
+	int		sl_sid;
+	struct timeval	sl_lag;		/* CSN timestamp to local apply */
+	char		sl_csn[LDAP_PVT_CSNSTR_BUFSIZE];	/* newest CSN applied */
+} sync_lag;
+
 #define RETRYNUM_FOREVER	(-1)	/* retry forever */
 #define RETRYNUM_TAIL		(-2)	/* end of retrynum array */
 #define RETRYNUM_VALID(n)	((n) >= RETRYNUM_FOREVER)	/* valid retrynum */
@@ -156,12 +163,18 @@ typedef struct syncinfo_s {
 	int			si_syncdata;
 	int			si_logstate;
 	int			si_lazyCommit;
+	int			si_refreshbatch;	/* refresh entries per backend txn */
+	int			si_logbatch;	/* delta-sync changes per backend txn */
+	int			si_batchnum;
+	OpExtra			*si_batch;	/* open batch txn */
+	struct sync_cookie	si_batchCookie;	/* newest CSNs applied in the batch */
+	slap_counter_t		si_batchgen;	/* authz generation at batch start */
 	int			si_got;
 	int			si_strict_refresh;	/* stop listening during fallback refresh */
 	int			si_too_old;
 	int			si_is_configdb;
 	ber_int_t	si_msgid;
-	Avlnode			*si_presentlist;
+	struct presentlist	*si_presentlist;
 	LDAP			*si_ld;
 	Connection		*si_conn;
 	LDAP_LIST_HEAD(np, nonpresent_entry)	si_nonpresentlist;
@@ -182,17 +195,27 @@ typedef struct syncinfo_s {
 	struct berval	si_lastCookieSent;
 	struct berval	si_monitor_ndn;
 	char	si_connaddrbuf[LDAP_IPADDRLEN];
+	slap_counter_t	si_bytesRcvd;
+	slap_counter_t	si_applied;	/* changes applied */
+	slap_rate_t	si_applyRate;
+	unsigned long	si_refreshEntries;	/* entries in current refresh */
+	unsigned long	si_refreshUUIDs;	/* present UUIDs in current refresh */
+	time_t	si_refreshStart;
+	time_t	si_refreshEnd;
+	/* these are protected by si_monitor_mutex */
+	slap_latency_t	si_applyLatency;
+	sync_lag	*si_lags;
+	int		si_numlags;
 
 	ldap_pvt_thread_mutex_t	si_monitor_mutex;
 	ldap_pvt_thread_mutex_t	si_mutex;
 } syncinfo_t;
 
-static int syncuuid_cmp( const void *, const void * );
 static int presentlist_insert( syncinfo_t* si, struct berval *syncUUID );
-static void presentlist_delete( Avlnode **av, struct berval *syncUUID );
-static char *presentlist_find( Avlnode *av, struct berval *syncUUID );
-static int presentlist_free( Avlnode *av );
+static int presentlist_find( struct presentlist *pl, struct berval *syncUUID );
+static int presentlist_free( struct presentlist *pl );
 static void syncrepl_del_nonpresent( Operation *, syncinfo_t *, BerVarray, struct sync_cookie *, int );
+static void syncrepl_monitor_applied( syncinfo_t *si, struct sync_cookie *sc );
 static int syncrepl_message_to_op(
 					syncinfo_t *, Operation *, LDAPMessage *, int );
 static int syncrepl_message_to_entry(
@@ -534,6 +557,9 @@ refresh_finished(syncinfo_t *si, int reschedule)
 	syncinfo_t *sie;
 	int removed = 0;
 
+	if ( si->si_refreshStart && !si->si_refreshEnd )
+		si->si_refreshEnd = slap_get_time();
+
 	if ( si->si_ctype > 0 && si->si_refreshDone && si->si_retrynum ) {
 		/* ITS#10234: We've made meaningful progress, reinit retry state */
 		int i;
@@ -870,6 +896,10 @@ ldap_sync_search(
 	si->si_refreshDone = 0;
 	si->si_refreshPresent = 0;
 	si->si_refreshDelete = 0;
+	si->si_refreshEntries = 0;
+	si->si_refreshUUIDs = 0;
+	si->si_refreshStart = slap_get_time();
+	si->si_refreshEnd = 0;
 
 	rc = ldap_search_ext( si->si_ld, base, scope, filter, attrs, attrsonly,
 		ctrls, NULL, NULL, si->si_slimit, &si->si_msgid );
@@ -1316,6 +1346,173 @@ get_pmutex(
 	return 0;
 }
 
+/* With refreshbatch, entries received during the refresh phase are
+ * applied in backend transactions of up to si_refreshbatch entries
+ * instead of one each. Likewise with logbatch, delta-sync changes that
+ * are already queued on the connection are replayed in transactions of
+ * up to si_logbatch changes; they are still applied one at a time in
+ * the order received, so CSN order and per-entry ordering are kept.
+ *
+ * The cookie pmutex is held for the life of the batch, so other
+ * consumers of this database don't queue on the backend's write lock
+ * while holding it. A batch is therefore never kept open while waiting
+ * for the provider, see syncrepl_result(). The cookie is only written after the batch has been
+ * committed, and a batch is aborted on any error, so cookies never get
+ * ahead of the data.
+ */
+static int
+syncrepl_batch_begin(
+	syncinfo_t *si,
+	Operation *op )
+{
+	BackendDB *be = op->o_bd;
+	int rc;
+
+	/* caller holds cs_pmutex */
+	if ( si->si_batch ) {
+		LDAP_SLIST_INSERT_HEAD( &op->o_extra, si->si_batch, oe_next );
+		return 0;
+	}
+
+	op->o_bd = si->si_wbe;
+	rc = op->o_bd->bd_info->bi_op_txn( op, SLAP_TXN_BEGIN, &si->si_batch );
+	if ( rc && si->si_batch ) {
+		LDAP_SLIST_REMOVE( &op->o_extra, si->si_batch, OpExtra, oe_next );
+		op->o_bd->bd_info->bi_op_txn( op, SLAP_TXN_ABORT, &si->si_batch );
+		si->si_batch = NULL;
+	}
+	op->o_bd = be;
+	if ( rc ) {
+		Debug( LDAP_DEBUG_ANY, "syncrepl_batch_begin: %s "
+			"couldn't start DB transaction (%d)\n", si->si_ridtxt, rc );
+		return LDAP_OTHER;
+	}
+	si->si_batchnum = 0;
+	si->si_batchgen = slap_sasl_authz_generation();
+	return 0;
+}
+
+/* Remember the newest CSN per SID applied so far in this batch */
+static void
+syncrepl_batch_cookie(
+	syncinfo_t *si,
+	struct sync_cookie *sc )
+{
+	struct sync_cookie *bc = &si->si_batchCookie;
+	int i, j;
+
+	for ( i = 0; i < sc->numcsns; i++ ) {
+		for ( j = 0; j < bc->numcsns && bc->sids[j] < sc->sids[i]; j++ )
+			;
+		if ( j < bc->numcsns && bc->sids[j] == sc->sids[i] ) {
+			if ( ber_bvcmp( &sc->ctxcsn[i], &bc->ctxcsn[j] ) > 0 )
+				ber_bvreplace( &bc->ctxcsn[j], &sc->ctxcsn[i] );
+		} else {
+			slap_insert_csn_sids( bc, j, sc->sids[i], &sc->ctxcsn[i] );
+		}
+	}
+}
+
+static int
+syncrepl_batch_commit(
+	syncinfo_t *si,
+	Operation *op )
+{
+	BackendDB *be = op->o_bd;
+	int rc;
+
+	if ( !si->si_batch )
+		return 0;
+
+	op->o_bd = si->si_wbe;
+	rc = op->o_bd->bd_info->bi_op_txn( op, SLAP_TXN_COMMIT, &si->si_batch );
+	Debug( LDAP_DEBUG_SYNC, "syncrepl_batch_commit: %s "
+		"%d entries, rc=%d\n", si->si_ridtxt, si->si_batchnum, rc );
+	si->si_batch = NULL;
+	si->si_batchnum = 0;
+	if ( !rc && si->si_batchCookie.numcsns )
+		rc = syncrepl_updateCookie( si, op, &si->si_batchCookie, 0 );
+	slap_sync_cookie_free( &si->si_batchCookie, 0 );
+	op->o_bd = be;
+	ldap_pvt_thread_mutex_unlock( &si->si_cookieState->cs_pmutex );
+	if ( rc ) {
+		Debug( LDAP_DEBUG_ANY, "syncrepl_batch_commit: %s "
+			"commit failed (%d)\n", si->si_ridtxt, rc );
+		return LDAP_OTHER;
+	}
+	acl_cache_data_changed();
+	/* the batched ops already bumped it if they touched authz data,
+	 * but before their changes were visible */
+	if ( slap_sasl_authz_generation() != si->si_batchgen )
+		slap_sasl_authz_changed();
+	return 0;
+}
+
+/* Read the next message. While a batch is open nothing is waited for:
+ * if no message is queued yet the batch is committed first, so the
+ * write txn and cs_pmutex are never held across a blocking read.
+ * A failed commit is reported like a failed read.
+ */
+static int
+syncrepl_result(
+	syncinfo_t *si,
+	Operation *op,
+	struct timeval *tout,
+	LDAPMessage **msg )
+{
+	struct timeval zero = { 0, 0 };
+	int rc;
+
+	if ( si->si_batch ) {
+		rc = ldap_result( si->si_ld, si->si_msgid, LDAP_MSG_ONE,
+			&zero, msg );
+		if ( rc )
+			return rc;
+		if ( syncrepl_batch_commit( si, op ))
+			return -1;
+	}
+	return ldap_result( si->si_ld, si->si_msgid, LDAP_MSG_ONE, tout, msg );
+}
+
+static void
+syncrepl_batch_abort(
+	syncinfo_t *si,
+	Operation *op )
+{
+	BackendDB *be = op->o_bd;
+	cookie_state *cs = si->si_cookieState;
+	int i, j;
+
+	if ( !si->si_batch )
+		return;
+
+	op->o_bd = si->si_wbe;
+	op->o_bd->bd_info->bi_op_txn( op, SLAP_TXN_ABORT, &si->si_batch );
+	op->o_bd = be;
+	Debug( LDAP_DEBUG_SYNC, "syncrepl_batch_abort: %s "
+		"discarded %d entries\n", si->si_ridtxt, si->si_batchnum );
+	si->si_batch = NULL;
+	si->si_batchnum = 0;
+
+	/* the discarded changes are no longer pending */
+	if ( si->si_batchCookie.numcsns ) {
+		ldap_pvt_thread_mutex_lock( &cs->cs_mutex );
+		for ( i = 0; i < cs->cs_pnum; i++ ) {
+			for ( j = 0; j < cs->cs_num; j++ ) {
+				if ( cs->cs_sids[j] == cs->cs_psids[i] ) {
+					ber_bvreplace( &cs->cs_pvals[i], &cs->cs_vals[j] );
+					break;
+				}
+			}
+			if ( j == cs->cs_num )
+				cs->cs_pvals[i].bv_val[0] = '\0';
+		}
+		ldap_pvt_thread_mutex_unlock( &cs->cs_mutex );
+		slap_sync_cookie_free( &si->si_batchCookie, 0 );
+	}
+	ldap_pvt_thread_mutex_unlock( &cs->cs_pmutex );
+}
+
 static int
 do_syncrep2(
 	Operation *op,
@@ -1362,10 +1559,11 @@ do_syncrep2(
 		tout.tv_sec = si->si_bindconf.sb_timeout_api;
 	}
 
-	while ( ( rc = ldap_result( si->si_ld, si->si_msgid, LDAP_MSG_ONE,
-		&tout, &msg ) ) > 0 )
+	while ( ( rc = syncrepl_result( si, op, &tout, &msg ) ) > 0 )
 	{
 		int				match, punlock, syncstate;
+		int				logbatch = si->si_logbatch && si->si_syncdata &&
+			si->si_logstate == SYNCLOG_LOGGING && si->si_wbe->bd_info->bi_op_txn;
 		struct berval	*retdata, syncUUID[2], cookie = BER_BVNULL;
 		char			*retoid;
 		LDAPControl		**rctrls = NULL, *rctrlp = NULL;
@@ -1379,7 +1577,13 @@ do_syncrep2(
 			rc = SYNC_SHUTDOWN;
 			goto done;
 		}
+		if ( ldap_msgtype( msg ) != LDAP_RES_SEARCH_ENTRY &&
+			( rc = syncrepl_batch_commit( si, op )))
+			goto done;
 		gettimeofday( &si->si_lastcontact, NULL );
+		if ( ber_get_option( ldap_get_message_ber( msg ),
+				LBER_OPT_BER_TOTAL_BYTES, &len ) == LBER_OPT_SUCCESS )
+			si->si_bytesRcvd += len;
 		switch( ldap_msgtype( msg ) ) {
 		case LDAP_RES_SEARCH_ENTRY:
 #ifdef LDAP_CONTROL_X_DIRSYNC
@@ -1530,7 +1734,10 @@ do_syncrep2(
 						si->si_too_old = 0;
 
 						/* check pending CSNs too */
-						if (( rc = get_pmutex( si ))) {
+						if ( si->si_batch && !logbatch &&
+							( rc = syncrepl_batch_commit( si, op )))
+							goto entry_done;
+						if ( !si->si_batch && ( rc = get_pmutex( si ))) {
 							goto entry_done;
 						}
 
@@ -1539,7 +1746,8 @@ do_syncrep2(
 							ber_bvreplace( &si->si_cookieState->cs_pvals[slot],
 								syncCookie.ctxcsn );
 						} else if ( i == CV_CSN_OLD ) {
-							ldap_pvt_thread_mutex_unlock( &si->si_cookieState->cs_pmutex );
+							if ( !si->si_batch )
+								ldap_pvt_thread_mutex_unlock( &si->si_cookieState->cs_pmutex );
 							rc = 0;
 							/* Should we loop instead? */
 							goto entry_done;
@@ -1566,7 +1774,19 @@ do_syncrep2(
 			rc = 0;
 			if ( si->si_syncdata && si->si_logstate == SYNCLOG_LOGGING ) {
 				modlist = NULL;
-				if ( ( rc = syncrepl_message_to_op( si, op, msg, punlock < 0 ) ) == LDAP_SUCCESS &&
+				if ( logbatch && punlock >= 0 ) {
+					if (( rc = syncrepl_batch_begin( si, op )))
+						goto logerr;
+					/* the batch now owns cs_pmutex and the pending CSN */
+					punlock = -1;
+					rc = syncrepl_message_to_op( si, op, msg, 0 );
+					LDAP_SLIST_REMOVE( &op->o_extra, si->si_batch, OpExtra, oe_next );
+					if ( rc != LDAP_SUCCESS )
+						goto logerr;
+					syncrepl_batch_cookie( si, &syncCookie );
+					if ( ++si->si_batchnum >= si->si_logbatch )
+						rc = syncrepl_batch_commit( si, op );
+				} else if ( ( rc = syncrepl_message_to_op( si, op, msg, punlock < 0 ) ) == LDAP_SUCCESS &&
 					syncCookie.ctxcsn )
 				{
 					rc = syncrepl_updateCookie( si, op, &syncCookie, 0 );
@@ -1595,7 +1815,22 @@ logerr:
 			} else if ( ( rc = syncrepl_message_to_entry( si, op, msg,
 				&modlist, &entry, syncstate, syncUUID ) ) == LDAP_SUCCESS )
 			{
-				if ( punlock < 0 ) {
+				int batch = si->si_refreshbatch && !si->si_refreshDone &&
+					!syncCookie.ctxcsn && si->si_wbe->bd_info->bi_op_txn;
+
+				if ( batch ) {
+					if ( !si->si_batch && ( rc = get_pmutex( si ))) {
+						slap_mods_free( modlist, 1 );
+						entry_free( entry );
+						goto entry_done;
+					}
+					if (( rc = syncrepl_batch_begin( si, op ))) {
+						ldap_pvt_thread_mutex_unlock( &si->si_cookieState->cs_pmutex );
+						slap_mods_free( modlist, 1 );
+						entry_free( entry );
+						goto entry_done;
+					}
+				} else if ( punlock < 0 ) {
 					if (( rc = get_pmutex( si ))) {
 						slap_mods_free( modlist, 1 );
 						entry_free( entry );
@@ -1608,7 +1843,11 @@ logerr:
 				{
 					rc = syncrepl_updateCookie( si, op, &syncCookie, 0 );
 				}
-				if ( punlock < 0 )
+				if ( batch ) {
+					LDAP_SLIST_REMOVE( &op->o_extra, si->si_batch, OpExtra, oe_next );
+					if ( !rc && ++si->si_batchnum >= si->si_refreshbatch )
+						rc = syncrepl_batch_commit( si, op );
+				} else if ( punlock < 0 )
 					ldap_pvt_thread_mutex_unlock( &si->si_cookieState->cs_pmutex );
 			}
 			if ( punlock >= 0 ) {
@@ -1633,6 +1872,9 @@ logerr:
 				slap_mods_free( modlist, 1 );
 			}
 entry_done:
+			if ( rc == LDAP_SUCCESS )
+				syncrepl_monitor_applied( si,
+					BER_BVISNULL( &cookie ) ? NULL : &syncCookie );
 			if ( LogTest( LDAP_DEBUG_SYNCSTATS | LDAP_DEBUG_SYNC ) ) {
 				struct timeval now;
 				gettimeofday( &now, NULL );
@@ -2119,6 +2361,8 @@ result_done:
 			break;
 
 		}
+		if ( si->si_refreshDone && !si->si_refreshEnd )
+			si->si_refreshEnd = slap_get_time();
 		if ( !BER_BVISNULL( &syncCookie.octet_str ) ) {
 			slap_sync_cookie_free( &syncCookie_req, 0 );
 			syncCookie_req = syncCookie;
@@ -2127,6 +2371,10 @@ result_done:
 		ldap_msgfree( msg );
 		msg = NULL;
 		if ( ldap_pvt_thread_pool_pausing( &connection_pool )) {
+			if ( syncrepl_batch_commit( si, op )) {
+				rc = LDAP_OTHER;
+				goto done;
+			}
 			slap_sync_cookie_free( &syncCookie, 0 );
 			slap_sync_cookie_free( &syncCookie_req, 0 );
 			return SYNC_PAUSED;
@@ -2140,6 +2388,10 @@ result_done:
 	}
 
 done:
+	if ( rc )
+		syncrepl_batch_abort( si, op );
+	else if ( syncrepl_batch_commit( si, op ))
+		rc = LDAP_OTHER;
 	if ( err != LDAP_SUCCESS ) {
 		Debug( LDAP_DEBUG_ANY,
 			"do_syncrep2: %s (%d) %s\n",
@@ -4136,7 +4388,93 @@ typedef struct dninfo {
 	char oldcsn[LDAP_PVT_CSNSTR_BUFSIZE];
 } dninfo;
 
-#define HASHUUID	1
+/* The present list records every UUID the provider reports during the
+ * present phase. It is hashed on the first two bytes of the UUID into
+ * 65536 blocks; each block keeps the remaining bytes packed in a single
+ * array, sorted except for a short unsorted tail that is merged in once
+ * it fills up. This costs PRESENT_VLEN bytes per UUID instead of a
+ * separately allocated tree node.
+ */
+#define PRESENT_VLEN	(UUIDLEN-2)
+#define PRESENT_TAIL	32
+#define PRESENT_SLOTS	65536
+
+typedef struct presentblock {
+	unsigned int pb_num;	/* values in the block */
+	unsigned int pb_sorted;	/* leading values that are sorted */
+	unsigned int pb_max;	/* values allocated */
+} presentblock;
+
+#define PB_VALS(pb)	((unsigned char *)((pb)+1))
+#define PB_VAL(pb,i)	(PB_VALS(pb) + (i) * PRESENT_VLEN)
+
+typedef struct presentlist {
+	int pl_num;		/* UUIDs inserted */
+	int pl_found;	/* UUIDs matched by the nonpresent search */
+	presentblock *pl_blocks[PRESENT_SLOTS];
+} presentlist;
+
+static int
+presentblock_search( presentblock *pb, const unsigned char *val )
+{
+	unsigned int lo = 0, hi = pb->pb_sorted, i;
+	int c;
+
+	while ( lo < hi ) {
+		unsigned int mid = ( lo + hi ) / 2;
+		c = memcmp( val, PB_VAL( pb, mid ), PRESENT_VLEN );
+		if ( !c )
+			return 1;
+		if ( c < 0 )
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	for ( i = pb->pb_sorted; i < pb->pb_num; i++ ) {
+		if ( !memcmp( val, PB_VAL( pb, i ), PRESENT_VLEN ))
+			return 1;
+	}
+	return 0;
+}
+
+static int
+presentval_cmp( const void *v1, const void *v2 )
+{
+	return memcmp( v1, v2, PRESENT_VLEN );
+}
+
+/* Sort the unsorted tail and merge it into the sorted head, working
+ * backwards so no scratch space is needed.
+ */
+static void
+presentblock_merge( presentblock *pb )
+{
+	unsigned int i, j, k, tail = pb->pb_num - pb->pb_sorted;
+	unsigned char tmp[PRESENT_TAIL * PRESENT_VLEN];
+
+	if ( !tail )
+		return;
+
+	AC_MEMCPY( tmp, PB_VAL( pb, pb->pb_sorted ), tail * PRESENT_VLEN );
+	qsort( tmp, tail, PRESENT_VLEN, presentval_cmp );
+
+	i = pb->pb_sorted;
+	j = tail;
+	k = pb->pb_num;
+	while ( j ) {
+		if ( i && memcmp( PB_VAL( pb, i-1 ), tmp + (j-1) * PRESENT_VLEN,
+				PRESENT_VLEN ) > 0 ) {
+			AC_MEMCPY( PB_VAL( pb, k-1 ), PB_VAL( pb, i-1 ), PRESENT_VLEN );
+			i--;
+		} else {
+			AC_MEMCPY( PB_VAL( pb, k-1 ), tmp + (j-1) * PRESENT_VLEN,
+				PRESENT_VLEN );
+			j--;
+		}
+		k--;
+	}
+	pb->pb_sorted = pb->pb_num;
+}
 
 /* return 1 if inserted, 0 otherwise */
 static int
@@ -4144,100 +4482,81 @@ presentlist_insert(
 	syncinfo_t* si,
 	struct berval *syncUUID )
 {
-	char *val;
+	presentlist *pl;
+	presentblock *pb;
+	unsigned char *val;
+	unsigned short s;
 
 	if ( syncUUID->bv_len != UUIDLEN ) {
 		return 1;
 	}
 
-#ifdef HASHUUID
-	Avlnode **av;
-	unsigned short s;
-
 	if ( !si->si_presentlist )
-		si->si_presentlist = ch_calloc(65536, sizeof( Avlnode * ));
+		si->si_presentlist = ch_calloc( 1, sizeof( presentlist ));
+	pl = si->si_presentlist;
 
-	av = (Avlnode **)si->si_presentlist;
+	memcpy( &s, syncUUID->bv_val, 2 );
+	val = (unsigned char *)syncUUID->bv_val + 2;
+	pb = pl->pl_blocks[s];
 
-	val = ch_malloc(UUIDLEN-2);
-	memcpy(&s, syncUUID->bv_val, 2);
-	memcpy(val, syncUUID->bv_val+2, UUIDLEN-2);
-
-	if ( ldap_avl_insert( &av[s], val,
-		syncuuid_cmp, ldap_avl_dup_error ) )
-	{
-		ch_free( val );
+	if ( pb && presentblock_search( pb, val ))
 		return 0;
-	}
-#else
-	val = ch_malloc(UUIDLEN);
 
-	AC_MEMCPY( val, syncUUID->bv_val, UUIDLEN );
+	si->si_refreshUUIDs++;
 
-	if ( ldap_avl_insert( &si->si_presentlist, val,
-		syncuuid_cmp, ldap_avl_dup_error ) )
-	{
-		ch_free( val );
-		return 0;
+	if ( !pb || pb->pb_num == pb->pb_max ) {
+		unsigned int max = pb ? pb->pb_max * 2 : 4;
+
+		pb = ch_realloc( pb, sizeof( presentblock ) + max * PRESENT_VLEN );
+		if ( !pl->pl_blocks[s] ) {
+			pb->pb_num = 0;
+			pb->pb_sorted = 0;
+		}
+		pb->pb_max = max;
+		pl->pl_blocks[s] = pb;
 	}
-#endif
+
+	AC_MEMCPY( PB_VAL( pb, pb->pb_num ), val, PRESENT_VLEN );
+	pb->pb_num++;
+	pl->pl_num++;
+	if ( pb->pb_num - pb->pb_sorted >= PRESENT_TAIL )
+		presentblock_merge( pb );
 
 	return 1;
 }
 
-static char *
+static int
 presentlist_find(
-	Avlnode *av,
+	presentlist *pl,
 	struct berval *val )
 {
-#ifdef HASHUUID
-	Avlnode **a2 = (Avlnode **)av;
+	presentblock *pb;
 	unsigned short s;
 
-	if (!av)
-		return NULL;
+	if ( !pl || val->bv_len != UUIDLEN )
+		return 0;
 
-	memcpy(&s, val->bv_val, 2);
-	return ldap_avl_find( a2[s], val->bv_val+2, syncuuid_cmp );
-#else
-	return ldap_avl_find( av, val->bv_val, syncuuid_cmp );
-#endif
+	memcpy( &s, val->bv_val, 2 );
+	pb = pl->pl_blocks[s];
+	return pb && presentblock_search( pb, (unsigned char *)val->bv_val + 2 );
 }
 
+/* returns the number of UUIDs that were never matched */
 static int
-presentlist_free( Avlnode *av )
+presentlist_free( presentlist *pl )
 {
-#ifdef HASHUUID
-	Avlnode **a2 = (Avlnode **)av;
-	int i, count = 0;
+	int i, count;
 
-	if ( av ) {
-		for (i=0; i<65536; i++) {
-			if (a2[i])
-				count += ldap_avl_free( a2[i], ch_free );
-		}
-		ch_free( av );
+	if ( !pl )
+		return 0;
+
+	for ( i = 0; i < PRESENT_SLOTS; i++ ) {
+		if ( pl->pl_blocks[i] )
+			ch_free( pl->pl_blocks[i] );
 	}
+	count = pl->pl_num - pl->pl_found;
+	ch_free( pl );
 	return count;
-#else
-	return ldap_avl_free( av, ch_free );
-#endif
-}
-
-static void
-presentlist_delete(
-	Avlnode **av,
-	struct berval *val )
-{
-#ifdef HASHUUID
-	Avlnode **a2 = *(Avlnode ***)av;
-	unsigned short s;
-
-	memcpy(&s, val->bv_val, 2);
-	ldap_avl_delete( &a2[s], val->bv_val+2, syncuuid_cmp );
-#else
-	ldap_avl_delete( av, val->bv_val, syncuuid_cmp );
-#endif
 }
 
 static int
@@ -6240,7 +6559,7 @@ nonpresent_callback(
 	syncinfo_t *si = op->o_callback->sc_private;
 	Attribute *a;
 	int count = 0;
-	char *present_uuid = NULL;
+	int present_uuid = 0;
 	struct nonpresent_entry *np_entry;
 	struct sync_cookie *syncCookie = op->o_controls[slap_cids.sc_LDAPsync];
 
@@ -6272,7 +6591,7 @@ nonpresent_callback(
 			return LDAP_SUCCESS;
 		}
 
-		if ( present_uuid == NULL ) {
+		if ( !present_uuid ) {
 			int covered = 1; /* covered by our new contextCSN? */
 
 			if ( !syncCookie )
@@ -6307,8 +6626,7 @@ nonpresent_callback(
 			}
 
 		} else {
-			presentlist_delete( &si->si_presentlist, &a->a_nvals[0] );
-			ch_free( present_uuid );
+			si->si_presentlist->pl_found++;
 		}
 	}
 	return LDAP_SUCCESS;
@@ -6417,16 +6735,6 @@ done:;
 	return new;
 }
 
-static int
-syncuuid_cmp( const void* v_uuid1, const void* v_uuid2 )
-{
-#ifdef HASHUUID
-	return ( memcmp( v_uuid1, v_uuid2, UUIDLEN-2 ));
-#else
-	return ( memcmp( v_uuid1, v_uuid2, UUIDLEN ));
-#endif
-}
-
 void
 syncinfo_free( syncinfo_t *sie, int free_all )
 {
@@ -6444,6 +6752,7 @@ syncinfo_free( syncinfo_t *sie, int free_all )
 		}
 		ch_free( sie->si_lastCookieSent.bv_val );
 		ch_free( sie->si_lastCookieRcvd.bv_val );
+		ch_free( sie->si_lags );
 
 		if ( sie->si_ld ) {
 			if ( sie->si_conn ) {
@@ -6532,6 +6841,7 @@ syncinfo_free( syncinfo_t *sie, int free_all )
 			ch_free( sie->si_retrynum_init );
 		}
 		slap_sync_cookie_free( &sie->si_syncCookie, 0 );
+		slap_sync_cookie_free( &sie->si_batchCookie, 0 );
 #ifdef LDAP_CONTROL_X_DIRSYNC
 		if ( sie->si_dirSyncCookie.bv_val ) {
 			ch_free( sie->si_dirSyncCookie.bv_val );
@@ -6642,6 +6952,8 @@ config_suffixm( ConfigArgs *c, syncinfo_t *si )
 #define SUFFIXMSTR		"suffixmassage"
 #define	STRICT_REFRESH	"strictrefresh"
 #define LAZY_COMMIT		"lazycommit"
+#define REFRESHBATCHSTR		"refreshbatch"
+#define LOGBATCHSTR		"logbatch"
 
 /* FIXME: undocumented */
 #define EXATTRSSTR		"exattrs"
@@ -7169,6 +7481,32 @@ parse_syncrepl_line(
 					STRLENOF( LAZY_COMMIT ) ) )
 		{
 			si->si_lazyCommit = 1;
+		} else if ( !strncasecmp( c->argv[ i ], REFRESHBATCHSTR "=",
+					STRLENOF( REFRESHBATCHSTR "=" ) ) )
+		{
+			val = c->argv[ i ] + STRLENOF( REFRESHBATCHSTR "=" );
+			if ( lutil_atoi( &si->si_refreshbatch, val ) != 0
+				|| si->si_refreshbatch < 0 )
+			{
+				snprintf( c->cr_msg, sizeof( c->cr_msg ),
+					"invalid refreshbatch value \"%s\".\n",
+					val );
+				Debug( LDAP_DEBUG_ANY, "%s: %s.\n", c->log, c->cr_msg );
+				return 1;
+			}
+		} else if ( !strncasecmp( c->argv[ i ], LOGBATCHSTR "=",
+					STRLENOF( LOGBATCHSTR "=" ) ) )
+		{
+			val = c->argv[ i ] + STRLENOF( LOGBATCHSTR "=" );
+			if ( lutil_atoi( &si->si_logbatch, val ) != 0
+				|| si->si_logbatch < 0 )
+			{
+				snprintf( c->cr_msg, sizeof( c->cr_msg ),
+					"invalid logbatch value \"%s\".\n",
+					val );
+				Debug( LDAP_DEBUG_ANY, "%s: %s.\n", c->log, c->cr_msg );
+				return 1;
+			}
 		} else if ( !bindconf_parse( c, c->argv[i], &si->si_bindconf ) ) {
 			si->si_got |= GOT_BINDCONF;
 		} else {
@@ -7246,13 +7584,16 @@ parse_syncrepl_line(
 	provider URLs
 	timestamp of last contact
 	cookievals
+	replication lag, throughput and refresh progress
 	*/
 
 static ObjectClass	*oc_olmSyncRepl;
 static AttributeDescription	*ad_olmProviderURIList,
 	*ad_olmConnection, *ad_olmSyncPhase,
 	*ad_olmNextConnect, *ad_olmLastConnect, *ad_olmLastContact,
-	*ad_olmLastCookieRcvd, *ad_olmLastCookieSent;
+	*ad_olmLastCookieRcvd, *ad_olmLastCookieSent,
+	*ad_olmProviderLag, *ad_olmChangesApplied, *ad_olmApplyRate,
+	*ad_olmBytesRcvd, *ad_olmRefreshProgress, *ad_olmApplyLatency;
 
 static struct {
 	char *name;
@@ -7328,6 +7669,55 @@ static struct {
 		"NO-USER-MODIFICATION "
 		"USAGE dSAOperation )",
 		&ad_olmLastCookieSent },
+	{ "( olmSyncReplAttributes:9 "
+		"NAME ( 'olmSRProviderLag' ) "
+		"DESC 'Delay between a change on each provider serverID and applying it here' "
+		"SUP monitoredInfo "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmProviderLag },
+	{ "( olmSyncReplAttributes:10 "
+		"NAME ( 'olmSRChangesApplied' ) "
+		"DESC 'Number of entries and changes applied' "
+		"SUP monitorCounter "
+		"SINGLE-VALUE "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmChangesApplied },
+	{ "( olmSyncReplAttributes:11 "
+		"NAME ( 'olmSRApplyRate' ) "
+		"DESC 'Entries and changes applied per second' "
+		"EQUALITY integerMatch "
+		"ORDERING integerOrderingMatch "
+		"SYNTAX 1.3.6.1.4.1.1466.115.121.1.27 "
+		"SINGLE-VALUE "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmApplyRate },
+	{ "( olmSyncReplAttributes:12 "
+		"NAME ( 'olmSRBytesRcvd' ) "
+		"DESC 'Bytes of sync messages received from provider' "
+		"SUP monitorCounter "
+		"SINGLE-VALUE "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmBytesRcvd },
+	{ "( olmSyncReplAttributes:13 "
+		"NAME ( 'olmSRRefreshProgress' ) "
+		"DESC 'Entries and present UUIDs received in the current or last refresh' "
+		"SUP monitoredInfo "
+		"SINGLE-VALUE "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmRefreshProgress },
+	{ "( olmSyncReplAttributes:14 "
+		"NAME ( 'olmSRApplyLatency' ) "
+		"DESC 'Histogram of time taken to apply received entries and changes' "
+		"SUP monitoredInfo "
+		"SINGLE-VALUE "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmApplyLatency },
 	{ NULL }
 };
 
@@ -7347,6 +7737,12 @@ static struct {
 			"$ olmSRLastContact "
 			"$ olmSRLastCookieRcvd "
 			"$ olmSRLastCookieSent "
+			"$ olmSRProviderLag "
+			"$ olmSRChangesApplied "
+			"$ olmSRApplyRate "
+			"$ olmSRBytesRcvd "
+			"$ olmSRRefreshProgress "
+			"$ olmSRApplyLatency "
 			") )",
 		&oc_olmSyncRepl },
 	{ NULL }
@@ -7523,11 +7919,129 @@ syncrepl_monitor_update(
 	if ( !BER_BVISEMPTY( &si->si_lastCookieSent ) &&
 		!bvmatch( &a->a_vals[0], &si->si_lastCookieSent ))
 		ber_bvreplace( &a->a_vals[0], &si->si_lastCookieSent );
+
+	/* the rest are rebuilt each time, after the fixed attributes above */
+	{
+		char buf[ 64 + SLAP_LATENCY_BUCKETS * 21 ];
+		struct berval bv;
+		time_t now = slap_get_time();
+		int i;
+
+		bv.bv_val = buf;
+
+		attr_delete( &e->e_attrs, ad_olmProviderLag );
+		for ( i = 0; i < si->si_numlags; i++ ) {
+			sync_lag *sl = &si->si_lags[i];
+			bv.bv_len = snprintf( buf, sizeof( buf ), "sid=%03x lag=%ld.%06ld csn=%s",
+				sl->sl_sid, (long)sl->sl_lag.tv_sec, (long)sl->sl_lag.tv_usec,
+				sl->sl_csn );
+			attr_merge_normalize_one( e, ad_olmProviderLag, &bv, NULL );
+		}
+
+		attr_delete( &e->e_attrs, ad_olmApplyLatency );
+		if ( si->si_applyLatency.sl_count ) {
+			bv.bv_len = slap_latency2str( &si->si_applyLatency, buf, sizeof( buf ));
+			attr_merge_normalize_one( e, ad_olmApplyLatency, &bv, NULL );
+		}
+
+		attr_delete( &e->e_attrs, ad_olmChangesApplied );
+		bv.bv_len = snprintf( buf, sizeof( buf ), "%llu",
+			(unsigned long long)si->si_applied );
+		attr_merge_normalize_one( e, ad_olmChangesApplied, &bv, NULL );
+
+		attr_delete( &e->e_attrs, ad_olmApplyRate );
+		bv.bv_len = snprintf( buf, sizeof( buf ), "%lu",
+			slap_rate_update( &si->si_applyRate, si->si_applied, now ));
+		attr_merge_normalize_one( e, ad_olmApplyRate, &bv, NULL );
+
+		attr_delete( &e->e_attrs, ad_olmBytesRcvd );
+		bv.bv_len = snprintf( buf, sizeof( buf ), "%llu",
+			(unsigned long long)si->si_bytesRcvd );
+		attr_merge_normalize_one( e, ad_olmBytesRcvd, &bv, NULL );
+
+		attr_delete( &e->e_attrs, ad_olmRefreshProgress );
+		if ( si->si_refreshStart ) {
+			time_t end = si->si_refreshEnd ? si->si_refreshEnd : now;
+			bv.bv_len = snprintf( buf, sizeof( buf ),
+				"entries=%lu present=%lu elapsed=%ld%s",
+				si->si_refreshEntries, si->si_refreshUUIDs,
+				(long)( end - si->si_refreshStart ),
+				si->si_refreshEnd ? "" : " running" );
+			attr_merge_normalize_one( e, ad_olmRefreshProgress, &bv, NULL );
+		}
+	}
 	ldap_pvt_thread_mutex_unlock( &si->si_monitor_mutex );
 
 	return SLAP_CB_CONTINUE;
 }
 
+/*
+ * Account for a received entry or change that was applied, or skipped
+ * as already present. sc is the cookie that came with it, if any; its
+ * CSNs give the replication lag for their serverIDs.
+ */
+static void
+syncrepl_monitor_applied( syncinfo_t *si, struct sync_cookie *sc )
+{
+	struct timeval now, tv;
+	int i, j;
+
+	gettimeofday( &now, NULL );
+	tv.tv_sec = now.tv_sec - si->si_lastcontact.tv_sec;
+	tv.tv_usec = now.tv_usec - si->si_lastcontact.tv_usec;
+	if ( tv.tv_usec < 0 ) {
+		--tv.tv_sec; tv.tv_usec += 1000000;
+	}
+
+	si->si_applied++;
+	if ( !si->si_refreshDone )
+		si->si_refreshEntries++;
+
+	ldap_pvt_thread_mutex_lock( &si->si_monitor_mutex );
+	slap_latency_add( &si->si_applyLatency,
+		tv.tv_sec * 1000000UL + tv.tv_usec );
+
+	for ( i = 0; sc && i < sc->numcsns; i++ ) {
+		struct lutil_tm tm;
+		struct lutil_timet tt;
+		sync_lag *sl;
+		int sid = slap_parse_csn_sid( &sc->ctxcsn[i] );
+
+		if ( sid < 0 )
+			continue;
+		for ( j = 0; j < si->si_numlags; j++ ) {
+			if ( si->si_lags[j].sl_sid == sid ) break;
+		}
+		if ( j == si->si_numlags ) {
+			si->si_lags = ch_realloc( si->si_lags,
+				( j + 1 ) * sizeof( sync_lag ));
+			si->si_numlags++;
+			si->si_lags[j].sl_sid = sid;
+			si->si_lags[j].sl_csn[0] = '\0';
+		}
+		sl = &si->si_lags[j];
+
+		/* only the newest CSN seen for the SID counts */
+		if ( sc->ctxcsn[i].bv_len >= sizeof( sl->sl_csn ) ||
+			strcmp( sc->ctxcsn[i].bv_val, sl->sl_csn ) <= 0 ||
+			lutil_parsetime( sc->ctxcsn[i].bv_val, &tm ))
+			continue;
+		lutil_tm2time( &tm, &tt );
+
+		AC_MEMCPY( sl->sl_csn, sc->ctxcsn[i].bv_val, sc->ctxcsn[i].bv_len + 1 );
+		sl->sl_lag.tv_sec = now.tv_sec - tt.tt_sec;
+		sl->sl_lag.tv_usec = now.tv_usec - tt.tt_nsec / 1000;
+		if ( sl->sl_lag.tv_usec < 0 ) {
+			--sl->sl_lag.tv_sec; sl->sl_lag.tv_usec += 1000000;
+		}
+		/* provider clock ahead of ours */
+		if ( sl->sl_lag.tv_sec < 0 ) {
+			sl->sl_lag.tv_sec = 0; sl->sl_lag.tv_usec = 0;
+		}
+	}
+	ldap_pvt_thread_mutex_unlock( &si->si_monitor_mutex );
+}
+
 static int
 syncrepl_monitor_add(
 	syncinfo_t *si
@@ -7990,6 +8504,20 @@ syncrepl_unparse( syncinfo_t *si, struct berval *bv )
 		ptr = lutil_strcopy( ptr, " " LAZY_COMMIT );
 	}
 
+	if ( si->si_refreshbatch ) {
+		len = snprintf( ptr, WHATSLEFT, " " REFRESHBATCHSTR "=%d",
+			si->si_refreshbatch );
+		if ( WHATSLEFT <= len ) return;
+		ptr += len;
+	}
+
+	if ( si->si_logbatch ) {
+		len = snprintf( ptr, WHATSLEFT, " " LOGBATCHSTR "=%d",
+			si->si_logbatch );
+		if ( WHATSLEFT <= len ) return;
+		ptr += len;
+	}
+
 	bc.bv_len = ptr - buf;
 	bc.bv_val = buf;
 	ber_dupbv( bv, &bc );
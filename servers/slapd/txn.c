@@ -296,6 +296,14 @@ int txn_end_extop(
 		if ( rc ) {
 			rs->sr_text = "transaction commit failed";
 			rc = LDAP_OTHER;
+		} else {
+			acl_cache_data_changed();
+			LDAP_STAILQ_FOREACH( o, &c->c_txn_ops, o_next ) {
+				if ( slap_sasl_authz_relevant( o )) {
+					slap_sasl_authz_changed();
+					break;
+				}
+			}
 		}
 	} else {
 		rs->sr_text = "transaction aborted";
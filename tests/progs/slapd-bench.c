@@ -0,0 +1,998 @@
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 1999-2026 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/*
+ * An open-loop benchmark driver. Unlike the other tools here, requests are
+ * not sent in response to the previous one completing but at a fixed rate
+ * over the whole run, spread over a number of connections and threads, with
+ * up to a configured number of requests outstanding on each connection. If
+ * the server falls behind, requests that could not be sent on time are
+ * still timed from the moment they were due to be sent, so that queueing
+ * delay shows up in the latencies instead of silently lowering the offered
+ * load. Connections can be recycled after a number of operations to
+ * measure the cost of connection setup as well.
+ *
+ * Latencies are kept in log-linear histograms with 1/128 relative
+ * precision, the results are written out as a JSON document.
+ */
+
+#include "portable.h"
+
+/* Requires libldap with threads */
+
+#include <stdio.h>
+#include <stdint.h>
+#include "ldap_pvt_thread.h"
+
+#include "ac/stdlib.h"
+
+#include "ac/errno.h"
+#include "ac/signal.h"
+#include "ac/socket.h"
+#include "ac/string.h"
+#include "ac/time.h"
+#include "ac/unistd.h"
+
+#include "ldap.h"
+#include "lutil.h"
+#include "ldap_pvt.h"
+
+#include "slapd-common.h"
+
+#define MAX_THREAD	1024
+
+/* How long to wait for outstanding responses at the end of the run */
+#define BENCH_GRACE	5000000
+/* How long to wait before retrying a failed connection */
+#define BENCH_RETRY	1000000
+
+enum {
+	BENCH_SEARCH,
+	BENCH_READ,
+	BENCH_COMPARE,
+	BENCH_MODIFY,
+	BENCH_BIND,
+	BENCH_LAST
+};
+
+static const char *bench_opnames[] = {
+	"search",
+	"read",
+	"compare",
+	"modify",
+	"bind",
+	NULL
+};
+
+/*
+ * Values below HIST_SUB_COUNT are counted exactly, above that each power of
+ * two is split into HIST_HALF buckets.
+ */
+#define HIST_SUB_BITS	8
+#define HIST_SUB_COUNT	( 1 << HIST_SUB_BITS )
+#define HIST_HALF	( HIST_SUB_COUNT / 2 )
+#define HIST_MAX_BITS	40
+#define HIST_BUCKETS	( HIST_SUB_COUNT + \
+		( HIST_MAX_BITS - HIST_SUB_BITS ) * HIST_HALF )
+
+typedef struct bench_hist {
+	uint64_t bh_counts[ HIST_BUCKETS ];
+	uint64_t bh_total, bh_sum, bh_min, bh_max;
+} bench_hist;
+
+typedef struct bench_stats {
+	bench_hist bs_hist;
+	unsigned long bs_count, bs_errors, bs_busy, bs_entries;
+} bench_stats;
+
+typedef struct bench_op {
+	int bo_msgid;
+	int bo_type;
+	int bo_entries;
+	uint64_t bo_start;
+} bench_op;
+
+typedef struct bench_conn {
+	LDAP *bc_ld;
+	int bc_pending;
+	int bc_binding;
+	int bc_issued;
+	uint64_t bc_retry;
+	bench_op *bc_ops;
+} bench_conn;
+
+typedef struct bench_thread {
+	ldap_pvt_thread_t bt_tid;
+	int bt_idx;
+
+	bench_conn *bt_conns;
+	int bt_nconns, bt_next;
+
+	unsigned int bt_seed;
+
+	bench_stats bt_ops[ BENCH_LAST ];
+	bench_stats bt_connect;
+	unsigned long bt_sent, bt_unsent, bt_lost;
+	uint64_t bt_maxlag;
+} bench_thread;
+
+static struct tester_conn_args *config;
+static int nobind;
+
+static char *base;
+static int scope = LDAP_SCOPE_SUBTREE;
+static char *filter = "(objectClass=*)";
+static char *entry;
+static char **attrs;
+static char *attr = "description";
+static struct berval value = BER_BVC("slapd-bench");
+
+static int mix[ BENCH_LAST ] = { 1 };
+static int mixtotal = 1;
+
+static int rate;
+static int duration = 10;
+static int warmup;
+static int depth = 1;
+static int churn;
+static int nconns = 1;
+static int nthreads = 1;
+
+static uint64_t t_begin, t_measure, t_end;
+
+static bench_thread *threads;
+
+static void
+usage( char *name, char opt )
+{
+	if ( opt != '\0' ) {
+		fprintf( stderr, "unknown/incorrect option \"%c\"\n", opt );
+	}
+
+	fprintf( stderr, "usage: %s " TESTER_COMMON_HELP
+		"-b <base> "
+		"-q <ops per second> "
+		"[-A <attr>=<value>] "
+		"[-c <connections>] "
+		"[-e <entry>] "
+		"[-f <filter>] "
+		"[-j <threads>] "
+		"[-m <op>=<weight>[,...]] "
+		"[-N] "
+		"[-n <ops per connection>] "
+		"[-o <output file>] "
+		"[-p <depth>] "
+		"[-s <scope>] "
+		"[-T <seconds>] "
+		"[-W <warmup seconds>] "
+		"[<attrs>] "
+		"\n",
+		name );
+	exit( EXIT_FAILURE );
+}
+
+static uint64_t
+bench_now( void )
+{
+#ifdef HAVE_CLOCK_GETTIME
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#else
+	struct timeval tv;
+
+	gettimeofday( &tv, NULL );
+	return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+#endif
+}
+
+static int
+hist_index( uint64_t v )
+{
+	int e = 0;
+
+	if ( v < HIST_SUB_COUNT ) {
+		return v;
+	}
+	if ( v >> HIST_MAX_BITS ) {
+		v = ( (uint64_t)1 << HIST_MAX_BITS ) - 1;
+	}
+	while ( ( v >> e ) >= HIST_SUB_COUNT ) {
+		e++;
+	}
+	return HIST_SUB_COUNT + ( e - 1 ) * HIST_HALF + ( v >> e ) - HIST_HALF;
+}
+
+/* Highest value that is counted in bucket idx */
+static uint64_t
+hist_value( int idx )
+{
+	int e;
+
+	if ( idx < HIST_SUB_COUNT ) {
+		return idx;
+	}
+	idx -= HIST_SUB_COUNT;
+	e = idx / HIST_HALF + 1;
+	return ( (uint64_t)( idx % HIST_HALF + HIST_HALF + 1 ) << e ) - 1;
+}
+
+static void
+hist_record( bench_hist *h, uint64_t v )
+{
+	h->bh_counts[ hist_index( v ) ]++;
+	if ( !h->bh_total || v < h->bh_min ) {
+		h->bh_min = v;
+	}
+	if ( v > h->bh_max ) {
+		h->bh_max = v;
+	}
+	h->bh_total++;
+	h->bh_sum += v;
+}
+
+static void
+hist_merge( bench_hist *to, bench_hist *from )
+{
+	int i;
+
+	if ( !from->bh_total ) return;
+
+	for ( i = 0; i < HIST_BUCKETS; i++ ) {
+		to->bh_counts[i] += from->bh_counts[i];
+	}
+	if ( !to->bh_total || from->bh_min < to->bh_min ) {
+		to->bh_min = from->bh_min;
+	}
+	if ( from->bh_max > to->bh_max ) {
+		to->bh_max = from->bh_max;
+	}
+	to->bh_total += from->bh_total;
+	to->bh_sum += from->bh_sum;
+}
+
+static uint64_t
+hist_percentile( bench_hist *h, double p )
+{
+	uint64_t target, seen = 0;
+	int i;
+
+	if ( !h->bh_total ) return 0;
+
+	target = (uint64_t)( p / 100 * h->bh_total + 0.5 );
+	if ( target < 1 ) target = 1;
+
+	for ( i = 0; i < HIST_BUCKETS; i++ ) {
+		seen += h->bh_counts[i];
+		if ( seen >= target ) {
+			uint64_t v = hist_value( i );
+			return v < h->bh_max ? v : h->bh_max;
+		}
+	}
+	return h->bh_max;
+}
+
+static void
+stats_merge( bench_stats *to, bench_stats *from )
+{
+	hist_merge( &to->bs_hist, &from->bs_hist );
+	to->bs_count += from->bs_count;
+	to->bs_errors += from->bs_errors;
+	to->bs_busy += from->bs_busy;
+	to->bs_entries += from->bs_entries;
+}
+
+/* When thread bt is due to send its k-th operation */
+static uint64_t
+bench_schedule( bench_thread *bt, uint64_t k )
+{
+	return t_begin +
+		( ( k * nthreads + bt->bt_idx ) * 1000000 ) / rate;
+}
+
+static int
+bench_pick_type( bench_thread *bt )
+{
+	int i, r = rand_r( &bt->bt_seed ) % mixtotal;
+
+	for ( i = 0; r >= mix[i]; i++ ) {
+		r -= mix[i];
+	}
+	return i;
+}
+
+static void
+conn_open( bench_thread *bt, bench_conn *bc )
+{
+	uint64_t start = bench_now();
+
+	tester_init_ld( &bc->bc_ld, config, nobind | TESTER_INIT_NOEXIT );
+	if ( bc->bc_ld == NULL ) {
+		bc->bc_retry = bench_now() + BENCH_RETRY;
+		return;
+	}
+	bc->bc_issued = 0;
+
+	if ( !nobind && start >= t_measure ) {
+		bench_stats *bs = &bt->bt_connect;
+
+		hist_record( &bs->bs_hist, bench_now() - start );
+		bs->bs_count++;
+	}
+}
+
+static void
+conn_close( bench_thread *bt, bench_conn *bc )
+{
+	int i;
+
+	for ( i = 0; bc->bc_pending && i < depth; i++ ) {
+		if ( bc->bc_ops[i].bo_msgid ) {
+			bc->bc_ops[i].bo_msgid = 0;
+			bc->bc_pending--;
+			bt->bt_lost++;
+		}
+	}
+	bc->bc_binding = 0;
+
+	if ( bc->bc_ld ) {
+		ldap_unbind_ext( bc->bc_ld, NULL, NULL );
+		bc->bc_ld = NULL;
+	}
+}
+
+static bench_conn *
+bench_pick_conn( bench_thread *bt, int type )
+{
+	int i;
+
+	for ( i = 0; i < bt->bt_nconns; i++ ) {
+		bench_conn *bc = &bt->bt_conns[ bt->bt_next ];
+
+		bt->bt_next = ( bt->bt_next + 1 ) % bt->bt_nconns;
+
+		if ( !bc->bc_ld || bc->bc_binding ) continue;
+		/* Winding down before being recycled */
+		if ( churn && bc->bc_issued >= churn ) continue;
+
+		if ( type == BENCH_BIND ? bc->bc_pending == 0 :
+				bc->bc_pending < depth ) {
+			return bc;
+		}
+	}
+	return NULL;
+}
+
+static int
+op_send( bench_thread *bt, bench_conn *bc, int type, uint64_t start )
+{
+	LDAPMod mod, *mods[ 2 ] = { &mod, NULL };
+	struct berval *values[ 2 ] = { &value, NULL };
+	bench_op *op;
+	int i, rc, msgid;
+
+	switch ( type ) {
+		case BENCH_SEARCH:
+			rc = ldap_search_ext( bc->bc_ld, base, scope, filter, attrs,
+					0, NULL, NULL, NULL, LDAP_NO_LIMIT, &msgid );
+			break;
+		case BENCH_READ:
+			rc = ldap_search_ext( bc->bc_ld, entry, LDAP_SCOPE_BASE, NULL,
+					attrs, 0, NULL, NULL, NULL, LDAP_NO_LIMIT, &msgid );
+			break;
+		case BENCH_COMPARE:
+			rc = ldap_compare_ext( bc->bc_ld, entry, attr, &value,
+					NULL, NULL, &msgid );
+			break;
+		case BENCH_MODIFY:
+			mod.mod_op = LDAP_MOD_REPLACE | LDAP_MOD_BVALUES;
+			mod.mod_type = attr;
+			mod.mod_bvalues = values;
+			rc = ldap_modify_ext( bc->bc_ld, entry, mods,
+					NULL, NULL, &msgid );
+			break;
+		case BENCH_BIND:
+			rc = ldap_sasl_bind( bc->bc_ld, config->binddn,
+					LDAP_SASL_SIMPLE, &config->pass, NULL, NULL, &msgid );
+			break;
+		default:
+			assert(0);
+	}
+
+	if ( rc != LDAP_SUCCESS ) {
+		tester_ldap_error( bc->bc_ld, bench_opnames[type], NULL );
+		return rc;
+	}
+
+	for ( i = 0; bc->bc_ops[i].bo_msgid; i++ )
+		/* find a free slot */ ;
+	op = &bc->bc_ops[i];
+	op->bo_msgid = msgid;
+	op->bo_type = type;
+	op->bo_entries = 0;
+	op->bo_start = start;
+
+	bc->bc_pending++;
+	bc->bc_issued++;
+	if ( type == BENCH_BIND ) {
+		bc->bc_binding = 1;
+	}
+	return LDAP_SUCCESS;
+}
+
+static void
+op_done( bench_thread *bt, bench_conn *bc, bench_op *op, int err )
+{
+	if ( op->bo_start >= t_measure ) {
+		bench_stats *bs = &bt->bt_ops[ op->bo_type ];
+
+		hist_record( &bs->bs_hist, bench_now() - op->bo_start );
+		bs->bs_count++;
+		bs->bs_entries += op->bo_entries;
+		switch ( err ) {
+			case LDAP_SUCCESS:
+			case LDAP_COMPARE_FALSE:
+			case LDAP_COMPARE_TRUE:
+				break;
+			case LDAP_BUSY:
+				bs->bs_busy++;
+				/* FALLTHRU */
+			default:
+				bs->bs_errors++;
+				break;
+		}
+	}
+
+	if ( op->bo_type == BENCH_BIND ) {
+		bc->bc_binding = 0;
+	}
+	op->bo_msgid = 0;
+	bc->bc_pending--;
+}
+
+/*
+ * Process all responses that have arrived on the connection, returns -1 if
+ * the connection was lost.
+ */
+static int
+conn_drain( bench_thread *bt, bench_conn *bc )
+{
+	struct timeval zero = { 0, 0 };
+	LDAPMessage *res;
+	bench_op *op;
+	int i, rc, err, msgid;
+
+	for ( ;; ) {
+		rc = ldap_result( bc->bc_ld, LDAP_RES_ANY, LDAP_MSG_ONE, &zero, &res );
+		if ( rc == 0 ) {
+			return 0;
+		} else if ( rc < 0 ) {
+			return -1;
+		}
+
+		msgid = ldap_msgid( res );
+		for ( i = 0, op = NULL; i < depth; i++ ) {
+			if ( bc->bc_ops[i].bo_msgid == msgid ) {
+				op = &bc->bc_ops[i];
+				break;
+			}
+		}
+		if ( op == NULL ) {
+			ldap_msgfree( res );
+			continue;
+		}
+
+		switch ( rc ) {
+			case LDAP_RES_SEARCH_ENTRY:
+				op->bo_entries++;
+				/* FALLTHRU */
+			case LDAP_RES_SEARCH_REFERENCE:
+			case LDAP_RES_INTERMEDIATE:
+				ldap_msgfree( res );
+				continue;
+		}
+
+		rc = ldap_parse_result( bc->bc_ld, res, &err,
+				NULL, NULL, NULL, NULL, 1 );
+		if ( rc != LDAP_SUCCESS ) {
+			err = rc;
+		}
+		op_done( bt, bc, op, err );
+	}
+}
+
+static void *
+bench_thread_main( void *arg )
+{
+	bench_thread *bt = arg;
+	bench_conn **polled;
+	fd_set rfds;
+	uint64_t k = 0, now, next;
+	int i, n, type = -1;
+
+	polled = calloc( bt->bt_nconns, sizeof(bench_conn *) );
+	if ( !polled ) {
+		tester_error( "out of memory" );
+		exit( EXIT_FAILURE );
+	}
+
+	for ( ;; ) {
+		/* poll() only has millisecond resolution, too coarse for this */
+		struct timeval tv = { 0, 100000 };
+		int maxfd = -1, pending = 0;
+
+		/* Send all requests that are due, oldest first */
+		now = bench_now();
+		while ( ( next = bench_schedule( bt, k ) ) <= now && next < t_end ) {
+			bench_conn *bc;
+
+			if ( type < 0 ) {
+				type = bench_pick_type( bt );
+			}
+			bc = bench_pick_conn( bt, type );
+			if ( bc == NULL ) {
+				if ( now - next > bt->bt_maxlag ) {
+					bt->bt_maxlag = now - next;
+				}
+				break;
+			}
+
+			if ( op_send( bt, bc, type, next ) ) {
+				conn_close( bt, bc );
+				bc->bc_retry = now;
+				continue;
+			}
+			bt->bt_sent++;
+			type = -1;
+			k++;
+		}
+
+		FD_ZERO( &rfds );
+		n = 0;
+		for ( i = 0; i < bt->bt_nconns; i++ ) {
+			bench_conn *bc = &bt->bt_conns[i];
+			ber_socket_t fd;
+
+			if ( bc->bc_ld == NULL ) {
+				if ( next < t_end && bc->bc_retry <= now ) {
+					conn_open( bt, bc );
+				}
+				continue;
+			}
+
+			if ( !bc->bc_pending ) {
+				if ( churn && bc->bc_issued >= churn ) {
+					conn_close( bt, bc );
+					conn_open( bt, bc );
+				}
+				continue;
+			}
+
+			ldap_get_option( bc->bc_ld, LDAP_OPT_DESC, &fd );
+			if ( fd >= FD_SETSIZE ) {
+				tester_error( "too many connections" );
+				exit( EXIT_FAILURE );
+			}
+			FD_SET( fd, &rfds );
+			if ( (int)fd > maxfd ) {
+				maxfd = fd;
+			}
+			polled[n++] = bc;
+			pending += bc->bc_pending;
+		}
+
+		if ( next >= t_end ) {
+			if ( !pending || now >= t_end + BENCH_GRACE ) {
+				break;
+			}
+		} else if ( next > now ) {
+			tv.tv_sec = ( next - now ) / 1000000;
+			tv.tv_usec = ( next - now ) % 1000000;
+		}
+
+		if ( select( maxfd + 1, &rfds, NULL, NULL, &tv ) < 0 ) {
+			if ( errno == EINTR ) continue;
+			tester_perror( "select", NULL );
+			exit( EXIT_FAILURE );
+		}
+
+		for ( i = 0; i < n; i++ ) {
+			ber_socket_t fd;
+
+			ldap_get_option( polled[i]->bc_ld, LDAP_OPT_DESC, &fd );
+			if ( FD_ISSET( fd, &rfds ) && conn_drain( bt, polled[i] ) ) {
+				tester_ldap_error( polled[i]->bc_ld, "ldap_result", NULL );
+				conn_close( bt, polled[i] );
+				polled[i]->bc_retry = bench_now();
+			}
+		}
+	}
+
+	/* Whatever we did not manage to send in time */
+	while ( bench_schedule( bt, k ) < t_end ) {
+		bt->bt_unsent++;
+		k++;
+	}
+
+	for ( i = 0; i < bt->bt_nconns; i++ ) {
+		conn_close( bt, &bt->bt_conns[i] );
+	}
+
+	free( polled );
+	return NULL;
+}
+
+static void
+print_stats( FILE *fp, const char *name, bench_stats *bs, double elapsed,
+		int last )
+{
+	static const double percentiles[] = { 50, 90, 99, 99.9, 99.99, 0 };
+	bench_hist *h = &bs->bs_hist;
+	int i, first = 1;
+
+	fprintf( fp, "\t\t\"%s\": {\n", name );
+	fprintf( fp, "\t\t\t\"count\": %lu,\n", bs->bs_count );
+	fprintf( fp, "\t\t\t\"errors\": %lu,\n", bs->bs_errors );
+	fprintf( fp, "\t\t\t\"busy\": %lu,\n", bs->bs_busy );
+	fprintf( fp, "\t\t\t\"entries\": %lu,\n", bs->bs_entries );
+	fprintf( fp, "\t\t\t\"throughput\": %.3f,\n", bs->bs_count / elapsed );
+	fprintf( fp, "\t\t\t\"latency_us\": {\n" );
+	fprintf( fp, "\t\t\t\t\"min\": %llu,\n",
+			(unsigned long long)h->bh_min );
+	fprintf( fp, "\t\t\t\t\"mean\": %.3f,\n",
+			h->bh_total ? (double)h->bh_sum / h->bh_total : 0.0 );
+	for ( i = 0; percentiles[i]; i++ ) {
+		fprintf( fp, "\t\t\t\t\"p%g\": %llu,\n", percentiles[i],
+				(unsigned long long)hist_percentile( h, percentiles[i] ) );
+	}
+	fprintf( fp, "\t\t\t\t\"max\": %llu,\n",
+			(unsigned long long)h->bh_max );
+
+	/* Only the non-empty buckets, as [ highest value, count ] */
+	fprintf( fp, "\t\t\t\t\"histogram\": [" );
+	for ( i = 0; i < HIST_BUCKETS; i++ ) {
+		if ( !h->bh_counts[i] ) continue;
+		fprintf( fp, "%s[ %llu, %llu ]", first ? " " : ", ",
+				(unsigned long long)hist_value( i ),
+				(unsigned long long)h->bh_counts[i] );
+		first = 0;
+	}
+	fprintf( fp, " ]\n" );
+	fprintf( fp, "\t\t\t}\n" );
+	fprintf( fp, "\t\t}%s\n", last ? "" : "," );
+}
+
+static void
+print_results( FILE *fp, double elapsed )
+{
+	bench_stats *ops, connect;
+	unsigned long sent = 0, unsent = 0, lost = 0, completed = 0, errors = 0;
+	uint64_t maxlag = 0;
+	int i, j, last;
+
+	ops = calloc( BENCH_LAST, sizeof(bench_stats) );
+	if ( !ops ) {
+		tester_error( "out of memory" );
+		exit( EXIT_FAILURE );
+	}
+	memset( &connect, 0, sizeof(connect) );
+
+	for ( i = 0; i < nthreads; i++ ) {
+		bench_thread *bt = &threads[i];
+
+		for ( j = 0; j < BENCH_LAST; j++ ) {
+			stats_merge( &ops[j], &bt->bt_ops[j] );
+		}
+		stats_merge( &connect, &bt->bt_connect );
+		sent += bt->bt_sent;
+		unsent += bt->bt_unsent;
+		lost += bt->bt_lost;
+		if ( bt->bt_maxlag > maxlag ) {
+			maxlag = bt->bt_maxlag;
+		}
+	}
+	for ( j = 0; j < BENCH_LAST; j++ ) {
+		completed += ops[j].bs_count;
+		errors += ops[j].bs_errors;
+	}
+
+	fprintf( fp, "{\n" );
+	fprintf( fp, "\t\"config\": {\n" );
+	fprintf( fp, "\t\t\"uri\": \"%s\",\n", config->uri ? config->uri : "" );
+	fprintf( fp, "\t\t\"rate\": %d,\n", rate );
+	fprintf( fp, "\t\t\"duration\": %d,\n", duration );
+	fprintf( fp, "\t\t\"warmup\": %d,\n", warmup );
+	fprintf( fp, "\t\t\"threads\": %d,\n", nthreads );
+	fprintf( fp, "\t\t\"connections\": %d,\n", nconns );
+	fprintf( fp, "\t\t\"depth\": %d,\n", depth );
+	fprintf( fp, "\t\t\"churn\": %d,\n", churn );
+	fprintf( fp, "\t\t\"mix\": {" );
+	for ( j = 0, last = 1; j < BENCH_LAST; j++ ) {
+		if ( !mix[j] ) continue;
+		fprintf( fp, "%s\"%s\": %d", last ? " " : ", ",
+				bench_opnames[j], mix[j] );
+		last = 0;
+	}
+	fprintf( fp, " }\n" );
+	fprintf( fp, "\t},\n" );
+
+	fprintf( fp, "\t\"elapsed\": %.3f,\n", elapsed );
+	fprintf( fp, "\t\"sent\": %lu,\n", sent );
+	fprintf( fp, "\t\"unsent\": %lu,\n", unsent );
+	fprintf( fp, "\t\"lost\": %lu,\n", lost );
+	fprintf( fp, "\t\"completed\": %lu,\n", completed );
+	fprintf( fp, "\t\"errors\": %lu,\n", errors );
+	fprintf( fp, "\t\"throughput\": %.3f,\n", completed / elapsed );
+	fprintf( fp, "\t\"max_lag_us\": %llu,\n", (unsigned long long)maxlag );
+
+	fprintf( fp, "\t\"operations\": {\n" );
+	for ( j = 0; j < BENCH_LAST; j++ ) {
+		int k;
+
+		if ( !mix[j] ) continue;
+		for ( k = j + 1; k < BENCH_LAST && !mix[k]; k++ )
+			/* is this the last one? */ ;
+		print_stats( fp, bench_opnames[j], &ops[j], elapsed,
+				k == BENCH_LAST );
+	}
+	fprintf( fp, "\t},\n" );
+
+	fprintf( fp, "\t\"connect\": {\n" );
+	print_stats( fp, "bind", &connect, elapsed, 1 );
+	fprintf( fp, "\t}\n" );
+	fprintf( fp, "}\n" );
+
+	free( ops );
+}
+
+static int
+parse_mix( char *arg )
+{
+	char **ops = ldap_str2charray( arg, "," );
+	int i, j;
+
+	if ( ops == NULL ) {
+		return -1;
+	}
+
+	memset( mix, 0, sizeof(mix) );
+	mixtotal = 0;
+	for ( i = 0; ops[i]; i++ ) {
+		char *sep = strchr( ops[i], '=' );
+		int weight = 1;
+
+		if ( sep ) {
+			*sep++ = '\0';
+			if ( lutil_atoi( &weight, sep ) != 0 || weight < 0 ) {
+				break;
+			}
+		}
+		for ( j = 0; bench_opnames[j]; j++ ) {
+			if ( !strcasecmp( ops[i], bench_opnames[j] ) ) {
+				break;
+			}
+		}
+		if ( !bench_opnames[j] ) {
+			break;
+		}
+		mix[j] = weight;
+		mixtotal += weight;
+	}
+	j = ( ops[i] != NULL );
+	ldap_charray_free( ops );
+
+	return ( j || !mixtotal ) ? -1 : 0;
+}
+
+int
+main( int argc, char **argv )
+{
+	FILE *out = stdout;
+	char *outfile = NULL;
+	uint64_t t_finish;
+	int i;
+
+	config = tester_init( "slapd-bench", TESTER_BENCH );
+
+	while ( ( i = getopt( argc, argv, TESTER_COMMON_OPTS "A:b:c:e:f:j:m:Nn:o:p:q:s:T:W:" ) ) != EOF )
+	{
+		switch ( i ) {
+		case 'A': {
+			char *sep = strchr( optarg, '=' );
+
+			if ( sep == NULL ) {
+				usage( argv[0], i );
+			}
+			*sep++ = '\0';
+			attr = optarg;
+			ber_str2bv( sep, 0, 0, &value );
+		} break;
+
+		case 'b':
+			base = optarg;
+			break;
+
+		case 'c':
+			if ( lutil_atoi( &nconns, optarg ) != 0 || nconns < 1 ) {
+				usage( argv[0], i );
+			}
+			break;
+
+		case 'e':
+			entry = optarg;
+			break;
+
+		case 'f':
+			filter = optarg;
+			break;
+
+		case 'j':
+			if ( lutil_atoi( &nthreads, optarg ) != 0 ||
+					nthreads < 1 || nthreads > MAX_THREAD ) {
+				usage( argv[0], i );
+			}
+			break;
+
+		case 'm':
+			if ( parse_mix( optarg ) ) {
+				usage( argv[0], i );
+			}
+			break;
+
+		case 'N':
+			nobind = TESTER_INIT_ONLY;
+			break;
+
+		case 'n':
+			if ( lutil_atoi( &churn, optarg ) != 0 || churn < 0 ) {
+				usage( argv[0], i );
+			}
+			break;
+
+		case 'o':
+			outfile = optarg;
+			break;
+
+		case 'p':
+			if ( lutil_atoi( &depth, optarg ) != 0 || depth < 1 ) {
+				usage( argv[0], i );
+			}
+			break;
+
+		case 'q':
+			if ( lutil_atoi( &rate, optarg ) != 0 || rate < 1 ) {
+				usage( argv[0], i );
+			}
+			break;
+
+		case 's':
+			scope = ldap_pvt_str2scope( optarg );
+			if ( scope == -1 ) {
+				usage( argv[0], i );
+			}
+			break;
+
+		case 'T':
+			if ( lutil_atoi( &duration, optarg ) != 0 || duration < 1 ) {
+				usage( argv[0], i );
+			}
+			break;
+
+		case 'W':
+			if ( lutil_atoi( &warmup, optarg ) != 0 || warmup < 0 ) {
+				usage( argv[0], i );
+			}
+			break;
+
+		default:
+			if ( tester_config_opt( config, i, optarg ) == LDAP_SUCCESS ) {
+				break;
+			}
+			usage( argv[0], i );
+			break;
+		}
+	}
+
+	if ( base == NULL || rate == 0 ) {
+		usage( argv[0], 0 );
+	}
+	if ( entry == NULL ) {
+		entry = base;
+	}
+	if ( nconns < nthreads ) {
+		nthreads = nconns;
+	}
+	if ( argv[optind] != NULL ) {
+		attrs = &argv[optind];
+	}
+
+	tester_config_finish( config );
+
+	if ( outfile && ( out = fopen( outfile, "w" ) ) == NULL ) {
+		tester_perror( "fopen", outfile );
+		exit( EXIT_FAILURE );
+	}
+
+#ifdef SIGPIPE
+	(void)SIGNAL( SIGPIPE, SIG_IGN );
+#endif
+
+	ldap_pvt_thread_initialize();
+
+	threads = calloc( nthreads, sizeof(bench_thread) );
+	if ( threads == NULL ) {
+		tester_error( "out of memory" );
+		exit( EXIT_FAILURE );
+	}
+	for ( i = 0; i < nthreads; i++ ) {
+		bench_thread *bt = &threads[i];
+		int j;
+
+		bt->bt_idx = i;
+		bt->bt_seed = pid + i;
+		bt->bt_nconns = nconns / nthreads + ( i < nconns % nthreads );
+		bt->bt_conns = calloc( bt->bt_nconns, sizeof(bench_conn) );
+		if ( bt->bt_conns == NULL ) {
+			tester_error( "out of memory" );
+			exit( EXIT_FAILURE );
+		}
+		for ( j = 0; j < bt->bt_nconns; j++ ) {
+			bt->bt_conns[j].bc_ops = calloc( depth, sizeof(bench_op) );
+			if ( bt->bt_conns[j].bc_ops == NULL ) {
+				tester_error( "out of memory" );
+				exit( EXIT_FAILURE );
+			}
+		}
+	}
+
+	/* Connections are set up by the threads before the clock starts */
+	t_begin = t_measure = t_end = (uint64_t)-1;
+	for ( i = 0; i < nthreads; i++ ) {
+		bench_thread *bt = &threads[i];
+		int j;
+
+		for ( j = 0; j < bt->bt_nconns; j++ ) {
+			conn_open( bt, &bt->bt_conns[j] );
+			if ( bt->bt_conns[j].bc_ld == NULL ) {
+				exit( EXIT_FAILURE );
+			}
+		}
+	}
+
+	t_begin = bench_now();
+	t_measure = t_begin + (uint64_t)warmup * 1000000;
+	t_end = t_measure + (uint64_t)duration * 1000000;
+
+	for ( i = 0; i < nthreads; i++ ) {
+		ldap_pvt_thread_create( &threads[i].bt_tid, 0,
+				bench_thread_main, &threads[i] );
+	}
+	for ( i = 0; i < nthreads; i++ ) {
+		ldap_pvt_thread_join( threads[i].bt_tid, NULL );
+	}
+	t_finish = bench_now();
+
+	/* Responses that trickle in after the end still count, so does the time
+	 * it took for them to arrive */
+	print_results( out,
+			( ( t_finish > t_end ? t_finish : t_end ) - t_measure ) / 1e6 );
+
+	if ( out != stdout ) {
+		fclose( out );
+	}
+
+	exit( EXIT_SUCCESS );
+}
@@ -28,6 +28,7 @@ typedef enum {
 	TESTER_MODRDN,
 	TESTER_READ,
 	TESTER_SEARCH,
+	TESTER_BENCH,
 	TESTER_LAST
 } tester_t;
 
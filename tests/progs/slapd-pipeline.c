@@ -0,0 +1,176 @@
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 1999-2026 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/*
+ * Send a StartTLS request immediately followed by a WhoAmI request in
+ * a single write, as a client injecting plaintext behind StartTLS
+ * would, and report how the server responds. Succeeds if the server
+ * closes the connection without ever answering the WhoAmI request.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+
+#include "ac/stdlib.h"
+
+#include "ac/errno.h"
+#include "ac/socket.h"
+#include "ac/string.h"
+#include "ac/time.h"
+#include "ac/unistd.h"
+
+#include "lber.h"
+#include "ldap.h"
+#include "lutil.h"
+
+static void
+usage( char *name )
+{
+	fprintf( stderr, "usage: %s -h <host> -p <port> [-t <seconds>]\n",
+		name );
+	exit( EXIT_FAILURE );
+}
+
+static int
+encode_exop( struct berval *out, ber_int_t msgid, char *oid )
+{
+	BerElement *ber;
+	struct berval bv;
+	int rc = -1;
+
+	ber = ber_alloc_t( LBER_USE_DER );
+	if ( ber == NULL )
+		return -1;
+
+	if ( ber_printf( ber, "{it{ts}}", msgid, LDAP_REQ_EXTENDED,
+			LDAP_TAG_EXOP_REQ_OID, oid ) >= 0 &&
+		ber_flatten2( ber, &bv, 0 ) == 0 )
+	{
+		out->bv_val = realloc( out->bv_val, out->bv_len + bv.bv_len );
+		if ( out->bv_val != NULL ) {
+			memcpy( out->bv_val + out->bv_len, bv.bv_val, bv.bv_len );
+			out->bv_len += bv.bv_len;
+			rc = 0;
+		}
+	}
+	ber_free( ber, 1 );
+
+	return rc;
+}
+
+int
+main( int argc, char **argv )
+{
+	char *host = NULL, *port = NULL;
+	int i, timeout = 5;
+	struct addrinfo hints = { 0 }, *res;
+	ber_socket_t fd;
+	struct timeval tv;
+	struct berval req = { 0, NULL };
+	Sockbuf *sb;
+	BerElement *ber;
+	ber_len_t len;
+	ber_tag_t tag;
+	ber_int_t msgid;
+	int answered = 0;
+
+	while ( ( i = getopt( argc, argv, "h:p:t:" ) ) != EOF ) {
+		switch ( i ) {
+		case 'h':
+			host = optarg;
+			break;
+
+		case 'p':
+			port = optarg;
+			break;
+
+		case 't':
+			if ( lutil_atoi( &timeout, optarg ) != 0 || timeout < 1 )
+				usage( argv[0] );
+			break;
+
+		default:
+			usage( argv[0] );
+		}
+	}
+	if ( host == NULL || port == NULL )
+		usage( argv[0] );
+
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	if ( getaddrinfo( host, port, &hints, &res ) != 0 ) {
+		fprintf( stderr, "%s: cannot resolve %s:%s\n", argv[0], host, port );
+		exit( EXIT_FAILURE );
+	}
+	fd = socket( res->ai_family, res->ai_socktype, res->ai_protocol );
+	if ( fd == AC_SOCKET_INVALID ||
+		connect( fd, res->ai_addr, res->ai_addrlen ) != 0 )
+	{
+		perror( "connect" );
+		exit( EXIT_FAILURE );
+	}
+	freeaddrinfo( res );
+
+	tv.tv_sec = timeout;
+	tv.tv_usec = 0;
+	setsockopt( fd, SOL_SOCKET, SO_RCVTIMEO, (void *)&tv, sizeof( tv ) );
+
+	if ( encode_exop( &req, 1, LDAP_EXOP_START_TLS ) != 0 ||
+		encode_exop( &req, 2, LDAP_EXOP_WHO_AM_I ) != 0 )
+	{
+		fprintf( stderr, "%s: cannot encode requests\n", argv[0] );
+		exit( EXIT_FAILURE );
+	}
+	if ( write( fd, req.bv_val, req.bv_len ) != (ssize_t)req.bv_len ) {
+		perror( "write" );
+		exit( EXIT_FAILURE );
+	}
+	free( req.bv_val );
+
+	sb = ber_sockbuf_alloc();
+	ber_sockbuf_add_io( sb, &ber_sockbuf_io_tcp, LBER_SBIOD_LEVEL_PROVIDER,
+		(void *)&fd );
+
+	for (;;) {
+		ber = ber_alloc_t( LBER_USE_DER );
+		errno = 0;
+		tag = ber_get_next( sb, &len, ber );
+		if ( tag != LDAP_TAG_MESSAGE ) {
+			ber_free( ber, 1 );
+			break;
+		}
+		if ( ber_scanf( ber, "{it", &msgid, &tag ) != LBER_ERROR ) {
+			printf( "response msgid=%d tag=0x%lx\n", msgid,
+				(unsigned long)tag );
+			if ( msgid == 2 )
+				answered = 1;
+		}
+		ber_free( ber, 1 );
+	}
+
+	if ( errno == EAGAIN || errno == EWOULDBLOCK ) {
+		printf( "timed out, connection still open\n" );
+		exit( EXIT_FAILURE );
+	}
+	if ( answered ) {
+		printf( "pipelined request was answered\n" );
+		exit( EXIT_FAILURE );
+	}
+
+	printf( "connection closed\n" );
+	ber_sockbuf_free( sb );
+	exit( EXIT_SUCCESS );
+}
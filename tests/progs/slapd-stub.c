@@ -0,0 +1,675 @@
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 1999-2026 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/*
+ * A stub LDAP server for benchmarking the load balancer without a real
+ * slapd behind it. Every request is answered with success after a
+ * configured latency (plus optional random jitter), searches return a
+ * fixed number of synthetic entries named after the search base. The
+ * request itself is not interpreted beyond what is needed to pick the
+ * right response. Connections are spread over a number of threads, each
+ * running its own select loop and a heap of responses ordered by the time
+ * they are due.
+ */
+
+#include "portable.h"
+
+/* Requires libldap with threads */
+
+#include <stdio.h>
+#include <stdint.h>
+#include "ldap_pvt_thread.h"
+
+#include "ac/stdlib.h"
+
+#include "ac/errno.h"
+#include "ac/signal.h"
+#include "ac/socket.h"
+#include "ac/string.h"
+#include "ac/time.h"
+#include "ac/unistd.h"
+
+#include "lber.h"
+#include "ldap.h"
+#include "lutil.h"
+#include "ldap_pvt.h"
+
+#define MAX_THREAD	1024
+#define MAX_CONNS	1024
+
+#define STUB_ATTR	"description"
+
+static struct berval whoami = BER_BVC(LDAP_EXOP_WHO_AM_I);
+
+typedef struct stub_conn {
+	ber_socket_t sc_fd;
+	Sockbuf *sc_sb;
+	BerElement *sc_ber;
+
+	/* responses encoded but not written out yet */
+	char *sc_out;
+	ber_len_t sc_outlen, sc_outoff, sc_outsize;
+
+	/* replies still queued for this connection, it is only freed once
+	 * these have been discarded */
+	int sc_refs;
+	int sc_closed;
+} stub_conn;
+
+typedef struct stub_reply {
+	uint64_t sr_due;
+	stub_conn *sr_conn;
+	ber_int_t sr_msgid;
+	ber_tag_t sr_tag;
+	ber_int_t sr_rc;
+	struct berval sr_dn;
+} stub_reply;
+
+typedef struct stub_thread {
+	ldap_pvt_thread_t st_tid;
+	int st_idx;
+
+	stub_conn *st_conns[ MAX_CONNS ];
+	int st_nconns;
+
+	stub_reply **st_heap;
+	int st_nheap, st_heapsize;
+
+	unsigned int st_seed;
+} stub_thread;
+
+static ber_socket_t	listenfd = AC_SOCKET_INVALID;
+
+static int		latency;	/* microseconds */
+static int		jitter;		/* microseconds */
+static int		nentries = 1;
+static struct berval	padding = BER_BVNULL;
+static ber_len_t	max_incoming = 4194303;
+
+static stub_thread	threads[ MAX_THREAD ];
+static int		nthreads = 1;
+
+static void
+usage( char *name, char opt )
+{
+	if ( opt != '\0' ) {
+		fprintf( stderr, "unknown/incorrect option \"%c\"\n", opt );
+	}
+
+	fprintf( stderr, "usage: %s "
+		"-H <uri> "
+		"[-d <level>] "
+		"[-j <threads>] "
+		"[-l <latency usec>] "
+		"[-J <jitter usec>] "
+		"[-n <entries per search>] "
+		"[-S <entry size>] "
+		"\n",
+		name );
+	exit( EXIT_FAILURE );
+}
+
+static uint64_t
+stub_now( void )
+{
+#ifdef HAVE_CLOCK_GETTIME
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#else
+	struct timeval tv;
+
+	gettimeofday( &tv, NULL );
+	return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+#endif
+}
+
+static int
+stub_listen( char *uri )
+{
+	LDAPURLDesc *lud;
+	struct addrinfo hints = { 0 }, *res, *ai;
+	char port[ 16 ];
+	int rc, on = 1;
+
+	if ( ldap_url_parse( uri, &lud ) != LDAP_URL_SUCCESS ) {
+		fprintf( stderr, "unable to parse URI \"%s\"\n", uri );
+		return -1;
+	}
+	if ( strcasecmp( lud->lud_scheme, "ldap" ) ) {
+		fprintf( stderr, "only ldap:// URIs are supported\n" );
+		ldap_free_urldesc( lud );
+		return -1;
+	}
+
+	snprintf( port, sizeof(port), "%d",
+			lud->lud_port ? lud->lud_port : LDAP_PORT );
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE;
+
+	rc = getaddrinfo( lud->lud_host && *lud->lud_host ? lud->lud_host : NULL,
+			port, &hints, &res );
+	ldap_free_urldesc( lud );
+	if ( rc ) {
+		fprintf( stderr, "getaddrinfo: %s\n", AC_GAI_STRERROR(rc) );
+		return -1;
+	}
+
+	for ( ai = res; ai; ai = ai->ai_next ) {
+		listenfd = socket( ai->ai_family, ai->ai_socktype, ai->ai_protocol );
+		if ( listenfd == AC_SOCKET_INVALID ) continue;
+
+		(void)setsockopt( listenfd, SOL_SOCKET, SO_REUSEADDR,
+				(char *)&on, sizeof(on) );
+		if ( !bind( listenfd, ai->ai_addr, ai->ai_addrlen ) &&
+				!listen( listenfd, SOMAXCONN ) ) {
+			break;
+		}
+		tcp_close( listenfd );
+		listenfd = AC_SOCKET_INVALID;
+	}
+	freeaddrinfo( res );
+
+	if ( listenfd == AC_SOCKET_INVALID ) {
+		perror( "bind" );
+		return -1;
+	}
+	ber_pvt_socket_set_nonblock( listenfd, 1 );
+	return 0;
+}
+
+static void
+heap_push( stub_thread *st, stub_reply *sr )
+{
+	int i;
+
+	if ( st->st_nheap == st->st_heapsize ) {
+		st->st_heapsize = st->st_heapsize ? st->st_heapsize * 2 : 64;
+		st->st_heap = realloc( st->st_heap,
+				st->st_heapsize * sizeof(stub_reply *) );
+		if ( !st->st_heap ) {
+			fprintf( stderr, "out of memory\n" );
+			exit( EXIT_FAILURE );
+		}
+	}
+
+	for ( i = st->st_nheap++; i; i = ( i - 1 ) / 2 ) {
+		stub_reply *parent = st->st_heap[ ( i - 1 ) / 2 ];
+
+		if ( parent->sr_due <= sr->sr_due ) break;
+		st->st_heap[i] = parent;
+	}
+	st->st_heap[i] = sr;
+}
+
+static stub_reply *
+heap_pop( stub_thread *st )
+{
+	stub_reply *top = st->st_heap[0], *last;
+	int i = 0, child;
+
+	last = st->st_heap[ --st->st_nheap ];
+	while ( ( child = 2 * i + 1 ) < st->st_nheap ) {
+		if ( child + 1 < st->st_nheap &&
+				st->st_heap[ child + 1 ]->sr_due <
+				st->st_heap[child]->sr_due ) {
+			child++;
+		}
+		if ( last->sr_due <= st->st_heap[child]->sr_due ) break;
+		st->st_heap[i] = st->st_heap[child];
+		i = child;
+	}
+	if ( st->st_nheap ) {
+		st->st_heap[i] = last;
+	}
+	return top;
+}
+
+static void
+conn_close( stub_conn *sc )
+{
+	if ( sc->sc_closed ) return;
+
+	sc->sc_closed = 1;
+	ber_sockbuf_free( sc->sc_sb );
+	sc->sc_sb = NULL;
+	if ( sc->sc_ber ) {
+		ber_free( sc->sc_ber, 1 );
+		sc->sc_ber = NULL;
+	}
+}
+
+static void
+conn_free( stub_conn *sc )
+{
+	free( sc->sc_out );
+	free( sc );
+}
+
+static int
+conn_append( stub_conn *sc, BerElement *ber )
+{
+	struct berval bv;
+
+	if ( ber_flatten2( ber, &bv, 0 ) ) {
+		return -1;
+	}
+
+	if ( sc->sc_outlen + bv.bv_len > sc->sc_outsize ) {
+		ber_len_t size = sc->sc_outsize ? sc->sc_outsize : 4096;
+
+		while ( size < sc->sc_outlen + bv.bv_len ) size *= 2;
+		sc->sc_out = realloc( sc->sc_out, size );
+		if ( !sc->sc_out ) {
+			fprintf( stderr, "out of memory\n" );
+			exit( EXIT_FAILURE );
+		}
+		sc->sc_outsize = size;
+	}
+	AC_MEMCPY( sc->sc_out + sc->sc_outlen, bv.bv_val, bv.bv_len );
+	sc->sc_outlen += bv.bv_len;
+	return 0;
+}
+
+static int
+conn_flush( stub_conn *sc )
+{
+	while ( sc->sc_outoff < sc->sc_outlen ) {
+		ber_slen_t n = tcp_write( sc->sc_fd, sc->sc_out + sc->sc_outoff,
+				sc->sc_outlen - sc->sc_outoff );
+
+		if ( n < 0 ) {
+			int err = sock_errno();
+
+			if ( err == EWOULDBLOCK || err == EAGAIN ) return 0;
+			if ( err == EINTR ) continue;
+			return -1;
+		}
+		sc->sc_outoff += n;
+	}
+	sc->sc_outoff = sc->sc_outlen = 0;
+	return 0;
+}
+
+static void
+send_reply( stub_reply *sr )
+{
+	stub_conn *sc = sr->sr_conn;
+	BerElement *ber;
+	int i, rc = 0;
+
+	if ( sc->sc_closed ) return;
+
+	if ( sr->sr_tag == LDAP_RES_SEARCH_RESULT ) {
+		for ( i = 0; !rc && i < nentries; i++ ) {
+			ber = ber_alloc_t( LBER_USE_DER );
+			if ( BER_BVISNULL( &padding ) ) {
+				rc = ber_printf( ber, "{it{O{{s[s]}}}}",
+						sr->sr_msgid, LDAP_RES_SEARCH_ENTRY, &sr->sr_dn,
+						"objectClass", "top" );
+			} else {
+				rc = ber_printf( ber, "{it{O{{s[s]}{s[O]}}}}",
+						sr->sr_msgid, LDAP_RES_SEARCH_ENTRY, &sr->sr_dn,
+						"objectClass", "top", STUB_ATTR, &padding );
+			}
+			rc = ( rc < 0 ) ? -1 : conn_append( sc, ber );
+			ber_free( ber, 1 );
+		}
+	}
+
+	if ( !rc ) {
+		ber = ber_alloc_t( LBER_USE_DER );
+		rc = ber_printf( ber, "{it{ess}}",
+				sr->sr_msgid, sr->sr_tag, sr->sr_rc, "", "" );
+		rc = ( rc < 0 ) ? -1 : conn_append( sc, ber );
+		ber_free( ber, 1 );
+	}
+
+	if ( rc ) {
+		fprintf( stderr, "failed to encode response to msgid=%d\n",
+				sr->sr_msgid );
+		conn_close( sc );
+	}
+}
+
+/*
+ * Queue the response to a request, return -1 if the connection should be
+ * closed.
+ */
+static int
+handle_request( stub_thread *st, stub_conn *sc, BerElement *ber )
+{
+	stub_reply *sr;
+	struct berval bv = BER_BVNULL;
+	ber_int_t msgid, rc = LDAP_SUCCESS;
+	ber_tag_t tag, rtag;
+	ber_len_t len;
+
+	if ( ber_get_int( ber, &msgid ) != LBER_INTEGER ) {
+		return -1;
+	}
+
+	tag = ber_peek_tag( ber, &len );
+	switch ( tag ) {
+		case LDAP_REQ_UNBIND:
+			return -1;
+		case LDAP_REQ_ABANDON:
+			/* The response is sent regardless, which is allowed */
+			return 0;
+		case LDAP_REQ_BIND:
+			rtag = LDAP_RES_BIND;
+			break;
+		case LDAP_REQ_SEARCH:
+			rtag = LDAP_RES_SEARCH_RESULT;
+			if ( ber_scanf( ber, "{m" /*}*/, &bv ) == LBER_ERROR ) {
+				return -1;
+			}
+			break;
+		case LDAP_REQ_COMPARE:
+			rtag = LDAP_RES_COMPARE;
+			rc = LDAP_COMPARE_TRUE;
+			break;
+		case LDAP_REQ_MODIFY:
+			rtag = LDAP_RES_MODIFY;
+			break;
+		case LDAP_REQ_ADD:
+			rtag = LDAP_RES_ADD;
+			break;
+		case LDAP_REQ_DELETE:
+			rtag = LDAP_RES_DELETE;
+			break;
+		case LDAP_REQ_MODDN:
+			rtag = LDAP_RES_MODDN;
+			break;
+		case LDAP_REQ_EXTENDED:
+			rtag = LDAP_RES_EXTENDED;
+			if ( ber_scanf( ber, "{m" /*}*/, &bv ) == LBER_ERROR ) {
+				return -1;
+			}
+			if ( ber_bvstrcasecmp( &bv, &whoami ) ) {
+				/* What slapd says about unknown extended operations */
+				rc = LDAP_PROTOCOL_ERROR;
+			}
+			BER_BVZERO( &bv );
+			break;
+		default:
+			return -1;
+	}
+
+	sr = calloc( 1, sizeof(stub_reply) + bv.bv_len + 1 );
+	if ( !sr ) {
+		fprintf( stderr, "out of memory\n" );
+		exit( EXIT_FAILURE );
+	}
+	sr->sr_due = stub_now() + latency;
+	if ( jitter ) {
+		sr->sr_due += rand_r( &st->st_seed ) % ( jitter + 1 );
+	}
+	sr->sr_conn = sc;
+	sr->sr_msgid = msgid;
+	sr->sr_tag = rtag;
+	sr->sr_rc = rc;
+	sr->sr_dn.bv_val = (char *)( sr + 1 );
+	sr->sr_dn.bv_len = bv.bv_len;
+	if ( bv.bv_len ) {
+		AC_MEMCPY( sr->sr_dn.bv_val, bv.bv_val, bv.bv_len );
+	}
+	sc->sc_refs++;
+	heap_push( st, sr );
+
+	return 0;
+}
+
+static void
+conn_read( stub_thread *st, stub_conn *sc )
+{
+	ber_tag_t tag;
+	ber_len_t len;
+
+	for ( ;; ) {
+		if ( !sc->sc_ber && !( sc->sc_ber = ber_alloc() ) ) {
+			fprintf( stderr, "out of memory\n" );
+			exit( EXIT_FAILURE );
+		}
+
+		tag = ber_get_next( sc->sc_sb, &len, sc->sc_ber );
+		if ( tag != LDAP_TAG_MESSAGE ) {
+			int err = sock_errno();
+
+			if ( tag == LBER_DEFAULT &&
+					( err == EWOULDBLOCK || err == EAGAIN ) ) {
+				return;
+			}
+			conn_close( sc );
+			return;
+		}
+
+		if ( handle_request( st, sc, sc->sc_ber ) ) {
+			conn_close( sc );
+			return;
+		}
+		ber_free( sc->sc_ber, 1 );
+		sc->sc_ber = NULL;
+	}
+}
+
+static void
+conn_accept( stub_thread *st )
+{
+	stub_conn *sc;
+	ber_socket_t fd;
+	int on = 1;
+
+	while ( st->st_nconns < MAX_CONNS ) {
+		fd = accept( listenfd, NULL, NULL );
+		if ( fd == AC_SOCKET_INVALID ) {
+			return;
+		}
+		if ( fd >= FD_SETSIZE ) {
+			tcp_close( fd );
+			continue;
+		}
+
+		(void)setsockopt( fd, IPPROTO_TCP, TCP_NODELAY,
+				(char *)&on, sizeof(on) );
+		ber_pvt_socket_set_nonblock( fd, 1 );
+
+		sc = calloc( 1, sizeof(stub_conn) );
+		if ( !sc ) {
+			fprintf( stderr, "out of memory\n" );
+			exit( EXIT_FAILURE );
+		}
+		sc->sc_fd = fd;
+		sc->sc_sb = ber_sockbuf_alloc();
+		ber_sockbuf_ctrl( sc->sc_sb, LBER_SB_OPT_SET_FD, &fd );
+		ber_sockbuf_add_io( sc->sc_sb, &ber_sockbuf_io_tcp,
+				LBER_SBIOD_LEVEL_PROVIDER, (void *)&fd );
+		ber_sockbuf_add_io( sc->sc_sb, &ber_sockbuf_io_readahead,
+				LBER_SBIOD_LEVEL_PROVIDER, NULL );
+		ber_sockbuf_ctrl( sc->sc_sb, LBER_SB_OPT_SET_NONBLOCK, (void *)1 );
+		ber_sockbuf_ctrl( sc->sc_sb, LBER_SB_OPT_SET_MAX_INCOMING,
+				&max_incoming );
+
+		st->st_conns[ st->st_nconns++ ] = sc;
+	}
+}
+
+static void *
+stub_thread_main( void *arg )
+{
+	stub_thread *st = arg;
+	stub_conn *polled[ MAX_CONNS ];
+	fd_set rfds, wfds;
+
+	for ( ;; ) {
+		uint64_t now = stub_now();
+		struct timeval tv, *tvp = NULL;
+		int i, n, maxfd = listenfd;
+
+		/* Send out whatever is due */
+		while ( st->st_nheap && st->st_heap[0]->sr_due <= now ) {
+			stub_reply *sr = heap_pop( st );
+
+			send_reply( sr );
+			sr->sr_conn->sc_refs--;
+			free( sr );
+		}
+		/* poll() only has millisecond resolution, too coarse for this */
+		if ( st->st_nheap ) {
+			uint64_t wait = st->st_heap[0]->sr_due - now;
+
+			tv.tv_sec = wait / 1000000;
+			tv.tv_usec = wait % 1000000;
+			tvp = &tv;
+		}
+
+		FD_ZERO( &rfds );
+		FD_ZERO( &wfds );
+		n = 0;
+		for ( i = 0; i < st->st_nconns; i++ ) {
+			stub_conn *sc = st->st_conns[i];
+
+			if ( !sc->sc_closed && conn_flush( sc ) ) {
+				conn_close( sc );
+			}
+			if ( sc->sc_closed ) {
+				if ( !sc->sc_refs ) {
+					conn_free( sc );
+					st->st_conns[i--] = st->st_conns[ --st->st_nconns ];
+				}
+				continue;
+			}
+			FD_SET( sc->sc_fd, &rfds );
+			if ( sc->sc_outlen ) {
+				FD_SET( sc->sc_fd, &wfds );
+			}
+			if ( sc->sc_fd > maxfd ) {
+				maxfd = sc->sc_fd;
+			}
+			polled[n++] = sc;
+		}
+		FD_SET( listenfd, &rfds );
+
+		if ( select( maxfd + 1, &rfds, &wfds, NULL, tvp ) < 0 ) {
+			if ( errno == EINTR ) continue;
+			perror( "select" );
+			exit( EXIT_FAILURE );
+		}
+
+		for ( i = 0; i < n; i++ ) {
+			if ( FD_ISSET( polled[i]->sc_fd, &rfds ) ) {
+				conn_read( st, polled[i] );
+			}
+		}
+		if ( FD_ISSET( listenfd, &rfds ) ) {
+			conn_accept( st );
+		}
+	}
+
+	return NULL;
+}
+
+int
+main( int argc, char **argv )
+{
+	char *uri = NULL;
+	int i, debug = 0;
+
+	while ( ( i = getopt( argc, argv, "d:H:J:j:l:n:S:" ) ) != EOF ) {
+		switch ( i ) {
+			case 'd':
+				if ( lutil_atoi( &debug, optarg ) != 0 ) {
+					usage( argv[0], i );
+				}
+				ber_set_option( NULL, LBER_OPT_DEBUG_LEVEL, &debug );
+				break;
+
+			case 'H':
+				uri = optarg;
+				break;
+
+			case 'J':
+				if ( lutil_atoi( &jitter, optarg ) != 0 || jitter < 0 ) {
+					usage( argv[0], i );
+				}
+				break;
+
+			case 'j':
+				if ( lutil_atoi( &nthreads, optarg ) != 0 ||
+						nthreads < 1 || nthreads > MAX_THREAD ) {
+					usage( argv[0], i );
+				}
+				break;
+
+			case 'l':
+				if ( lutil_atoi( &latency, optarg ) != 0 || latency < 0 ) {
+					usage( argv[0], i );
+				}
+				break;
+
+			case 'n':
+				if ( lutil_atoi( &nentries, optarg ) != 0 || nentries < 0 ) {
+					usage( argv[0], i );
+				}
+				break;
+
+			case 'S': {
+				int size;
+
+				if ( lutil_atoi( &size, optarg ) != 0 || size < 0 ) {
+					usage( argv[0], i );
+				}
+				if ( size ) {
+					padding.bv_len = size;
+					padding.bv_val = malloc( size );
+					memset( padding.bv_val, 'x', size );
+				}
+			} break;
+
+			default:
+				usage( argv[0], i );
+				break;
+		}
+	}
+
+	if ( uri == NULL ) {
+		usage( argv[0], '\0' );
+	}
+
+#ifdef SIGPIPE
+	(void)SIGNAL( SIGPIPE, SIG_IGN );
+#endif
+
+	if ( stub_listen( uri ) ) {
+		exit( EXIT_FAILURE );
+	}
+
+	ldap_pvt_thread_initialize();
+
+	for ( i = 0; i < nthreads; i++ ) {
+		threads[i].st_idx = i;
+		threads[i].st_seed = getpid() + i;
+		ldap_pvt_thread_create( &threads[i].st_tid, 0,
+				stub_thread_main, &threads[i] );
+	}
+
+	for ( i = 0; i < nthreads; i++ ) {
+		ldap_pvt_thread_join( threads[i].st_tid, NULL );
+	}
+
+	exit( EXIT_SUCCESS );
+}
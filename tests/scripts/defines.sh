@@ -275,6 +275,9 @@ LDAPEXOP="$CLIENTDIR/ldapexop $TOOLARGS"
 SLAPDTESTER=$PROGDIR/slapd-tester
 LDIFFILTER=$PROGDIR/ldif-filter
 SLAPDMTREAD=$PROGDIR/slapd-mtread
+SLAPDBENCH=$PROGDIR/slapd-bench
+SLAPDSTUB=$PROGDIR/slapd-stub
+SLAPDPIPELINE=$PROGDIR/slapd-pipeline
 LVL=${SLAPD_DEBUG-0x4105}
 LOCALHOST=localhost
 LOCALIP=127.0.0.1